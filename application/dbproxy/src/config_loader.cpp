@@ -8,6 +8,7 @@
 #include <mooon/sys/mysql_db.h>
 #include <mooon/utils/args_parser.h>
 #include <mooon/utils/md5_helper.h>
+#include <mooon/utils/scoped_ptr.h>
 #include <mooon/utils/string_utils.h>
 #include <set>
 #include <sys/inotify.h> // 一些低版本内核没有实现
@@ -20,39 +21,12 @@ namespace mooon { namespace db_proxy {
 // 线程级DB连接
 static __thread sys::CMySQLConnection* g_db_connection[MAX_DB_CONNECTION] = { NULL } ;
 
-static void init_db_info_array(struct DbInfo* db_info_array[])
-{
-    for (int index=0; index<MAX_DB_CONNECTION; ++index)
-        db_info_array[index] = NULL;
-}
-
-static void init_query_info_array(struct QueryInfo* query_info_array[])
-{
-    for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
-        query_info_array[index] = NULL;
-}
-
 static void init_sql_logger_array(CSqlLogger* sql_logger_array[])
 {
     for (int index=0; index<MAX_DB_CONNECTION; ++index)
         sql_logger_array[index] = NULL;
 }
 
-static void init_update_info_array(struct UpdateInfo* update_info_array[])
-{
-    for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
-        update_info_array[index] = NULL;
-}
-
-static void release_db_info_array(struct DbInfo* db_info_array[])
-{
-    for (int index=0; index<MAX_DB_CONNECTION; ++index)
-    {
-        delete db_info_array[index];
-        db_info_array[index] = NULL;
-    }
-}
-
 static void release_sql_logger_array(CSqlLogger* sql_logger_array[])
 {
     for (int index=0; index<MAX_DB_CONNECTION; ++index)
@@ -65,24 +39,6 @@ static void release_sql_logger_array(CSqlLogger* sql_logger_array[])
     }
 }
 
-static void release_query_info_array(struct QueryInfo* query_info_array[])
-{
-    for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
-    {
-        delete query_info_array[index];
-        query_info_array[index] = NULL;
-    }
-}
-
-static void release_update_info_array(struct UpdateInfo* update_info_array[])
-{
-    for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
-    {
-        delete update_info_array[index];
-        update_info_array[index] = NULL;
-    }
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 SINGLETON_IMPLEMENT(CConfigLoader);
 
@@ -124,9 +80,6 @@ CConfigLoader::CConfigLoader()
     : _stop_monitor(false)
 {
     init_sql_logger_array(_sql_logger_array);
-    init_db_info_array(_db_info_array);
-    init_query_info_array(_query_info_array);
-    init_update_info_array(_update_info_array);
 
     // 无效md5值
     _md5_sum = "-";
@@ -137,9 +90,6 @@ bool CConfigLoader::load(const std::string& filepath)
     Json::Reader reader;
     Json::Value root;
     std::ifstream fs(filepath.c_str());
-    struct DbInfo* db_info_array[MAX_DB_CONNECTION] = { NULL };
-    struct QueryInfo* query_info_array[MAX_SQL_TEMPLATE] = { NULL };
-    struct UpdateInfo* update_info_array[MAX_SQL_TEMPLATE] = { NULL };
 
     if (_md5_sum.empty())
     {
@@ -168,48 +118,48 @@ bool CConfigLoader::load(const std::string& filepath)
         return true; // 未发生变化
     }
 
-    init_db_info_array(db_info_array);
-    init_query_info_array(query_info_array);
-    init_update_info_array(update_info_array);
-    if (!load_database(root["database"], db_info_array))
+    utils::ScopedPtr<struct ConfigSnapshot> config(new struct ConfigSnapshot);
+    if (!load_database(root["database"], config->db_info_array))
         return false;
-    if (!load_query(root["query"], query_info_array))
+    if (!load_query(root["query"], config->query_info_array))
         return false;
-    if (!load_update(root["update"], update_info_array))
+    if (!load_update(root["update"], config->update_info_array))
         return false;
 
-    // 加写锁
-    sys::WriteLockHelper write_lock(_read_write_lock);
-    release_db_info_array(_db_info_array);
-    release_sql_logger_array(_sql_logger_array);
-    release_query_info_array(_query_info_array);
-    release_update_info_array(_update_info_array);
-
+    // 启动时即连接一下，以早期发现配置等问题，不需要持有锁
     for (int index=0; index<MAX_DB_CONNECTION; ++index)
     {
-        if (db_info_array[index] != NULL)
+        if (config->db_info_array[index] != NULL)
         {
-            // 启动时即连接一下，以早期发现配置等问题
-            _db_info_array[index] = new struct DbInfo(*db_info_array[index]);
-            sys::DBConnection* db_connection = init_db_connection(index, false);
-            if (db_connection != NULL)
+            sys::DBConnection* db_connection = do_init_db_connection(config->db_info_array[index]);
+            delete db_connection;
+        }
+    }
+
+    struct ConfigSnapshot* old_config = NULL;
+    { // 加写锁，SqlLogger和配置一起替换
+        sys::WriteLockHelper write_lock(_read_write_lock);
+        release_sql_logger_array(_sql_logger_array);
+
+        for (int index=0; index<MAX_DB_CONNECTION; ++index)
+        {
+            if (config->db_info_array[index] != NULL)
             {
-                delete db_connection;
-                db_connection = NULL;
+                // 创建好SqlLogger
+                CSqlLogger* sql_logger = new CSqlLogger(index, config->db_info_array[index]);
+                _sql_logger_array[index] = sql_logger;
+                sql_logger->inc_refcount();
             }
-
-            // 创建好SqlLogger
-            CSqlLogger* sql_logger = new CSqlLogger(index, _db_info_array[index]);
-            _sql_logger_array[index] = sql_logger;
-            sql_logger->inc_refcount();
         }
+
+        old_config = _config.exchange(config.release());
     }
-    for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
+
+    // 在写锁外等待读者离开后再释放旧配置，因为读区内可能会去取SqlLogger
+    if (old_config != NULL)
     {
-        if (query_info_array[index] != NULL)
-            _query_info_array[index] = new struct QueryInfo(*query_info_array[index]);
-        if (update_info_array[index] != NULL)
-            _update_info_array[index] = new struct UpdateInfo(*update_info_array[index]);
+        sys::CRcu::synchronize();
+        delete old_config;
     }
 
     _md5_sum = md5_sum;
@@ -240,7 +190,8 @@ CSqlLogger* CConfigLoader::get_sql_logger(int index)
             }
             else
             {
-                struct DbInfo* dbinfo = _db_info_array[index];
+                sys::CRcuReadHelper rcu_read_helper;
+                const struct DbInfo* dbinfo = get_db_info(index);
                 if (dbinfo != NULL)
                 {
                     sql_logger = new CSqlLogger(index, dbinfo);
@@ -289,7 +240,7 @@ sys::CMySQLConnection* CConfigLoader::get_db_connection(int index) const
     }
     if (NULL == g_db_connection[index])
     {
-        g_db_connection[index] = init_db_connection(index, true);
+        g_db_connection[index] = init_db_connection(index);
     }
 
     return g_db_connection[index];
@@ -297,41 +248,64 @@ sys::CMySQLConnection* CConfigLoader::get_db_connection(int index) const
 
 bool CConfigLoader::get_db_info(int index, struct DbInfo* db_info) const
 {
-    sys::ReadLockHelper read_lock(_read_write_lock);
-
-    if ((index < 0) || (index >= MAX_DB_CONNECTION))
-        return false;
-    if (NULL == _db_info_array[index])
+    sys::CRcuReadHelper rcu_read_helper;
+    const struct DbInfo* db_info_ = get_db_info(index);
+    if (NULL == db_info_)
         return false;
 
-    *db_info = *(_db_info_array[index]);
+    *db_info = *db_info_;
     return true;
 }
 
 bool CConfigLoader::get_query_info(int index, struct QueryInfo* query_info) const
 {
-    sys::ReadLockHelper read_lock(_read_write_lock);
-    if ((index < 0) || (index >= MAX_SQL_TEMPLATE))
-        return false;
-    if (NULL == _query_info_array[index])
+    sys::CRcuReadHelper rcu_read_helper;
+    const struct QueryInfo* query_info_ = get_query_info(index);
+    if (NULL == query_info_)
         return false;
 
-    *query_info = *(_query_info_array[index]);
+    *query_info = *query_info_;
     return true;
 }
 
 bool CConfigLoader::get_update_info(int index, struct UpdateInfo* update_info) const
 {
-    sys::ReadLockHelper read_lock(_read_write_lock);
-    if ((index < 0) || (index >= MAX_SQL_TEMPLATE))
-        return false;
-    if (NULL == _update_info_array[index])
+    sys::CRcuReadHelper rcu_read_helper;
+    const struct UpdateInfo* update_info_ = get_update_info(index);
+    if (NULL == update_info_)
         return false;
 
-    *update_info = *(_update_info_array[index]);
+    *update_info = *update_info_;
     return true;
 }
 
+const struct DbInfo* CConfigLoader::get_db_info(int index) const
+{
+    const struct ConfigSnapshot* config = _config.get();
+    if ((NULL == config) || (index < 0) || (index >= MAX_DB_CONNECTION))
+        return NULL;
+
+    return config->db_info_array[index];
+}
+
+const struct QueryInfo* CConfigLoader::get_query_info(int index) const
+{
+    const struct ConfigSnapshot* config = _config.get();
+    if ((NULL == config) || (index < 0) || (index >= MAX_SQL_TEMPLATE))
+        return NULL;
+
+    return config->query_info_array[index];
+}
+
+const struct UpdateInfo* CConfigLoader::get_update_info(int index) const
+{
+    const struct ConfigSnapshot* config = _config.get();
+    if ((NULL == config) || (index < 0) || (index >= MAX_SQL_TEMPLATE))
+        return NULL;
+
+    return config->update_info_array[index];
+}
+
 bool CConfigLoader::load_database(const Json::Value& json, struct DbInfo* db_info_array[])
 {
     std::set<std::string> alias_set;
@@ -477,23 +451,22 @@ bool CConfigLoader::add_update_info(struct UpdateInfo* update_info, struct Updat
     return true;
 }
 
-sys::CMySQLConnection* CConfigLoader::init_db_connection(int index, bool need_lock) const
+sys::CMySQLConnection* CConfigLoader::init_db_connection(int index) const
 {
-    if (!need_lock)
-    {
-        return do_init_db_connection(index);
-    }
-    else
+    // 复制一份，连接DB较慢且可能重试，get_db_connection的调用者也不能在读区内调用
+    struct DbInfo db_info;
+    if (!get_db_info(index, &db_info))
     {
-        sys::ReadLockHelper read_lock(_read_write_lock);
-        return do_init_db_connection(index);
+        MYLOG_ERROR("database_index[%d] not exists\n", index);
+        return NULL;
     }
+
+    return do_init_db_connection(&db_info);
 }
 
-sys::CMySQLConnection* CConfigLoader::do_init_db_connection(int index) const
+sys::CMySQLConnection* CConfigLoader::do_init_db_connection(const struct DbInfo* _db_info) const
 {
     const int max_retries = 3;
-    const struct DbInfo* _db_info = _db_info_array[index];
     sys::CMySQLConnection* db_connection = NULL;
 
     for (int retries=0; retries<max_retries; ++retries)
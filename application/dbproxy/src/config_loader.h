@@ -4,6 +4,7 @@
 #include <json/json.h>
 #include <mooon/sys/log.h>
 #include <mooon/sys/mysql_db.h>
+#include <mooon/sys/rcu.h>
 #include <mooon/sys/read_write_lock.h>
 #include <mooon/sys/utils.h>
 #include <mooon/utils/args_parser.h>
@@ -273,9 +274,41 @@ struct UpdateInfo
     }
 };
 
+// 一次完整加载的配置，加载后只读，重新加载时整体替换
+struct ConfigSnapshot
+{
+    struct DbInfo* db_info_array[MAX_DB_CONNECTION];
+    struct QueryInfo* query_info_array[MAX_SQL_TEMPLATE];
+    struct UpdateInfo* update_info_array[MAX_SQL_TEMPLATE];
+
+    ConfigSnapshot()
+    {
+        for (int index=0; index<MAX_DB_CONNECTION; ++index)
+            db_info_array[index] = NULL;
+        for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
+        {
+            query_info_array[index] = NULL;
+            update_info_array[index] = NULL;
+        }
+    }
+
+    ~ConfigSnapshot()
+    {
+        for (int index=0; index<MAX_DB_CONNECTION; ++index)
+            delete db_info_array[index];
+        for (int index=0; index<MAX_SQL_TEMPLATE; ++index)
+        {
+            delete query_info_array[index];
+            delete update_info_array[index];
+        }
+    }
+};
+
 class CSqlLogger;
 
 // 负责配置的加载
+// 配置由sys::CRcuSnapshot持有，查询路径上的读取不加锁，
+// 不带复制的get_*_info须在sys::CRcuReadHelper的范围内调用，返回值只在该范围内有效
 class CConfigLoader
 {
 public:
@@ -294,12 +327,19 @@ public:
     void release_sql_logger(CSqlLogger* sql_logger);
 
     void release_db_connection(int index);
+    // 可能连接DB（最多重试3次），不能在sys::CRcuReadHelper的范围内调用，否则重新加载配置会一直等待
     sys::CMySQLConnection* get_db_connection(int index) const;
 
+    // 带复制的版本，可在读区外调用
     bool get_db_info(int index, struct DbInfo* db_info) const;
     bool get_query_info(int index, struct QueryInfo* query_info) const;
     bool get_update_info(int index, struct UpdateInfo* update_info) const;
 
+    // 不带复制的版本，须在读区内调用，不存在时返回NULL
+    const struct DbInfo* get_db_info(int index) const;
+    const struct QueryInfo* get_query_info(int index) const;
+    const struct UpdateInfo* get_update_info(int index) const;
+
 private:
     bool load_database(const Json::Value& json, struct DbInfo* db_info_array[]);
     bool load_query(const Json::Value& json, struct QueryInfo* query_info_array[]);
@@ -309,19 +349,15 @@ private:
     bool add_update_info(struct UpdateInfo* update_info, struct UpdateInfo* update_info_array[]);
 
 private:
-    // 有锁版本
-    // need_lock 用来指示是否需要加锁
-    sys::CMySQLConnection* init_db_connection(int index, bool need_lock) const;
-    // 无锁版本，被init_db_connection()调用
-    sys::CMySQLConnection* do_init_db_connection(int index) const;
+    // 从当前配置取DbInfo后调用do_init_db_connection()
+    sys::CMySQLConnection* init_db_connection(int index) const;
+    sys::CMySQLConnection* do_init_db_connection(const struct DbInfo* db_info) const;
 
 private:
     volatile bool _stop_monitor;
-    mutable sys::CReadWriteLock _read_write_lock;
+    mutable sys::CReadWriteLock _read_write_lock; // 只保护_sql_logger_array
     CSqlLogger* _sql_logger_array[MAX_DB_CONNECTION];
-    struct DbInfo* _db_info_array[MAX_DB_CONNECTION];
-    struct QueryInfo* _query_info_array[MAX_SQL_TEMPLATE];
-    struct UpdateInfo* _update_info_array[MAX_SQL_TEMPLATE];
+    sys::CRcuSnapshot<struct ConfigSnapshot> _config;
     std::string _md5_sum;
 };
 
@@ -412,15 +412,17 @@ bool CDbProcess::handle_file(const std::string& filename)
             }
             catch (sys::CDBException& ex)
             {
-                MYLOG_ERROR("[%s:%u]%s\n", log_tag.c_str(), offset, ex.str().c_str());
-
                 // 网络类需要重试，直到成功
                 if (!_mysql.is_disconnected_exception(ex))
                 {
+                    MYLOG_ERROR("[%s:%u]%s\n", log_tag.c_str(), offset, ex.str().c_str());
                     ++_failure_num_sqls;
                     break;
                 }
 
+                // 数据库不可用时每秒重试一次，每分钟只记录一条，其余的汇总为被抑制的条数
+                MYLOG_ERROR_EVERY(60000, "[%s:%u]%s\n", log_tag.c_str(), offset, ex.str().c_str());
+
                 ++_retry_times;
                 sys::CUtils::millisleep(1000);
             }
@@ -54,27 +54,38 @@ void CDbProxyHandler::cleanup_cache()
 void CDbProxyHandler::query(DBTable& _return, const std::string& sign, const int32_t seq, const int32_t query_index, const std::vector<std::string> & tokens, const int32_t limit, const int32_t limit_start)
 {
     CConfigLoader* config_loader = CConfigLoader::get_singleton();
-    struct QueryInfo query_info;
-    std::vector<std::string> escaped_tokens;
+    std::string sql_template;
+    int database_index;
+    int cached_seconds;
 
-    if (!config_loader->get_query_info(query_index, &query_info))
+    // 读区只覆盖查找和校验，只复制需要的字段，
+    // 连接DB和查询都在读区外，重新加载配置不用等待慢查询
     {
-        MYLOG_ERROR("query_index[%d] not exists\n", query_index);
-        throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("query_index(%d) not exists", query_index));
-    }
-    if (sign != query_info.sign)
-    {
-        MYLOG_ERROR("sign[%s] error: %s\n", sign.c_str(), query_info.sign.c_str());
-        throw apache::thrift::TApplicationException("sign error");
+        sys::CRcuReadHelper rcu_read_helper;
+        const struct QueryInfo* query_info = config_loader->get_query_info(query_index);
+        if (NULL == query_info)
+        {
+            MYLOG_ERROR("query_index[%d] not exists\n", query_index);
+            throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("query_index(%d) not exists", query_index));
+        }
+        if (sign != query_info->sign)
+        {
+            MYLOG_ERROR("sign[%s] error: %s\n", sign.c_str(), query_info->sign.c_str());
+            throw apache::thrift::TApplicationException("sign error");
+        }
+
+        sql_template = query_info->sql_template;
+        database_index = query_info->database_index;
+        cached_seconds = query_info->cached_seconds;
     }
 
     try
     {
-        sys::CMySQLConnection* db_connection = config_loader->get_db_connection(query_info.database_index);
+        sys::CMySQLConnection* db_connection = config_loader->get_db_connection(database_index);
         if (NULL == db_connection)
         {
-            MYLOG_ERROR("database_index[%d] not exists or cannot connect\n", query_info.database_index);
-            throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("database_index(%d) not exists or cannot connect", query_info.database_index));
+            MYLOG_ERROR("database_index[%d] not exists or cannot connect\n", database_index);
+            throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("database_index(%d) not exists or cannot connect", database_index));
         }
         else if (tokens.size() > utils::FORMAT_STRING_SIZE)
         {
@@ -85,12 +96,12 @@ void CDbProxyHandler::query(DBTable& _return, const std::string& sign, const int
         {
             std::vector<std::string> escaped_tokens;
             escape_tokens(db_connection, tokens, &escaped_tokens);
-            std::string sql = utils::format_string(query_info.sql_template.c_str(), escaped_tokens);
+            std::string sql = utils::format_string(sql_template.c_str(), escaped_tokens);
 
             if (sql.empty())
             {
-                MYLOG_ERROR("error number of tokens or template: %s\n", query_info.str().c_str());
-                throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("error number of tokens or invalid template(%s)", query_info.str().c_str()));
+                MYLOG_ERROR("error number of tokens or template: query_index[%d] %s\n", query_index, sql_template.c_str());
+                throw apache::thrift::TApplicationException(utils::CStringUtils::format_string("error number of tokens or invalid template(%s)", sql_template.c_str()));
             }
             else
             {
@@ -104,7 +115,7 @@ void CDbProxyHandler::query(DBTable& _return, const std::string& sign, const int
                 else
                     sql = utils::CStringUtils::format_string("%s LIMIT %d,%d", sql.c_str(), limit_start, limit_);
 
-                if (query_info.cached_seconds < 1)
+                if (cached_seconds < 1)
                 {
                     MYLOG_DEBUG("not cache: %s", sql.c_str());
                 }
@@ -127,9 +138,9 @@ void CDbProxyHandler::query(DBTable& _return, const std::string& sign, const int
                 }
 
                 ++_num_query_success;
-                if ((query_info.cached_seconds > 0) && !_return.empty())
+                if ((cached_seconds > 0) && !_return.empty())
                 {
-                    add_data_to_cache(_return, sql, query_info.cached_seconds);
+                    add_data_to_cache(_return, sql, cached_seconds);
                 }
             }
         }
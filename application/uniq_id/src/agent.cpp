@@ -37,6 +37,9 @@
 // 是否检查magic
 #define _CHECK_MAGIC_ 1
 
+// 一次系统调用最多收发的消息个数
+#define BATCH_NUMBER 64
+
 // 日志控制：
 // 可通过设置环境变量MOOON_LOG_LEVEL和MOOON_LOG_SCREEN来控制日志级别和是否在屏幕上输出日志
 // 1) MOOON_LOG_LEVEL可以取值debug,info,error,warn,fatal
@@ -147,6 +150,10 @@ private:
     int on_response_error();
     int on_response_label();
 
+private:
+    bool on_request(int bytes_received);
+    void send_responses(int number);
+
 private:
     uint32_t _echo;
     std::vector<struct sockaddr_in> _masters_addr;
@@ -175,6 +182,13 @@ private:
     char _request_buffer[SOCKET_BUFFER_SIZE];
     char _response_buffer[SOCKET_BUFFER_SIZE];
     size_t _response_size;
+
+private:
+    // 批量收发（recvmmsg和sendmmsg）用到的Buffer
+    net::udp_datagram_t _requests[BATCH_NUMBER];
+    net::udp_datagram_t _responses[BATCH_NUMBER];
+    char _request_buffers[BATCH_NUMBER][SOCKET_BUFFER_SIZE];
+    char _response_buffers[BATCH_NUMBER][SOCKET_BUFFER_SIZE];
 };
 
 extern "C" int main(int argc, char* argv[])
@@ -195,6 +209,15 @@ CUniqAgent::CUniqAgent()
     memset(&_request_buffer, 0, sizeof(_request_buffer));
     memset(&_response_buffer, 0, sizeof(_response_buffer));
     _response_size = 0;
+
+    memset(_requests, 0, sizeof(_requests));
+    memset(_responses, 0, sizeof(_responses));
+    for (int i=0; i<BATCH_NUMBER; ++i)
+    {
+        _requests[i].buffer = _request_buffers[i];
+        _requests[i].buffer_size = sizeof(_request_buffers[i]);
+        _responses[i].buffer = _response_buffers[i];
+    }
 }
 
 CUniqAgent::~CUniqAgent()
@@ -282,128 +305,160 @@ bool CUniqAgent::run()
         }
         else
         {
-            // 循环，可以减少对CEpoller::timed_wait的调用
-            for (int i=0; i<10000; ++i)
+            // 循环，可以减少对CEpoller::timed_wait的调用，
+            // 每次由一个recvmmsg收取一批请求，处理完后由一个sendmmsg回复这一批的响应
+            for (int i=0; i<10000;)
             {
+                int number = -1;
                 try
                 {
-                    // Linux 2.6.33开始支持recvmsg
-                    // glibc 2.12开始支持recvmmsg
-//#if __GLIBC__ == 2 && __GLIBC_MINOR__ == 12
-//                    int k;
-//                    const unsigned int vlen = 100;
-//                    char bufs[vlen][SOCKET_BUFFER_SIZE];
-//                    struct mmsghdr msgs[vlen];
-//                    int n = recvmmsg(_udp_socket->get_fd(), msgs, vlen, MSG_DONTWAIT, NULL);
-//#else
-                    int bytes_received = _udp_socket->receive_from(_request_buffer, sizeof(_request_buffer), &_from_addr);
-//#endif
-                    if (-1 == bytes_received)
-                    {
-                        // WOULDBLOCK
-                        break;
-                    }
-                    else if (bytes_received < static_cast<int>(sizeof(struct MessageHead)))
+                    number = _udp_socket->receive_batch(_requests, BATCH_NUMBER);
+                }
+                catch (sys::CSyscallException& ex)
+                {
+                    MYLOG_ERROR("receive_batch failed: %s\n", ex.str().c_str());
+                    break;
+                }
+                if (-1 == number)
+                {
+                    // WOULDBLOCK
+                    break;
+                }
+
+                int response_number = 0;
+                for (int k=0; k<number; ++k)
+                {
+                    // 处理过程中可能同步地向master租赁Label，会用到_request_buffer和_response_buffer，
+                    // 因此逐个复制到_request_buffer中处理，响应处理完后再复制出来
+                    _from_addr = _requests[k].addr;
+                    memcpy(_request_buffer, _requests[k].buffer, _requests[k].bytes);
+                    if (on_request(static_cast<int>(_requests[k].bytes)))
                     {
-                        MYLOG_ERROR("invalid size (%d) from %s: %s\n", bytes_received, net::to_string(_from_addr).c_str(), strerror(errno));
+                        memcpy(_responses[response_number].buffer, _response_buffer, _response_size);
+                        _responses[response_number].buffer_size = _response_size;
+                        _responses[response_number].addr = _from_addr;
+                        ++response_number;
                     }
-                    else
-                    {
-                        _message_head = reinterpret_cast<struct MessageHead*>(_request_buffer);
-                        MYLOG_DEBUG("%s from %s", _message_head->str().c_str(), net::to_string(_from_addr).c_str());
+                }
 
-                        if (bytes_received != _message_head->len)
-                        {
-                            MYLOG_ERROR("invalid size (%d/%d/%zd) from %s: %s\n", bytes_received, _message_head->len.to_int(), sizeof(struct MessageHead), net::to_string(_from_addr).c_str(), strerror(errno));
-                        }
-                        else
-                        {
-                            int errcode = 0;
-                            std::string errmsg;
+                send_responses(response_number);
+                i += number;
+            } // for
+        } // if (0 == n)
+    } // while (true)
+
+    return true;
+}
+
+// 处理_request_buffer中的一个消息，需要回响应给_from_addr时返回true，响应在_response_buffer中
+bool CUniqAgent::on_request(int bytes_received)
+{
+    if (bytes_received < static_cast<int>(sizeof(struct MessageHead)))
+    {
+        MYLOG_ERROR("invalid size (%d) from %s: %s\n", bytes_received, net::to_string(_from_addr).c_str(), strerror(errno));
+    }
+    else
+    {
+        _message_head = reinterpret_cast<struct MessageHead*>(_request_buffer);
+        MYLOG_DEBUG("%s from %s", _message_head->str().c_str(), net::to_string(_from_addr).c_str());
+
+        if (bytes_received != _message_head->len)
+        {
+            MYLOG_ERROR("invalid size (%d/%d/%zd) from %s: %s\n", bytes_received, _message_head->len.to_int(), sizeof(struct MessageHead), net::to_string(_from_addr).c_str(), strerror(errno));
+        }
+        else
+        {
+            int errcode = 0;
+            std::string errmsg;
 
 #if _CHECK_MAGIC_ == 1
-                            const uint32_t magic_ = _message_head->calc_magic();
-                            if (magic_ != _message_head->magic)
-                            {
-                                //errcode = ERROR_ILLEGAL; // 非法来源，直接丢弃
-                                MYLOG_ERROR("[%s] illegal request: %s|%u\n", net::to_string(_from_addr).c_str(), _message_head->str().c_str(), magic_);
-                            }
+            const uint32_t magic_ = _message_head->calc_magic();
+            if (magic_ != _message_head->magic)
+            {
+                //errcode = ERROR_ILLEGAL; // 非法来源，直接丢弃
+                MYLOG_ERROR("[%s] illegal request: %s|%u\n", net::to_string(_from_addr).c_str(), _message_head->str().c_str(), magic_);
+            }
 #endif // _CHECK_MAGIC_
 
-                            // 如果errcode在这里为非0，
-                            // 则表示一个非法的包，这种情形不需做出响应
-                            if (0 == errcode)
-                            {
-                                // Request from client
-                                if (REQUEST_LABEL == _message_head->type)
-                                {
-                                    errcode = prepare_response_get_label();
-                                }
-                                else if (REQUEST_UNIQ_ID == _message_head->type)
-                                {
-                                    errcode = prepare_response_get_uniq_id();
-                                }
-                                else if (REQUEST_UNIQ_SEQ == _message_head->type)
-                                {
-                                    errcode = prepare_response_get_uniq_seq();
-                                }
-                                else if (REQUEST_LABEL_AND_SEQ == _message_head->type)
-                                {
-                                    errcode = prepare_response_get_label_and_seq();
-                                }
-                                // Response from master
-                                else if (RESPONSE_ERROR == _message_head->type)
-                                {
-                                    if (magic_ != _message_head->magic)
-                                        errcode = -1;
-                                    else
-                                        errcode = on_response_error();
-                                }
-                                else if (RESPONSE_LABEL == _message_head->type)
-                                {
-                                    if (magic_ != _message_head->magic)
-                                        errcode = -1;
-                                    else
-                                        errcode = on_response_label();
-                                }
-                                else
-                                {
-                                    errcode = ERROR_INVALID_TYPE;
-                                    MYLOG_ERROR("invalid message type: %s\n", _message_head->str().c_str());
-                                }
-                                if ((errcode != 0) && (errcode != -1))
-                                {
-                                    prepare_response_error(errcode);
-                                }
-
-                                // -1为Master回给Agent的响应，
-                                // 其它为Client向Agent的请求，这种情形Agent需要回响应给Client
-                                if (errcode != -1)
-                                {
-                                    try
-                                    {
-                                        _udp_socket->send_to(_response_buffer, _response_size, _from_addr);
-                                        MYLOG_DEBUG("send to %s ok\n", net::to_string(_from_addr).c_str());
-                                    }
-                                    catch (sys::CSyscallException& ex)
-                                    {
-                                        MYLOG_ERROR("send to %s failed: %s\n", net::to_string(_from_addr).c_str(), ex.str().c_str());
-                                    }
-                                }
-                            }
-                        }
-                    }
+            // 如果errcode在这里为非0，
+            // 则表示一个非法的包，这种情形不需做出响应
+            if (0 == errcode)
+            {
+                // Request from client
+                if (REQUEST_LABEL == _message_head->type)
+                {
+                    errcode = prepare_response_get_label();
                 }
-                catch (sys::CSyscallException& ex)
+                else if (REQUEST_UNIQ_ID == _message_head->type)
                 {
-                    MYLOG_ERROR("receive_from failed: %s\n", ex.str().c_str());
-                    break;
+                    errcode = prepare_response_get_uniq_id();
+                }
+                else if (REQUEST_UNIQ_SEQ == _message_head->type)
+                {
+                    errcode = prepare_response_get_uniq_seq();
+                }
+                else if (REQUEST_LABEL_AND_SEQ == _message_head->type)
+                {
+                    errcode = prepare_response_get_label_and_seq();
+                }
+                // Response from master
+                else if (RESPONSE_ERROR == _message_head->type)
+                {
+                    if (magic_ != _message_head->magic)
+                        errcode = -1;
+                    else
+                        errcode = on_response_error();
+                }
+                else if (RESPONSE_LABEL == _message_head->type)
+                {
+                    if (magic_ != _message_head->magic)
+                        errcode = -1;
+                    else
+                        errcode = on_response_label();
+                }
+                else
+                {
+                    errcode = ERROR_INVALID_TYPE;
+                    MYLOG_ERROR("invalid message type: %s\n", _message_head->str().c_str());
+                }
+                if ((errcode != 0) && (errcode != -1))
+                {
+                    prepare_response_error(errcode);
                 }
-            } // while (true)
-        } // if (0 == n)
-    } // while (true)
 
-    return true;
+                // -1为Master回给Agent的响应，
+                // 其它为Client向Agent的请求，这种情形Agent需要回响应给Client
+                return (errcode != -1);
+            }
+        }
+    }
+
+    return false;
+}
+
+void CUniqAgent::send_responses(int number)
+{
+    for (int k=0; k<number;)
+    {
+        try
+        {
+            int sent = _udp_socket->send_batch(_responses+k, number-k);
+            if (-1 == sent)
+            {
+                MYLOG_ERROR("send %d responses would block\n", number-k);
+                break;
+            }
+
+            MYLOG_DEBUG("send %d responses ok\n", sent);
+            k += sent;
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            // 跳过出错的，继续发送之后的
+            MYLOG_ERROR("send to %s failed: %s\n", net::to_string(_responses[k].addr).c_str(), ex.str().c_str());
+            ++k;
+        }
+    }
 }
 
 void CUniqAgent::fini()
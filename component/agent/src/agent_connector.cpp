@@ -32,6 +32,7 @@ CAgentConnector::CAgentConnector(CAgentThread* thread)
 void CAgentConnector::before_close()
 {
     _recv_machine.reset();
+    _recv_buffer.reset();
     _send_machine.reset(true);
 }
 
@@ -69,9 +70,8 @@ net::epoll_event_t CAgentConnector::handle_error(void* input_ptr, void* ouput_pt
 
 net::epoll_event_t CAgentConnector::handle_input(void* input_ptr, void* ouput_ptr)
 {
-    char recv_buffer[1024];
-    
-    ssize_t bytes_recved = receive(recv_buffer, sizeof(recv_buffer));
+    // 每次work之后都保证有可写的空间，消息不跨越回绕点时不需要复制
+    ssize_t bytes_recved = receive(_recv_buffer.write_ptr(), _recv_buffer.writable());
     if (0 == bytes_recved)
     {
     	AGENT_LOG_DEBUG("%s closed.\n", to_string().c_str());
@@ -84,7 +84,8 @@ net::epoll_event_t CAgentConnector::handle_input(void* input_ptr, void* ouput_pt
         return net::epoll_none;
     }
     
-    return utils::handle_error == _recv_machine.work(recv_buffer, bytes_recved)
+    _recv_buffer.commit(bytes_recved);
+    return utils::handle_error == _recv_machine.work(&_recv_buffer)
          ? net::epoll_close
          : net::epoll_none;
 }
@@ -93,40 +94,31 @@ net::epoll_event_t CAgentConnector::handle_output(void* input_ptr, void* ouput_p
 {
     utils::handle_result_t hr = utils::handle_finish;
     
-    // 如果上次有未发送完的，则先保证原有的发送完
-    if (!_send_machine.is_finish())
-    {
-        hr = _send_machine.continue_send();
-    }
-    
-    // 发送新的消息
-    if (utils::handle_finish == hr)
+    for (;;)
     {
-        _send_machine.reset(true);
+        // 如果上次有未发送完的，则先保证原有的发送完
+        hr = _send_machine.flush();
+        if (hr != utils::handle_finish)
+        {
+            break;
+        }
 
-        while (true)
+        // 一次加锁取出一批新的消息，一次writev发送
+        const net::TCommonMessageHeader* agent_messages[IOV_MAX];
+        uint32_t message_number = IOV_MAX;
+        _thread->get_messages(agent_messages, &message_number);
+        for (uint32_t i=0; i<message_number; ++i)
         {
-            const net::TCommonMessageHeader* agent_message = _thread->get_message();
-            if (NULL == agent_message)
-            {
-                // 需要将CReportQueue再次放入Epoller中监控
-                AGENT_LOG_DEBUG("No message to send.\n");
-                _thread->enable_queue_read();
-                hr = utils::handle_finish;
-                break;
-            }
-            
-            size_t bytes_sent = sizeof(net::TCommonMessageHeader) + agent_message->size;
+            size_t bytes_sent = sizeof(net::TCommonMessageHeader) + agent_messages[i]->size;
             AGENT_LOG_DEBUG("Will send %zu bytes\n", bytes_sent);
-            hr = _send_machine.send(reinterpret_cast<const char*>(agent_message), bytes_sent);
-            if (utils::handle_finish == hr)
-            {
-                _send_machine.reset(true);
-            }
-            else
-            {
-                break;
-            }
+            _send_machine.push(reinterpret_cast<const char*>(agent_messages[i]), bytes_sent, true);
+        }
+        if (0 == message_number)
+        {
+            // 需要将CReportQueue再次放入Epoller中监控
+            AGENT_LOG_DEBUG("No message to send.\n");
+            _thread->enable_queue_read();
+            break;
         }
     }
     
@@ -44,6 +44,7 @@ private:
 private:
     CAgentThread* _thread;        
     net::CSendMachine<CAgentConnector> _send_machine;        
+    net::CRecvBuffer _recv_buffer; // 直接收到这里，由_recv_machine就地解析
     net::CRecvMachine<net::TCommonMessageHeader, CProcessorManager> _recv_machine;
 };
 
@@ -18,12 +18,15 @@
  */
 #include "agent_thread.h"
 #include <algorithm>
+#include <poll.h>
 #include <mooon/utils/tokener.h>
 #include "agent_context.h"
 AGENT_NAMESPACE_BEGIN
 
 CAgentThread::CAgentThread(CAgentContext* context)
  :_context(context)
+ ,_resolve_queue(1)
+ ,_resolving(false)
  ,_connector(this)
  ,_report_queue(context->get_agent_info().queue_size + 1, this)
 {
@@ -36,19 +39,17 @@ CAgentThread::~CAgentThread()
     clear_center_hosts();
 }
 
+// CReportQueue自带锁，不再另外加锁，
+// 否则push_back等待队列非满时持有的锁会挡住取消息的网络线程，只能等到超时
 bool CAgentThread::put_message(const net::TCommonMessageHeader* header, uint32_t timeout_millisecond)
 {
-    sys::LockHelper<sys::CLock> lh(_queue_lock);
     return _report_queue.push_back(const_cast<net::TCommonMessageHeader*>(header), timeout_millisecond);
 }
 
-const net::TCommonMessageHeader* CAgentThread::get_message()
+void CAgentThread::get_messages(const net::TCommonMessageHeader** messages, uint32_t* number)
 {
-    net::TCommonMessageHeader* agent_message = NULL;
-    sys::LockHelper<sys::CLock> lh(_queue_lock);
-    
-    _report_queue.pop_front(agent_message);
-    return agent_message;
+    // 只加一次锁，并且只在取空时读一次eventfd
+    _report_queue.pop_front(const_cast<net::TCommonMessageHeader**>(messages), *number);
 }
 
 void CAgentThread::enable_queue_read()
@@ -155,6 +156,7 @@ void CAgentThread::run()
 void CAgentThread::before_start() throw (utils::CException, sys::CSyscallException)
 {
     _epoller.create(1024);
+    _resolver.start();
     enable_queue_read();
 }
 
@@ -184,23 +186,8 @@ bool CAgentThread::parse_domainname_or_iplist()
         return false;
     }
     
-    std::string errinfo;
     net::string_ip_array_t string_ip_array;
-    if (!net::CUtils::get_ip_address(domainname_or_iplist.c_str(), string_ip_array, errinfo))
-    {
-        // 也许是IP列表，尝试一下
-        utils::CTokener tokner;
-        std::vector<std::string> token_list;
-
-        tokner.split(&token_list, domainname_or_iplist, ",");
-        if (token_list.empty())
-        {
-            AGENT_LOG_WARN("Not found any IP from %s.\n", domainname_or_iplist.c_str());
-            return false;
-        }
-
-        std::copy(token_list.begin(), token_list.end(), std::back_inserter(string_ip_array));
-    }
+    resolve_center(domainname_or_iplist, &string_ip_array);
 
     // 如果新解析出IP，否则保持不变，也就是什么也不用做
     if (!string_ip_array.empty())
@@ -242,6 +229,63 @@ bool CAgentThread::parse_domainname_or_iplist()
     return !_center_hosts.empty();
 }
 
+// 在事件循环线程中，不能调用阻塞的CResolver::resolve：
+// 命中缓存时直接使用，否则提交异步解析，由_resolve_queue带回结果，
+// 只有在还没有任何可用的Center时才等待结果，并且最多等待一个连接超时
+void CAgentThread::resolve_center(const std::string& domainname_or_iplist, net::string_ip_array_t* string_ip_array)
+{
+    // IP列表不需要解析
+    if (domainname_or_iplist.find(',') != std::string::npos)
+    {
+        utils::CTokener tokner;
+        std::vector<std::string> token_list;
+
+        tokner.split(&token_list, domainname_or_iplist, ",");
+        std::copy(token_list.begin(), token_list.end(), std::back_inserter(*string_ip_array));
+        return;
+    }
+    if (_resolver.lookup(domainname_or_iplist, string_ip_array))
+    {
+        return;
+    }
+
+    if (!_resolving)
+    {
+        _resolving = true;
+        _resolver.async_resolve(domainname_or_iplist, &_resolve_queue, NULL);
+    }
+    if (_center_hosts.empty())
+    {
+        struct pollfd pfd;
+        pfd.fd = _resolve_queue.get_fd();
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        (void)poll(&pfd, 1, _connector.get_connect_timeout_milliseconds());
+    }
+
+    net::resolve_result_t* result = NULL;
+    while (_resolve_queue.pop_front(result))
+    {
+        _resolving = false;
+        if (!result->success)
+        {
+            AGENT_LOG_WARN("Resolve %s failed: %s.\n", result->hostname.c_str(), result->errinfo.c_str());
+        }
+        else if (result->hostname == domainname_or_iplist)
+        {
+            *string_ip_array = result->ip_array;
+        }
+
+        delete result;
+    }
+
+    // 失败的结果被负缓存，之后会立即完成，避免没有Center时空转
+    if (string_ip_array->empty() && _center_hosts.empty() && !_resolving)
+    {
+        do_millisleep(_connector.get_connect_timeout_milliseconds());
+    }
+}
+
 void CAgentThread::clear_center_hosts()
 {    
     for (std::list< CCenterHost*>::iterator iter = _center_hosts.begin()
@@ -20,6 +20,7 @@
 #define MOOON_AGENT_THREAD_H
 #include <list>
 #include <mooon/net/epoller.h>
+#include <mooon/net/resolver.h>
 #include <mooon/sys/lock.h>
 #include <mooon/sys/thread.h>
 #include <mooon/agent/agent.h>
@@ -37,7 +38,8 @@ public:
     ~CAgentThread();
     
     bool put_message(const net::TCommonMessageHeader* header, uint32_t timeout_millisecond);
-    const net::TCommonMessageHeader* get_message();
+    // 一次取出最多*number条消息，*number返回实际取出的条数
+    void get_messages(const net::TCommonMessageHeader** messages, uint32_t* number);
     void enable_queue_read();
     void enable_connector_write();
     bool register_command_processor(ICommandProcessor* processor);
@@ -56,6 +58,7 @@ private:
     
 private:    
     bool parse_domainname_or_iplist();
+    void resolve_center(const std::string& domainname_or_iplist, net::string_ip_array_t* string_ip_array);
     void clear_center_hosts();
     CCenterHost* choose_center_host();
     CCenterHost* poll_choose_center_host();
@@ -67,7 +70,9 @@ private:
     TAgentInfo _agent_info;
     CAgentContext* _context;
     net::CEpoller _epoller;
-    sys::CLock _queue_lock;
+    net::CResolver _resolver;           // 重连时解析域名，只查缓存或异步解析，不阻塞
+    net::CResolveQueue _resolve_queue;  // 异步解析的结果
+    bool _resolving;                    // 已提交异步解析，结果尚未取出
     CAgentConnector _connector;
     CReportQueue _report_queue;
     CProcessorManager _processor_manager;
@@ -161,6 +161,15 @@ public:
 
     /** 设置重连接间隔秒数 */
     virtual void set_reconnect_seconds(uint32_t seconds) = 0;
+
+    /***
+      * 设置TCP_INFO采样，默认不采样，
+      * 采样在连接有事件时进行，结果按发送线程汇总成直方图（名为"dispatcher.线程顺序号"），
+      * 可通过observer::CTcpInfoObservable上报，见net::CTcpInfoSampler
+      * @interval_milliseconds: 同一连接两次采样的最小间隔毫秒数，为0表示不采样
+      * @max_samples_per_second: 每个发送线程每秒最多的采样次数，为0表示不限制
+      */
+    virtual void set_tcp_info_sampling(uint32_t interval_milliseconds, uint32_t max_samples_per_second=1000) = 0;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -180,9 +189,11 @@ extern void destroy(IDispatcher* dispatcher);
   * 创建分发器
   * @thread_count 工作线程个数
   * @timeout_seconds 连接超时很秒数
+  * @cpu_affinity 工作线程的CPU亲和配置，为空表示不绑定，
+  *               可为"spread"、"compact"或CPU列表（如"0-3,8"），格式请参见sys::CCpuAffinity
   * @return 如果失败则返回NULL，否则返回非NULL
   */
-extern IDispatcher* create(uint16_t thread_count, uint32_t timeout_seconds=60);
+extern IDispatcher* create(uint16_t thread_count, uint32_t timeout_seconds=60, const std::string& cpu_affinity="");
 
 DISPATCHER_NAMESPACE_END
 #endif // MOOON_DISPATCHER_H
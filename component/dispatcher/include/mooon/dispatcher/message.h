@@ -19,6 +19,7 @@
 #ifndef MOOON_DISPATCHER_MESSAGE_H
 #define MOOON_DISPATCHER_MESSAGE_H
 #include <mooon/dispatcher/config.h>
+#include <mooon/sys/size_class_allocator.h>
 DISPATCHER_NAMESPACE_BEGIN
 
 /***
@@ -38,6 +39,13 @@ typedef struct
     char data[0];     /** 需要发送的消息 */
 }buffer_message_t;
 
+/***
+  * 消息内存分配器，所有分发器实例共享，为NULL时使用new和delete
+  * 如需使用，应当在创建第一个消息之前设置好，之后不能再修改，
+  * 且须在所有消息销毁之后才能销毁分配器
+  */
+extern sys::CSizeClassAllocator* message_allocator;
+
 extern file_message_t* create_file_message(size_t file_size);
 extern buffer_message_t* create_buffer_message(size_t data_length);
 
@@ -30,8 +30,9 @@ CDispatcherContext::~CDispatcherContext()
     delete _unmanaged_sender_table;
 }
 
-CDispatcherContext::CDispatcherContext(uint16_t thread_count, uint32_t timeout_seconds)
+CDispatcherContext::CDispatcherContext(uint16_t thread_count, uint32_t timeout_seconds, const std::string& cpu_affinity)
     :_timeout_seconds(timeout_seconds)
+    ,_cpu_affinity(cpu_affinity)
     ,_thread_pool(NULL)
 {    
 	set_reconnect_seconds(2); // 默认重连接间隔秒数
@@ -79,6 +80,16 @@ void CDispatcherContext::set_reconnect_seconds(uint32_t seconds)
 	atomic_set(&_reconnect_seconds, seconds);
 }
 
+void CDispatcherContext::set_tcp_info_sampling(uint32_t interval_milliseconds, uint32_t max_samples_per_second)
+{
+    CSendThread** send_thread = _thread_pool->get_thread_array();
+    uint16_t thread_count = _thread_pool->get_thread_count();
+    for (uint16_t i=0; i<thread_count; ++i)
+    {
+        send_thread[i]->get_tcp_info_sampler()->set_sampling(interval_milliseconds, max_samples_per_second);
+    }
+}
+
 bool CDispatcherContext::create_thread_pool()
 {        
     try
@@ -86,7 +97,7 @@ bool CDispatcherContext::create_thread_pool()
         // 创建线程池
         // 只有CThread::before_start返回false，create才会返回false
         _thread_pool = new CSendThreadPool;
-        _thread_pool->create(_thread_count, this);
+        _thread_pool->create(_thread_count, this, _cpu_affinity);
         DISPATCHER_LOG_INFO("Sender thread number is %d.\n", _thread_pool->get_thread_count());
 
         CSendThread** send_thread = _thread_pool->get_thread_array();
@@ -101,6 +112,7 @@ bool CDispatcherContext::create_thread_pool()
     catch (sys::CSyscallException& syscall_ex)
     {
         delete _thread_pool;
+        _thread_pool = NULL;
         DISPATCHER_LOG_ERROR("Failed to create thread pool: %s.\n", syscall_ex.str().c_str());
     }
 
@@ -133,9 +145,9 @@ void destroy(IDispatcher* dispatcher)
     delete dispatcher;
 }
 
-IDispatcher* create(uint16_t thread_count, uint32_t timeout_seconds)
+IDispatcher* create(uint16_t thread_count, uint32_t timeout_seconds, const std::string& cpu_affinity)
 {    
-    CDispatcherContext* dispatcher = new CDispatcherContext(thread_count, timeout_seconds);    
+    CDispatcherContext* dispatcher = new CDispatcherContext(thread_count, timeout_seconds, cpu_affinity);    
     if (!dispatcher->create())
     {
         delete dispatcher;
@@ -36,7 +36,7 @@ class CDispatcherContext: public IDispatcher
 {
 public:
     ~CDispatcherContext();
-    CDispatcherContext(uint16_t thread_count, uint32_t timeout_seconds);
+    CDispatcherContext(uint16_t thread_count, uint32_t timeout_seconds, const std::string& cpu_affinity);
     
     bool create();         
     void add_sender(CSender* sender); 
@@ -56,6 +56,7 @@ private: // IDispatcher
     virtual IUnmanagedSenderTable* get_unmanaged_sender_table();
     virtual uint16_t get_thread_number() const;
     virtual void set_reconnect_seconds(uint32_t seconds);
+    virtual void set_tcp_info_sampling(uint32_t interval_milliseconds, uint32_t max_samples_per_second);
 
 private:        
     bool create_thread_pool();  
@@ -66,6 +67,7 @@ private:
     typedef sys::CThreadPool<CSendThread> CSendThreadPool;
     uint16_t _thread_count;
     uint32_t _timeout_seconds;
+    std::string _cpu_affinity;
     atomic_t _reconnect_seconds;
     CSendThreadPool* _thread_pool;
     CManagedSenderTable* _managed_sender_table;
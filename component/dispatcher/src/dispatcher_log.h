@@ -32,6 +32,10 @@ DISPATCHER_NAMESPACE_BEGIN
 #define DISPATCHER_LOG_DEBUG(format, ...)     __MYLOG_DEBUG(dispatcher::logger, DISPATCHER_MODULE_NAME, format, ##__VA_ARGS__)
 #define DISPATCHER_LOG_DETAIL(format, ...)    __MYLOG_DETAIL(dispatcher::logger, DISPATCHER_MODULE_NAME, format, ##__VA_ARGS__)
 
+// 对端异常时可能被大量重复的日志，按调用点限流
+#define DISPATCHER_LOG_ERROR_RATELIMIT(rate, burst, format, ...) __MYLOG_RATELIMIT(ERROR, dispatcher::logger, DISPATCHER_MODULE_NAME, rate, burst, format, ##__VA_ARGS__)
+#define DISPATCHER_LOG_WARN_RATELIMIT(rate, burst, format, ...)  __MYLOG_RATELIMIT(WARN, dispatcher::logger, DISPATCHER_MODULE_NAME, rate, burst, format, ##__VA_ARGS__)
+
 /***
   * 分发消息类型
   */
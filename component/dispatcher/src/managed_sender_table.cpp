@@ -37,7 +37,7 @@ CManagedSenderTable::CManagedSenderTable(CDispatcherContext* context)
 {
     _table_size = std::numeric_limits<uint16_t>::max();
 
-    _lock_array = new sys::CLock[_table_size];
+    _lock_array = new sys::CAdaptiveLock[_table_size];
     _sender_table = new CManagedSender*[_table_size];
     
     for (int i=0; i<_table_size; ++i)
@@ -60,7 +60,7 @@ ISender* CManagedSenderTable::open_sender(const SenderInfo& sender_info)
     }
 
     CManagedSender* sender = NULL;
-    sys::LockHelper<sys::CLock> lock(_lock_array[sender_info.key]);
+    sys::LockHelper<sys::CAdaptiveLock> lock(_lock_array[sender_info.key]);
 
     if (NULL == _sender_table[sender_info.key])
     {    
@@ -83,7 +83,7 @@ void CManagedSenderTable::close_sender(ISender* sender)
     CManagedSender* sender_ = static_cast<CManagedSender*>(sender);
     uint16_t key = sender_->get_sender_info().key;
 
-    sys::LockHelper<sys::CLock> lock(_lock_array[key]);                
+    sys::LockHelper<sys::CAdaptiveLock> lock(_lock_array[key]);                
     if (sender_->is_in_table())
     {
         sender_->shutdown();
@@ -99,7 +99,7 @@ void CManagedSenderTable::release_sender(ISender* sender)
     CManagedSender* sender_ = static_cast<CManagedSender*>(sender);
     uint16_t key = sender_->get_sender_info().key;
 
-    sys::LockHelper<sys::CLock> lock(_lock_array[key]);    
+    sys::LockHelper<sys::CAdaptiveLock> lock(_lock_array[key]);    
     if (sender_->is_in_table() && sender_->dec_refcount())
     {
         // 因为走到这里，说明Sender已经被deleted
@@ -113,7 +113,7 @@ void CManagedSenderTable::remove_sender(ISender* sender)
     CManagedSender* sender_ = static_cast<CManagedSender*>(sender);
     uint16_t key = sender_->get_sender_info().key;
     
-    sys::LockHelper<sys::CLock> lock(_lock_array[key]);                
+    sys::LockHelper<sys::CAdaptiveLock> lock(_lock_array[key]);                
     if (sender_->is_in_table())
     {
         sender_->set_in_table(false);
@@ -126,7 +126,7 @@ void CManagedSenderTable::remove_sender(ISender* sender)
 ISender* CManagedSenderTable::get_sender(uint16_t key)
 {
     CManagedSender* sender = NULL;
-    sys::LockHelper<sys::CLock> lock(_lock_array[key]);
+    sys::LockHelper<sys::CAdaptiveLock> lock(_lock_array[key]);
 
     if (_sender_table[key] != NULL)
     {
@@ -142,7 +142,7 @@ void CManagedSenderTable::clear_sender()
     // 下面这个循环最大可能为65535次，但只有更新发送表时才发生，所以对性能影响可以忽略
     for (uint16_t key=0; key<_table_size; ++key)
     {
-        sys::LockHelper<sys::CLock> lock(_lock_array[key]);
+        sys::LockHelper<sys::CAdaptiveLock> lock(_lock_array[key]);
         if (_sender_table[key] != NULL)
         {
             _sender_table[key]->shutdown();
@@ -20,6 +20,7 @@
 #define MOOON_DISPATCHER_MANAGED_SENDER_TABLE_H
 #include "sender_table.h"
 #include "managed_sender.h"
+#include <mooon/sys/adaptive_lock.h>
 DISPATCHER_NAMESPACE_BEGIN
 
 class CDispatcherContext;
@@ -46,7 +47,7 @@ private:
 
 private:        
     uint16_t _table_size;
-    sys::CLock* _lock_array;
+    sys::CAdaptiveLock* _lock_array; // 不统计，65535个锁都登记的话get_all_stats每次都要遍历它们
     sender_table_t _sender_table;        
 };
 
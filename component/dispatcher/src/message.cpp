@@ -20,9 +20,26 @@
 #include "dispatcher_log.h"
 DISPATCHER_NAMESPACE_BEGIN
 
+sys::CSizeClassAllocator* message_allocator = NULL;
+
+static char* allocate_message_buffer(size_t size)
+{
+    if (NULL == message_allocator)
+        return new char[size];
+    return static_cast<char*>(message_allocator->allocate(size));
+}
+
+static void reclaim_message_buffer(char* message_buffer)
+{
+    if (NULL == message_allocator)
+        delete []message_buffer;
+    else
+        message_allocator->reclaim(message_buffer);
+}
+
 message_t* create_message()
 {
-    char* message_buffer = new char[sizeof(message_t)];
+    char* message_buffer = allocate_message_buffer(sizeof(message_t));
     return reinterpret_cast<message_t*>(message_buffer);
 }
 
@@ -38,7 +55,7 @@ message_t* create_stop_message()
 
 file_message_t* create_file_message(size_t file_size)
 {
-    char* message_buffer = new char[sizeof(message_t)+sizeof(file_message_t)];
+    char* message_buffer = allocate_message_buffer(sizeof(message_t)+sizeof(file_message_t));
     message_t* message = reinterpret_cast<message_t*>(message_buffer);
 
     message->type = DISPATCH_FILE;
@@ -49,7 +66,7 @@ file_message_t* create_file_message(size_t file_size)
 
 buffer_message_t* create_buffer_message(size_t data_length)
 {
-    char* message_buffer = new char[sizeof(message_t)+data_length];
+    char* message_buffer = allocate_message_buffer(sizeof(message_t)+data_length);
     message_t* message = reinterpret_cast<message_t*>(message_buffer);
 
     message->type = DISPATCH_BUFFER;
@@ -61,19 +78,19 @@ buffer_message_t* create_buffer_message(size_t data_length)
 void destroy_message(message_t* message)
 {
     char* message_buffer = reinterpret_cast<char*>(message);
-    delete []message_buffer;
+    reclaim_message_buffer(message_buffer);
 }
 
 void destroy_file_message(file_message_t* file_messsage)
 {
     char* message_buffer = reinterpret_cast<char*>(file_messsage)-sizeof(message_t);
-    delete []reinterpret_cast<char*>(message_buffer);
+    reclaim_message_buffer(message_buffer);
 }
 
 void destroy_buffer_message(buffer_message_t* buffer_messsage)
 {
     char* message_buffer = reinterpret_cast<char*>(buffer_messsage)-sizeof(message_t);
-    delete []reinterpret_cast<char*>(message_buffer);
+    reclaim_message_buffer(message_buffer);
 }
 
 DISPATCHER_NAMESPACE_END
@@ -25,7 +25,7 @@
 DISPATCHER_NAMESPACE_BEGIN
 
 class CSender;
-class CSendQueue: public net::CEpollableQueue<utils::CArrayQueue<message_t*> >
+class CSendQueue: public net::CEventfdQueue<utils::CArrayQueue<message_t*> >
 {
 public:
     CSendQueue(uint32_t queue_max, CSender* sender);
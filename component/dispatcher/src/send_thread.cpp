@@ -18,7 +18,10 @@
  */
 #include <sstream>
 #include <mooon/net/utils.h>
+#include <mooon/sys/cpu_affinity.h>
+#include <mooon/sys/futex.h>
 #include <mooon/sys/utils.h>
+#include <mooon/utils/string_utils.h>
 #include "send_thread.h"
 #include "dispatcher_context.h"
 #include "unmanaged_sender_table.h"
@@ -26,6 +29,7 @@ DISPATCHER_NAMESPACE_BEGIN
 
 CSendThread::CSendThread()
     :_current_time(0)    
+    ,_current_milliseconds(0)
     ,_last_connect_time(0)
     ,_context(NULL)
 {
@@ -59,6 +63,7 @@ void CSendThread::run()
     }
 
     int events_count = _epoller.timed_wait(2000);
+    _current_milliseconds = sys::get_monotonic_milliseconds();
     if (0 == events_count)
     {
         // 超时处理
@@ -160,6 +165,10 @@ void CSendThread::before_start() throw (utils::CException, sys::CSyscallExceptio
 {
     _timeout_manager.set_timeout_seconds(_context->get_timeout_seconds());
     _timeout_manager.set_timeout_handler(this);    
+    _tcp_info_sampler.set_name(std::string("dispatcher.") + utils::CStringUtils::int_tostring(get_index()));
+
+    // epoll事件数组只被本线程访问，从本线程绑定的CPU所在的NUMA结点分配
+    sys::CNumaPolicyHelper numa_policy_helper(sys::CCpuAffinity::get_cpu_numa_node(get_cpu_affinity()));
     _epoller.create(10000);
 }
 
@@ -20,6 +20,7 @@
 #define MOOON_DISPATCHER_SEND_THREAD_H
 #include <list>
 #include <mooon/net/epoller.h>
+#include <mooon/net/tcp_info_sampler.h>
 #include <mooon/sys/pool_thread.h>
 #include <mooon/utils/timeout_manager.h>
 #include "dispatcher_log.h"
@@ -40,6 +41,13 @@ public:
 
     net::CEpoller& get_epoller() const { return _epoller; }
     utils::CTimeoutManager<CSender>* get_timeout_manager() { return &_timeout_manager; }
+    net::CTcpInfoSampler* get_tcp_info_sampler() { return &_tcp_info_sampler; }
+
+    // 到了连接的采样时间时采样TCP_INFO，未开启采样时什么也不做
+    void sample_tcp_info(int fd, uint64_t* next_sample_milliseconds)
+    {
+        _tcp_info_sampler.sample(fd, next_sample_milliseconds, _current_milliseconds);
+    }
         
 private:
     virtual void run();  
@@ -63,6 +71,7 @@ private:
     
 private:
     time_t _current_time;
+    uint64_t _current_milliseconds; // 单调时钟，用于TCP_INFO采样
     time_t _last_connect_time;   // 上一次连接时间
     
 private:
@@ -86,6 +95,7 @@ private:
     CSenderQueue _unconnected_queue; // 待连接队列
     CDispatcherContext* _context;
     utils::CTimeoutManager<CSender> _timeout_manager;
+    net::CTcpInfoSampler _tcp_info_sampler;
 };
 
 DISPATCHER_NAMESPACE_END
@@ -32,6 +32,9 @@ CSender::CSender()
     ,_cur_resend_times(0)
     ,_current_offset(0)
     ,_current_message(NULL)
+    ,_batch_index(0)
+    ,_batch_number(0)
+    ,_next_tcp_info_milliseconds(0)
 {
     /***
       * 默认构造函数，不做实际用，仅为满足CListQueue的空闲头结点需求
@@ -53,6 +56,9 @@ CSender::CSender(const SenderInfo& sender_info)
     ,_cur_resend_times(0)
     ,_current_offset(0)
     ,_current_message(NULL)
+    ,_batch_index(0)
+    ,_batch_number(0)
+    ,_next_tcp_info_milliseconds(0)
 {   
     set_peer(sender_info.ip_node);
     memcpy(&_sender_info, &sender_info, sizeof(SenderInfo));    
@@ -113,7 +119,12 @@ void CSender::on_connect_failure()
 
 void CSender::clear_message()
 {
-    // 删除列队中的所有消息
+    // 删除已取出但还未发送的消息，以及列队中的所有消息
+    for (; _batch_index<_batch_number; ++_batch_index)
+        destroy_message(_batch_messages[_batch_index]);
+    _batch_index = 0;
+    _batch_number = 0;
+
     message_t* message;
     while (_send_queue.pop_front(message))
     {              
@@ -154,7 +165,7 @@ utils::handle_result_t CSender::do_handle_reply()
     ssize_t data_size = this->receive(buffer+buffer_offset, buffer_length-buffer_offset);
     if (0 == data_size) 
     {
-        DISPATCHER_LOG_WARN("%s closed by peer.\n", to_string().c_str());
+        DISPATCHER_LOG_WARN_RATELIMIT(10, 100, "%s closed by peer.\n", to_string().c_str());
         return utils::handle_error; // 连接被关闭
     }
 
@@ -179,11 +190,20 @@ utils::handle_result_t CSender::do_handle_reply()
 bool CSender::get_current_message()
 {
     if (_current_message != NULL) return _current_message;
-    bool retval = _send_queue.pop_front(_current_message);
-    if (retval)
-        _sender_info.reply_handler->before_send();
 
-    return retval;
+    // 取完上一批后，一次加锁从队列中取出一批
+    if (_batch_index == _batch_number)
+    {
+        _batch_index = 0;
+        _batch_number = SENDER_BATCH_NUMBER;
+        _send_queue.pop_front(_batch_messages, _batch_number);
+        if (0 == _batch_number)
+            return false;
+    }
+
+    _current_message = _batch_messages[_batch_index++];
+    _sender_info.reply_handler->before_send();
+    return true;
 }
 
 void CSender::free_current_message()
@@ -333,6 +353,7 @@ net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events,
                 }
                 
                 timeout_manager->push(this, get_send_thread()->get_current_time());
+                get_send_thread()->sample_tcp_info(get_fd(), &_next_tcp_info_milliseconds);
                 return net::epoll_none;                
             }
             else if (EPOLLOUT & events)
@@ -351,6 +372,7 @@ net::epoll_event_t CSender::handle_epoll_event(void* input_ptr, uint32_t events,
                 }
                 
                 timeout_manager->push(this, get_send_thread()->get_current_time());
+                get_send_thread()->sample_tcp_info(get_fd(), &_next_tcp_info_milliseconds);
                 return send_retval;
             }    
             else // Unknown events
@@ -25,6 +25,9 @@
 #include "send_queue.h"
 DISPATCHER_NAMESPACE_BEGIN
 
+// 一次从发送队列中最多取出的消息数
+#define SENDER_BATCH_NUMBER 32
+
 class CSendThread;
 class CSenderTable;
 class CSender: public ISender, public net::CTcpClient, public utils::CTimeoutable, public utils::CListable<CSender>
@@ -96,6 +99,10 @@ private:
     volatile int _cur_resend_times;    // 当前已经连续重发的次数
     volatile size_t _current_offset;      // 当前已经发送的字节数
     message_t* _current_message; // 当前正在发送的消息
+    uint32_t _batch_index;       // _batch_messages中下一条待发送消息的下标
+    uint32_t _batch_number;      // _batch_messages中的消息数
+    message_t* _batch_messages[SENDER_BATCH_NUMBER]; // 一次从队列中批量取出的消息，减少加锁和eventfd读写次数
+    uint64_t _next_tcp_info_milliseconds; // 下一次采样TCP_INFO的时间
 };
 
 DISPATCHER_NAMESPACE_END
@@ -0,0 +1,62 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: JianYi, eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_OBSERVER_LOCK_STATS_OBSERVABLE_H
+#define MOOON_OBSERVER_LOCK_STATS_OBSERVABLE_H
+#include <mooon/observer/observable.h>
+#include <mooon/sys/adaptive_lock.h>
+#include <inttypes.h>
+#include <map>
+OBSERVER_NAMESPACE_BEGIN
+
+/***
+  * 上报所有带名字的sys::CAdaptiveLock的竞争统计，同名的锁被累加，
+  * 只上报有新加锁的，每把锁一行，格式为：
+  * [时间][L]锁名,加锁次数,竞争次数,睡眠次数,等待总纳秒数
+  * 各值均为累计值。使用方法：
+  * observer::get()->register_observee(new observer::CLockStatsObservable);
+  */
+class CLockStatsObservable: public IObservable
+{
+public:
+    virtual void on_report(IDataReporter* data_reporter, const std::string& current_datetime)
+    {
+        std::vector<std::pair<std::string, sys::lock_stats_t> > all_stats;
+        sys::CAdaptiveLock::get_all_stats(&all_stats);
+
+        for (std::vector<std::pair<std::string, sys::lock_stats_t> >::size_type i=0; i<all_stats.size(); ++i)
+        {
+            const std::string& name = all_stats[i].first;
+            const sys::lock_stats_t& stats = all_stats[i].second;
+
+            uint64_t& last_acquire_number = _last_acquire_number[name];
+            if (stats.acquire_number == last_acquire_number)
+                continue;
+
+            last_acquire_number = stats.acquire_number;
+            data_reporter->reportf("[%s][L]%s,%" PRIu64",%" PRIu64",%" PRIu64",%" PRIu64"\n", current_datetime.c_str(), name.c_str()
+                , stats.acquire_number, stats.contended_number, stats.parked_number, stats.wait_nanoseconds);
+        }
+    }
+
+private:
+    std::map<std::string, uint64_t> _last_acquire_number; // 只在observer线程中访问
+};
+
+OBSERVER_NAMESPACE_END
+#endif // MOOON_OBSERVER_LOCK_STATS_OBSERVABLE_H
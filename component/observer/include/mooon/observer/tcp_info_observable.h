@@ -0,0 +1,84 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_OBSERVER_TCP_INFO_OBSERVABLE_H
+#define MOOON_OBSERVER_TCP_INFO_OBSERVABLE_H
+#include <mooon/observer/observable.h>
+#include <mooon/net/tcp_info_sampler.h>
+#include <inttypes.h>
+#include <map>
+#include <string.h>
+OBSERVER_NAMESPACE_BEGIN
+
+/***
+  * 上报所有带名字的net::CTcpInfoSampler在本上报周期内的采样，同名的被累加，
+  * 只上报有新采样的，每个采样器一行，格式为：
+  * [时间][T]名字,采样次数,失败次数,跳过次数,RTT,RTT偏差,重传段数,拥塞窗口,未确认字节数,发送队列字节数
+  * 其中每个指标为“平均值,P50,P99,最大值”四个值，P50、P99和最大值为直方图的桶上界（2的幂减1）。
+  * 使用方法：
+  * observer::get()->register_observee(new observer::CTcpInfoObservable);
+  */
+class CTcpInfoObservable: public IObservable
+{
+public:
+    virtual void on_report(IDataReporter* data_reporter, const std::string& current_datetime)
+    {
+        std::vector<std::pair<std::string, net::tcp_info_stats_t> > all_stats;
+        net::CTcpInfoSampler::get_all_stats(&all_stats);
+
+        for (std::vector<std::pair<std::string, net::tcp_info_stats_t> >::size_type i=0; i<all_stats.size(); ++i)
+        {
+            const std::string& name = all_stats[i].first;
+            const net::tcp_info_stats_t& stats = all_stats[i].second;
+
+            std::map<std::string, net::tcp_info_stats_t>::iterator iter = _last_stats.find(name);
+            if (iter == _last_stats.end())
+            {
+                net::tcp_info_stats_t zero_stats;
+                memset(&zero_stats, 0, sizeof(zero_stats));
+                iter = _last_stats.insert(std::make_pair(name, zero_stats)).first;
+            }
+
+            net::tcp_info_stats_t delta;
+            net::CTcpInfoSampler::subtract_stats(stats, iter->second, &delta);
+            iter->second = stats;
+            if ((0 == delta.sample_number) && (0 == delta.failure_number) && (0 == delta.skip_number))
+                continue;
+
+            std::string line = utils::CStringUtils::format_string("[%s][T]%s,%" PRIu64",%" PRIu64",%" PRIu64
+                , current_datetime.c_str(), name.c_str(), delta.sample_number, delta.failure_number, delta.skip_number);
+            for (int j=0; j<net::tcp_info_metric_number; ++j)
+            {
+                const net::tcp_info_histogram_t& histogram = delta.histograms[j];
+                line += utils::CStringUtils::format_string(",%" PRIu64",%u,%u,%u"
+                    , (0 == delta.sample_number)? 0: histogram.sum / delta.sample_number
+                    , net::CTcpInfoSampler::get_percentile(histogram, delta.sample_number, 50)
+                    , net::CTcpInfoSampler::get_percentile(histogram, delta.sample_number, 99)
+                    , histogram.max);
+            }
+
+            data_reporter->reportf("%s\n", line.c_str());
+        }
+    }
+
+private:
+    std::map<std::string, net::tcp_info_stats_t> _last_stats; // 上次上报时的累计值，只在observer线程中访问
+};
+
+OBSERVER_NAMESPACE_END
+#endif // MOOON_OBSERVER_TCP_INFO_OBSERVABLE_H
@@ -18,6 +18,7 @@
  */
 #ifndef MOOON_SERVER_CONFIG_H
 #define MOOON_SERVER_CONFIG_H
+#include <mooon/net/epoller.h>
 #include <mooon/net/ip_address.h>
 #include <mooon/sys/log.h>
 
@@ -48,21 +49,65 @@ public:
     /** 得到epoll大小 */
     virtual uint32_t get_epoll_size() const { return 10000; }
 
+    /***
+      * 工作线程的事件引擎，为net::poller_uring时使用io_uring（见net::CUringPoller），
+      * 事件的修改和等待合并为一次系统调用，内核不支持时仍使用Epoll
+      */
+    virtual net::poller_engine_t get_poller_engine() const { return net::poller_epoll; }
+
     /** 得到框架的工作线程个数 */
     virtual uint16_t get_thread_number() const { return 1; }
 
+    /***
+      * 工作线程的CPU亲和配置，为空表示不绑定，
+      * 可为"spread"（分散到各NUMA结点）、"compact"（先占满一个NUMA结点）或CPU列表（如"0-3,8"），
+      * 绑定后各线程的连接池和epoll事件数组从所在NUMA结点分配
+      */
+    virtual std::string get_cpu_affinity() const { return std::string(""); }
+
     /** 得到每个线程的连接池大小 */
     virtual uint32_t get_connection_pool_size() const { return 10000; }
 
     /** 连接超时秒数 */
     virtual uint32_t get_connection_timeout_seconds() const { return 10; }
 
+    /** 请求超时毫秒数，从收到请求的第一部分数据算起，收到后续数据不顺延，为0表示使用连接超时 */
+    virtual uint32_t get_request_timeout_milliseconds() const { return 0; }
+
+    /** 写超时毫秒数，发送响应时每次可写后重新计算，为0表示使用连接超时 */
+    virtual uint32_t get_write_timeout_milliseconds() const { return 0; }
+
     /** 得到epool等待超时毫秒数 */
     virtual uint32_t get_epoll_timeout_milliseconds() const { return 2000; }
 
     /** 得到监听参数 */
     virtual const net::ip_port_pair_array_t& get_listen_parameter() const = 0;
 
+    /***
+      * 是否每个工作线程独立监听（SO_REUSEPORT），由内核在各线程间分配新连接，
+      * 避免所有线程共享监听时的惊群和负载不均，为false时所有线程共享同一组监听
+      */
+    virtual bool is_reuse_port() const { return false; }
+
+    /***
+      * 独立监听时，是否为各线程的监听设置SO_INCOMING_CPU为线程绑定的CPU，
+      * 使连接由收到它的CPU上的线程处理，需同时配置CPU亲和，内核不支持时忽略
+      */
+    virtual bool is_incoming_cpu() const { return false; }
+
+    /** 每次监听事件最多接受的连接数，避免一个线程在连接风暴中长时间不处理已有连接 */
+    virtual uint32_t get_accept_batch_number() const { return 64; }
+
+    /***
+      * 同一连接两次TCP_INFO采样的最小间隔毫秒数，为0表示不采样，
+      * 采样在连接有事件时进行，结果按工作线程汇总成直方图（名为"server.线程顺序号"），
+      * 可通过observer::CTcpInfoObservable上报，见net::CTcpInfoSampler
+      */
+    virtual uint32_t get_tcp_info_interval_milliseconds() const { return 0; }
+
+    /** 每个工作线程每秒最多的TCP_INFO采样次数，连接数很多时用来限制采样的开销，为0表示不限制 */
+    virtual uint32_t get_tcp_info_samples_per_second() const { return 1000; }
+
     /** 得到每个线程的接管队列的大小 */
     virtual uint32_t get_takeover_queue_size() const { return 100; }
 };
@@ -69,7 +69,7 @@ public:
     }
 
     /***
-     * 包发送完后被回调
+     * 包发送完后被回调，对端流水线发送多个消息时，它们的响应一起发送完后只回调一次
      * @return util::handle_continue 表示不关闭连接继续使用，
      *         返回其它值则会关闭连接
      */
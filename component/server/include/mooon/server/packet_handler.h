@@ -19,6 +19,7 @@
 #ifndef MOOON_SERVER_PACKET_HANDLER_H
 #define MOOON_SERVER_PACKET_HANDLER_H
 #include <mooon/server/config.h>
+#include <mooon/server/response_chain.h>
 #include <sys/epoll.h>
 #include <sstream>
 SERVER_NAMESPACE_BEGIN
@@ -114,6 +115,13 @@ struct ResponseContext
   * 如果你的消息头和net::TCommonMessageHeader一致，
   * 则建议使用IMessageObserver，而不是IPacketHandler,
   * IMessageObserver相对于IPacketHandler是更高级别的接口
+  *
+  * 响应有两种方式：
+  * 1) 填写_response_context，on_handle_request返回handle_finish，一次一个请求一个响应；
+  * 2) 流水线：on_handle_request中解析出收到数据里所有完整的请求，
+  *    将各自的响应追加到_response_chain，不完整的部分留在请求Buffer中继续接收，
+  *    然后返回handle_continue，框架立即发送输出链，不必等下一轮epoll，
+  *    发完后回调on_response_chain_flushed；输出链未发完时暂停接收，以免积压
   */
 class CALLBACK_INTERFACE IPacketHandler
 {
@@ -177,6 +185,16 @@ public:
     {
     }
 
+    /***
+      * 是否有请求只收到了一部分，框架据此选择连接的超时类型：
+      * 为true时使用请求超时，否则使用空闲超时。
+      * 默认以request_offset是否大于0判断，每次都复位request_offset的处理器（如流水线）须重写
+      */
+    virtual bool is_request_in_progress() const
+    {
+        return _request_context.request_offset > 0;
+    }
+
     /***
       * 移动偏移
       * @offset: 本次发送的字节数
@@ -208,6 +226,18 @@ public:
         return utils::handle_continue;
     }
 
+    /***
+     * 输出链全部发送完后被回调，可能对应多个请求
+     * @param indicator.reset 默认值为false
+     *        indicator.thread_index 默认值为当前线程顺序号
+     *        indicator.epoll_events 默认值为EPOLLIN
+     * @return 同on_response_completed
+     */
+    virtual utils::handle_result_t on_response_chain_flushed(Indicator& indicator)
+    {
+        return utils::handle_continue;
+    }
+
 public:
     /***
       * 返回指向请求的上下文指针
@@ -225,9 +255,18 @@ public:
         return &_response_context;
     }
 
+    /***
+      * 返回指向输出链的指针
+      */
+    CResponseChain* get_response_chain()
+    {
+        return &_response_chain;
+    }
+
 protected:
     RequestContext _request_context;   /** 用来接收请求的上下文，子类应当修改它 */
     ResponseContext _response_context; /** 用来发送响应的上下文，子类应当修改它 */
+    CResponseChain _response_chain;    /** 流水线的输出链，子类往上追加响应 */
 };
 
 SERVER_NAMESPACE_END
@@ -0,0 +1,104 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SERVER_RESPONSE_CHAIN_H
+#define MOOON_SERVER_RESPONSE_CHAIN_H
+#include <mooon/server/config.h>
+#include <mooon/sys/syscall_exception.h>
+#include <deque>
+#include <sys/types.h>
+NET_NAMESPACE_BEGIN
+class CTcpWaiter;
+NET_NAMESPACE_END
+SERVER_NAMESPACE_BEGIN
+
+/***
+  * 连接的输出链，由多段Buffer和文件区间组成，按追加的顺序发送，
+  * 相邻的Buffer用writev合并发送，文件区间用sendfile发送。
+  * 用于流水线：一次收到的多个请求，各自的响应依次追加到链上，由框架一次发出
+  */
+class CResponseChain
+{
+public:
+    CResponseChain();
+    ~CResponseChain();
+
+    /***
+      * 追加数据，数据被复制，小块数据会被合并到同一段中
+      */
+    void append(const char* data, size_t size);
+    void append(const std::string& data) { append(data.data(), data.size()); }
+
+    /***
+      * 追加Buffer，不复制
+      * @own: 为true时，Buffer必须是new char[]出来的，发送完或连接关闭时由链delete []它；
+      *       为false时，调用者须保证在发送完之前Buffer有效
+      */
+    void append_buffer(char* buffer, size_t size, bool own);
+
+    /***
+      * 追加文件区间
+      * @own: 为true时，发送完或连接关闭时由链close文件
+      */
+    void append_file(int fd, off_t offset, size_t size, bool own);
+
+    /** 是否没有待发送的数据 */
+    bool empty() const { return _node_queue.empty(); }
+
+    /** 待发送的字节数 */
+    size_t size() const { return _size; }
+
+    /** 丢弃所有待发送的数据，并释放链拥有的Buffer和文件 */
+    void clear();
+
+    /***
+      * 发送，直到全部发完或Socket不可写，由框架调用
+      * @return 全部发完返回true，Socket不可写返回false
+      * @exception: 出错抛出CSyscallException，文件比追加时指定的短时错误码为EIO
+      */
+    bool flush(net::CTcpWaiter* waiter) throw (sys::CSyscallException);
+
+private:
+    struct Node
+    {
+        int fd;            // 文件句柄，为-1表示是Buffer
+        bool own;
+        char* buffer;
+        size_t capacity;   // 为0表示不能再往buffer追加数据
+        size_t size;       // Buffer时为数据的结束位置，文件时为余下待发送的字节数
+        size_t offset;     // Buffer时为已发送的位置
+        off_t file_offset; // 文件时为下一次发送的位置
+    };
+
+    void release(Node& node);
+    void pop_front();
+    bool flush_file(net::CTcpWaiter* waiter);
+    bool flush_buffers(net::CTcpWaiter* waiter);
+
+private:
+    CResponseChain(const CResponseChain&);
+    CResponseChain& operator =(const CResponseChain&);
+
+private:
+    std::deque<Node> _node_queue;
+    size_t _size;
+    uint32_t _file_number; // 链上的文件个数，有文件时发送前用TCP_CORK，避免文件前的响应头单独成包
+};
+
+SERVER_NAMESPACE_END
+#endif // MOOON_SERVER_RESPONSE_CHAIN_H
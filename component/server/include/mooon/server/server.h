@@ -23,6 +23,17 @@ SERVER_NAMESPACE_BEGIN
 
 typedef void* server_t;
 
+/***
+  * 工作线程接受连接的统计，均为累计值
+  */
+typedef struct
+{
+    uint64_t accept_number;       // 接受的连接数
+    uint64_t accept_batch_number; // 接受到连接的监听事件数，accept_number除以它为平均每批接受的连接数
+    uint64_t reject_number;       // 因连接池满等原因被关闭的连接数
+    uint64_t error_number;        // accept出错次数
+}accept_stats_t;
+
 /**
   * 日志器，所有实例共享同一个日志器
   * 如需要记录日志，则在调用create_server之前应当设置好日志器
@@ -44,5 +55,12 @@ extern void destroy(server_t server);
   */
 extern server_t create(server::IConfig* config, server::IFactory* factory);
 
+/***
+  * 得到指定工作线程接受连接的统计，可在任意线程中调用
+  * @thread_index: 工作线程顺序号，从0开始，小于IConfig::get_thread_number()
+  * @return 如果thread_index无效返回false，否则返回true
+  */
+extern bool get_accept_stats(server_t server, uint16_t thread_index, accept_stats_t* accept_stats);
+
 SERVER_NAMESPACE_END
 #endif // MOOON_SERVER_H
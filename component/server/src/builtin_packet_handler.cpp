@@ -20,11 +20,18 @@
 #include "log.h"
 SERVER_NAMESPACE_BEGIN
 
+// 接收Buffer的大小，小消息可一次收多个；消息体余下的部分比它大时，直接收到消息体中
+#define BUILTIN_RECV_BUFFER_SIZE 4096
+
 CBuiltinPacketHandler::CBuiltinPacketHandler(IConnection* connection, IMessageObserver* message_observer)
  :_connection(connection)
  ,_message_observer(message_observer)
+ ,_recv_buffer(NULL)
+ ,_request_body(NULL)
+ ,_request_body_offset(0)
  ,_recv_machine(this)
 {
+    // 第一次只收一个消息头，连接池中未使用的连接不分配接收Buffer
     _request_context.request_size = sizeof(_request_header);
     _request_context.request_buffer = reinterpret_cast<char*>(&_request_header);
 }
@@ -39,15 +46,14 @@ bool CBuiltinPacketHandler::on_header(const net::TCommonMessageHeader& header)
 {
     SERVER_LOG_TRACE("enter %s.\n", __FUNCTION__);
 
-    memcpy(&_request_header, &header, sizeof(_request_header));
+    // header可能就是_request_header本身，而memcpy的源和目的不能重叠
+    if (&header != &_request_header)
+        memcpy(reinterpret_cast<char*>(&_request_header), &header, sizeof(_request_header));
     uint32_t size = _request_header.size.to_int();
 
-    _request_context.request_size = size;
-    _request_context.request_offset = 0;
-    if (0 == size)
-        _request_context.request_buffer = NULL;
-    else
-        _request_context.request_buffer = new char[size];
+    _request_body_offset = 0;
+    if (size > 0)
+        _request_body = new char[size];
 
     return true;
 }
@@ -60,35 +66,40 @@ bool CBuiltinPacketHandler::on_message(
 {
     SERVER_LOG_TRACE("enter %s.\n", __FUNCTION__);
 
+    // 直接收到消息体中时，不需要复制
+    if ((buffer_size > 0) && (buffer != _request_body+finished_size))
+        memcpy(_request_body+finished_size, buffer, buffer_size);
+    _request_body_offset = finished_size + buffer_size;
+
     if (finished_size+buffer_size == header.size)
     {
-        // 完整包体
-        if (_response_context.response_buffer != NULL)
-        {
-            SERVER_LOG_ERROR("%s is not NULL.\n", _response_context.to_string().c_str());
-        }
-
-        // 防止on_message()抛异常
-        const char* request_buffer = _request_context.request_buffer;
-        _request_context.request_buffer = NULL;
+        // 完整包体，防止on_message()抛异常，先交出消息体
+        const char* request_body = _request_body;
+        char* response_buffer = NULL;
+        size_t response_size = 0;
 
+        _request_body = NULL;
+        _request_body_offset = 0;
         if (!_message_observer->on_message(header
-                                        , request_buffer
-                                        , &_response_context.response_buffer
-                                        , &_response_context.response_size))
+                                        , request_body
+                                        , &response_buffer
+                                        , &response_size))
         {
             SERVER_LOG_DEBUG("%s on_message ERROR.\n", _connection->str().c_str());
+            delete []response_buffer;
             return false;
         }
 
-        if ((0 == _response_context.response_size)
-         && (_response_context.response_buffer != NULL))
+        if (NULL == response_buffer)
         {
-            SERVER_LOG_WARN("%s.\n", _response_context.to_string().c_str());
+            if (response_size > 0)
+                SERVER_LOG_WARN("%s response buffer is NULL, size: %zu.\n", _connection->str().c_str(), response_size);
         }
         else
         {
-            SERVER_LOG_DEBUG("%s.\n", _response_context.to_string().c_str());
+            // 响应依次追加到输出链，由框架一次发出
+            SERVER_LOG_DEBUG("%s response size: %zu.\n", _connection->str().c_str(), response_size);
+            _response_chain.append_buffer(response_buffer, response_size, true);
         }
     }
 
@@ -98,12 +109,15 @@ bool CBuiltinPacketHandler::on_message(
 void CBuiltinPacketHandler::reset()
 {
     // 复位请求参数
-    char* request_buffer= reinterpret_cast<char*>(&_request_header);
-    if (_request_context.request_buffer != request_buffer)
-        delete []_request_context.request_buffer;
+    delete []_request_body;
+    _request_body = NULL;
+    _request_body_offset = 0;
+    delete []_recv_buffer;
+    _recv_buffer = NULL;
     _request_context.request_buffer = reinterpret_cast<char*>(&_request_header);
     _request_context.request_size = sizeof(_request_header);
     _request_context.request_offset = 0;
+    _recv_machine.reset();
 
     // 复位响应参数
     delete []_response_context.response_buffer;
@@ -116,16 +130,17 @@ utils::handle_result_t CBuiltinPacketHandler::on_handle_request(size_t data_size
 {
     SERVER_LOG_TRACE("enter %s.\n", __FUNCTION__);
 
-    // 注意：work会调用CBuiltinPacketHandler::on_message和CBuiltinPacketHandler::on_header
+    // 注意：work会调用CBuiltinPacketHandler::on_message和CBuiltinPacketHandler::on_header，
+    // 收到的数据可能包含多个消息，每个完整的消息的响应都追加到输出链
     utils::handle_result_t handle_result = _recv_machine.work(_request_context.request_buffer
                                                             +_request_context.request_offset
                                                             , data_size);
+    if (utils::handle_error == handle_result)
+        return utils::handle_error;
 
-    // 成功无响应，则返回utils::handle_continue
-    return ((utils::handle_finish == handle_result)
-         && (NULL == _response_context.response_buffer || 0 == _response_context.response_size))
-         ? handle_result = utils::handle_continue
-         : handle_result;
+    // 有响应时，框架在返回后立即发送输出链
+    prepare_request_context();
+    return utils::handle_continue;
 }
 
 void CBuiltinPacketHandler::on_connection_closed()
@@ -150,4 +165,37 @@ utils::handle_result_t CBuiltinPacketHandler::on_response_completed(Indicator& i
     return utils::handle_close;
 }
 
+utils::handle_result_t CBuiltinPacketHandler::on_response_chain_flushed(Indicator& indicator)
+{
+    return on_response_completed(indicator);
+}
+
+bool CBuiltinPacketHandler::is_request_in_progress() const
+{
+    // 小消息每次都从接收Buffer的头开始收，request_offset通常为0，以状态机是否在消息的边界上判断
+    return !_recv_machine.is_idle();
+}
+
+void CBuiltinPacketHandler::prepare_request_context()
+{
+    uint32_t body_size = _request_header.size.to_int();
+
+    if ((_request_body != NULL) && (body_size - _request_body_offset > BUILTIN_RECV_BUFFER_SIZE))
+    {
+        // 大消息体余下的部分直接收到消息体中
+        _request_context.request_buffer = _request_body;
+        _request_context.request_size = body_size;
+        _request_context.request_offset = _request_body_offset;
+    }
+    else
+    {
+        if (NULL == _recv_buffer)
+            _recv_buffer = new char[BUILTIN_RECV_BUFFER_SIZE];
+
+        _request_context.request_buffer = _recv_buffer;
+        _request_context.request_size = BUILTIN_RECV_BUFFER_SIZE;
+        _request_context.request_offset = 0;
+    }
+}
+
 SERVER_NAMESPACE_END
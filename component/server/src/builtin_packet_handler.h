@@ -27,7 +27,8 @@ SERVER_NAMESPACE_BEGIN
 
 /***
   * 内置的包处理器，提供基于net::TCommonMessageHeader
-  * 格式的通用解决方案，以提升server组件的易用性
+  * 格式的通用解决方案，以提升server组件的易用性。
+  * 支持流水线：一次收到的多个消息依次交给IMessageObserver，响应追加到输出链
   */
 class CBuiltinPacketHandler: public IPacketHandler
 {
@@ -48,10 +49,18 @@ private:
     virtual void on_connection_closed();
     virtual bool on_connection_timeout();
     virtual utils::handle_result_t on_response_completed(Indicator& indicator);
+    virtual utils::handle_result_t on_response_chain_flushed(Indicator& indicator);
+    virtual bool is_request_in_progress() const;
+
+private:
+    void prepare_request_context();
 
 private:
     IConnection* _connection;
     IMessageObserver* _message_observer;
+    char* _recv_buffer;                   // 可容纳多个小消息，第一次收数据时才分配
+    char* _request_body;                  // 正在接收的消息体
+    size_t _request_body_offset;          // 消息体已接收的字节数
     net::TCommonMessageHeader _request_header;
     net::CRecvMachine<net::TCommonMessageHeader, CBuiltinPacketHandler> _recv_machine;
 };
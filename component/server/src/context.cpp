@@ -44,6 +44,17 @@ void* create(IConfig* config, IFactory* factory)
     return context;
 }
 
+bool get_accept_stats(server_t server, uint16_t thread_index, accept_stats_t* accept_stats)
+{
+    const CContext* context = static_cast<const CContext*>(server);
+    const CWorkThread* thread = context->get_thread(thread_index);
+    if (NULL == thread)
+        return false;
+
+    thread->get_accept_stats(accept_stats);
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // CServerContext
 
@@ -126,6 +137,13 @@ bool CContext::create_listen_manager()
         SERVER_LOG_ERROR("Listen parameters are not specified.\n");
         return false;
     }
+
+    // 每个工作线程独立监听，在create_thread_pool中创建
+    if (_config->is_reuse_port())
+    {
+        SERVER_LOG_INFO("Listeners will be created by each thread with SO_REUSEPORT.\n");
+        return true;
+    }
 		
     for (net::ip_port_pair_array_t::size_type i=0; i<listen_parameter.size(); ++i)
     {
@@ -151,7 +169,7 @@ bool CContext::create_thread_pool(net::CListenManager<CListener>* listen_manager
     }
 
 	// 创建线程池
-	_thread_pool.create(_config->get_thread_number(), this);	
+	_thread_pool.create(_config->get_thread_number(), this, _config->get_cpu_affinity());	
 
 	uint16_t thread_count = _thread_pool.get_thread_count();
 	CWorkThread** thread_array = _thread_pool.get_thread_array();
@@ -159,6 +177,12 @@ bool CContext::create_thread_pool(net::CListenManager<CListener>* listen_manager
 	// 设置线程运行时参数
 	for (uint16_t i=0; i<thread_count; ++i)
 	{
+	    if (_config->is_reuse_port())
+	    {
+	        thread_array[i]->create_listener_array(_config->get_listen_parameter(), _config->is_incoming_cpu());
+	        continue;
+	    }
+
 		uint16_t listen_count = listen_manager->get_listener_count();
 		CListener* listener_array = listen_manager->get_listener_array();
 		
@@ -23,28 +23,47 @@
 SERVER_NAMESPACE_BEGIN
 
 net::epoll_event_t CListener::handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
-{           
-    try
+{
+    CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
+    uint32_t accept_batch_number = thread->get_accept_batch_number();
+    uint32_t accepted_number = 0;
+
+    // 一直接受到没有待接受的连接，但每次最多尝试accept_batch_number次（包括出错的），
+    // 剩下的在下次epoll时再接受（监听者为水平触发）
+    for (uint32_t i=0; i<accept_batch_number; ++i)
     {
-        net::port_t peer_port;
-        net::ip_address_t peer_ip;
-        
-        int newfd = accept(peer_ip, peer_port);
-        if (newfd != -1)
+        try
         {
-            CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
+            net::port_t peer_port;
+            net::ip_address_t peer_ip;
+
+            // 直接得到非阻塞的连接，省去之后设置的系统调用
+            int newfd = accept(peer_ip, peer_port, SOCK_NONBLOCK|SOCK_CLOEXEC);
+            if (-1 == newfd)
+                break;
+
+            ++accepted_number;
             if (!thread->add_waiter(newfd, peer_ip, peer_port, get_listen_ip(), get_listen_port()))
             {
+                thread->on_accept_rejected();
                 net::close_fd(newfd);
             }
         }
+        catch (sys::CSyscallException& ex)
+        {
+            // 对于某些server，这类信息巨大，如webserver
+            thread->on_accept_error();
+            SERVER_LOG_ERROR("Accept error: %s.\n", ex.str().c_str());
+
+            // 描述符或内存耗尽时，再接受也只会失败，等下次epoll；
+            // 其它错误（如ECONNABORTED、EPROTO和EPERM）只和出错的那个连接有关，继续接受后面的
+            int errcode = ex.errcode();
+            if ((EMFILE == errcode) || (ENFILE == errcode) || (ENOBUFS == errcode) || (ENOMEM == errcode))
+                break;
+        }
     }
-    catch (sys::CSyscallException& ex)
-    {
-		// 对于某些server，这类信息巨大，如webserver
-        SERVER_LOG_ERROR("Accept error: %s.\n", ex.str().c_str());
-    }
-    
+
+    thread->on_accepted(accepted_number);
     return net::epoll_none;
 }
 
@@ -0,0 +1,240 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <mooon/net/tcp_waiter.h>
+#include <mooon/net/utils.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "mooon/server/response_chain.h"
+SERVER_NAMESPACE_BEGIN
+
+// 复制追加时每段的最小容量，多个小响应合并到一段，减少writev的段数
+#define RESPONSE_CHAIN_COPY_SIZE 4096
+
+// 一次writev最多的段数
+#define RESPONSE_CHAIN_IOV_NUMBER 64
+
+CResponseChain::CResponseChain()
+    :_size(0)
+    ,_file_number(0)
+{
+}
+
+CResponseChain::~CResponseChain()
+{
+    clear();
+}
+
+void CResponseChain::append(const char* data, size_t size)
+{
+    if (0 == size)
+        return;
+
+    if (!_node_queue.empty())
+    {
+        // 只合并到链自己复制出来的段，append_buffer和append_file的段capacity为0，不能写入
+        Node& back = _node_queue.back();
+        if ((back.capacity > 0)
+         && (-1 == back.fd)
+         && (back.size <= back.capacity)
+         && (back.capacity - back.size >= size))
+        {
+            memcpy(back.buffer + back.size, data, size);
+            back.size += size;
+            _size += size;
+            return;
+        }
+    }
+
+    Node node;
+    node.fd = -1;
+    node.own = true;
+    node.capacity = (size > RESPONSE_CHAIN_COPY_SIZE)? size: RESPONSE_CHAIN_COPY_SIZE;
+    node.buffer = new char[node.capacity];
+    node.size = size;
+    node.offset = 0;
+    node.file_offset = 0;
+    memcpy(node.buffer, data, size);
+
+    _node_queue.push_back(node);
+    _size += size;
+}
+
+void CResponseChain::append_buffer(char* buffer, size_t size, bool own)
+{
+    if (0 == size)
+    {
+        if (own)
+            delete []buffer;
+        return;
+    }
+
+    Node node;
+    node.fd = -1;
+    node.own = own;
+    node.buffer = buffer;
+    node.capacity = 0;
+    node.size = size;
+    node.offset = 0;
+    node.file_offset = 0;
+
+    _node_queue.push_back(node);
+    _size += size;
+}
+
+void CResponseChain::append_file(int fd, off_t offset, size_t size, bool own)
+{
+    if (0 == size)
+    {
+        if (own)
+            ::close(fd);
+        return;
+    }
+
+    Node node;
+    node.fd = fd;
+    node.own = own;
+    node.buffer = NULL;
+    node.capacity = 0;
+    node.size = size;
+    node.offset = 0;
+    node.file_offset = offset;
+
+    _node_queue.push_back(node);
+    _size += size;
+    ++_file_number;
+}
+
+void CResponseChain::clear()
+{
+    while (!_node_queue.empty())
+        pop_front();
+    _size = 0;
+}
+
+bool CResponseChain::flush(net::CTcpWaiter* waiter) throw (sys::CSyscallException)
+{
+    bool corked = _file_number > 0;
+    if (corked)
+        net::set_tcp_option(waiter->get_fd(), true, TCP_CORK);
+
+    try
+    {
+        bool finished = true;
+        while (!_node_queue.empty())
+        {
+            finished = (_node_queue.front().fd != -1)? flush_file(waiter): flush_buffers(waiter);
+            if (!finished)
+                break;
+        }
+
+        if (corked)
+            net::set_tcp_option(waiter->get_fd(), false, TCP_CORK);
+        return finished;
+    }
+    catch (...)
+    {
+        if (corked)
+            net::set_tcp_option(waiter->get_fd(), false, TCP_CORK);
+        throw;
+    }
+}
+
+void CResponseChain::release(Node& node)
+{
+    if (node.own)
+    {
+        if (node.fd != -1)
+            ::close(node.fd);
+        else
+            delete []node.buffer;
+    }
+}
+
+void CResponseChain::pop_front()
+{
+    Node& front = _node_queue.front();
+    if (front.fd != -1)
+        --_file_number;
+
+    release(front);
+    _node_queue.pop_front();
+}
+
+bool CResponseChain::flush_file(net::CTcpWaiter* waiter)
+{
+    Node& front = _node_queue.front();
+    ssize_t retval = waiter->send_file(front.fd, &front.file_offset, front.size);
+    if (-1 == retval)
+        return false;
+    if (0 == retval)
+        THROW_SYSCALL_EXCEPTION("file is shorter than appended", EIO, "sendfile");
+
+    front.size -= (size_t)retval;
+    _size -= (size_t)retval;
+    if (front.size > 0)
+        return false;
+
+    pop_front();
+    return true;
+}
+
+bool CResponseChain::flush_buffers(net::CTcpWaiter* waiter)
+{
+    // 收集从头开始连续的Buffer
+    int iovcnt = 0;
+    size_t total = 0;
+    struct iovec iov[RESPONSE_CHAIN_IOV_NUMBER];
+    for (std::deque<Node>::iterator iter=_node_queue.begin(); iter!=_node_queue.end(); ++iter)
+    {
+        if ((iter->fd != -1) || (RESPONSE_CHAIN_IOV_NUMBER == iovcnt))
+            break;
+
+        iov[iovcnt].iov_base = iter->buffer + iter->offset;
+        iov[iovcnt].iov_len = iter->size - iter->offset;
+        total += iov[iovcnt].iov_len;
+        ++iovcnt;
+    }
+
+    ssize_t retval = (1 == iovcnt)
+                   ? waiter->send(static_cast<char*>(iov[0].iov_base), iov[0].iov_len)
+                   : waiter->writev(iov, iovcnt);
+    if (-1 == retval)
+        return false;
+
+    // 移除已发完的段，最后一段可能只发了一部分
+    size_t sent = (size_t)retval;
+    _size -= sent;
+    while (sent > 0)
+    {
+        Node& front = _node_queue.front();
+        size_t remaining = front.size - front.offset;
+        if (sent < remaining)
+        {
+            front.offset += sent;
+            break;
+        }
+
+        sent -= remaining;
+        pop_front();
+    }
+
+    return (size_t)retval == total;
+}
+
+SERVER_NAMESPACE_END
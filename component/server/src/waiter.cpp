@@ -26,8 +26,11 @@ SERVER_NAMESPACE_BEGIN
 
 CWaiter::CWaiter()
     :_is_sending(false)
+    ,_is_flushing(false)
     ,_is_in_pool(false) // 只能初始化为false
     ,_thread_index(0)
+    ,_timeout_type(timeout_idle)
+    ,_next_tcp_info_milliseconds(0)
     ,_packet_handler(NULL)
 {
 }
@@ -41,6 +44,9 @@ CWaiter::~CWaiter()
 void CWaiter::reset()
 {
     _is_sending = false;
+    _is_flushing = false;
+    _next_tcp_info_milliseconds = 0;
+    _packet_handler->get_response_chain()->clear();
     _packet_handler->reset();
 }
 
@@ -63,7 +69,6 @@ net::epoll_event_t CWaiter::handle_epoll_event(void* input_ptr, uint32_t events,
 {
     net::epoll_event_t retval = net::epoll_close;
     CWorkThread* thread = static_cast<CWorkThread *>(input_ptr);
-    thread->update_waiter(this); // 更新时间戳，防止超时
     
     try
     {   
@@ -102,6 +107,19 @@ net::epoll_event_t CWaiter::handle_epoll_event(void* input_ptr, uint32_t events,
         return net::epoll_close;
     }
 
+    // 仍由本线程管理的，根据接下来等待的是什么重新定时，防止超时
+    if ((retval < net::epoll_close) || (net::epoll_release == retval))
+    {
+        timeout_type_t timeout_type = timeout_idle;
+        if (_is_sending || _is_flushing || (net::epoll_write == retval))
+            timeout_type = timeout_write;
+        else if (_packet_handler->is_request_in_progress())
+            timeout_type = timeout_request;
+
+        thread->update_waiter(this, timeout_type);
+        thread->sample_tcp_info(get_fd(), &_next_tcp_info_milliseconds);
+    }
+
     return retval;
 }
 
@@ -111,12 +129,24 @@ net::epoll_event_t CWaiter::do_handle_epoll_send(void* input_ptr, void* ouput_pt
     size_t offset;
     ssize_t retval;
 
+    // 流水线的输出链
+    if (_is_flushing)
+    {
+        return do_flush_response_chain(ouput_ptr);
+    }
+
     if (!_is_sending)
     {
         _is_sending = true;
         _packet_handler->before_response();
     }
 
+    // 先发送输出链中的，再发送响应上下文中的
+    if (!_packet_handler->get_response_chain()->flush(this))
+    {
+        return net::epoll_write;
+    }
+
     const ResponseContext* response_context = _packet_handler->get_response_context();
     size = response_context->response_size;
     offset = response_context->response_offset;
@@ -309,6 +339,13 @@ net::epoll_event_t CWaiter::do_handle_epoll_read(void* input_ptr, void* ouput_pt
     }
     else if (utils::handle_continue == handle_result)
     {        
+        // 流水线：有响应时立即发送，不必等到下一轮epoll
+        if (!_packet_handler->get_response_chain()->empty())
+        {
+            _is_flushing = true;
+            return do_flush_response_chain(ouput_ptr);
+        }
+
         //SERVER_LOG_DEBUG("%s continue to receive ...\n", to_string().c_str());
         return net::epoll_none; // 也可以返回net::epoll_read
     }
@@ -319,6 +356,46 @@ net::epoll_event_t CWaiter::do_handle_epoll_read(void* input_ptr, void* ouput_pt
     }    
 }
 
+net::epoll_event_t CWaiter::do_flush_response_chain(void* ouput_ptr)
+{
+    if (!_packet_handler->get_response_chain()->flush(this))
+    {
+        // 发不完时只等可写，暂停接收，以免对端只发不收时输出链无限增长
+        return net::epoll_write;
+    }
+
+    Indicator indicator;
+    indicator.reset = false;
+    indicator.thread_index = get_thread_index();
+    indicator.epoll_events = EPOLLIN;
+
+    _is_flushing = false; // 再次进入接收状态
+    utils::handle_result_t handle_result = _packet_handler->on_response_chain_flushed(indicator);
+    if (indicator.reset)
+    {
+        reset();
+    }
+
+    HandOverParam* handover_param = static_cast<HandOverParam*>(ouput_ptr);
+    if (utils::handle_release == handle_result)
+    {
+        SERVER_LOG_DEBUG("%s will be released.\n", str().c_str());
+        handover_param->thread_index = indicator.thread_index;
+        handover_param->epoll_events = indicator.epoll_events;
+        return net::epoll_release;
+    }
+    if (utils::handle_continue == handle_result)
+    {
+        handover_param->epoll_events = indicator.epoll_events;
+        return net::epoll_none;
+    }
+    else
+    {
+        SERVER_LOG_DEBUG("Return %d, %s will be closed.\n", handle_result, str().c_str());
+        return net::epoll_close;
+    }
+}
+
 net::epoll_event_t CWaiter::do_handle_epoll_error(void* input_ptr, void* ouput_ptr)
 {
     SERVER_LOG_DEBUG("%s: %s.\n", to_string().c_str(), (char*)input_ptr);
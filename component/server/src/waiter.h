@@ -21,14 +21,22 @@
 #include <mooon/sys/log.h>
 #include <mooon/utils/listable.h>
 #include <mooon/net/tcp_waiter.h>
-#include <mooon/utils/timeoutable.h>
+#include <mooon/utils/timing_wheel.h>
 #include "log.h"
 #include "mooon/server/connection.h"
 #include "mooon/server/packet_handler.h"
 SERVER_NAMESPACE_BEGIN
 
+/** 连接当前在等待什么，不同的等待使用不同的超时 */
+typedef enum
+{
+    timeout_idle    = 0, /** 等待新请求，使用连接超时 */
+    timeout_request = 1, /** 已收到部分请求，等待余下部分 */
+    timeout_write   = 2  /** 等待发送响应 */
+}timeout_type_t;
+
 class CWaiter: public net::CTcpWaiter
-             , public utils::CTimeoutable
+             , public utils::CTimingWheelNode<CWaiter>
              , public utils::CListable<CWaiter>
              , public IConnection
 {
@@ -42,6 +50,8 @@ public:
     bool on_timeout();
     void on_switch_failure(bool overflow);
     void set_thread_index(uint16_t index) { _thread_index = index; }    
+    timeout_type_t get_timeout_type() const { return _timeout_type; }
+    void set_timeout_type(timeout_type_t timeout_type) { _timeout_type = timeout_type; }
 
 private: // 只有CWaiterPool会调用
     bool is_in_pool() const { return _is_in_pool; }
@@ -64,11 +74,15 @@ private:
     net::epoll_event_t do_handle_epoll_send(void* input_ptr, void* ouput_ptr);
     net::epoll_event_t do_handle_epoll_read(void* input_ptr, void* ouput_ptr);
     net::epoll_event_t do_handle_epoll_error(void* input_ptr, void* ouput_ptr);
+    net::epoll_event_t do_flush_response_chain(void* ouput_ptr);
 
 private:        
     bool _is_sending; // 是否处于正发送数据状态中
+    bool _is_flushing; // 是否处于发送输出链状态中，此时暂停接收
     bool _is_in_pool; // 是否在连接池中
     uint16_t _thread_index;
+    timeout_type_t _timeout_type;
+    uint64_t _next_tcp_info_milliseconds; // 下一次采样TCP_INFO的时间
     IPacketHandler* _packet_handler;
     mutable std::string _string_id;
 };
@@ -18,19 +18,28 @@
  */
 #include <sstream>
 #include <mooon/net/utils.h>
+#include <mooon/sys/cpu_affinity.h>
+#include <mooon/sys/futex.h>
 #include <mooon/sys/utils.h>
+#include <mooon/utils/string_utils.h>
 #include "context.h"
 #include "work_thread.h"
 SERVER_NAMESPACE_BEGIN
 
 CWorkThread::CWorkThread()
-    :_waiter_pool(NULL)
+    :_connection_timeout_milliseconds(0)
+    ,_request_timeout_milliseconds(0)
+    ,_write_timeout_milliseconds(0)
+    ,_waiter_pool(NULL)
     ,_context(NULL)
     ,_follower(NULL)
+    ,_accept_batch_number(1)
     ,_takeover_waiter_queue(NULL)
 {
+    memset(&_accept_stats, 0, sizeof(_accept_stats));
     _current_time = time(NULL);
-    _timeout_manager.set_timeout_handler(this);  
+    _current_milliseconds = sys::get_monotonic_milliseconds();
+    _timing_wheel.set_timeout_handler(this);  
 
     init_epoll_event_proc();     
 }
@@ -38,6 +47,7 @@ CWorkThread::CWorkThread()
 CWorkThread::~CWorkThread()
 {
     _epoller.destroy();
+    _listen_manager.destroy();
     delete _follower;
     delete _takeover_waiter_queue;
 }
@@ -45,8 +55,9 @@ CWorkThread::~CWorkThread()
 void CWorkThread::run()
 {
     int retval; // _epoller.timed_wait的返回值
+    uint32_t epoll_timeout_milliseconds; // 不超过最近一个连接超时的时刻
 
-    _timeout_manager.check_timeout(_current_time);
+    _timing_wheel.check_timeout(_current_milliseconds);
     check_pending_queue();
         
     // epoll前回调
@@ -57,7 +68,8 @@ void CWorkThread::run()
     try
     {                
         // EPOLL检测
-        retval = _epoller.timed_wait(_context->get_config()->get_epoll_timeout_milliseconds());        
+        epoll_timeout_milliseconds = _timing_wheel.get_wait_milliseconds(_current_milliseconds, _context->get_config()->get_epoll_timeout_milliseconds());
+        retval = _epoller.timed_wait(epoll_timeout_milliseconds);        
     }
     catch (sys::CSyscallException& ex)
     {
@@ -69,6 +81,7 @@ void CWorkThread::run()
     {        
         // 得到当前时间
         _current_time = time(NULL);
+        _current_milliseconds = sys::get_monotonic_milliseconds();
 
         if (0 == retval) // timeout
         {
@@ -136,9 +149,20 @@ void CWorkThread::before_start() throw (utils::CException, sys::CSyscallExceptio
 
         _follower = factory->create_thread_follower(get_index());
         _takeover_waiter_queue = new utils::CArrayQueue<PendingInfo*>(config->get_takeover_queue_size());
-        _timeout_manager.set_timeout_seconds(config->get_connection_timeout_seconds());       
-        
-        _epoller.create(config->get_epoll_size());        
+        _connection_timeout_milliseconds = config->get_connection_timeout_seconds() * 1000;
+        _request_timeout_milliseconds = config->get_request_timeout_milliseconds();
+        _write_timeout_milliseconds = config->get_write_timeout_milliseconds();
+        _accept_batch_number = config->get_accept_batch_number();
+        if (0 == _accept_batch_number)
+            _accept_batch_number = 1;
+        _tcp_info_sampler.set_name(std::string("server.") + utils::CStringUtils::int_tostring(get_index()));
+        _tcp_info_sampler.set_sampling(config->get_tcp_info_interval_milliseconds(), config->get_tcp_info_samples_per_second());
+
+        // 连接池和epoll事件数组只被本线程访问，从本线程绑定的CPU所在的NUMA结点分配
+        sys::CNumaPolicyHelper numa_policy_helper(sys::CCpuAffinity::get_cpu_numa_node(get_cpu_affinity()));
+        _epoller.create(config->get_epoll_size(), config->get_poller_engine());
+        if (_epoller.get_engine() != config->get_poller_engine())
+            SERVER_LOG_WARN("Thread[%u] uses epoll because io_uring is not supported.\n", get_index());
         
         uint32_t thread_connection_pool_size = config->get_connection_pool_size();
         
@@ -175,7 +199,7 @@ void CWorkThread::on_timeout_event(CWaiter* waiter)
 
     if (!waiter->on_timeout())
     {
-        _timeout_manager.update(waiter, _current_time);
+        update_waiter(waiter, timeout_idle);
     }
     else
     {
@@ -231,7 +255,7 @@ bool CWorkThread::watch_waiter(CWaiter* waiter, uint32_t epoll_events)
     try
     {               
         _epoller.set_events(waiter, epoll_events);
-        _timeout_manager.push(waiter, _current_time);
+        update_waiter(waiter, timeout_idle);
 
         return true;
     }
@@ -279,7 +303,7 @@ void CWorkThread::remove_waiter(CWaiter* waiter)
     try
     {
         _epoller.del_events(waiter);        
-        _timeout_manager.remove(waiter);        
+        _timing_wheel.remove(waiter);        
     }
     catch (sys::CSyscallException& ex)
     {
@@ -287,10 +311,28 @@ void CWorkThread::remove_waiter(CWaiter* waiter)
     }    
 }
 
-void CWorkThread::update_waiter(CWaiter* waiter)
+void CWorkThread::update_waiter(CWaiter* waiter, timeout_type_t timeout_type)
 {
-    _timeout_manager.remove(waiter);
-    _timeout_manager.push(waiter, _current_time);
+    uint32_t timeout_milliseconds = _connection_timeout_milliseconds;
+
+    if ((timeout_write == timeout_type) && (_write_timeout_milliseconds > 0))
+    {
+        timeout_milliseconds = _write_timeout_milliseconds;
+    }
+    else if ((timeout_request == timeout_type) && (_request_timeout_milliseconds > 0))
+    {
+        // 同一个请求收到后续数据时不顺延
+        if ((timeout_request == waiter->get_timeout_type()) && waiter->is_timer_pending())
+            return;
+        timeout_milliseconds = _request_timeout_milliseconds;
+    }
+    else
+    {
+        timeout_type = timeout_idle;
+    }
+
+    waiter->set_timeout_type(timeout_type);
+    _timing_wheel.update(waiter, _current_milliseconds, timeout_milliseconds);
 }
 
 bool CWorkThread::add_waiter(int fd, const net::ip_address_t& peer_ip, net::port_t peer_port
@@ -303,8 +345,7 @@ bool CWorkThread::add_waiter(int fd, const net::ip_address_t& peer_ip, net::port
         return false;
     }    
         
-    waiter->attach(fd, peer_ip, peer_port);
-    waiter->set_nonblock(true); // 设置为非阻塞
+    waiter->attach(fd, peer_ip, peer_port); // fd已由accept4设置为非阻塞
     waiter->set_self(self_ip, self_port);
     return watch_waiter(waiter, EPOLLIN);    
 }
@@ -315,6 +356,64 @@ void CWorkThread::add_listener_array(CListener* listener_array, uint16_t listen_
          _epoller.set_events(&listener_array[i], EPOLLIN, true);    
 }
 
+void CWorkThread::create_listener_array(const net::ip_port_pair_array_t& listen_parameter, bool incoming_cpu)
+{
+    for (net::ip_port_pair_array_t::size_type i=0; i<listen_parameter.size(); ++i)
+        _listen_manager.add(listen_parameter[i].first, listen_parameter[i].second);
+    _listen_manager.create(true, true);
+
+    uint16_t listen_count = _listen_manager.get_listener_count();
+    CListener* listener_array = _listen_manager.get_listener_array();
+    int cpu = get_cpu_affinity();
+
+    if (incoming_cpu && (cpu != -1))
+    {
+        for (uint16_t i=0; i<listen_count; ++i)
+        {
+            try
+            {
+                listener_array[i].set_incoming_cpu(cpu);
+            }
+            catch (sys::CSyscallException& ex)
+            {
+                // 只是优化，不支持时仍可正常工作
+                SERVER_LOG_WARN("Set incoming cpu %d for %s:%d error: %s.\n"
+                               , cpu, listener_array[i].get_listen_ip().to_string().c_str(), listener_array[i].get_listen_port(), ex.str().c_str());
+                break;
+            }
+        }
+    }
+
+    add_listener_array(listener_array, listen_count);
+}
+
+void CWorkThread::on_accepted(uint32_t accepted_number)
+{
+    if (accepted_number > 0)
+    {
+        __sync_add_and_fetch(&_accept_stats.accept_number, accepted_number);
+        __sync_add_and_fetch(&_accept_stats.accept_batch_number, 1);
+    }
+}
+
+void CWorkThread::on_accept_rejected()
+{
+    __sync_add_and_fetch(&_accept_stats.reject_number, 1);
+}
+
+void CWorkThread::on_accept_error()
+{
+    __sync_add_and_fetch(&_accept_stats.error_number, 1);
+}
+
+void CWorkThread::get_accept_stats(accept_stats_t* accept_stats) const
+{
+    accept_stats->accept_number = __atomic_load_n(&_accept_stats.accept_number, __ATOMIC_RELAXED);
+    accept_stats->accept_batch_number = __atomic_load_n(&_accept_stats.accept_batch_number, __ATOMIC_RELAXED);
+    accept_stats->reject_number = __atomic_load_n(&_accept_stats.reject_number, __ATOMIC_RELAXED);
+    accept_stats->error_number = __atomic_load_n(&_accept_stats.error_number, __ATOMIC_RELAXED);
+}
+
 void CWorkThread::init_epoll_event_proc()
 {
     using namespace net;
@@ -19,11 +19,14 @@
 #ifndef MOOON_SERVER_THREAD_H
 #define MOOON_SERVER_THREAD_H
 #include <mooon/net/epoller.h>
+#include <mooon/net/listen_manager.h>
+#include <mooon/net/tcp_info_sampler.h>
 #include <mooon/sys/pool_thread.h>
-#include <mooon/utils/timeout_manager.h>
+#include <mooon/utils/timing_wheel.h>
 #include "log.h"
 #include "listener.h"
 #include "waiter_pool.h"
+#include "mooon/server/server.h"
 SERVER_NAMESPACE_BEGIN
 
 // CWaiter切换线程参数
@@ -49,12 +52,29 @@ public:
 
     void del_waiter(CWaiter* waiter);       
     void remove_waiter(CWaiter* waiter);       
-    void update_waiter(CWaiter* waiter);  
+    void update_waiter(CWaiter* waiter, timeout_type_t timeout_type);  
     bool add_waiter(int fd, const net::ip_address_t& peer_ip, net::port_t peer_port
                           , const net::ip_address_t& self_ip, net::port_t self_port);   
       
     void add_listener_array(CListener* listener_array, uint16_t listen_count);    
     bool takeover_waiter(CWaiter* waiter, uint32_t epoll_event);
+
+    // 创建本线程独占的监听（SO_REUSEPORT），并加入到本线程的epoll中，
+    // incoming_cpu为true且线程绑定了CPU时，设置SO_INCOMING_CPU
+    void create_listener_array(const net::ip_port_pair_array_t& listen_parameter, bool incoming_cpu);
+
+    // 接受连接的统计，只在本线程中更新，可在其它线程中读取
+    uint32_t get_accept_batch_number() const { return _accept_batch_number; }
+    void on_accepted(uint32_t accepted_number);
+    void on_accept_rejected();
+    void on_accept_error();
+    void get_accept_stats(accept_stats_t* accept_stats) const;
+
+    // 到了连接的采样时间时采样TCP_INFO，未开启采样时什么也不做
+    void sample_tcp_info(int fd, uint64_t* next_sample_milliseconds)
+    {
+        _tcp_info_sampler.sample(fd, next_sample_milliseconds, _current_milliseconds);
+    }
         
 private:
     virtual void run();
@@ -75,11 +95,19 @@ private:
 
 private:    
     time_t _current_time;
+    uint64_t _current_milliseconds; // 单调时钟，用于超时
+    uint32_t _connection_timeout_milliseconds;
+    uint32_t _request_timeout_milliseconds;
+    uint32_t _write_timeout_milliseconds;
     net::CEpoller _epoller;
     CWaiterPool* _waiter_pool;       
-    utils::CTimeoutManager<CWaiter> _timeout_manager;
+    utils::CTimingWheel<CWaiter> _timing_wheel;
     CContext* _context;
     IThreadFollower* _follower;
+    uint32_t _accept_batch_number;
+    accept_stats_t _accept_stats;
+    net::CListenManager<CListener> _listen_manager; // 每个线程独立监听时才使用
+    net::CTcpInfoSampler _tcp_info_sampler;
     
 private:    
     struct PendingInfo
@@ -0,0 +1,171 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CBuiltinPacketHandler的流水线测试：一次收到的多个消息，响应依次追加到输出链，
+// 以及只收到部分消息时is_request_in_progress为true
+#include <mooon/net/tcp_waiter.h>
+#include <mooon/sys/thread_engine.h>
+#include "builtin_packet_handler.h"
+#include "../../../mooon/test/ut_utils.h"
+#include <string>
+using namespace mooon;
+
+class CConnection: public server::IConnection
+{
+public:
+    virtual std::string str() const { return "ut"; }
+    virtual net::port_t self_port() const { return 0; }
+    virtual net::port_t peer_port() const { return 0; }
+    virtual const net::ip_address_t& self_ip() const { return _ip; }
+    virtual const net::ip_address_t& peer_ip() const { return _ip; }
+    virtual uint16_t get_thread_index() const { return 0; }
+
+private:
+    net::ip_address_t _ip;
+};
+
+// 响应为消息头加上原样的消息体
+class CEchoObserver: public server::IMessageObserver
+{
+public:
+    CEchoObserver(int* messages)
+        :_messages(messages)
+    {
+    }
+
+    virtual bool on_message(const net::TCommonMessageHeader& request_header
+                          , const char* request_body
+                          , char** response_buffer
+                          , size_t* response_size)
+    {
+        uint32_t size = request_header.size.to_int();
+        *response_size = sizeof(request_header) + size;
+        *response_buffer = new char[*response_size];
+        memcpy(*response_buffer, &request_header, sizeof(request_header));
+        if (size > 0)
+            memcpy(*response_buffer + sizeof(request_header), request_body, size);
+        delete []request_body;
+        ++*_messages;
+        return true;
+    }
+
+private:
+    int* _messages;
+};
+
+static std::string make_message(uint32_t command, size_t body_size)
+{
+    net::TCommonMessageHeader header;
+    header.size = static_cast<uint32_t>(body_size);
+    header.command = command;
+
+    std::string message(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (size_t i=0; i<body_size; ++i)
+        message += static_cast<char>('a' + (command + i) % 26);
+    return message;
+}
+
+// 像CWaiter那样，每次收不超过请求Buffer余下大小的数据，交给处理器
+static void feed(server::IPacketHandler* packet_handler, const std::string& data)
+{
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        server::RequestContext* request_context = packet_handler->get_request_context();
+        size_t size = request_context->request_size - request_context->request_offset;
+        if (size > data.size() - offset)
+            size = data.size() - offset;
+        CHECK(size > 0);
+        memcpy(request_context->request_buffer + request_context->request_offset, data.data() + offset, size);
+
+        server::Indicator indicator;
+        indicator.reset = false;
+        indicator.thread_index = 0;
+        indicator.epoll_events = EPOLLOUT;
+        CHECK(utils::handle_continue == packet_handler->on_handle_request(size, indicator));
+        CHECK(!indicator.reset);
+        offset += size;
+    }
+}
+
+static void receive_all(net::CTcpWaiter* receiver, std::string* data)
+{
+    size_t size = data->size();
+    CHECK(receiver->full_receive(&(*data)[0], size));
+}
+
+// 发送输出链，对端读到的须和expected一致
+static void flush_and_compare(server::CResponseChain* chain, const std::string& expected)
+{
+    int client_fd, server_fd;
+    uint16_t port = connect_loopback(&client_fd, &server_fd);
+    net::CTcpWaiter sender, receiver;
+    sender.attach(client_fd, "127.0.0.1", port);
+    receiver.attach(server_fd, "127.0.0.1", 0);
+
+    CHECK(expected.size() == chain->size());
+    std::string received(expected.size(), '\0');
+    sys::CThreadEngine thread(sys::bind(receive_all, &receiver, &received));
+    CHECK(chain->flush(&sender));
+    thread.join();
+    CHECK(expected == received);
+}
+
+static void test_pipeline()
+{
+    int messages = 0;
+    CConnection connection;
+    server::CBuiltinPacketHandler packet_handler(&connection, new CEchoObserver(&messages));
+    server::IPacketHandler* handler = &packet_handler;
+
+    // 一次收到三个完整的消息和第四个消息的一部分
+    std::string data;
+    for (uint32_t i=0; i<3; ++i)
+        data += make_message(i, 10 + i);
+    data += make_message(0, 0); // 无消息体
+    std::string fourth = make_message(4, 100);
+    CHECK(!handler->is_request_in_progress());
+    feed(handler, data + fourth.substr(0, 20));
+
+    // 接收Buffer每次都从头开始，request_offset为0，但第四个消息只收到了一部分
+    CHECK(4 == messages);
+    CHECK(0 == handler->get_request_context()->request_offset);
+    CHECK(handler->is_request_in_progress());
+    flush_and_compare(handler->get_response_chain(), data);
+
+    // 第四个消息余下的部分，以及一个大于接收Buffer的消息
+    std::string large = make_message(5, 10000);
+    feed(handler, fourth.substr(20) + large);
+    CHECK(6 == messages);
+    CHECK(!handler->is_request_in_progress());
+    flush_and_compare(handler->get_response_chain(), fourth + large);
+
+    // 只收到消息头的一部分
+    feed(handler, make_message(6, 1).substr(0, 3));
+    CHECK(handler->is_request_in_progress());
+    handler->reset();
+    CHECK(!handler->is_request_in_progress());
+}
+
+int main()
+{
+    test_pipeline();
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,271 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CResponseChain的测试：复制、借用Buffer和文件区间混合，部分发送，以及clear
+#include <mooon/server/response_chain.h>
+#include <mooon/net/tcp_waiter.h>
+#include <mooon/sys/thread_engine.h>
+#include "../../../mooon/test/ut_utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string>
+#include <vector>
+using namespace mooon;
+
+// 在回环地址上建立一个TCP连接，两端分别关联到sender和receiver
+static void connect_loopback(net::CTcpWaiter* sender, net::CTcpWaiter* receiver)
+{
+    int client_fd, server_fd;
+    uint16_t port = connect_loopback(&client_fd, &server_fd);
+
+    sender->attach(client_fd, "127.0.0.1", port);
+    receiver->attach(server_fd, "127.0.0.1", 0);
+}
+
+// 创建内容为data的临时文件
+static int create_file(const std::string& data)
+{
+    char filename[] = "/tmp/ut_response_chain_XXXXXX";
+    int fd = mkstemp(filename);
+    CHECK(fd != -1);
+    unlink(filename);
+    CHECK(static_cast<ssize_t>(data.size()) == pwrite(fd, data.data(), data.size(), 0));
+    return fd;
+}
+
+static std::string make_data(size_t size, char seed)
+{
+    std::string data(size, '\0');
+    for (size_t i=0; i<size; ++i)
+        data[i] = static_cast<char>(seed + i * 7 + i / 1000);
+    return data;
+}
+
+static void receive_all(net::CTcpWaiter* receiver, std::string* data)
+{
+    size_t size = data->size();
+    CHECK(receiver->full_receive(&(*data)[0], size));
+}
+
+// 发送整个链，对端读到的须和expected一致
+static void flush_and_compare(server::CResponseChain* chain, const std::string& expected)
+{
+    net::CTcpWaiter sender, receiver;
+    connect_loopback(&sender, &receiver);
+
+    std::string received(expected.size(), '\0');
+    sys::CThreadEngine thread(sys::bind(receive_all, &receiver, &received));
+    CHECK(chain->flush(&sender));
+    thread.join();
+
+    CHECK(chain->empty());
+    CHECK(0 == chain->size());
+    CHECK(expected == received);
+}
+
+// 借用的Buffer和文件之后再复制追加小块数据，不能写到借用的Buffer里或NULL上
+static void test_mixed()
+{
+    server::CResponseChain chain;
+    std::string expected;
+
+    std::string borrowed = make_data(100, 'b');
+    const std::string borrowed_copy = borrowed;
+    std::string file_data = make_data(5000, 'f');
+    int file_fd = create_file(file_data);
+
+    chain.append("head", 4);
+    expected += "head";
+    chain.append(std::string("er"));
+    expected += "er";
+    chain.append_buffer(&borrowed[0], borrowed.size(), false);
+    expected += borrowed;
+    chain.append("x", 1);
+    expected += "x";
+
+    char* owned = new char[3];
+    memcpy(owned, "own", 3);
+    chain.append_buffer(owned, 3, true);
+    expected += "own";
+    chain.append("y", 1);
+    expected += "y";
+
+    chain.append_file(file_fd, 1000, 3000, false);
+    expected += file_data.substr(1000, 3000);
+    chain.append("tail", 4);
+    expected += "tail";
+
+    // 大于一段最小容量的也可以
+    std::string large = make_data(10000, 'l');
+    chain.append(large);
+    expected += large;
+    chain.append("", 0);
+    chain.append_buffer(NULL, 0, false);
+    CHECK(expected.size() == chain.size());
+
+    flush_and_compare(&chain, expected);
+    CHECK(borrowed_copy == borrowed);
+
+    // 链可以继续使用
+    chain.append("again", 5);
+    flush_and_compare(&chain, "again");
+    close(file_fd);
+}
+
+static void wait_writable(int fd)
+{
+    struct pollfd fds;
+    fds.fd = fd;
+    fds.events = POLLOUT;
+    fds.revents = 0;
+    CHECK(1 == poll(&fds, 1, 10000));
+}
+
+// Socket不可写时发送一部分，之后接着发送余下的
+static void test_partial_flush()
+{
+    net::CTcpWaiter sender, receiver;
+    connect_loopback(&sender, &receiver);
+    sender.set_nonblock(true);
+    int buffer_size = 4096;
+    CHECK(0 == setsockopt(sender.get_fd(), SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size)));
+    CHECK(0 == setsockopt(receiver.get_fd(), SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size)));
+
+    server::CResponseChain chain;
+    std::string expected;
+    std::string borrowed = make_data(1024 * 1024, 'b');
+    std::string file_data = make_data(2 * 1024 * 1024, 'f');
+    int file_fd = create_file(file_data);
+
+    for (int i=0; i<100; ++i)
+    {
+        std::string small = make_data(100 + i, 's');
+        chain.append(small);
+        expected += small;
+    }
+    chain.append_buffer(&borrowed[0], borrowed.size(), false);
+    expected += borrowed;
+    chain.append("between", 7);
+    expected += "between";
+    chain.append_file(file_fd, 100, file_data.size() - 100, false);
+    expected += file_data.substr(100);
+    for (int i=0; i<200; ++i)
+    {
+        char* owned = new char[1000];
+        memset(owned, 'a' + i % 26, 1000);
+        chain.append_buffer(owned, 1000, true);
+        expected.append(owned, 1000);
+    }
+    chain.append("end", 3);
+    expected += "end";
+    CHECK(expected.size() == chain.size());
+
+    // 对端未读，发不完
+    CHECK(!chain.flush(&sender));
+    CHECK(!chain.empty());
+    CHECK(chain.size() > 0);
+    CHECK(chain.size() < expected.size());
+
+    std::string received(expected.size(), '\0');
+    sys::CThreadEngine thread(sys::bind(receive_all, &receiver, &received));
+    int flushes = 1;
+    while (!chain.flush(&sender))
+    {
+        wait_writable(sender.get_fd());
+        ++flushes;
+    }
+    thread.join();
+
+    fprintf(stdout, "partial flush: %d flushes for %zu bytes\n", flushes, expected.size());
+    CHECK(flushes > 2);
+    CHECK(chain.empty());
+    CHECK(0 == chain.size());
+    CHECK(expected == received);
+    close(file_fd);
+}
+
+// clear丢弃所有数据，只关闭链拥有的文件
+static void test_clear()
+{
+    int own_fd = create_file("owned file");
+    int borrowed_fd = create_file("borrowed file");
+    std::string borrowed = "borrowed";
+
+    server::CResponseChain chain;
+    chain.append("copy", 4);
+    chain.append_buffer(new char[10], 10, true);
+    chain.append_buffer(&borrowed[0], borrowed.size(), false);
+    chain.append_file(own_fd, 0, 10, true);
+    chain.append_file(borrowed_fd, 0, 13, false);
+    chain.append("copy", 4);
+    CHECK(4 + 10 + 8 + 10 + 13 + 4 == chain.size());
+
+    chain.clear();
+    CHECK(chain.empty());
+    CHECK(0 == chain.size());
+    CHECK((-1 == fcntl(own_fd, F_GETFD)) && (EBADF == errno));
+    CHECK(fcntl(borrowed_fd, F_GETFD) != -1);
+    CHECK("borrowed" == borrowed);
+
+    // 长度为0的拥有的文件立即被关闭
+    own_fd = create_file("");
+    chain.append_file(own_fd, 0, 0, true);
+    CHECK(chain.empty());
+    CHECK((-1 == fcntl(own_fd, F_GETFD)) && (EBADF == errno));
+
+    // clear后可以继续使用，文件计数也被复位
+    chain.append_file(borrowed_fd, 9, 4, false);
+    chain.append("!", 1);
+    flush_and_compare(&chain, "file!");
+    close(borrowed_fd);
+}
+
+// 文件比追加时指定的短时报EIO
+static void test_short_file()
+{
+    int file_fd = create_file("short");
+    server::CResponseChain chain;
+    chain.append_file(file_fd, 0, 100, true);
+
+    net::CTcpWaiter sender, receiver;
+    connect_loopback(&sender, &receiver);
+    try
+    {
+        // 第一次发出文件现有的部分，下一次sendfile返回0时报错
+        CHECK(!chain.flush(&sender));
+        chain.flush(&sender);
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(EIO == ex.errcode());
+    }
+    chain.clear();
+}
+
+int main()
+{
+    test_mixed();
+    test_partial_flush();
+    test_clear();
+    test_short_file();
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
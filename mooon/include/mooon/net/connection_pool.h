@@ -0,0 +1,545 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_CONNECTION_POOL_H
+#define MOOON_NET_CONNECTION_POOL_H
+#include "mooon/net/tcp_client.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/stop_watch.h"
+#include "mooon/utils/string_utils.h"
+#include <list>
+#include <map>
+NET_NAMESPACE_BEGIN
+
+/** 连接池的配置，可先调用init_connection_pool_config取得默认值 */
+typedef struct
+{
+    uint32_t min_idle;                 /** 每个地址至少保留的空闲连接数，不被回收，由maintain补足 */
+    uint32_t max_idle;                 /** 每个地址最多保留的空闲连接数，超过的在归还时关闭 */
+    uint32_t max_active;               /** 每个地址最多的连接数（包括借出的和空闲的），为0表示不限 */
+    uint32_t max_waiters;              /** 每个地址连接用完时最多等待的借用者个数，超过的直接失败 */
+    uint32_t wait_milliseconds;        /** 连接用完时最多等待的毫秒数 */
+    uint32_t idle_seconds;             /** 空闲超过多少秒的连接被回收 */
+    uint32_t validate_milliseconds;    /** 空闲超过多少毫秒的连接在借出前检查一次，为0表示每次借出都检查 */
+    uint32_t min_backoff_milliseconds; /** 建立连接失败后的退避毫秒数，连续失败时加倍 */
+    uint32_t max_backoff_milliseconds; /** 退避的最大毫秒数 */
+}connection_pool_config_t;
+
+/** 连接池的统计 */
+typedef struct
+{
+    uint64_t borrow_number;           /** 借出成功次数 */
+    uint64_t borrow_failure_number;   /** 借出失败次数 */
+    uint64_t borrow_microseconds;     /** 借出成功的累计微秒数，包括等待和建立连接的时间 */
+    uint64_t max_borrow_microseconds; /** 单次借出成功的最大微秒数 */
+    uint64_t create_number;           /** 新建立的连接数 */
+    uint64_t create_failure_number;   /** 建立连接失败次数 */
+    uint64_t invalid_number;          /** 借出前检查不可用而关闭的连接数 */
+    uint64_t broken_number;           /** 归还时被标记为已坏而关闭的连接数 */
+    uint64_t evict_number;            /** 空闲超时或超过max_idle而关闭的连接数 */
+    uint64_t exhausted_number;        /** 连接用完需要等待的次数 */
+    uint64_t rejected_number;         /** 等待的借用者已达max_waiters而直接失败的次数 */
+    uint64_t timeout_number;          /** 等待超时的次数 */
+    uint64_t backoff_number;          /** 地址处于退避期而直接失败的次数 */
+}connection_pool_stats_t;
+
+/** 取得连接池的默认配置 */
+extern void init_connection_pool_config(connection_pool_config_t* config);
+
+/***
+  * 连接池中和连接类型无关的部分：配置、统计、锁和时间
+  */
+class CConnectionPoolBase
+{
+public:
+    const connection_pool_config_t& get_config() const { return _config; }
+
+    /** 得到连接池的统计 */
+    void get_stats(connection_pool_stats_t* stats) const;
+
+    /** 统计转换成可读的字符串，常用于定时记录日志 */
+    std::string str_stats() const;
+
+protected:
+    explicit CConnectionPoolBase(const connection_pool_config_t& config);
+
+    /** 单调时钟的毫秒数 */
+    static uint64_t get_milliseconds();
+
+    /** 连续失败failure_number次后的退避毫秒数 */
+    uint32_t get_backoff_milliseconds(uint32_t failure_number) const;
+
+    /** 记录一次成功的借出，须在锁内调用 */
+    void record_borrow(uint64_t microseconds);
+
+    /** 记录一次失败的借出，不能在锁内调用 */
+    void record_borrow_failure();
+
+    /** 唤醒等待的借用者，须在锁内调用 */
+    void wakeup_waiters();
+
+private:
+    CConnectionPoolBase(const CConnectionPoolBase&);
+    CConnectionPoolBase& operator =(const CConnectionPoolBase&);
+
+protected:
+    connection_pool_config_t _config;
+    connection_pool_stats_t _stats;
+    uint32_t _waiter_number; // 所有地址等待的借用者个数
+    mutable sys::CLock _lock;
+    sys::CEvent _event;      // 所有地址共用，因此总是broadcast
+};
+
+/***
+  * 按地址（host:port）分组的连接池，可在多个线程间共享，
+  * Connection为连接的类型，ConnectionFactory负责连接的建立、检查和关闭，需提供以下三个方法：
+  * Connection* create(const std::string& host, uint16_t port); // 建立连接，出错抛出异常
+  * bool validate(Connection* connection);                        // 空闲的连接是否仍可用，不能阻塞
+  * void destroy(Connection* connection);                         // 关闭并删除连接，不能抛出异常
+  * CTcpClient可使用CTcpClientFactory，Thrift客户端可使用thrift_helper.h中的CThriftClientFactory
+  *
+  * 1) 借出时优先使用最近归还的空闲连接，空闲超过validate_milliseconds的先检查（惰性检查），
+  *    检查不可用的关闭后再取下一个，没有空闲连接且未达到max_active时建立新连接，建立连接时不持有锁
+  * 2) 连接数已达max_active时，最多max_waiters个借用者等待归还，等待超过wait_milliseconds则失败
+  * 3) 建立连接失败后，该地址进入退避期，退避期内借出直接失败，不再尝试连接
+  * 4) 空闲超过idle_seconds的连接在归还或maintain时关闭，但保留min_idle个
+  *
+  * 借出失败抛出CSyscallException异常，错误码：
+  * EBUSY 等待的借用者已满，ETIMEDOUT 等待超时，EAGAIN 地址处于退避期，
+  * 建立连接时的异常（比如Thrift的TTransportException）原样抛出
+  *
+  * 使用示例：
+  * net::connection_pool_config_t config;
+  * net::init_connection_pool_config(&config);
+  * net::CConnectionPool<net::CTcpClient, net::CTcpClientFactory> pool(config);
+  * {
+  *     net::CPooledConnection<net::CTcpClient, net::CTcpClientFactory> connection(&pool, "127.0.0.1", 2016);
+  *     try
+  *     {
+  *         connection->full_send(buffer, buffer_size);
+  *     }
+  *     catch (sys::CSyscallException& ex)
+  *     {
+  *         connection.set_broken(); // 出错的连接不再放回池中
+  *     }
+  * }
+  */
+template <class Connection, class ConnectionFactory>
+class CConnectionPool: public CConnectionPoolBase
+{
+public:
+    explicit CConnectionPool(const connection_pool_config_t& config, const ConnectionFactory& factory=ConnectionFactory());
+
+    /** 关闭所有空闲的连接，借出的连接须在这之前全部归还 */
+    ~CConnectionPool();
+
+    /***
+      * 借出一个到host:port的连接，用完后须调用give_back归还，推荐使用CPooledConnection
+      * @exception: 出错抛出CSyscallException异常，或者ConnectionFactory::create抛出的异常
+      */
+    Connection* borrow(const std::string& host, uint16_t port);
+
+    /***
+      * 归还借出的连接
+      * @broken: 连接是否已坏（比如收发出错），已坏的直接关闭，不放回池中
+      */
+    void give_back(Connection* connection, bool broken=false);
+
+    /***
+      * 关闭空闲超时的连接，并为各地址补足min_idle个空闲连接，
+      * 建议由定时线程每隔几秒调用一次，不调用时空闲连接只在归还时被回收
+      */
+    void maintain();
+
+    /** 得到到host:port的空闲连接数和总连接数 */
+    void get_connection_number(const std::string& host, uint16_t port, uint32_t* idle_number, uint32_t* active_number) const;
+
+private:
+    typedef struct
+    {
+        Connection* connection;
+        uint64_t milliseconds; // 放入空闲队列的时间
+    }idle_connection_t;
+
+    typedef struct
+    {
+        std::string host;
+        uint16_t port;
+        uint32_t active_number;        // 借出的和空闲的连接数，包括正在建立的
+        uint32_t waiter_number;
+        uint32_t failure_number;       // 连续建立连接失败次数
+        uint64_t retry_milliseconds;   // 退避期的结束时间
+        std::list<idle_connection_t> idle_list; // 头部为最近归还的
+    }endpoint_t;
+
+    endpoint_t* get_endpoint(const std::string& host, uint16_t port);
+    Connection* do_borrow(const std::string& host, uint16_t port);
+    Connection* create_connection(endpoint_t* endpoint);
+    void evict_idle(endpoint_t* endpoint, uint64_t now);
+
+private:
+    ConnectionFactory _factory;
+    std::map<std::string, endpoint_t*> _endpoint_table;
+    std::map<Connection*, endpoint_t*> _borrowed_table;
+};
+
+/***
+  * 借出连接的辅助类，构造时借出，析构时归还
+  */
+template <class Connection, class ConnectionFactory>
+class CPooledConnection
+{
+public:
+    CPooledConnection(CConnectionPool<Connection, ConnectionFactory>* pool, const std::string& host, uint16_t port)
+        :_pool(pool), _broken(false)
+    {
+        _connection = pool->borrow(host, port);
+    }
+
+    ~CPooledConnection()
+    {
+        _pool->give_back(_connection, _broken);
+    }
+
+    /** 标记连接已坏，归还时直接关闭 */
+    void set_broken() { _broken = true; }
+
+    Connection* get() const { return _connection; }
+    Connection* operator ->() const { return _connection; }
+    Connection& operator *() const { return *_connection; }
+
+private:
+    CPooledConnection(const CPooledConnection&);
+    CPooledConnection& operator =(const CPooledConnection&);
+
+private:
+    CConnectionPool<Connection, ConnectionFactory>* _pool;
+    Connection* _connection;
+    bool _broken;
+};
+
+/***
+  * CTcpClient的连接工厂，连接为阻塞模式
+  */
+class CTcpClientFactory
+{
+public:
+    explicit CTcpClientFactory(uint32_t connect_timeout_milliseconds=2000)
+        :_connect_timeout_milliseconds(connect_timeout_milliseconds)
+    {
+    }
+
+    /***
+      * host须为IP地址
+      * @exception: 出错抛出CSyscallException异常，IP无效抛出utils::CException异常
+      */
+    CTcpClient* create(const std::string& host, uint16_t port);
+    bool validate(CTcpClient* tcp_client);
+    void destroy(CTcpClient* tcp_client);
+
+private:
+    uint32_t _connect_timeout_milliseconds;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+template <class Connection, class ConnectionFactory>
+CConnectionPool<Connection, ConnectionFactory>::CConnectionPool(const connection_pool_config_t& config, const ConnectionFactory& factory)
+    :CConnectionPoolBase(config), _factory(factory)
+{
+}
+
+template <class Connection, class ConnectionFactory>
+CConnectionPool<Connection, ConnectionFactory>::~CConnectionPool()
+{
+    typename std::map<std::string, endpoint_t*>::iterator iter = _endpoint_table.begin();
+    for (; iter!=_endpoint_table.end(); ++iter)
+    {
+        endpoint_t* endpoint = iter->second;
+        typename std::list<idle_connection_t>::iterator idle_iter = endpoint->idle_list.begin();
+        for (; idle_iter!=endpoint->idle_list.end(); ++idle_iter)
+            _factory.destroy(idle_iter->connection);
+        delete endpoint;
+    }
+}
+
+template <class Connection, class ConnectionFactory>
+Connection* CConnectionPool<Connection, ConnectionFactory>::borrow(const std::string& host, uint16_t port)
+{
+    try
+    {
+        return do_borrow(host, port);
+    }
+    catch (...)
+    {
+        record_borrow_failure();
+        throw;
+    }
+}
+
+template <class Connection, class ConnectionFactory>
+void CConnectionPool<Connection, ConnectionFactory>::give_back(Connection* connection, bool broken)
+{
+    const uint64_t now = get_milliseconds();
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    typename std::map<Connection*, endpoint_t*>::iterator iter = _borrowed_table.find(connection);
+
+    if (iter == _borrowed_table.end())
+    {
+        // 不是从本池借出的
+        _factory.destroy(connection);
+        return;
+    }
+
+    endpoint_t* endpoint = iter->second;
+    _borrowed_table.erase(iter);
+    if (broken)
+    {
+        --endpoint->active_number;
+        ++_stats.broken_number;
+        _factory.destroy(connection);
+    }
+    else if (endpoint->idle_list.size() >= _config.max_idle)
+    {
+        --endpoint->active_number;
+        ++_stats.evict_number;
+        _factory.destroy(connection);
+    }
+    else
+    {
+        idle_connection_t idle_connection;
+        idle_connection.connection = connection;
+        idle_connection.milliseconds = now;
+        endpoint->idle_list.push_front(idle_connection);
+        evict_idle(endpoint, now);
+    }
+
+    // 放回了空闲连接，或者连接数减少了，都可以让等待者继续
+    wakeup_waiters();
+}
+
+template <class Connection, class ConnectionFactory>
+void CConnectionPool<Connection, ConnectionFactory>::maintain()
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+    // 建立连接时会释放锁，但地址只增不删，std::map的迭代器仍有效
+    typename std::map<std::string, endpoint_t*>::iterator iter = _endpoint_table.begin();
+    for (; iter!=_endpoint_table.end(); ++iter)
+    {
+        endpoint_t* endpoint = iter->second;
+        evict_idle(endpoint, get_milliseconds());
+
+        while ((endpoint->idle_list.size() < _config.min_idle)
+            && (get_milliseconds() >= endpoint->retry_milliseconds)
+            && ((0 == _config.max_active) || (endpoint->active_number < _config.max_active)))
+        {
+            Connection* connection = NULL;
+            try
+            {
+                connection = create_connection(endpoint);
+            }
+            catch (...)
+            {
+                // 已记录了失败并进入退避期，由下一次maintain再试
+                break;
+            }
+
+            idle_connection_t idle_connection;
+            idle_connection.connection = connection;
+            idle_connection.milliseconds = get_milliseconds();
+            endpoint->idle_list.push_front(idle_connection);
+            wakeup_waiters();
+        }
+    }
+}
+
+template <class Connection, class ConnectionFactory>
+void CConnectionPool<Connection, ConnectionFactory>::get_connection_number(const std::string& host, uint16_t port, uint32_t* idle_number, uint32_t* active_number) const
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    typename std::map<std::string, endpoint_t*>::const_iterator iter = _endpoint_table.find(utils::CStringUtils::format_string("%s:%u", host.c_str(), port));
+
+    if (iter == _endpoint_table.end())
+    {
+        *idle_number = 0;
+        *active_number = 0;
+    }
+    else
+    {
+        *idle_number = static_cast<uint32_t>(iter->second->idle_list.size());
+        *active_number = iter->second->active_number;
+    }
+}
+
+template <class Connection, class ConnectionFactory>
+typename CConnectionPool<Connection, ConnectionFactory>::endpoint_t* CConnectionPool<Connection, ConnectionFactory>::get_endpoint(const std::string& host, uint16_t port)
+{
+    const std::string key = utils::CStringUtils::format_string("%s:%u", host.c_str(), port);
+    typename std::map<std::string, endpoint_t*>::iterator iter = _endpoint_table.find(key);
+    if (iter != _endpoint_table.end())
+        return iter->second;
+
+    endpoint_t* endpoint = new endpoint_t;
+    endpoint->host = host;
+    endpoint->port = port;
+    endpoint->active_number = 0;
+    endpoint->waiter_number = 0;
+    endpoint->failure_number = 0;
+    endpoint->retry_milliseconds = 0;
+    _endpoint_table.insert(std::make_pair(key, endpoint));
+    return endpoint;
+}
+
+template <class Connection, class ConnectionFactory>
+Connection* CConnectionPool<Connection, ConnectionFactory>::do_borrow(const std::string& host, uint16_t port)
+{
+    sys::CStopWatch stop_watch;
+    const uint64_t deadline = get_milliseconds() + _config.wait_milliseconds;
+    bool exhausted = false;
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    endpoint_t* endpoint = get_endpoint(host, port);
+
+    for (;;)
+    {
+        Connection* connection = NULL;
+        const uint64_t now = get_milliseconds();
+
+        if (!endpoint->idle_list.empty())
+        {
+            idle_connection_t idle_connection = endpoint->idle_list.front();
+            endpoint->idle_list.pop_front();
+
+            // 惰性检查：刚归还的连接不检查，检查本身不阻塞，因此在锁内进行
+            if ((now - idle_connection.milliseconds < _config.validate_milliseconds)
+             || _factory.validate(idle_connection.connection))
+            {
+                connection = idle_connection.connection;
+            }
+            else
+            {
+                --endpoint->active_number;
+                ++_stats.invalid_number;
+                _factory.destroy(idle_connection.connection);
+                wakeup_waiters();
+                continue;
+            }
+        }
+        else if (now < endpoint->retry_milliseconds)
+        {
+            ++_stats.backoff_number;
+            THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("%s:%u in backoff", host.c_str(), port), EAGAIN, "borrow");
+        }
+        else if ((0 == _config.max_active) || (endpoint->active_number < _config.max_active))
+        {
+            connection = create_connection(endpoint);
+        }
+        else
+        {
+            // 连接已用完，等待归还
+            if (endpoint->waiter_number >= _config.max_waiters)
+            {
+                ++_stats.rejected_number;
+                THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("%s:%u exhausted", host.c_str(), port), EBUSY, "borrow");
+            }
+            if (!exhausted)
+            {
+                exhausted = true;
+                ++_stats.exhausted_number;
+            }
+            if (now >= deadline)
+            {
+                ++_stats.timeout_number;
+                THROW_SYSCALL_EXCEPTION(utils::CStringUtils::format_string("%s:%u wait timeout", host.c_str(), port), ETIMEDOUT, "borrow");
+            }
+
+            ++endpoint->waiter_number;
+            ++_waiter_number;
+            try
+            {
+                // 允许虚假唤醒，醒来后重新检查
+                (void)_event.timed_wait(_lock, static_cast<uint32_t>(deadline - now));
+            }
+            catch (...)
+            {
+                --endpoint->waiter_number;
+                --_waiter_number;
+                throw;
+            }
+            --endpoint->waiter_number;
+            --_waiter_number;
+            continue;
+        }
+
+        _borrowed_table.insert(std::make_pair(connection, endpoint));
+        record_borrow(stop_watch.get_total_elapsed_microseconds());
+        return connection;
+    }
+}
+
+// 调用时须持有锁，建立连接期间释放锁，返回时仍持有锁
+template <class Connection, class ConnectionFactory>
+Connection* CConnectionPool<Connection, ConnectionFactory>::create_connection(endpoint_t* endpoint)
+{
+    Connection* connection = NULL;
+
+    // 先占位，保证建立连接期间其它线程不会超过max_active
+    ++endpoint->active_number;
+    _lock.unlock();
+    try
+    {
+        connection = _factory.create(endpoint->host, endpoint->port);
+    }
+    catch (...)
+    {
+        _lock.lock();
+        --endpoint->active_number;
+        ++_stats.create_failure_number;
+        ++endpoint->failure_number;
+        endpoint->retry_milliseconds = get_milliseconds() + get_backoff_milliseconds(endpoint->failure_number);
+
+        // 让等待者尽快以退避失败返回
+        wakeup_waiters();
+        throw;
+    }
+
+    _lock.lock();
+    ++_stats.create_number;
+    endpoint->failure_number = 0;
+    endpoint->retry_milliseconds = 0;
+    return connection;
+}
+
+// 从队尾（最久未用的）开始关闭空闲超时的连接，保留min_idle个
+template <class Connection, class ConnectionFactory>
+void CConnectionPool<Connection, ConnectionFactory>::evict_idle(endpoint_t* endpoint, uint64_t now)
+{
+    const uint64_t idle_milliseconds = static_cast<uint64_t>(_config.idle_seconds) * 1000;
+
+    while ((endpoint->idle_list.size() > _config.min_idle)
+        && (now - endpoint->idle_list.back().milliseconds >= idle_milliseconds))
+    {
+        --endpoint->active_number;
+        ++_stats.evict_number;
+        _factory.destroy(endpoint->idle_list.back().connection);
+        endpoint->idle_list.pop_back();
+    }
+}
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_CONNECTION_POOL_H
@@ -132,6 +132,7 @@ long get_recv_buffer_bytes();
 class CEpollable: public sys::CRefCountable
 {
     friend class CEpoller;
+    friend class CUringPoller;
 
 public:
     CEpollable();
@@ -226,6 +227,10 @@ private:
 private:
     int _fd;
     int _epoll_events;
+    // 供CUringPoller使用，只属于第一个登记它的io_uring（_uring_id），
+    // 同时登记到其它io_uring时（如多个工作线程共享的监听者），状态由各io_uring自己保存
+    uint32_t _uring_id;  // 为0表示没有登记到任何io_uring
+    int _pending_index;  // 在待重新提交POLL_ADD队列中的位置，不在队列中时为-1
 };
 
 NET_NAMESPACE_END
@@ -20,6 +20,8 @@
 #define MOOON_NET_EPOLLABLE_QUEUE_H
 #include "mooon/net/epollable.h"
 #include "mooon/sys/event.h"
+#include "mooon/sys/futex.h"
+#include <sys/eventfd.h>
 NET_NAMESPACE_BEGIN
 
 /** 可以放入Epoll监控的队列
@@ -207,5 +209,401 @@ private:
     volatile int32_t _push_waiter_number; /** 等待队列非满的线程个数 */
 };
 
+/** 可以放入Epoll监控的队列，基于eventfd
+  * 和CEpollableQueue的接口和语义相同（队列非空时可读），但不是每个元素读写一次管道，
+  * 而是只在队列由空变为非空时写一次eventfd，由非空变为空时读一次eventfd，
+  * 所以消费者被唤醒后一次取走所有元素（见批量的pop_front），只需两次系统调用
+  * RawQueueClass为原始队列类名，如utils::CArrayQueue
+  * 为线程安全类
+  */
+template <class RawQueueClass>
+class CEventfdQueue: public CEpollable
+{
+    typedef typename RawQueueClass::_DataType DataType;
+
+public:
+    /** 构造一个基于eventfd的可Epoll的队列，注意只可监控读事件，也就是队列中是否有数据
+      * @queue_max: 队列最大可容纳的元素个数
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    CEventfdQueue(uint32_t queue_max) throw (sys::CSyscallException)
+        :_raw_queue(queue_max)
+        ,_push_waiter_number(0)
+    {
+        int fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (-1 == fd)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "eventfd");
+
+        set_fd(fd);
+    }
+
+    ~CEventfdQueue()
+    {
+        close();
+    }
+
+    /** 关闭队列 */
+    virtual void close()
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        if (get_fd() != -1)
+            CEpollable::close();
+    }
+
+    /** 判断队列是否已满 */
+    bool is_full() const
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        return _raw_queue.is_full();
+    }
+
+    /** 判断队列是否为空 */
+    bool is_empty() const
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        return _raw_queue.is_empty();
+    }
+
+    /***
+      * 取队首元素
+      * @elem: 存储取到的队首元素
+      * @return: 如果队列为空，则返回false，否则返回true
+      */
+    bool front(DataType& elem) const
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        if (_raw_queue.is_empty()) return false;
+
+        elem = _raw_queue.front();
+        return true;
+    }
+
+    /***
+      * 弹出队首元素
+      * @elem: 存储弹出的队首元素
+      * @return: 如果队列为空，则返回false，否则取到元素并返回true
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    bool pop_front(DataType& elem)
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        if (_raw_queue.is_empty()) return false;
+
+        elem = _raw_queue.pop_front();
+        after_pop();
+        return true;
+    }
+
+    void pop_front()
+    {
+        DataType elem;
+        (void)pop_front(elem);
+    }
+
+    /***
+      * 从队首依次弹出多个元素，只加一次锁
+      * @elem_array: 存储弹出的队首元素数组
+      * @array_size: 输入和输出参数，存储实际弹出的元素个数
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    void pop_front(DataType* elem_array, uint32_t& array_size)
+    {
+        uint32_t i = 0;
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+        for (; (i<array_size) && !_raw_queue.is_empty(); ++i)
+            elem_array[i] = _raw_queue.pop_front();
+        if (i > 0)
+            after_pop();
+
+        array_size = i;
+    }
+
+    /***
+      * 向队尾插入一元素
+      * @elem: 待插入到队尾的元素
+      * @millisecond: 如果队列满，等待队列非满的毫秒数，如果为0则不等待，直接返回false
+      * @return: 如果队列已经满，则返回false，否则插入成功并返回true
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    bool push_back(DataType elem, uint32_t millisecond=0) throw (sys::CSyscallException)
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        while (_raw_queue.is_full())
+        {
+            // 立即返回
+            if (0 == millisecond) return false;
+
+            // 超时等待
+            utils::CountHelper<volatile int32_t> ch(_push_waiter_number);
+            if (!_event.timed_wait(_lock, millisecond))
+            {
+                return false;
+            }
+        }
+
+        bool was_empty = _raw_queue.is_empty();
+        _raw_queue.push_back(elem);
+
+        // 只有由空变为非空时才需要通知消费者
+        if (was_empty)
+        {
+            uint64_t one = 1;
+            while (-1 == write(get_fd(), &one, sizeof(one)))
+            {
+                if (errno != EINTR)
+                    THROW_SYSCALL_EXCEPTION(NULL, errno, "write");
+            }
+        }
+
+        return true;
+    }
+
+    /** 得到队列中当前存储的元素个数 */
+    uint32_t size() const
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        return _raw_queue.size();
+    }
+
+private:
+    // 调用时已持有锁
+    void after_pop() throw (sys::CSyscallException)
+    {
+        // 由非空变为空时清除eventfd的计数，使其不再可读
+        if (_raw_queue.is_empty())
+        {
+            uint64_t value;
+            while (-1 == read(get_fd(), &value, sizeof(value)))
+            {
+                if (EAGAIN == errno)
+                    break;
+                if (errno != EINTR)
+                    THROW_SYSCALL_EXCEPTION(NULL, errno, "read");
+            }
+        }
+
+        // 如果有等待者，则唤醒其中一个
+        if (_push_waiter_number > 0) _event.signal();
+    }
+
+private:
+    sys::CEvent _event;
+    mutable sys::CLock _lock;
+    RawQueueClass _raw_queue; /** 普通队列实例 */
+    volatile int32_t _push_waiter_number; /** 等待队列非满的线程个数 */
+};
+
+/** 可以放入Epoll监控的单生产者单消费者无锁队列，基于eventfd
+  * 只能有一个线程push_back，一个线程pop_front（通常是Epoll所在的线程），两者都不加锁
+  *
+  * 和CEventfdQueue不同，可读只表示“可能有数据”：消费者须一直pop_front直到返回false，
+  * pop_front返回false时会登记消费者将要等待，之后生产者放入数据时才写eventfd唤醒它，
+  * 在消费者忙的时候，生产者不会执行任何系统调用
+  */
+template <typename DataType>
+class CSpscEventfdQueue: public CEpollable
+{
+public:
+    /** 构造一个单生产者单消费者的可Epoll的队列
+      * @queue_max: 队列大小，会被向上取整为2的幂，最小为2
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    CSpscEventfdQueue(uint32_t queue_max) throw (sys::CSyscallException)
+        :_capacity(2)
+        ,_head(0)
+        ,_tail(0)
+        ,_consumer_waiting(1) // 初始时消费者尚未pop_front，视为已在等待
+        ,_consumer_armed(true)
+        ,_producer_waiting(0)
+    {
+        while (_capacity < queue_max)
+            _capacity <<= 1;
+        _elems = new DataType[_capacity];
+
+        int fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+        if (-1 == fd)
+        {
+            delete []_elems;
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "eventfd");
+        }
+
+        set_fd(fd);
+    }
+
+    ~CSpscEventfdQueue()
+    {
+        close();
+        delete []_elems;
+    }
+
+    /** 判断队列是否为空，只是近似值 */
+    bool is_empty() const
+    {
+        return __atomic_load_n(&_head, __ATOMIC_ACQUIRE) == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+    }
+
+    /** 得到队列中当前存储的元素个数，只是近似值 */
+    uint32_t size() const
+    {
+        uint64_t head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+        uint64_t tail = __atomic_load_n(&_tail, __ATOMIC_ACQUIRE);
+        return static_cast<uint32_t>(tail - head);
+    }
+
+    /** 得到队列的容量，为2的幂 */
+    uint32_t capacity() const
+    {
+        return _capacity;
+    }
+
+    /***
+      * 弹出队首元素，只能由消费者线程调用
+      * @elem: 存储弹出的队首元素
+      * @return: 如果队列为空，则返回false，这时消费者已登记为等待，有数据时eventfd将可读
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    bool pop_front(DataType& elem) throw (sys::CSyscallException)
+    {
+        uint64_t head = _head;
+
+        if (head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE))
+        {
+            if (!prepare_wait())
+                return false;
+        }
+
+        elem = _elems[head & (_capacity-1)];
+        __atomic_store_n(&_head, head+1, __ATOMIC_RELEASE);
+
+        // 不加屏障，生产者在等待时会定期自己重新检查，见push_back
+        if (_producer_waiting != 0)
+        {
+            _producer_waiting = 0;
+            sys::futex_wake(&_producer_waiting, 1);
+        }
+
+        return true;
+    }
+
+    /***
+      * 从队首依次弹出多个元素，只能由消费者线程调用
+      * @elem_array: 存储弹出的队首元素数组
+      * @array_size: 输入和输出参数，存储实际弹出的元素个数，
+      *              如果小于输入值，表示队列已空且消费者已登记为等待
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    void pop_front(DataType* elem_array, uint32_t& array_size) throw (sys::CSyscallException)
+    {
+        uint32_t i = 0;
+
+        for (; i<array_size; ++i)
+        {
+            if (!pop_front(elem_array[i]))
+                break;
+        }
+
+        array_size = i;
+    }
+
+    /***
+      * 向队尾插入一元素，只能由生产者线程调用
+      * @elem: 待插入到队尾的元素
+      * @millisecond: 如果队列满，等待队列非满的毫秒数，如果为0则不等待，直接返回false
+      * @return: 如果队列已经满，则返回false，否则插入成功并返回true
+      * @exception: 如果出错，则抛出CSyscallException异常
+      */
+    bool push_back(DataType elem, uint32_t millisecond=0) throw (sys::CSyscallException)
+    {
+        uint64_t tail = _tail;
+
+        if (tail - __atomic_load_n(&_head, __ATOMIC_ACQUIRE) >= _capacity)
+        {
+            if (0 == millisecond)
+                return false;
+
+            uint64_t deadline = sys::get_monotonic_milliseconds() + millisecond;
+            while (tail - __atomic_load_n(&_head, __ATOMIC_ACQUIRE) >= _capacity)
+            {
+                uint64_t now = sys::get_monotonic_milliseconds();
+                if (now >= deadline)
+                    return false;
+
+                // 消费者检查_producer_waiting时没有屏障，可能错过唤醒，所以每次最多睡1毫秒
+                _producer_waiting = 1;
+                __sync_synchronize();
+                if (tail - __atomic_load_n(&_head, __ATOMIC_ACQUIRE) < _capacity)
+                    break;
+                (void)sys::futex_wait(&_producer_waiting, 1, 1);
+            }
+
+            _producer_waiting = 0;
+        }
+
+        _elems[tail & (_capacity-1)] = elem;
+        __atomic_store_n(&_tail, tail+1, __ATOMIC_RELEASE);
+
+        // 和prepare_wait中的屏障配对：要么消费者看到新数据，要么这里看到消费者在等待
+        __sync_synchronize();
+        if ((_consumer_waiting != 0) && __sync_bool_compare_and_swap(&_consumer_waiting, 1, 0))
+        {
+            uint64_t one = 1;
+            while (-1 == write(get_fd(), &one, sizeof(one)))
+            {
+                if (errno != EINTR)
+                    THROW_SYSCALL_EXCEPTION(NULL, errno, "write");
+            }
+        }
+
+        return true;
+    }
+
+private:
+    // 队列为空时调用，登记消费者将要等待，返回true表示登记后发现又有了数据
+    bool prepare_wait() throw (sys::CSyscallException)
+    {
+        if (_consumer_armed)
+        {
+            // 仍在等待中，生产者还未写eventfd
+            if (_consumer_waiting != 0)
+                return false;
+
+            // 生产者已写过eventfd，读走使其不再可读
+            uint64_t value;
+            while (-1 == read(get_fd(), &value, sizeof(value)))
+            {
+                if (EAGAIN == errno)
+                    break;
+                if (errno != EINTR)
+                    THROW_SYSCALL_EXCEPTION(NULL, errno, "read");
+            }
+        }
+
+        _consumer_armed = true;
+        __sync_lock_test_and_set(&_consumer_waiting, 1); // 带屏障
+        if (_head == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE))
+            return false;
+
+        // 又有了数据，撤销等待，如果撤销失败，说明生产者已写了eventfd，下次为空时再读走
+        if (__sync_bool_compare_and_swap(&_consumer_waiting, 1, 0))
+            _consumer_armed = false;
+        return true;
+    }
+
+private:
+    enum { CACHE_LINE_SIZE = 64 };
+
+    DataType* _elems;
+    uint32_t _capacity;
+    char _pad0[CACHE_LINE_SIZE];
+    volatile uint64_t _head; /** 只由消费者修改 */
+    char _pad1[CACHE_LINE_SIZE];
+    volatile uint64_t _tail; /** 只由生产者修改 */
+    char _pad2[CACHE_LINE_SIZE];
+    volatile int32_t _consumer_waiting; /** 为1表示消费者在等待，由生产者置0并写eventfd */
+    bool _consumer_armed;               /** 消费者登记过等待，且还未读走eventfd，只由消费者访问 */
+    volatile int32_t _producer_waiting; /** 为1表示生产者在等待队列非满 */
+};
+
 NET_NAMESPACE_END
 #endif // MOOON_NET_EPOLLABLE_QUEUE_H
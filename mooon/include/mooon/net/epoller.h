@@ -21,8 +21,18 @@
 #include <sys/epoll.h>
 #include "mooon/net/sensor.h"
 #include "mooon/net/epollable.h"
+#include "mooon/net/uring_poller.h"
 NET_NAMESPACE_BEGIN
 
+/***
+  * 事件引擎类型
+  */
+typedef enum
+{
+    poller_epoll = 0, /** Epoll */
+    poller_uring = 1  /** io_uring，见CUringPoller */
+}poller_engine_t;
+
 /***
   * Epoll操作封装类
   */
@@ -39,9 +49,11 @@ public:
     /***
       * 创建Epoll，进行初始化
       * @epoll_size: 建议性Epoll大小
+      * @engine: 事件引擎，为poller_uring时如果内核不支持io_uring，则仍使用Epoll，
+      *          实际使用的引擎可由get_engine得到
       * @exception: 如果出错，抛出CSyscallException异常
       */
-    void create(uint32_t epoll_size);
+    void create(uint32_t epoll_size, poller_engine_t engine=poller_epoll);
 
     /***
       * 销毁已经创建的Epoll
@@ -82,22 +94,32 @@ public:
       * @index: 编号，请注意index必须在timed_wait成功的返回值范围内
       * @return: 返回一个指向可Epoll对象的指针
       */
-    CEpollable* get(uint32_t index) const { return (CEpollable *)_events[index].data.ptr; }
+    CEpollable* get(uint32_t index) const
+    {
+        return (NULL == _uring_poller)? (CEpollable *)_events[index].data.ptr: _uring_poller->get(index);
+    }
 
     /***
       * 根据编号得到触发的Epoll事件
       * @index: 编号，请注意index必须在timed_wait成功的返回值范围内
       * @return: 返回发生的Epoll事件
       */
-    uint32_t get_events(uint32_t index) const { return _events[index].events; }
+    uint32_t get_events(uint32_t index) const
+    {
+        return (NULL == _uring_poller)? _events[index].events: _uring_poller->get_events(index);
+    }
 
     /***
       * 唤醒Epoll
       */
     void wakeup();
 
+    /** 得到实际使用的事件引擎 */
+    poller_engine_t get_engine() const { return (NULL == _uring_poller)? poller_epoll: poller_uring; }
+
 private:
     int _epfd;
+    CUringPoller* _uring_poller;
     CSensor _sensor;
     uint32_t _epoll_size;
     uint32_t _max_events;
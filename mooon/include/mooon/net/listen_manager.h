@@ -53,9 +53,10 @@ public:
 
     /***
       * 启动在所有IP和端口对上的监听
+      * @reuse_port: 是否设置SO_REUSEPORT，设置后多个监听者（如每个线程一个）可监听同一IP和端口
       * @exception: 如果出错，则抛出CSyscallException异常
       */
-    void create(bool nonblock=true)
+    void create(bool nonblock=true, bool reuse_port=false)
     {
         _listener_array = new ListenClass[_ip_port_array.size()];
 
@@ -63,7 +64,7 @@ public:
         {
             try
             {                
-                _listener_array[i].listen(_ip_port_array[i].first, _ip_port_array[i].second, nonblock);
+                _listener_array[i].listen(_ip_port_array[i].first, _ip_port_array[i].second, nonblock, false, reuse_port);
                 ++_listener_count;
             }
             catch (...)
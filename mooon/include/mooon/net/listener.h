@@ -50,10 +50,19 @@ public:
       * 接受连接请求
       * @peer_ip: 用来存储对端的IP地址
       * @peer_port: 用来存储对端端口号
-      * @return: 新的SOCKET句柄
+      * @flags: 传给accept4的标志，如SOCK_NONBLOCK|SOCK_CLOEXEC，可省去之后设置的系统调用
+      * @return: 新的SOCKET句柄，如果没有待接受的连接则返回-1
       * @exception: 如果发生错误，则抛出CSyscallException异常
       */
-    int accept(ip_address_t& peer_ip, uint16_t& peer_port) throw (sys::CSyscallException);
+    int accept(ip_address_t& peer_ip, uint16_t& peer_port, int flags=0) throw (sys::CSyscallException);
+
+    /***
+      * 设置SO_INCOMING_CPU，和SO_REUSEPORT一起使用时，
+      * 内核优先将在该CPU上收到的连接交给本监听者，应在listen之后调用
+      * @cpu: CPU编号
+      * @exception: 如果发生错误，则抛出CSyscallException异常，内核不支持时错误码为ENOPROTOOPT
+      */
+    void set_incoming_cpu(int cpu) throw (sys::CSyscallException);
     
     /** 得到监听的IP地址 */
     const ip_address_t& get_listen_ip() const throw () { return _ip; }
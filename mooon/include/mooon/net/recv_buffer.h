@@ -0,0 +1,87 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_RECV_BUFFER_H
+#define MOOON_NET_RECV_BUFFER_H
+#include "mooon/net/config.h"
+NET_NAMESPACE_BEGIN
+
+/***
+  * 接收Buffer，数据直接收到这里，由CRecvMachine就地解析，完整的消息以指针的形式交给处理者。
+  * 数据区为[读位置, 写位置)，写到末尾时将未处理完的数据移回开头（相当于环形Buffer的回绕），
+  * 未处理完的数据至多是一个不完整的消息，因此只有跨越回绕点的消息才需要复制，
+  * 消息比容量还大时扩容，保证任一消息在Buffer中都是连续的
+  */
+class CRecvBuffer
+{
+public:
+    /***
+      * @init_capacity: 初始容量
+      * @max_capacity: 最大容量，即允许的最大消息（含消息头）
+      */
+    explicit CRecvBuffer(size_t init_capacity=4096, size_t max_capacity=64*1024*1024);
+    ~CRecvBuffer();
+
+    /** 可写的位置，接收数据时用 */
+    char* write_ptr() const { return _buffer + _write_offset; }
+
+    /** 可写的字节数，为0时应先调用reserve */
+    size_t writable() const { return _capacity - _write_offset; }
+
+    /** 已往write_ptr()写入size字节 */
+    void commit(size_t size) { _write_offset += size; }
+
+    /** 未处理的数据 */
+    const char* read_ptr() const { return _buffer + _read_offset; }
+
+    /** 未处理的字节数 */
+    size_t readable() const { return _write_offset - _read_offset; }
+
+    /** 已处理size字节，全部处理完时回到开头，不需要复制 */
+    void consume(size_t size);
+
+    /***
+      * 保证至少有size字节可写，先尝试回绕，不够时再扩容
+      * @return 需要的容量超过最大容量时返回false
+      */
+    bool reserve(size_t size);
+
+    /** 丢弃所有数据，并释放超过初始容量的部分 */
+    void reset();
+
+    size_t capacity() const { return _capacity; }
+
+    /** 回绕和扩容时复制的字节数，用于观察 */
+    uint64_t get_copied_bytes() const { return _copied_bytes; }
+
+private:
+    CRecvBuffer(const CRecvBuffer&);
+    CRecvBuffer& operator =(const CRecvBuffer&);
+
+private:
+    char* _buffer;
+    size_t _capacity;
+    size_t _init_capacity;
+    size_t _max_capacity;
+    size_t _read_offset;
+    size_t _write_offset;
+    uint64_t _copied_bytes;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_RECV_BUFFER_H
@@ -19,6 +19,7 @@
 #ifndef MOOON_NET_RECV_MACHINE_H
 #define MOOON_NET_RECV_MACHINE_H
 #include <mooon/net/config.h>
+#include <mooon/net/recv_buffer.h>
 NET_NAMESPACE_BEGIN
 
 /***
@@ -93,9 +94,24 @@ public:
     // buffer还包含第二个包的部分时，也是返回utils::handle_continue
     utils::handle_result_t work(const char* buffer, size_t buffer_size);
 
+    // 就地解析接收Buffer中的数据，只复制消息头，不复制消息体：
+    // 每个完整的消息依次回调on_header(header)和on_message(header, 0, body, header.size)，
+    // body指向recv_buffer内部，只在回调期间有效，处理后从recv_buffer中移除；
+    // 不完整的消息留在recv_buffer中，并保证有足够的空间接收它余下的部分。
+    // 返回值同work(buffer, buffer_size)，消息超过recv_buffer的最大容量时返回utils::handle_error。
+    // 注意：同一个状态机不能混用两个work
+    utils::handle_result_t work(CRecvBuffer* recv_buffer);
+
     // 复位状态，再次以包头开始
     void reset();
 
+    // 是否在消息的边界上，即没有只收到一部分的消息头或消息体，只适用于work(buffer, buffer_size)，
+    // 注意work的返回值不能用来判断，数据刚好用完时即使消息不完整也返回utils::handle_finish
+    bool is_idle() const
+    {
+        return (rs_header == _current_recv_state) && (0 == _finished_size);
+    }
+
 private:
     void set_next_state(recv_state_t next_state);
     utils::handle_result_t handle_header(const RecvStateContext& cur_ctx, RecvStateContext* next_ctx);
@@ -150,6 +166,55 @@ utils::handle_result_t CRecvMachine<MessageHeaderType, ProcessorManager>::work(
     return hr;
 }
 
+template <typename MessageHeaderType, class ProcessorManager>
+utils::handle_result_t CRecvMachine<MessageHeaderType, ProcessorManager>::work(
+    CRecvBuffer* recv_buffer)
+{
+    // 每次接收至少能收这么多，避免Buffer尾部只剩几个字节时频繁地小读
+    static const size_t min_recv_size = 1024;
+
+    for (;;)
+    {
+        size_t data_size = recv_buffer->readable();
+        size_t need_size = sizeof(MessageHeaderType);
+
+        if (data_size >= sizeof(MessageHeaderType))
+        {
+            // 消息在Buffer中的位置不一定按MessageHeaderType对齐，所以只复制固定大小的消息头，消息体仍就地引用
+            memcpy(reinterpret_cast<char*>(&_header), recv_buffer->read_ptr(), sizeof(MessageHeaderType));
+            need_size = sizeof(MessageHeaderType) + _header.size;
+
+            if (data_size >= need_size)
+            {
+                const char* body = (_header.size > 0)? recv_buffer->read_ptr() + sizeof(MessageHeaderType): NULL;
+                if (!_processor_manager->on_header(_header)
+                 || !_processor_manager->on_message(_header, 0, body, _header.size))
+                {
+                    return utils::handle_error;
+                }
+
+                recv_buffer->consume(need_size);
+                continue;
+            }
+        }
+
+        if (0 == data_size)
+        {
+            // 刚好到包的边界
+            return utils::handle_finish;
+        }
+
+        need_size -= data_size;
+        if (!recv_buffer->reserve((need_size < min_recv_size)? min_recv_size: need_size)
+         && !recv_buffer->reserve(need_size))
+        {
+            return utils::handle_error;
+        }
+
+        return utils::handle_continue;
+    }
+}
+
 template <typename MessageHeaderType, class ProcessorManager>
 void CRecvMachine<MessageHeaderType, ProcessorManager>::set_next_state(
     recv_state_t next_state)
@@ -0,0 +1,226 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_RESOLVER_H
+#define MOOON_NET_RESOLVER_H
+#include "mooon/net/epollable_queue.h"
+#include "mooon/sys/event.h"
+#include "mooon/sys/lock.h"
+#include "mooon/sys/thread_engine.h"
+#include <list>
+#include <map>
+NET_NAMESPACE_BEGIN
+
+/** 异步解析的结果，调用者从完成队列中取出后负责delete */
+typedef struct
+{
+    std::string hostname;
+    bool success;
+    string_ip_array_t ip_array;
+    std::string errinfo;
+    void* context; /** async_resolve时传入的参数 */
+}resolve_result_t;
+
+/***
+  * 完成队列使用的不限大小的原始队列，满足CEventfdQueue对RawQueueClass的要求，
+  * 后台线程放入结果时既不能等待（消费者可能正在stop中等它），也不能丢弃（context将无法带回），
+  * 所以不限大小，元素个数受同时进行的异步解析数限制
+  */
+class CResolveList
+{
+public:
+    typedef resolve_result_t* _DataType;
+
+    /** queue_max只为和CArrayQueue的构造参数一致，不限制大小 */
+    CResolveList(uint32_t queue_max)
+        :_size(0)
+    {
+    }
+
+    bool is_full() const { return false; }
+    bool is_empty() const { return 0 == _size; }
+    uint32_t size() const { return _size; }
+
+    _DataType front() const
+    {
+        return _list.front();
+    }
+
+    _DataType pop_front()
+    {
+        _DataType elem = _list.front();
+        _list.pop_front();
+        --_size;
+        return elem;
+    }
+
+    void push_back(_DataType elem)
+    {
+        _list.push_back(elem);
+        ++_size;
+    }
+
+private:
+    uint32_t _size; // std::list::size()可能是O(n)的
+    std::list<_DataType> _list;
+};
+
+/***
+  * 异步解析的完成队列，可放入CEpoller监控读事件，有解析结果时可读，
+  * 通常每个事件循环线程一个，不限大小，每个async_resolve都一定会有一个结果放入
+  */
+typedef CEventfdQueue<CResolveList> CResolveQueue;
+
+/** 解析器的统计 */
+typedef struct
+{
+    uint64_t hit_number;             /** 命中未过期的成功结果 */
+    uint64_t stale_hit_number;       /** 命中已过期但仍可用的成功结果，同时触发后台刷新 */
+    uint64_t negative_hit_number;    /** 命中失败的结果 */
+    uint64_t miss_number;            /** 未命中 */
+    uint64_t resolve_number;         /** 实际解析的次数 */
+    uint64_t resolve_failure_number; /** 实际解析失败的次数 */
+    uint64_t resolve_microseconds;   /** 实际解析的累计微秒数 */
+}resolver_stats_t;
+
+/***
+  * 带缓存的域名解析器，解决CUtils::get_ip_address每次都同步调用getaddrinfo的问题，
+  * 可在多个线程间共享
+  *
+  * 1) 成功的结果缓存ttl_seconds秒，失败的结果缓存negative_ttl_seconds秒（负缓存），
+  *    避免不存在的域名反复解析
+  * 2) 成功的结果过期后的stale_seconds秒内仍然可用，使用时由后台线程刷新，
+  *    刷新失败时保留原结果，因此DNS短暂不可用时不影响已解析过的域名
+  * 3) 事件循环线程使用lookup和async_resolve，不会因为解析而阻塞：
+  *    if (!resolver.lookup(hostname, &ip_array))
+  *        resolver.async_resolve(hostname, &resolve_queue, context);
+  *    resolve_queue可读时取出resolve_result_t处理并delete
+  * 4) IP地址不解析也不缓存，直接返回
+  * 5) 派生类重写了do_resolve时，须在自己的析构函数中调用stop()，
+  *    因为~CResolver调用stop()时派生类部分已析构，后台线程仍可能在调用do_resolve
+  */
+class CResolver
+{
+public:
+    /***
+      * @ttl_seconds: 成功的结果缓存的秒数
+      * @negative_ttl_seconds: 失败的结果缓存的秒数，期间直接返回失败，为0表示不缓存失败的结果
+      * @stale_seconds: 成功的结果过期后仍然可用的秒数，超过后须重新解析
+      */
+    CResolver(uint32_t ttl_seconds=60, uint32_t negative_ttl_seconds=5, uint32_t stale_seconds=300);
+    virtual ~CResolver();
+
+    /***
+      * 启动后台解析线程，async_resolve和后台刷新依赖它，只调用resolve时可不启动
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void start(uint16_t thread_number=1) throw (sys::CSyscallException);
+
+    /***
+      * 停止后台解析线程，未完成的异步解析以失败结果完成，
+      * 完成队列不限大小，所以也可在拥有完成队列的事件循环线程中调用
+      */
+    void stop();
+
+    /***
+      * 同步解析，命中缓存（包括已过期但仍可用的）时不阻塞，否则阻塞调用getaddrinfo并缓存结果
+      * @return: 成功返回true，否则返回false，errinfo为出错信息
+      */
+    bool resolve(const std::string& hostname, string_ip_array_t* ip_array, std::string* errinfo=NULL);
+
+    /***
+      * 只查缓存，不阻塞，命中成功的结果时返回true，
+      * 未命中时提交后台解析（如果已start）并返回false，命中失败的结果也返回false
+      */
+    bool lookup(const std::string& hostname, string_ip_array_t* ip_array);
+
+    /***
+      * 异步解析，结果放入queue，不阻塞，
+      * 缓存中有结果时由本调用直接放入，否则由后台线程解析后放入，同一域名的并发请求只解析一次，
+      * 每次调用都一定有且只有一个结果放入queue
+      * @context: 原样带回给resolve_result_t::context
+      */
+    void async_resolve(const std::string& hostname, CResolveQueue* queue, void* context);
+
+    /** 得到统计 */
+    void get_stats(resolver_stats_t* stats) const;
+
+    /** 清空缓存 */
+    void clear();
+
+private:
+    /***
+      * 实际的解析，默认调用CUtils::get_ip_address，可重写以便测试
+      * 会被多个线程同时调用
+      */
+    virtual bool do_resolve(const std::string& hostname, string_ip_array_t* ip_array, std::string* errinfo);
+
+private:
+    typedef struct
+    {
+        bool success;
+        string_ip_array_t ip_array;
+        std::string errinfo;
+        uint64_t expire_seconds; // 过期时间
+        uint64_t stale_seconds;  // 可用的截止时间，失败的结果和expire_seconds相同
+    }entry_t;
+
+    typedef struct
+    {
+        CResolveQueue* queue;
+        void* context;
+    }waiter_t;
+
+    typedef enum
+    {
+        entry_fresh,    // 未过期
+        entry_stale,    // 已过期但仍可用
+        entry_negative, // 未过期的失败结果
+        entry_missing   // 没有或已不可用
+    }entry_state_t;
+
+    entry_state_t find_entry(const std::string& hostname, uint64_t now, string_ip_array_t* ip_array, std::string* errinfo);
+    void store_entry(const std::string& hostname, bool success, const string_ip_array_t& ip_array, const std::string& errinfo);
+    void submit(const std::string& hostname);
+    bool timed_resolve(const std::string& hostname, string_ip_array_t* ip_array, std::string* errinfo);
+    void run();
+
+    static uint64_t get_seconds();
+    void complete(const waiter_t& waiter, const std::string& hostname, bool success, const string_ip_array_t& ip_array, const std::string& errinfo);
+
+private:
+    CResolver(const CResolver&);
+    CResolver& operator =(const CResolver&);
+
+private:
+    uint32_t _ttl_seconds;
+    uint32_t _negative_ttl_seconds;
+    uint32_t _stale_seconds;
+
+    mutable sys::CLock _lock;
+    sys::CEvent _event;
+    bool _stop;
+    std::vector<sys::CThreadEngine*> _threads;
+    resolver_stats_t _stats;
+    std::map<std::string, entry_t> _cache;
+    std::map<std::string, std::vector<waiter_t> > _pending_table; // 已提交解析的域名和等待结果的请求
+    std::list<std::string> _request_list;                         // 待后台线程解析的域名
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_RESOLVER_H
@@ -19,18 +19,71 @@
 #ifndef MOOON_NET_SEND_MACHINE_H
 #define MOOON_NET_SEND_MACHINE_H
 #include <mooon/net/config.h>
+#include <mooon/sys/ref_countable.h>
+#include <deque>
+#include <limits.h>
+#include <sys/uio.h>
 NET_NAMESPACE_BEGIN
 
+/***
+  * 发送状态机，有两种用法：
+  * 1) 单消息：send发送一个消息，未发完时continue_send，发完后reset；
+  * 2) 发送队列：push多个消息入队，flush用一次writev发送至多IOV_MAX段，
+  *    跨段的部分发送由状态机跟踪，每个消息只有完全发出后才释放。
+  * 两种用法不要混用。
+  * Connector须提供send(const char*, size_t)和writev(const struct iovec*, int)，
+  * 不可写时返回-1，出错抛出CSyscallException，如net::CTcpClient
+  */
 template <class Connector>
 class CSendMachine
 {
 public:
     CSendMachine(Connector* connector);
+    ~CSendMachine();
     bool is_finish() const;
     utils::handle_result_t continue_send();
     utils::handle_result_t send(const char* msg, size_t msg_size);
     void reset(bool delete_message);
-    
+
+public:
+    /***
+      * 消息入队，不发送
+      * @own: 为true时msg必须是new char[]出来的，发送完或reset时delete []它；
+      *       为false时是借用的，调用者须保证发送完之前msg有效
+      */
+    void push(const char* msg, size_t msg_size, bool own);
+
+    /***
+      * 引用计数的消息入队，入队时对ref_countable增加引用，发送完或reset时减少引用，
+      * 用于同一个消息发给多个连接，msg通常指向ref_countable内部
+      */
+    void push(const char* msg, size_t msg_size, sys::CRefCountable* ref_countable);
+
+    /***
+      * 发送队列中的消息，直到队列为空或不可写
+      * @return 队列为空返回utils::handle_finish，否则返回utils::handle_continue，
+      *         出错时抛出CSyscallException
+      */
+    utils::handle_result_t flush();
+
+    /** 队列中的消息个数，含部分发送的 */
+    size_t get_queued_number() const { return _queue.size(); }
+
+    /** 队列中待发送的字节数 */
+    size_t get_queued_bytes() const { return _queued_bytes; }
+
+private:
+    struct QueuedMessage
+    {
+        const char* data;
+        size_t size;
+        size_t offset;                     // 已发送的字节数
+        bool own;
+        sys::CRefCountable* ref_countable; // 不为NULL时是引用计数的消息
+    };
+
+    void release(QueuedMessage& queued_message);
+
 private:
     Connector* _connector;
     
@@ -38,20 +91,36 @@ private:
     const char* _message;
     const char* _cursor;
     size_t _remain_size;    
+
+private:
+    std::deque<QueuedMessage> _queue;
+    size_t _queued_bytes;
 };
 
 template <class Connector>
 CSendMachine<Connector>::CSendMachine(Connector* connector)
  :_connector(connector) 
+ ,_queued_bytes(0)
 {
     reset(false);
 }
 
-// 当前消息是否已经发送完
+template <class Connector>
+CSendMachine<Connector>::~CSendMachine()
+{
+    // 只释放队列中的，send的消息由调用者通过reset释放
+    while (!_queue.empty())
+    {
+        release(_queue.front());
+        _queue.pop_front();
+    }
+}
+
+// 当前消息是否已经发送完，使用队列时为队列是否为空
 template <class Connector>
 bool CSendMachine<Connector>::is_finish() const
 {
-    return 0 == _remain_size;
+    return (0 == _remain_size) && _queue.empty();
 }
 
 // 发送消息，可能是一个消息的第一次发送，也可能是一个消息的非第一次发送
@@ -84,6 +153,8 @@ utils::handle_result_t CSendMachine<Connector>::send(const char* msg, size_t msg
     return continue_send();
 }
 
+// 复位，队列中的消息按各自的所有权释放，
+// delete_message只针对send的消息
 template <class Connector>
 void CSendMachine<Connector>::reset(bool delete_message)
 {
@@ -93,6 +164,102 @@ void CSendMachine<Connector>::reset(bool delete_message)
     _message = NULL;
     _cursor = NULL;
     _remain_size = 0;
+
+    while (!_queue.empty())
+    {
+        release(_queue.front());
+        _queue.pop_front();
+    }
+    _queued_bytes = 0;
+}
+
+template <class Connector>
+void CSendMachine<Connector>::push(const char* msg, size_t msg_size, bool own)
+{
+    QueuedMessage queued_message;
+    queued_message.data = msg;
+    queued_message.size = msg_size;
+    queued_message.offset = 0;
+    queued_message.own = own;
+    queued_message.ref_countable = NULL;
+
+    _queue.push_back(queued_message);
+    _queued_bytes += msg_size;
+}
+
+template <class Connector>
+void CSendMachine<Connector>::push(const char* msg, size_t msg_size, sys::CRefCountable* ref_countable)
+{
+    QueuedMessage queued_message;
+    queued_message.data = msg;
+    queued_message.size = msg_size;
+    queued_message.offset = 0;
+    queued_message.own = false;
+    queued_message.ref_countable = ref_countable;
+
+    ref_countable->inc_refcount();
+    _queue.push_back(queued_message);
+    _queued_bytes += msg_size;
+}
+
+template <class Connector>
+utils::handle_result_t CSendMachine<Connector>::flush()
+{
+    struct iovec iov[IOV_MAX];
+
+    while (!_queue.empty())
+    {
+        // 从队首开始收集，第一段可能是上次部分发送的
+        int iovcnt = 0;
+        size_t total = 0;
+        for (typename std::deque<QueuedMessage>::iterator iter=_queue.begin()
+            ; (iter!=_queue.end()) && (iovcnt<IOV_MAX)
+            ; ++iter)
+        {
+            iov[iovcnt].iov_base = const_cast<char*>(iter->data + iter->offset);
+            iov[iovcnt].iov_len = iter->size - iter->offset;
+            total += iov[iovcnt].iov_len;
+            ++iovcnt;
+        }
+
+        ssize_t bytes_sent = (0 == total)? 0: _connector->writev(iov, iovcnt);
+        if (-1 == bytes_sent)
+            break; // 不可写
+
+        // 释放完全发出的消息，最后一个可能只发了一部分
+        size_t remain_bytes = (size_t)bytes_sent;
+        _queued_bytes -= remain_bytes;
+        while (!_queue.empty())
+        {
+            QueuedMessage& front = _queue.front();
+            size_t size = front.size - front.offset;
+            if (remain_bytes < size)
+            {
+                front.offset += remain_bytes;
+                break;
+            }
+
+            remain_bytes -= size;
+            release(front);
+            _queue.pop_front();
+        }
+
+        if ((size_t)bytes_sent < total)
+            break; // 没有全部写入，Socket缓冲区已满
+    }
+
+    return _queue.empty()
+         ? utils::handle_finish
+         : utils::handle_continue;
+}
+
+template <class Connector>
+void CSendMachine<Connector>::release(QueuedMessage& queued_message)
+{
+    if (queued_message.ref_countable != NULL)
+        queued_message.ref_countable->dec_refcount();
+    else if (queued_message.own)
+        delete []queued_message.data;
 }
 
 NET_NAMESPACE_END
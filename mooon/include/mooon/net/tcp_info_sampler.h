@@ -0,0 +1,169 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ *
+ * 定期采样连接的TCP_INFO，按线程汇总成直方图，用于区分延迟是来自网络还是来自程序
+ */
+#ifndef MOOON_NET_TCP_INFO_SAMPLER_H
+#define MOOON_NET_TCP_INFO_SAMPLER_H
+#include "mooon/net/config.h"
+#include <string>
+#include <vector>
+NET_NAMESPACE_BEGIN
+
+/** 采样的指标 */
+typedef enum
+{
+    tcp_info_rtt = 0,     /** 平滑后的RTT，单位为微秒 */
+    tcp_info_rttvar,      /** RTT的偏差，单位为微秒 */
+    tcp_info_retransmits, /** 采样时已重传但还未被确认的段数 */
+    tcp_info_cwnd,        /** 拥塞窗口，单位为段 */
+    tcp_info_unacked,     /** 已发送但还未被确认的字节数（未确认段数乘以MSS） */
+    tcp_info_send_queue,  /** 发送缓冲区中还未发送的字节数 */
+    tcp_info_metric_number
+}tcp_info_metric_t;
+
+/** 一次采样，下标为tcp_info_metric_t */
+typedef struct
+{
+    uint32_t values[tcp_info_metric_number];
+}tcp_info_sample_t;
+
+/** 直方图的桶数，第0个桶记录值0，第i个桶记录[2^(i-1), 2^i)之间的值 */
+#define TCP_INFO_BUCKET_NUMBER 33
+
+/** 一个指标的直方图 */
+typedef struct
+{
+    uint64_t buckets[TCP_INFO_BUCKET_NUMBER];
+    uint64_t sum; /** 所有采样值的和，除以采样次数为平均值 */
+    uint32_t max; /** 最大的采样值 */
+}tcp_info_histogram_t;
+
+/** 采样的统计，均为累计值 */
+typedef struct
+{
+    uint64_t sample_number;  /** 采样次数 */
+    uint64_t failure_number; /** 采样失败次数，如连接已断开 */
+    uint64_t skip_number;    /** 到了采样时间，但因超出每秒采样数而跳过的次数 */
+    tcp_info_histogram_t histograms[tcp_info_metric_number];
+}tcp_info_stats_t;
+
+/***
+  * TCP_INFO采样器，每个事件循环线程一个，只由所在线程采样，统计可在任意线程中读取
+  *
+  * 连接有事件时调用sample，距该连接上一次采样超过interval_milliseconds时采样一次，
+  * 同时每秒采样的次数不超过max_samples_per_second，因此10万连接时的开销也是有界的，
+  * 每次采样为一次getsockopt(TCP_INFO)和一次ioctl(SIOCOUTQNSD)。
+  * 指定了名字的采样器登记到全局表中，可由get_all_stats取得，同名的被累加，
+  * 通常以线程名命名（如"server.0"），以得到各线程的直方图。
+  * 使用方法：
+  * sampler.set_name("server.0");
+  * sampler.set_sampling(10000, 1000);
+  * sampler.sample(fd, &connection->next_sample_milliseconds, now_milliseconds);
+  */
+class CTcpInfoSampler
+{
+public:
+    CTcpInfoSampler();
+    ~CTcpInfoSampler();
+
+    /***
+      * 设置名字并登记到全局表，只可调用一次
+      * @name: 名字，为空表示不登记
+      */
+    void set_name(const std::string& name);
+
+    /** 得到名字 */
+    const std::string& get_name() const { return _name; }
+
+    /***
+      * 设置采样频率，可在任意线程中调用
+      * @interval_milliseconds: 同一连接两次采样的最小间隔毫秒数，为0表示不采样
+      * @max_samples_per_second: 每秒最多采样的次数，为0表示不限制
+      */
+    void set_sampling(uint32_t interval_milliseconds, uint32_t max_samples_per_second);
+
+    /** 是否开启了采样 */
+    bool is_enabled() const { return _interval_milliseconds > 0; }
+
+    /***
+      * 到了连接的采样时间时采样，只可在所在线程中调用
+      * @fd: 连接的fd
+      * @next_sample_milliseconds: 连接的下一次采样时间，由调用者为每个连接保存，新连接为0
+      * @now_milliseconds: 当前的单调时钟毫秒数
+      * @return: 采样了返回true，否则返回false
+      */
+    bool sample(int fd, uint64_t* next_sample_milliseconds, uint64_t now_milliseconds)
+    {
+        if ((0 == _interval_milliseconds) || (now_milliseconds < *next_sample_milliseconds))
+            return false;
+        return do_sample(fd, next_sample_milliseconds, now_milliseconds);
+    }
+
+    /** 将一次采样加入直方图，只可在所在线程中调用 */
+    void add_sample(const tcp_info_sample_t& sample);
+
+    /** 得到本采样器的统计 */
+    void get_stats(tcp_info_stats_t* stats) const;
+
+public:
+    /***
+      * 取得连接的TCP_INFO
+      * @return: 成功返回true，否则返回false（如不是TCP连接）
+      */
+    static bool get_tcp_info(int fd, tcp_info_sample_t* sample);
+
+    /***
+      * 得到所有登记的采样器的统计，同名的被累加，按名字排序
+      */
+    static void get_all_stats(std::vector<std::pair<std::string, tcp_info_stats_t> >* all_stats);
+
+    /***
+      * 得到直方图的百分位数，为所在桶的上界，但不超过最大值
+      * @percentile: 百分位，如50、99
+      */
+    static uint32_t get_percentile(const tcp_info_histogram_t& histogram, uint64_t sample_number, double percentile);
+
+    /***
+      * 对统计做减法，得到两次读取之间的增量，
+      * 增量的max为最高的非空桶的上界，但不超过after的max
+      */
+    static void subtract_stats(const tcp_info_stats_t& after, const tcp_info_stats_t& before, tcp_info_stats_t* delta);
+
+private:
+    bool do_sample(int fd, uint64_t* next_sample_milliseconds, uint64_t now_milliseconds);
+    void register_stats();
+    void deregister_stats();
+
+private:
+    CTcpInfoSampler(const CTcpInfoSampler&);
+    CTcpInfoSampler& operator =(const CTcpInfoSampler&);
+
+private:
+    std::string _name;
+    volatile uint32_t _interval_milliseconds;
+    volatile uint32_t _max_samples_per_second;
+    uint64_t _current_second;   // 当前计数的秒
+    uint32_t _current_samples;  // 当前秒内已采样的次数
+    tcp_info_stats_t _stats;
+    CTcpInfoSampler* _prev; // 全局登记表的双向链表
+    CTcpInfoSampler* _next;
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_TCP_INFO_SAMPLER_H
@@ -117,6 +117,11 @@ public:
       * @count: 需要发送的大小
       */
     ssize_t send_file(int file_fd, off_t *offset, size_t count);
+
+    /** 完整发送文件，使用sendfile，文件不支持sendfile时改用pread加send
+      * @count: 需要发送的大小，返回实际已经发送了的字节数(不管成功还是失败或异常)
+      * @exception: 对于非阻塞连接，不能继续发送时抛出错误码为EAGAIN的CSyscallException异常
+      */
     void full_send_file(int file_fd, off_t *offset, size_t& count);
 
     /** 采用内存映射的方式接收，并将数据存放文件，适合文件不是太大
@@ -128,12 +133,13 @@ public:
       */
     bool full_map_tofile(int file_fd, size_t& size, size_t offset);
 
-    /** 采用write调用的方式接收，并将数据存放文件，适合任意大小的文件，但是大文件会导致该调用长时间阻塞
+    /** 接收数据并写入文件，适合任意大小的文件，但是大文件会导致该调用长时间阻塞，
+      * 较大的数据经管道splice到文件，不经过用户空间，不支持splice时改用缓冲区接收再pwrite
       * @file_fd: 打开的文件句柄
-      * @size: 需要写入文件的大小，返回实际已经接收到的字节数(不管成功还是失败或异常)
+      * @size: 需要写入文件的大小，返回实际已经接收并写入文件的字节数(不管成功还是失败或异常)
       * @offset: 写入文件的偏移值
-      * @return: 如果连接被对端关闭，则返回false否则成功返回true
-      * @exception: 如果发生系统调用错误，则抛出CSyscallException异常
+      * @return: 全部接收完返回true；对于非阻塞连接，如果暂无数据可接收则返回false
+      * @exception: 如果连接被对端关闭或发生系统调用错误，则抛出CSyscallException异常
       */
     bool full_write_tofile(int file_fd, size_t& size, size_t offset);
 
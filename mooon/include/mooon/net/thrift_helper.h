@@ -21,6 +21,7 @@
 #ifndef MOOON_NET_THRIFT_HELPER_H
 #define MOOON_NET_THRIFT_HELPER_H
 #include <mooon/net/config.h>
+#include <mooon/net/utils.h>
 #include <mooon/sys/log.h>
 #include <mooon/utils/string_utils.h>
 #include <mooon/utils/scoped_ptr.h>
@@ -171,6 +172,75 @@ private:
     boost::shared_ptr<ThriftClient> _client;
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// CThriftClientHelper的连接工厂，用于connection_pool.h中的CConnectionPool，
+// 连接池按地址共享连接，避免每个线程各持一个连接或者每次调用都重新连接
+//
+// 使用示例：
+// typedef mooon::net::CThriftClientFactory<ExampleServiceClient> ExampleFactory;
+// typedef mooon::net::CThriftClientHelper<ExampleServiceClient> ExampleClient;
+// mooon::net::CConnectionPool<ExampleClient, ExampleFactory> pool(config, ExampleFactory(2000, 2000, 2000));
+// mooon::net::CPooledConnection<ExampleClient, ExampleFactory> client(&pool, rpc_server_ip, rpc_server_port);
+// try
+// {
+//     (*client)->foo();
+// }
+// catch (apache::thrift::transport::TTransportException& ex)
+// {
+//     client.set_broken(); // 连接已不可用，不放回池中
+// }
+template <class ThriftClient,
+          class Protocol=apache::thrift::protocol::TBinaryProtocol,
+          class Transport=apache::thrift::transport::TFramedTransport>
+class CThriftClientFactory
+{
+public:
+    typedef CThriftClientHelper<ThriftClient, Protocol, Transport> Connection;
+
+    CThriftClientFactory(int connect_timeout_milliseconds=2000,
+                         int receive_timeout_milliseconds=2000,
+                         int send_timeout_milliseconds=2000)
+        : _connect_timeout_milliseconds(connect_timeout_milliseconds),
+          _receive_timeout_milliseconds(receive_timeout_milliseconds),
+          _send_timeout_milliseconds(send_timeout_milliseconds)
+    {
+    }
+
+    // 出错时抛出thrift异常
+    Connection* create(const std::string& host, uint16_t port)
+    {
+        mooon::utils::ScopedPtr<Connection> connection(
+            new Connection(host, port, _connect_timeout_milliseconds, _receive_timeout_milliseconds, _send_timeout_milliseconds));
+        connection->connect();
+        return connection.release();
+    }
+
+    // 对端已关闭或者有残留的未读数据，都不能再用
+    bool validate(Connection* connection)
+    {
+        return connection->is_connected()
+            && CUtils::is_socket_alive(connection->get_socket()->getSocketFD());
+    }
+
+    void destroy(Connection* connection)
+    {
+        try
+        {
+            connection->close();
+        }
+        catch (apache::thrift::TException&)
+        {
+        }
+
+        delete connection;
+    }
+
+private:
+    int _connect_timeout_milliseconds;
+    int _receive_timeout_milliseconds;
+    int _send_timeout_milliseconds;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // thrift服务端辅助类
 //
@@ -21,6 +21,16 @@
 #include "mooon/net/epollable.h"
 NET_NAMESPACE_BEGIN
 
+// 批量收发时的一个数据报
+typedef struct
+{
+    void* buffer;            // 收：接收Buffer；发：待发送的数据
+    size_t buffer_size;      // 收：Buffer大小；发：待发送的字节数
+    size_t bytes;            // 实际收到或发出的字节数
+    int flags;               // 收到时的msg_flags，如为MSG_TRUNC表示数据报比buffer_size大，多出的部分被丢弃
+    struct sockaddr_in addr; // 收：对端地址；发：目标地址
+}udp_datagram_t;
+
 // UDP不分服务端和客户端，
 // 但如果仅做服务端或即做服务端又做客户端时，都必须调用listen()，
 // 仅做客户端使用时，可不必调用listen()
@@ -52,6 +62,21 @@ public:
 
     int timed_receive_from(void* buffer, size_t buffer_size, uint32_t* from_ip, uint16_t* from_port, uint32_t milliseconds) throw (sys::CSyscallException);
     int timed_receive_from(void* buffer, size_t buffer_size, struct sockaddr_in* from_addr, uint32_t milliseconds) throw (sys::CSyscallException);
+
+    // 批量接收，一次recvmmsg系统调用最多收取number个数据报，适合小包高频的场景，
+    // 如果wait_for_one为true（MSG_WAITFORONE），则阻塞模式下只等待第一个数据报，之后有多少收多少，不再等待；
+    // 为false时阻塞模式下须收满number个才返回
+    // 出错抛出异常，成功返回收到的数据报个数，如果返回-1表示为非阻塞模式没有数据可接收
+    int receive_batch(udp_datagram_t* datagrams, int number, bool wait_for_one=true) throw (sys::CSyscallException);
+
+    // 超时批量接收，等待第一个数据报最多milliseconds毫秒，超时抛出错误码为ETIMEDOUT的异常，
+    // 之后只收取已到达的数据报，不会再等待
+    // 注意不使用recvmmsg自带的timeout参数，它只在收到一个数据报后才检查，没有数据时并不会超时
+    int timed_receive_batch(udp_datagram_t* datagrams, int number, uint32_t milliseconds) throw (sys::CSyscallException);
+
+    // 批量发送，一次sendmmsg系统调用最多发送number个数据报，
+    // 出错抛出异常，成功返回发出的数据报个数（可能小于number），如果返回-1表示为非阻塞模式一个也没有发出
+    int send_batch(udp_datagram_t* datagrams, int number) throw (sys::CSyscallException);
 };
 
 NET_NAMESPACE_END
@@ -0,0 +1,177 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_NET_URING_POLLER_H
+#define MOOON_NET_URING_POLLER_H
+#include <sys/epoll.h>
+#include <map>
+#include <vector>
+#include "mooon/net/epollable.h"
+NET_NAMESPACE_BEGIN
+
+/***
+  * 基于io_uring的事件引擎，接口和CEpoller相同，可由CEpoller::create按配置选用，
+  * 不依赖liburing，直接使用io_uring_setup/io_uring_enter系统调用（需要Linux 5.19及以上）
+  *
+  * 1) 就绪通知：每个对象提交一个单次的IORING_OP_POLL_ADD，触发后在下一次timed_wait时重新提交，
+  *    提交时内核会立即检查一次，因此和Epoll的水平触发语义一致，
+  *    handle_epoll_event一次没有读完的数据，下一轮仍会通知；
+  *    set_events、del_events和重新提交只是放入提交队列，和等待一起由一次io_uring_enter完成，
+  *    相比Epoll每次修改事件都要调用一次epoll_ctl，减少了系统调用次数
+  * 2) 完成通知：accept_multishot和recv_multishot由内核持续地接受连接和接收数据，
+  *    结果随事件一起返回（get_result和get_buffer），不需要再调用accept和recv，
+  *    接收的数据放在create时注册给内核的Buffer（provided buffer ring）中
+  *
+  * 注意和Epoll的区别：
+  * 1) 内核中未完成的请求持有文件的引用，因此关闭句柄前必须先调用del_events，否则连接不会真正关闭
+  * 2) 提交队列不加锁，timed_wait、set_events和del_events只能由同一个线程调用（wakeup除外），
+  *    可以在别的线程中create和set_events，但第一次timed_wait之后就只能由该线程调用
+  * 3) 同一对象可以同时登记到多个io_uring（如多个工作线程共享的监听者），
+  *    是否已提交POLL_ADD和是否待重新提交按io_uring分别记录
+  */
+class CUringPoller
+{
+public:
+    CUringPoller();
+    ~CUringPoller();
+
+    /***
+      * 创建io_uring
+      * @max_events: timed_wait一次最多返回的事件数
+      * @buffer_number: 注册给内核的接收Buffer个数，为0时不能使用recv_multishot
+      * @buffer_size: 每个接收Buffer的大小
+      * @exception: 如果出错，抛出CSyscallException异常，
+      *             内核不支持io_uring或版本过低时错误码为ENOSYS，调用者可改用CEpoller
+      */
+    void create(uint32_t max_events, uint16_t buffer_number=0, uint32_t buffer_size=0);
+
+    /***
+      * 销毁已经创建的io_uring，内核中未完成的请求全部取消
+      * 不会抛出任何异常
+      */
+    void destroy();
+
+    /***
+      * 提交所有排队的请求，并以超时方式等待事件，语义同CEpoller::timed_wait，
+      * 上一次timed_wait返回的接收Buffer在这里归还给内核，因此get_buffer得到的数据只在本轮有效
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    int timed_wait(uint32_t milliseconds);
+
+    /***
+      * 设置或修改对象的就绪事件，语义同CEpoller::set_events，请求放入提交队列
+      * @old_events: 对象原来的事件，为-1表示新加入，
+      *              对象已在本io_uring中时，为-1表示句柄被重新打开或强制重新加入，会先取消原来的POLL_ADD，
+      *              对象不在本io_uring中时总是新加入，和old_events无关
+      */
+    void set_events(CEpollable* epollable, int old_events, int events);
+
+    /***
+      * 取消对象的所有请求，包括尚未被取走的事件，之后不会再返回该对象
+      * @exception: 如果出错，抛出CSyscallException异常
+      */
+    void del_events(CEpollable* epollable);
+
+    /***
+      * 由内核持续地接受连接，每个新连接返回一个EPOLLIN事件，
+      * get_result为新连接的句柄（已设置为非阻塞），小于0时为负的错误码
+      */
+    void accept_multishot(CEpollable* listener);
+
+    /***
+      * 由内核持续地接收数据，每次返回一个EPOLLIN事件，
+      * get_result为收到的字节数，为0表示对端已关闭，小于0时为负的错误码，
+      * 数据在get_buffer中，Buffer用完时内核会暂停，在下一次timed_wait归还Buffer后自动恢复
+      */
+    void recv_multishot(CEpollable* epollable);
+
+    /** 同CEpoller::get */
+    CEpollable* get(uint32_t index) const { return (CEpollable *)_events[index].data.ptr; }
+
+    /** 同CEpoller::get_events */
+    uint32_t get_events(uint32_t index) const { return _events[index].events; }
+
+    /** 完成通知的结果，就绪通知时为0 */
+    int get_result(uint32_t index) const { return _results[index]; }
+
+    /** recv_multishot收到的数据，其它情况下为NULL */
+    const char* get_buffer(uint32_t index) const { return _buffers[index]; }
+
+    /** 累计调用io_uring_enter的次数，用于观察提交的批量效果 */
+    uint64_t get_enter_number() const { return _enter_number; }
+
+private:
+    CUringPoller(const CUringPoller&);
+    CUringPoller& operator =(const CUringPoller&);
+
+    void* get_sqe();
+    void submit(uint32_t min_complete, uint32_t milliseconds, bool wait);
+    void prep_poll(CEpollable* epollable, int events);
+    void prep_multishot(CEpollable* epollable, int type);
+    void prep_poll_remove(CEpollable* epollable, int events, bool update);
+    int* find_state(CEpollable* epollable);
+    int* add_state(CEpollable* epollable);
+    void remove_state(CEpollable* epollable);
+    int reap();
+    void recycle_buffers();
+
+private:
+    int _ring_fd;
+    uint32_t _id;   // 每次create时分配，用于识别对象中记录的是否为本io_uring的状态
+    bool _disabled; // 尚未被提交线程启用
+    uint32_t _max_events;
+    uint64_t _enter_number;
+    struct epoll_event* _events;
+    int* _results;
+    const char** _buffers;
+
+    // 提交队列和完成队列，指向和内核共享的内存
+    void* _sq_ring;
+    size_t _sq_ring_size;
+    void* _cq_ring;
+    size_t _cq_ring_size;
+    void* _sqes;
+    size_t _sqes_size;
+    uint32_t* _sq_head;
+    uint32_t* _sq_tail;
+    uint32_t _sq_mask;
+    uint32_t _sq_entries;
+    uint32_t* _sq_array;
+    uint32_t _sq_local_tail; // 已填写但尚未提交的请求在_sq_local_tail之前
+    uint32_t* _cq_head;
+    uint32_t* _cq_tail;
+    uint32_t _cq_mask;
+    void* _cqes;
+
+    // 触发后待重新提交POLL_ADD的对象，被del_events的置为NULL
+    std::vector<CEpollable*> _pending_array;
+    // 已被其它io_uring登记的对象在本io_uring中的状态，值同CEpollable::_pending_index
+    std::map<CEpollable*, int> _shared_table;
+
+    // 注册给内核的接收Buffer
+    void* _buffer_ring;
+    size_t _buffer_ring_size;
+    char* _buffer_pool;
+    uint16_t _buffer_number;
+    uint32_t _buffer_size;
+    uint16_t _buffer_tail;
+    std::vector<uint16_t> _used_buffers; // 本轮返回给调用者，下一轮归还的Buffer
+};
+
+NET_NAMESPACE_END
+#endif // MOOON_NET_URING_POLLER_H
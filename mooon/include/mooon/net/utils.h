@@ -240,6 +240,13 @@ public:
       * @exception: 网络错误，则抛出CSyscallException异常
       */
     static bool timed_poll(int fd, int events_requested, int milliseconds, int* events_returned=NULL);
+
+    /***
+      * 检查空闲的连接是否仍可复用，不阻塞，常用于连接池借出连接前的检查
+      * @return: 连接没有任何事件时返回true；对端已关闭、出错或者有残留的数据可读时返回false，
+      *          对请求响应式的协议，残留的数据说明收发已经错位，连接不能再用
+      */
+    static bool is_socket_alive(int fd);
 };
 
 extern std::string to_string(const struct in_addr& sin_addr);
@@ -0,0 +1,152 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ *
+ * 基于futex的自适应锁：先短暂自旋，仍拿不到锁再睡眠，并可统计锁的竞争情况
+ */
+#ifndef MOOON_SYS_ADAPTIVE_LOCK_H
+#define MOOON_SYS_ADAPTIVE_LOCK_H
+#include "mooon/sys/futex.h"
+#include "mooon/sys/syscall_exception.h"
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/** 锁的统计 */
+typedef struct
+{
+    uint64_t acquire_number;   /** 加锁次数 */
+    uint64_t contended_number; /** 加锁时锁已被占用的次数 */
+    uint64_t parked_number;    /** 自旋后仍拿不到锁而睡眠的次数 */
+    uint64_t wait_nanoseconds; /** 因竞争而等待的总纳秒数 */
+}lock_stats_t;
+
+/***
+  * 自适应互斥锁（非递归），可直接替换CLock用作LockHelper的模板参数，如：
+  * CAdaptiveLock lock("dispatcher.sender_table");
+  * LockHelper<CAdaptiveLock> lh(lock);
+  *
+  * 无竞争时加解锁各只需一次原子操作；有竞争时先自旋spin_number次，仍拿不到才在futex上睡眠，
+  * 解锁时只在有睡眠者时才调用futex_wake。单CPU时不自旋。
+  * 指定了名字的锁会统计竞争情况，并登记到全局表中，可由get_all_stats取得，
+  * 同名的锁（如锁数组）统计会被累加。统计在持有锁时更新，不需额外的原子操作。
+  * get_all_stats会遍历所有登记的锁，所以只给少量关心的锁命名，大的锁数组（如按key分片的表）不要命名。
+  * 构造时登记的是this，所以不可复制。
+  */
+class CAdaptiveLock
+{
+public:
+    /***
+      * 构造一个自适应锁
+      * @name: 锁名，为NULL表示不统计，名字须在锁的生命周期内有效，通常为字符串常量
+      * @spin_number: 睡眠前的自旋次数
+      */
+    explicit CAdaptiveLock(const char* name=NULL, uint32_t spin_number=100) throw ();
+    ~CAdaptiveLock();
+
+    /** 加锁，如果不能获取到锁，则一直等待到获取到锁为止 */
+    void lock() throw (CSyscallException);
+
+    /** 解锁，必须已经调用了lock加锁 */
+    void unlock() throw (CSyscallException);
+
+    /***
+      * 尝试性的去获取锁，如果得不到锁，则立即返回
+      * @return: 如果获取到了锁，则返回true，否则返回false
+      */
+    bool try_lock() throw (CSyscallException);
+
+    /***
+      * 以超时方式去获取锁，和CLock相同，millisecond为0时一直等待
+      * @return: 如果在指定的毫秒时间内获取到了锁，则返回true，否则如果超时则返回false
+      */
+    bool timed_lock(uint32_t millisecond) throw (CSyscallException);
+
+    /***
+      * 开启统计并登记到全局表，用于不能在构造时指定名字的情况，如锁数组
+      * @name: 锁名，须在锁的生命周期内有效
+      */
+    void enable_stats(const char* name) throw ();
+
+    /** 得到锁名，不统计时为NULL */
+    const char* get_name() const { return _name; }
+
+    /** 得到本锁的统计 */
+    void get_stats(lock_stats_t* stats) const;
+
+public:
+    /***
+      * 得到所有登记的锁的统计，同名的锁被累加，按名字排序
+      */
+    static void get_all_stats(std::vector<std::pair<std::string, lock_stats_t> >* all_stats);
+
+private:
+    bool lock_contended(uint32_t millisecond);
+    void register_stats();
+    void deregister_stats();
+
+private:
+    CAdaptiveLock(const CAdaptiveLock&);
+    CAdaptiveLock& operator =(const CAdaptiveLock&);
+
+private:
+    enum
+    {
+        unlocked = 0,
+        locked = 1,            // 已被占用，没有睡眠者
+        locked_with_waiters = 2 // 已被占用，可能有睡眠者
+    };
+
+    volatile int32_t _state;
+    uint32_t _spin_number;
+    const char* _name;
+    lock_stats_t _stats;
+    CAdaptiveLock* _prev; // 全局登记表的双向链表
+    CAdaptiveLock* _next;
+};
+
+/***
+  * 和CAdaptiveLock配套使用的通知事件，语义同CEvent，基于futex序号实现，
+  * 和pthread条件变量一样允许虚假唤醒，调用者应在循环中检查条件
+  */
+class CAdaptiveEvent
+{
+public:
+    CAdaptiveEvent() throw ();
+
+    /** 释放锁并等待被唤醒，返回前重新加锁 */
+    void wait(CAdaptiveLock& lock) throw (CSyscallException);
+
+    /***
+      * 释放锁并等待被唤醒或超时，返回前重新加锁，millisecond为0时一直等待
+      * @return: 如果在指定的毫秒数之前被唤醒，则返回true，否则返回false
+      */
+    bool timed_wait(CAdaptiveLock& lock, uint32_t millisecond) throw (CSyscallException);
+
+    /** 唤醒一个等待的线程 */
+    void signal() throw (CSyscallException);
+
+    /** 唤醒所有等待的线程 */
+    void broadcast() throw (CSyscallException);
+
+private:
+    volatile int32_t _sequence;
+    volatile int32_t _waiters;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_ADAPTIVE_LOCK_H
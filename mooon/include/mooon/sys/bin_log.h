@@ -0,0 +1,101 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ *
+ * 延迟格式化的二进制日志文件格式，由CLogger写入，由tools/bin_log_decoder还原成文本
+ *
+ * 文件由连续的记录组成，每条记录以bin_log_head_t开头，所有整数均为本机字节序：
+ * 1) BIN_LOG_RECORD_FILE：文件头，每次打开日志文件时写入，之前的字符串字典全部作废
+ * 2) BIN_LOG_RECORD_STRING：字符串字典项，格式串和文件名只记录地址，第一次出现时写入地址对应的内容
+ * 3) BIN_LOG_RECORD_TEXT：一条日志，只有格式串地址和按格式串编码的参数原始字节，不做格式化
+ * 4) BIN_LOG_RECORD_RAW：由log_bin写入的二进制数据
+ */
+#ifndef MOOON_SYS_BIN_LOG_H
+#define MOOON_SYS_BIN_LOG_H
+#include "mooon/sys/config.h"
+#include <stdarg.h>
+#include <string>
+SYS_NAMESPACE_BEGIN
+
+#define BIN_LOG_MAGIC "MOOONBIN"
+
+enum
+{
+    BIN_LOG_VERSION = 1,
+
+    BIN_LOG_RECORD_FILE   = 1,
+    BIN_LOG_RECORD_STRING = 2,
+    BIN_LOG_RECORD_TEXT   = 3,
+    BIN_LOG_RECORD_RAW    = 4,
+
+    BIN_LOG_FLAG_AUTO_ADDDOT  = 0x01,
+    BIN_LOG_FLAG_AUTO_NEWLINE = 0x02
+};
+
+// 所有记录共有的头部
+typedef struct
+{
+    uint16_t size;   // 整条记录的字节数，包含头部
+    uint8_t type;    // 记录类型，值为BIN_LOG_RECORD_*
+    uint8_t level;   // 日志级别，仅对TEXT和RAW记录有效
+    uint32_t lineno; // 行号，仅对TEXT和RAW记录有效
+}bin_log_head_t;
+
+typedef struct
+{
+    bin_log_head_t head;
+    char magic[8];     // 值为BIN_LOG_MAGIC，不含结尾符
+    uint32_t version;  // 值为BIN_LOG_VERSION
+    uint32_t pid;      // 写日志的进程ID
+    uint32_t flags;    // BIN_LOG_FLAG_*的组合
+    uint32_t reserved;
+}bin_log_file_t;
+
+typedef struct
+{
+    bin_log_head_t head;
+    uint64_t address;  // 字符串在写日志进程中的地址
+    // 之后为字符串内容，不含结尾符
+}bin_log_string_t;
+
+typedef struct
+{
+    bin_log_head_t head;
+    uint32_t thread_id;
+    uint32_t reserved;
+    uint64_t timestamp; // 微秒
+    uint64_t filename;  // 文件名的地址
+    uint64_t format;    // 格式串的地址，RAW记录为0
+    // 之后为模块名（2字节长度加内容，长度为0表示没有模块名），
+    // 再之后TEXT记录为编码后的参数，RAW记录为原始数据
+}bin_log_text_t;
+
+/***
+  * 按格式串将参数编码为原始字节，整数、浮点数和指针直接复制，字符串复制内容
+  * @buffer_size: 空间不够时，字符串参数被截断，其后的参数被丢弃
+  * @return: 返回写入buffer的字节数
+  */
+extern int encode_bin_log_args(char* buffer, int buffer_size, const char* format, va_list& args);
+
+/***
+  * 将encode_bin_log_args编码的参数按格式串还原成文本，结果追加到text
+  * @return: 如果参数不完整（被截断或数据损坏）则返回false，缺少的参数以原转换说明代替
+  */
+extern bool decode_bin_log_args(std::string* text, const char* format, const char* args, int args_size);
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_BIN_LOG_H
@@ -0,0 +1,106 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ *
+ * 线程的CPU亲和及NUMA内存策略，CPU拓扑从/sys/devices/system读取，不依赖libnuma
+ */
+#ifndef MOOON_SYS_CPU_AFFINITY_H
+#define MOOON_SYS_CPU_AFFINITY_H
+#include "mooon/sys/syscall_exception.h"
+#include <string>
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * CPU亲和配置，将各种策略都转换成一个有序的CPU列表，第i个线程绑定到列表中第i%n个CPU。
+  * 支持的配置字符串：
+  * 空串："不绑定"
+  * "spread"：依次分散到各NUMA结点上，同一结点内先用不同的物理核，再用超线程
+  * "compact"：先占满一个NUMA结点（同样先用不同的物理核），再用下一个结点
+  * CPU列表，如"0-3,8,10-11"：按列出的顺序绑定
+  * 只使用本进程允许使用的CPU（sched_getaffinity），以适应taskset和容器
+  */
+class CCpuAffinity
+{
+public:
+    /***
+      * 解析亲和配置
+      * @affinity: 配置字符串，格式见类说明
+      * @exception: 格式错误或CPU不可用时抛出CSyscallException，出错码为EINVAL
+      */
+    void parse(const std::string& affinity) throw (CSyscallException);
+
+    /** 是否需要绑定 */
+    bool is_enabled() const { return !_cpus.empty(); }
+
+    /** 得到第thread_index个线程应绑定的CPU，不需要绑定时返回-1 */
+    int get_thread_cpu(uint16_t thread_index) const;
+
+    /** 得到有序的CPU列表 */
+    const std::vector<int>& get_cpus() const { return _cpus; }
+
+public:
+    /***
+      * 解析"0-3,8,10-11"格式的CPU列表，结果按出现顺序，不去重
+      * @return: 格式错误返回false
+      */
+    static bool parse_cpu_list(const std::string& cpu_list, std::vector<int>* cpus);
+
+    /** 得到NUMA结点个数，非NUMA系统返回1 */
+    static int get_numa_node_number();
+
+    /** 得到CPU所在的NUMA结点，cpu为-1或无法确定时返回-1 */
+    static int get_cpu_numa_node(int cpu);
+
+    /***
+      * 将当前线程绑定到指定CPU
+      * @exception: 出错抛出CSyscallException
+      */
+    static void set_current_thread_cpu(int cpu) throw (CSyscallException);
+
+    /** 得到当前线程所在的CPU，失败返回-1 */
+    static int get_current_cpu();
+
+private:
+    // 按结点得到本进程可用的CPU，每个结点内先物理核后超线程
+    static void get_node_cpus(std::vector<std::vector<int> >* node_cpus);
+
+private:
+    std::vector<int> _cpus;
+};
+
+/***
+  * NUMA内存策略帮助类，在生命周期内让当前线程优先从指定结点分配物理页，析构时恢复原策略。
+  * 物理页在首次访问时才分配，因此可在创建线程之前（如before_start中）为它分配和初始化私有数据。
+  * 注意malloc可能复用已分配过物理页的内存，所以只对新分配的大块内存（如连接池、epoll事件数组）效果确定。
+  * 内核不支持NUMA时什么也不做
+  */
+class CNumaPolicyHelper
+{
+public:
+    /** @numa_node: NUMA结点，为-1时什么也不做 */
+    explicit CNumaPolicyHelper(int numa_node);
+    ~CNumaPolicyHelper();
+
+private:
+    bool _changed;
+    int _old_mode;
+    unsigned long _old_nodemask[16];
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_CPU_AFFINITY_H
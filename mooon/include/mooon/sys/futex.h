@@ -0,0 +1,70 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ *
+ * Linux futex系统调用的简单封装，只用于同一进程内的线程间（FUTEX_PRIVATE_FLAG）
+ */
+#ifndef MOOON_SYS_FUTEX_H
+#define MOOON_SYS_FUTEX_H
+#include "mooon/sys/config.h"
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 如果*addr的值等于expected，则睡眠直到被futex_wake唤醒或超时
+  * @milliseconds: 超时毫秒数，为0表示一直等待
+  * @return: 超时返回false，其它（被唤醒、值已不等于expected或被信号中断）返回true，调用者应重新检查条件
+  */
+inline bool futex_wait(volatile int32_t* addr, int32_t expected, uint32_t milliseconds=0)
+{
+    struct timespec timeout;
+    struct timespec* timeout_ptr = NULL;
+
+    if (milliseconds > 0)
+    {
+        timeout.tv_sec = milliseconds / 1000;
+        timeout.tv_nsec = (milliseconds % 1000) * 1000000;
+        timeout_ptr = &timeout;
+    }
+
+    int ret = syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, timeout_ptr, NULL, 0);
+    return (0 == ret) || (errno != ETIMEDOUT);
+}
+
+/***
+  * 唤醒最多number个在addr上等待的线程
+  * @return: 返回被唤醒的线程个数
+  */
+inline int futex_wake(volatile int32_t* addr, int number=1)
+{
+    return static_cast<int>(syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, number, NULL, NULL, 0));
+}
+
+/** 得到单调时钟的毫秒数，用于计算futex_wait剩余的超时时间 */
+inline uint64_t get_monotonic_milliseconds()
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_FUTEX_H
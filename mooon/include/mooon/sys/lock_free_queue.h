@@ -0,0 +1,392 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_LOCK_FREE_QUEUE_H
+#define MOOON_SYS_LOCK_FREE_QUEUE_H
+#include "mooon/sys/futex.h"
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 有界无锁多生产者多消费者队列
+  * 每个槽位有一个序号：序号等于入队位置时槽位可写，等于入队位置加1时槽位可读，
+  * 生产者和消费者只在各自的位置上CAS竞争，不会互相等锁，
+  * 入队位置和出队位置放在不同的缓存行，避免生产者和消费者互相使对方的缓存行失效
+  *
+  * 也可作为CEventQueue的RawQueueClass使用（这时在CEventQueue的锁保护下），
+  * 但要发挥无锁的作用，应使用CLockFreeEventQueue或直接使用try_push和try_pop
+  *
+  * DataType应当是可以直接复制的小类型，比如指针或整数
+  */
+template <typename DataType>
+class CLockFreeQueue
+{
+public:
+    typedef DataType _DataType;
+
+public:
+    /***
+      * 构造一个无锁队列
+      * @queue_max: 队列大小，会被向上取整为2的幂，最小为2
+      */
+    CLockFreeQueue(uint32_t queue_max)
+        :_capacity(2)
+        ,_enqueue_pos(0)
+        ,_dequeue_pos(0)
+    {
+        while (_capacity < queue_max)
+            _capacity <<= 1;
+        _mask = _capacity - 1;
+
+        _cells = new Cell[_capacity];
+        for (uint32_t i=0; i<_capacity; ++i)
+            _cells[i].sequence = i;
+    }
+
+    ~CLockFreeQueue()
+    {
+        delete []_cells;
+    }
+
+    /***
+      * 往队尾插入一个元素
+      * @return: 如果队列已满返回false，否则返回true
+      */
+    bool try_push(const DataType& elem)
+    {
+        Cell* cell;
+        uint64_t pos = __atomic_load_n(&_enqueue_pos, __ATOMIC_RELAXED);
+
+        while (true)
+        {
+            cell = &_cells[pos & _mask];
+            uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            int64_t diff = static_cast<int64_t>(sequence - pos);
+
+            if (0 == diff)
+            {
+                // 槽位可写，抢占入队位置
+                uint64_t old_pos = __sync_val_compare_and_swap(&_enqueue_pos, pos, pos+1);
+                if (old_pos == pos)
+                    break;
+                pos = old_pos;
+            }
+            else if (diff < 0)
+            {
+                // 槽位上一轮的数据还未被取走，队列已满
+                return false;
+            }
+            else
+            {
+                // 其它生产者已抢占了这个位置
+                pos = __atomic_load_n(&_enqueue_pos, __ATOMIC_RELAXED);
+            }
+        }
+
+        cell->data = elem;
+        __atomic_store_n(&cell->sequence, pos+1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /***
+      * 弹出队首元素
+      * @return: 如果队列为空返回false，否则返回true
+      */
+    bool try_pop(DataType& elem)
+    {
+        Cell* cell;
+        uint64_t pos = __atomic_load_n(&_dequeue_pos, __ATOMIC_RELAXED);
+
+        while (true)
+        {
+            cell = &_cells[pos & _mask];
+            uint64_t sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+            int64_t diff = static_cast<int64_t>(sequence - (pos+1));
+
+            if (0 == diff)
+            {
+                uint64_t old_pos = __sync_val_compare_and_swap(&_dequeue_pos, pos, pos+1);
+                if (old_pos == pos)
+                    break;
+                pos = old_pos;
+            }
+            else if (diff < 0)
+            {
+                // 槽位还未写入，队列为空
+                return false;
+            }
+            else
+            {
+                pos = __atomic_load_n(&_dequeue_pos, __ATOMIC_RELAXED);
+            }
+        }
+
+        elem = cell->data;
+        // 槽位留给下一轮的生产者
+        __atomic_store_n(&cell->sequence, pos+_capacity, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    /** 判断队列是否已满，并发时只是近似值 */
+    bool is_full() const
+    {
+        return size() >= _capacity;
+    }
+
+    /** 判断队列是否为空，并发时只是近似值 */
+    bool is_empty() const
+    {
+        return 0 == size();
+    }
+
+    /** 返回队首元素，调用者需保证队列不为空，且没有并发的出队 */
+    DataType front() const
+    {
+        return _cells[_dequeue_pos & _mask].data;
+    }
+
+    /** 弹出队首元素，调用者需保证队列不为空，供CEventQueue使用 */
+    DataType pop_front()
+    {
+        DataType elem = DataType();
+        (void)try_pop(elem);
+        return elem;
+    }
+
+    /** 往队尾插入一个元素，调用者需保证队列不满，供CEventQueue使用 */
+    void push_back(DataType elem)
+    {
+        (void)try_push(elem);
+    }
+
+    /** 得到队列中的元素个数，并发时只是近似值 */
+    uint32_t size() const
+    {
+        uint64_t dequeue_pos = __atomic_load_n(&_dequeue_pos, __ATOMIC_ACQUIRE);
+        uint64_t enqueue_pos = __atomic_load_n(&_enqueue_pos, __ATOMIC_ACQUIRE);
+
+        // 先读出队位置，所以不会出现负数
+        return (enqueue_pos > dequeue_pos)? static_cast<uint32_t>(enqueue_pos - dequeue_pos): 0;
+    }
+
+    /** 得到队列的容量，为2的幂 */
+    uint32_t capacity() const
+    {
+        return _capacity;
+    }
+
+private:
+    enum { CACHE_LINE_SIZE = 64 };
+
+    struct Cell
+    {
+        volatile uint64_t sequence;
+        DataType data;
+    };
+
+private:
+    char _pad0[CACHE_LINE_SIZE];
+    Cell* _cells;
+    uint32_t _capacity;
+    uint64_t _mask;
+    char _pad1[CACHE_LINE_SIZE];
+    volatile uint64_t _enqueue_pos;  /** 生产者竞争的位置，独占一个缓存行 */
+    char _pad2[CACHE_LINE_SIZE];
+    volatile uint64_t _dequeue_pos;  /** 消费者竞争的位置，独占一个缓存行 */
+    char _pad3[CACHE_LINE_SIZE];
+};
+
+/***
+  * 基于CLockFreeQueue和futex的阻塞队列，push_back和pop_front的超时语义和CEventQueue相同
+  * 入队和出队本身不加锁，只有在队列为空（或满）需要等待时，才通过futex睡眠，
+  * 而对方只有在确有等待者时才执行futex唤醒，且每次只唤醒一个，不会广播
+  */
+template <typename DataType>
+class CLockFreeEventQueue
+{
+public:
+    /***
+      * 构造一个无锁事件队列
+      * @queue_max: 队列大小，会被向上取整为2的幂
+      * @pop_milliseconds: pop_front时等待队列为非空时的毫秒数，如果为0则表示不等待，
+      *                这种情况下如果队列为空，则pop_front立即返回false
+      * @push_milliseconds: push_back时等待队列为非满时的毫秒数，如果为0则表示不等待，
+      *                这种情况下如果队列已满，则push_back立即返回false
+      */
+    CLockFreeEventQueue(uint32_t queue_max, uint32_t pop_milliseconds, uint32_t push_milliseconds)
+        :_raw_queue(queue_max)
+        ,_pop_milliseconds(pop_milliseconds)
+        ,_push_milliseconds(push_milliseconds)
+        ,_pop_sequence(0)
+        ,_push_sequence(0)
+        ,_pop_waiter_number(0)
+        ,_push_waiter_number(0)
+        ,_pop_wake_pending(0)
+        ,_push_wake_pending(0)
+    {
+    }
+
+    bool is_full() const
+    {
+        return _raw_queue.is_full();
+    }
+
+    bool is_empty() const
+    {
+        return _raw_queue.is_empty();
+    }
+
+    /***
+      * 弹出队首元素
+      * @elem: 存储被弹出的队首元素
+      * @return: 如果成功从队列弹出数据则返回true，否则（队列为空或超时）返回false
+      */
+    bool pop_front(DataType& elem)
+    {
+        if (!_raw_queue.try_pop(elem))
+        {
+            if (0 == _pop_milliseconds)
+                return false;
+
+            uint64_t deadline = get_monotonic_milliseconds() + _pop_milliseconds;
+            while (true)
+            {
+                // 须先取序号再登记为等待者，之后入队的生产者一定会看到等待者并改变序号
+                int32_t sequence = __atomic_load_n(&_pop_sequence, __ATOMIC_ACQUIRE);
+                __sync_add_and_fetch(&_pop_waiter_number, 1);
+
+                bool popped = _raw_queue.try_pop(elem);
+                if (!popped)
+                {
+                    uint64_t now = get_monotonic_milliseconds();
+                    if (now >= deadline)
+                    {
+                        __sync_sub_and_fetch(&_pop_waiter_number, 1);
+                        return false;
+                    }
+
+                    (void)futex_wait(&_pop_sequence, sequence, static_cast<uint32_t>(deadline - now));
+                    _pop_wake_pending = 0;
+                }
+
+                __sync_sub_and_fetch(&_pop_waiter_number, 1);
+                if (popped)
+                    break;
+                if (_raw_queue.try_pop(elem))
+                    break;
+            }
+        }
+
+        wake_up(&_push_sequence, &_push_waiter_number, &_push_wake_pending);
+        // 唤醒被跳过时（见wake_up），由取到数据的消费者接力唤醒下一个
+        if ((_pop_waiter_number > 0) && !_raw_queue.is_empty())
+            wake_up(&_pop_sequence, &_pop_waiter_number, &_pop_wake_pending);
+        return true;
+    }
+
+    bool pop_front()
+    {
+        DataType elem;
+        return pop_front(elem);
+    }
+
+    /***
+      * 往队尾插入一个元素
+      * @elem: 需要插入队尾的数据
+      * @return: 如果成功往对尾插入了数据，则返回true，否则（队列满或超时）返回false
+      */
+    bool push_back(DataType elem)
+    {
+        if (!_raw_queue.try_push(elem))
+        {
+            if (0 == _push_milliseconds)
+                return false;
+
+            uint64_t deadline = get_monotonic_milliseconds() + _push_milliseconds;
+            while (true)
+            {
+                int32_t sequence = __atomic_load_n(&_push_sequence, __ATOMIC_ACQUIRE);
+                __sync_add_and_fetch(&_push_waiter_number, 1);
+
+                bool pushed = _raw_queue.try_push(elem);
+                if (!pushed)
+                {
+                    uint64_t now = get_monotonic_milliseconds();
+                    if (now >= deadline)
+                    {
+                        __sync_sub_and_fetch(&_push_waiter_number, 1);
+                        return false;
+                    }
+
+                    (void)futex_wait(&_push_sequence, sequence, static_cast<uint32_t>(deadline - now));
+                    _push_wake_pending = 0;
+                }
+
+                __sync_sub_and_fetch(&_push_waiter_number, 1);
+                if (pushed)
+                    break;
+                if (_raw_queue.try_push(elem))
+                    break;
+            }
+        }
+
+        wake_up(&_pop_sequence, &_pop_waiter_number, &_pop_wake_pending);
+        if ((_push_waiter_number > 0) && !_raw_queue.is_full())
+            wake_up(&_push_sequence, &_push_waiter_number, &_push_wake_pending);
+        return true;
+    }
+
+    /** 得到队列中存储的元素个数，并发时只是近似值 */
+    uint32_t size() const
+    {
+        return _raw_queue.size();
+    }
+
+    uint32_t capacity() const
+    {
+        return _raw_queue.capacity();
+    }
+
+private:
+    // 已有一个唤醒还未被等待者处理时不再唤醒，以免每次入队（出队）都执行一次系统调用，
+    // 被跳过的唤醒由被唤醒者取到数据后接力完成
+    void wake_up(volatile int32_t* sequence, volatile int32_t* waiter_number, volatile int32_t* wake_pending)
+    {
+        // 和等待者登记后的重新检查配对：要么等待者看到刚入队（出队）的数据，要么这里看到等待者
+        __sync_synchronize();
+        if ((*waiter_number > 0) && (0 == *wake_pending) && __sync_bool_compare_and_swap(wake_pending, 0, 1))
+        {
+            __sync_add_and_fetch(sequence, 1);
+            if (0 == futex_wake(sequence, 1))
+                *wake_pending = 0; // 等待者还未睡眠，它会发现序号已变而不睡眠
+        }
+    }
+
+private:
+    CLockFreeQueue<DataType> _raw_queue;
+    uint32_t _pop_milliseconds;    /** 出队时等待超时毫秒数 */
+    uint32_t _push_milliseconds;   /** 入队时等待超时毫秒数 */
+    volatile int32_t _pop_sequence;   /** 消费者在其上futex等待，有数据入队时加1 */
+    volatile int32_t _push_sequence;  /** 生产者在其上futex等待，有数据出队时加1 */
+    volatile int32_t _pop_waiter_number;  /** 等待队列有数据的线程个数 */
+    volatile int32_t _push_waiter_number; /** 等待队列有空位置的线程个数 */
+    volatile int32_t _pop_wake_pending;   /** 已唤醒消费者，但它还未醒来 */
+    volatile int32_t _push_wake_pending;  /** 已唤醒生产者，但它还未醒来 */
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_LOCK_FREE_QUEUE_H
@@ -21,6 +21,9 @@
 #include <mooon/sys/config.h>
 #include <mooon/utils/print_color.h>
 #include <stdio.h>
+#if __cplusplus >= 201103L
+#include <type_traits>
+#endif // __cplusplus
 SYS_NAMESPACE_BEGIN
 
 class ILogger;
@@ -98,6 +101,55 @@ extern void set_log_filesize_by_env(ILogger* logger);
 // 根据环境变量名MOOON_LOG_BACKUP控制日志文件备份个数
 extern void set_log_backup_by_env(ILogger* logger);
 
+// 日志限流器类型
+enum
+{
+    LOG_LIMITER_RATE   = 0, // 令牌桶，每秒最多rate条，允许burst条的突发
+    LOG_LIMITER_SAMPLE = 1, // 采样，每rate条只记录1条
+    LOG_LIMITER_PERIOD = 2  // 每rate毫秒最多1条，用于低于每秒1条的频率
+};
+
+// 每个调用点一个的日志限流器，由限流日志宏以静态变量的方式定义，
+// 为POD类型，在编译期即完成初始化，不存在多线程初始化的问题
+typedef struct log_limiter
+{
+    uint32_t type;                // LOG_LIMITER_RATE、LOG_LIMITER_SAMPLE或LOG_LIMITER_PERIOD
+    uint32_t rate;
+    uint32_t burst;               // 只对LOG_LIMITER_RATE有效
+    volatile uint32_t suppressed; // 自上次记录以来被抑制的条数
+    volatile uint64_t state;      // 令牌桶为理论上下一条到达的时间（微秒），采样为已调用的次数
+
+    // 以下在第一次抑制时填写，用于调用点不再记录日志时补记汇总日志
+    volatile uint32_t registered;   // 是否已加入全局的限流器链表
+    int level;                      // log_level_t
+    int lineno;
+    const char* filename;
+    const char* module_name;        // 须为常量字符串
+    ILogger* volatile logger;       // 最近一次被抑制时的日志器
+    uint64_t flushed_state;         // 采样时上一次检查时的state，未变化说明调用点已不再记录
+    struct log_limiter* next;
+}log_limiter_t;
+
+// 无锁判断是否允许记录一条日志，
+// 允许时suppressed返回自上次记录以来被抑制的条数，调用者可据此补记一条汇总日志
+extern bool log_limiter_allow(log_limiter_t* limiter, uint32_t* suppressed);
+
+// 限流日志宏在日志被抑制时调用，记下补记汇总日志所需的信息
+extern void log_limiter_suppressed(log_limiter_t* limiter, ILogger* logger, int level, const char* module_name, const char* filename, int lineno);
+
+/***
+  * 为已不再记录日志的调用点补记“suppressed N messages”：
+  * 限流的调用点为又可以记录但没有记录，采样的调用点为自上一次调用本函数以来没有再被调用过
+  * @force: 为true时不管调用点是否仍在记录，补记所有未报告的被抑制条数
+  */
+extern void log_limiter_flush(bool force=false);
+
+// 由日志器在每次写日志时调用，每秒最多执行一次log_limiter_flush()
+extern void log_limiter_tick();
+
+// 由日志器在析构时调用，补记所有使用该日志器的调用点，并不再引用它
+extern void log_limiter_detach(ILogger* logger);
+
 /**
   * 日志器接口，提供常见的写日志功能
   */
@@ -188,18 +240,30 @@ public:
 //////////////////////////////////////////////////////////////////////////
 // 日志宏，方便记录日志
 extern ILogger* g_logger; // 只是声明，不是定义，不能赋值哦！
+
+// 在编译期去掉__FILE__的目录部分，以免每条日志都在运行时提取文件名，
+// 不支持C++11的编译器仍使用完整的__FILE__
+#if __cplusplus >= 201103L
+constexpr size_t get_basename_offset(const char* filepath, size_t index=0, size_t offset=0)
+{
+    return ('\0' == filepath[index])? offset: get_basename_offset(filepath, index+1, ('/' == filepath[index])? index+1: offset);
+}
+#define __MYLOG_FILENAME (__FILE__ + std::integral_constant<size_t, ::mooon::sys::get_basename_offset(__FILE__)>::value)
+#else
+#define __MYLOG_FILENAME __FILE__
+#endif // __cplusplus
 extern bool g_null_print_screen; // 当g_logger为空时是否打屏，默认为true
 
 #define __MYLOG_DETAIL(logger, module_name, format, ...) \
 do { \
 	if (NULL == logger) { \
 	    if (::mooon::sys::g_null_print_screen) { \
-	        fprintf(stderr, "[DETAIL][%s:%d]", __FILE__, __LINE__); \
+	        fprintf(stderr, "[DETAIL][%s:%d]", __MYLOG_FILENAME, __LINE__); \
 	        fprintf(stderr, format, ##__VA_ARGS__); \
 	    } \
 	} \
 	else if (logger->enabled_detail()) { \
-		logger->log_detail(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		logger->log_detail(__MYLOG_FILENAME, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -209,12 +273,12 @@ do { \
 do { \
 	if (NULL == logger) { \
 	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, PRINT_COLOR_DARY_GRAY "[DEBUG][%s:%d]" PRINT_COLOR_NONE, __FILE__, __LINE__); \
+            fprintf(stderr, PRINT_COLOR_DARY_GRAY "[DEBUG][%s:%d]" PRINT_COLOR_NONE, __MYLOG_FILENAME, __LINE__); \
             fprintf(stderr, format, ##__VA_ARGS__); \
 	    } \
 	} \
 	else if (logger->enabled_debug()) { \
-		logger->log_debug(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		logger->log_debug(__MYLOG_FILENAME, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -222,12 +286,12 @@ do { \
 do { \
 	if (NULL == logger) { \
 	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, "[INFO][%s:%d]", __FILE__, __LINE__); \
+            fprintf(stderr, "[INFO][%s:%d]", __MYLOG_FILENAME, __LINE__); \
             fprintf(stderr, format, ##__VA_ARGS__); \
 	    } \
 	} \
 	else if (logger->enabled_info()) { \
-		logger->log_info(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		logger->log_info(__MYLOG_FILENAME, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -235,12 +299,12 @@ do { \
 do { \
 	if (NULL == logger) { \
 	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, PRINT_COLOR_YELLOW "[WARN][%s:%d]" PRINT_COLOR_NONE, __FILE__, __LINE__); \
+            fprintf(stderr, PRINT_COLOR_YELLOW "[WARN][%s:%d]" PRINT_COLOR_NONE, __MYLOG_FILENAME, __LINE__); \
             fprintf(stderr, format, ##__VA_ARGS__); \
 	    } \
 	} \
 	else if (logger->enabled_warn()) { \
-		logger->log_warn(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		logger->log_warn(__MYLOG_FILENAME, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -248,12 +312,12 @@ do { \
 do { \
 	if (NULL == logger) { \
 	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, PRINT_COLOR_RED "[ERROR][%s:%d]" PRINT_COLOR_NONE, __FILE__, __LINE__); \
+            fprintf(stderr, PRINT_COLOR_RED "[ERROR][%s:%d]" PRINT_COLOR_NONE, __MYLOG_FILENAME, __LINE__); \
             fprintf(stderr, format, ##__VA_ARGS__); \
 	    } \
 	} \
 	else if (logger->enabled_error()) { \
-		logger->log_error(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		logger->log_error(__MYLOG_FILENAME, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -261,12 +325,12 @@ do { \
 do { \
 	if (NULL == logger) { \
 	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, PRINT_COLOR_BROWN "[FATAL][%s:%d]" PRINT_COLOR_NONE, __FILE__, __LINE__); \
+            fprintf(stderr, PRINT_COLOR_BROWN "[FATAL][%s:%d]" PRINT_COLOR_NONE, __MYLOG_FILENAME, __LINE__); \
             fprintf(stderr, format, ##__VA_ARGS__); \
 	    } \
 	} \
 	else if (logger->enabled_fatal()) { \
-		logger->log_fatal(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		logger->log_fatal(__MYLOG_FILENAME, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -274,12 +338,12 @@ do { \
 do { \
 	if (NULL == logger) { \
 	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, "[STATE][%s:%d]", __FILE__, __LINE__); \
+            fprintf(stderr, "[STATE][%s:%d]", __MYLOG_FILENAME, __LINE__); \
             fprintf(stderr, format, ##__VA_ARGS__); \
 	    } \
 	} \
 	else if (logger->enabled_state()) { \
-		logger->log_state(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		logger->log_state(__MYLOG_FILENAME, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -287,12 +351,12 @@ do { \
 do { \
 	if (NULL == logger) { \
 	    if (::mooon::sys::g_null_print_screen) { \
-            fprintf(stderr, "[TRACE][%s:%d]", __FILE__, __LINE__); \
+            fprintf(stderr, "[TRACE][%s:%d]", __MYLOG_FILENAME, __LINE__); \
             fprintf(stderr, format, ##__VA_ARGS__); \
 	    } \
 	} \
 	else if (logger->enabled_trace()) { \
-		logger->log_trace(__FILE__, __LINE__, module_name, format, ##__VA_ARGS__); \
+		logger->log_trace(__MYLOG_FILENAME, __LINE__, module_name, format, ##__VA_ARGS__); \
 	} \
 } while(false)
 
@@ -311,9 +375,36 @@ do { \
 #define __MYLOG_BIN(logger, module_name, log, size) \
 do { \
     if ((logger != NULL) && logger->enabled_bin()) \
-        logger->log_bin(__FILE__, __LINE__, module_name, log, size); \
+        logger->log_bin(__MYLOG_FILENAME, __LINE__, module_name, log, size); \
 } while(false)
 
+// 限流和采样日志，每个调用点独立计数，
+// 被抑制的日志不会被格式化，下一条被记录前先补记一条“suppressed N messages”的汇总日志，
+// 调用点不再记录日志时，由log_limiter_tick()或log_limiter_flush()补记
+#define __MYLOG_LIMITED(level, logger, module_name, limiter_type, rate, burst, format, ...) \
+do { \
+    if (__MYLOG_##level##_ENABLE(logger)) { \
+        static ::mooon::sys::log_limiter_t __mylog_limiter = { limiter_type, rate, burst, 0, 0 }; \
+        uint32_t __mylog_suppressed = 0; \
+        if (::mooon::sys::log_limiter_allow(&__mylog_limiter, &__mylog_suppressed)) { \
+            if (__mylog_suppressed > 0) \
+                __MYLOG_##level(logger, module_name, "suppressed %u messages\n", __mylog_suppressed); \
+            __MYLOG_##level(logger, module_name, format, ##__VA_ARGS__); \
+        } \
+        else { \
+            ::mooon::sys::log_limiter_suppressed(&__mylog_limiter, logger, ::mooon::sys::LOG_LEVEL_##level, module_name, __MYLOG_FILENAME, __LINE__); \
+        } \
+    } \
+} while(false)
+
+// level为DETAIL、DEBUG、INFO、WARN、ERROR、FATAL、STATE或TRACE
+#define __MYLOG_RATELIMIT(level, logger, module_name, rate, burst, format, ...) \
+    __MYLOG_LIMITED(level, logger, module_name, ::mooon::sys::LOG_LIMITER_RATE, rate, burst, format, ##__VA_ARGS__)
+#define __MYLOG_SAMPLE(level, logger, module_name, n, format, ...) \
+    __MYLOG_LIMITED(level, logger, module_name, ::mooon::sys::LOG_LIMITER_SAMPLE, n, 0, format, ##__VA_ARGS__)
+#define __MYLOG_EVERY(level, logger, module_name, milliseconds, format, ...) \
+    __MYLOG_LIMITED(level, logger, module_name, ::mooon::sys::LOG_LIMITER_PERIOD, milliseconds, 1, format, ##__VA_ARGS__)
+
 #define __MYLOG_DETAIL_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_detail())))
 #define __MYLOG_DEBUG_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_debug())))
 #define __MYLOG_INFO_ENABLE(logger) (((NULL == logger) && ::mooon::sys::g_null_print_screen) || ((logger != NULL) && (logger->enabled_info())))
@@ -337,6 +428,36 @@ do { \
 #define MYLOG_DEBUG(format, ...)     __MYLOG_DEBUG(::mooon::sys::g_logger, NULL, format, ##__VA_ARGS__)
 #define MYLOG_DETAIL(format, ...)    __MYLOG_DETAIL(::mooon::sys::g_logger, NULL, format, ##__VA_ARGS__)
 
+// 每个调用点每秒最多rate条，允许burst条的突发，如：MYLOG_ERROR_RATELIMIT(10, 100, "%s closed by peer\n", peer.c_str());
+#define MYLOG_TRACE_RATELIMIT(rate, burst, format, ...)  __MYLOG_RATELIMIT(TRACE, ::mooon::sys::g_logger, NULL, rate, burst, format, ##__VA_ARGS__)
+#define MYLOG_STATE_RATELIMIT(rate, burst, format, ...)  __MYLOG_RATELIMIT(STATE, ::mooon::sys::g_logger, NULL, rate, burst, format, ##__VA_ARGS__)
+#define MYLOG_FATAL_RATELIMIT(rate, burst, format, ...)  __MYLOG_RATELIMIT(FATAL, ::mooon::sys::g_logger, NULL, rate, burst, format, ##__VA_ARGS__)
+#define MYLOG_ERROR_RATELIMIT(rate, burst, format, ...)  __MYLOG_RATELIMIT(ERROR, ::mooon::sys::g_logger, NULL, rate, burst, format, ##__VA_ARGS__)
+#define MYLOG_WARN_RATELIMIT(rate, burst, format, ...)   __MYLOG_RATELIMIT(WARN, ::mooon::sys::g_logger, NULL, rate, burst, format, ##__VA_ARGS__)
+#define MYLOG_INFO_RATELIMIT(rate, burst, format, ...)   __MYLOG_RATELIMIT(INFO, ::mooon::sys::g_logger, NULL, rate, burst, format, ##__VA_ARGS__)
+#define MYLOG_DEBUG_RATELIMIT(rate, burst, format, ...)  __MYLOG_RATELIMIT(DEBUG, ::mooon::sys::g_logger, NULL, rate, burst, format, ##__VA_ARGS__)
+#define MYLOG_DETAIL_RATELIMIT(rate, burst, format, ...) __MYLOG_RATELIMIT(DETAIL, ::mooon::sys::g_logger, NULL, rate, burst, format, ##__VA_ARGS__)
+
+// 每个调用点每n条只记录1条（第1条总是被记录），如：MYLOG_DEBUG_SAMPLE(1000, "%s\n", sql.c_str());
+#define MYLOG_TRACE_SAMPLE(n, format, ...)  __MYLOG_SAMPLE(TRACE, ::mooon::sys::g_logger, NULL, n, format, ##__VA_ARGS__)
+#define MYLOG_STATE_SAMPLE(n, format, ...)  __MYLOG_SAMPLE(STATE, ::mooon::sys::g_logger, NULL, n, format, ##__VA_ARGS__)
+#define MYLOG_FATAL_SAMPLE(n, format, ...)  __MYLOG_SAMPLE(FATAL, ::mooon::sys::g_logger, NULL, n, format, ##__VA_ARGS__)
+#define MYLOG_ERROR_SAMPLE(n, format, ...)  __MYLOG_SAMPLE(ERROR, ::mooon::sys::g_logger, NULL, n, format, ##__VA_ARGS__)
+#define MYLOG_WARN_SAMPLE(n, format, ...)   __MYLOG_SAMPLE(WARN, ::mooon::sys::g_logger, NULL, n, format, ##__VA_ARGS__)
+#define MYLOG_INFO_SAMPLE(n, format, ...)   __MYLOG_SAMPLE(INFO, ::mooon::sys::g_logger, NULL, n, format, ##__VA_ARGS__)
+#define MYLOG_DEBUG_SAMPLE(n, format, ...)  __MYLOG_SAMPLE(DEBUG, ::mooon::sys::g_logger, NULL, n, format, ##__VA_ARGS__)
+#define MYLOG_DETAIL_SAMPLE(n, format, ...) __MYLOG_SAMPLE(DETAIL, ::mooon::sys::g_logger, NULL, n, format, ##__VA_ARGS__)
+
+// 每个调用点每milliseconds毫秒最多1条，如：MYLOG_ERROR_EVERY(60000, "%s\n", ex.str().c_str());
+#define MYLOG_TRACE_EVERY(milliseconds, format, ...)    __MYLOG_EVERY(TRACE, ::mooon::sys::g_logger, NULL, milliseconds, format, ##__VA_ARGS__)
+#define MYLOG_STATE_EVERY(milliseconds, format, ...)    __MYLOG_EVERY(STATE, ::mooon::sys::g_logger, NULL, milliseconds, format, ##__VA_ARGS__)
+#define MYLOG_FATAL_EVERY(milliseconds, format, ...)    __MYLOG_EVERY(FATAL, ::mooon::sys::g_logger, NULL, milliseconds, format, ##__VA_ARGS__)
+#define MYLOG_ERROR_EVERY(milliseconds, format, ...)    __MYLOG_EVERY(ERROR, ::mooon::sys::g_logger, NULL, milliseconds, format, ##__VA_ARGS__)
+#define MYLOG_WARN_EVERY(milliseconds, format, ...)     __MYLOG_EVERY(WARN, ::mooon::sys::g_logger, NULL, milliseconds, format, ##__VA_ARGS__)
+#define MYLOG_INFO_EVERY(milliseconds, format, ...)     __MYLOG_EVERY(INFO, ::mooon::sys::g_logger, NULL, milliseconds, format, ##__VA_ARGS__)
+#define MYLOG_DEBUG_EVERY(milliseconds, format, ...)    __MYLOG_EVERY(DEBUG, ::mooon::sys::g_logger, NULL, milliseconds, format, ##__VA_ARGS__)
+#define MYLOG_DETAIL_EVERY(milliseconds, format, ...)   __MYLOG_EVERY(DETAIL, ::mooon::sys::g_logger, NULL, milliseconds, format, ##__VA_ARGS__)
+
 #define MYLOG_DETAIL_ENABLE() __MYLOG_DETAIL_ENABLE(::mooon::sys::g_logger)
 #define MYLOG_DEBUG_ENABLE() __MYLOG_DEBUG_ENABLE(::mooon::sys::g_logger)
 #define MYLOG_INFO_ENABLE() __MYLOG_INFO_ENABLE(::mooon::sys::g_logger)
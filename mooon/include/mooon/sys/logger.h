@@ -25,16 +25,29 @@
  * 4) 销毁：logger->destroy();，在这之后logger不能再被使用
  *
  * 请注意不需要delete logger;，否则将报编译错误
+ *
+ * 如果create时thread_ring为true，则启用线程日志环模式：
+ * 每个写日志的线程独占一个预分配的单生产者单消费者日志环（CLogRing），
+ * 日志直接格式化到环的槽位中，写日志过程中既不加锁也不分配内存，
+ * CLogThread一次唤醒即可取走所有环中的日志，只有在消费者休眠时才需要通过eventfd唤醒
+ *
+ * 如果create时deferred_format为true，则在线程日志环模式的基础上启用延迟格式化：
+ * 写日志时只记录格式串地址、级别、时间戳和参数的原始字节，不调用vsnprintf，
+ * 日志文件为二进制格式（见sys/bin_log.h），需用tools/bin_log_decoder还原成文本，
+ * 这种模式下格式串必须为字符串常量，log_bin也只在这种模式下生效
  */
 #ifndef MOOON_SYS_LOGGER_H
 #define MOOON_SYS_LOGGER_H
+#include <mooon/sys/adaptive_lock.h>
 #include <mooon/sys/atomic.h>
 #include <mooon/sys/event.h>
 #include <mooon/sys/lock.h>
 #include <mooon/sys/log.h>
 #include <mooon/sys/thread.h>
 #include <mooon/utils/array_queue.h>
+#include <set>
 #include <sys/epoll.h>
+#include <sys/uio.h>
 SYS_NAMESPACE_BEGIN
 
 class CLogger;
@@ -46,7 +59,10 @@ class CLogThread;
 enum
 {
     LOGGER_NUMBER_MAX = 100,     /** 允许创建的最多Logger个数 */
-    LOG_NUMBER_WRITED_ONCE = 10  /** 一次可连接写入的日志条数，最大不能超过IOV_MAX */
+    LOG_NUMBER_WRITED_ONCE = 10, /** 一次可连接写入的日志条数，最大不能超过IOV_MAX */
+    LOG_RING_NUMBER_MAX = 1024,  /** 单个Logger最多可拥有的线程日志环个数，超出的线程退回到队列方式 */
+    LOG_RING_WRITED_ONCE = 64,   /** 线程日志环模式下一次writev写入的日志条数，最大不能超过IOV_MAX */
+    LOG_RING_SPIN_NUMBER = 16    /** 线程日志环满时，在futex上睡眠前让出CPU的次数 */
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -71,9 +87,57 @@ public:
 protected:
     void send_signal();
     void read_signal(int signal_number);
+    /** 以eventfd替换pipe，多次send_signal只需一次read_signal即可全部读走 */
+    void use_eventfd();
 
 protected:
     int _pipe_fd[2];
+    bool _eventfd_used;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// CLogRing
+// 单生产者单消费者的日志环，生产者为写日志的线程，消费者为CLogThread，
+// 所有槽位在构造时一次性分配，每个槽位可容纳一条完整的日志
+class CLogRing: public CRefCountable
+{
+public:
+    /***
+      * @slot_number: 槽位个数，会被调整为2的幂
+      * @slot_size: 每个槽位可存放的日志内容字节数
+      */
+    CLogRing(uint32_t slot_number, uint16_t slot_size);
+    ~CLogRing();
+
+    /** 生产者取得一个可写的空闲槽位，如果环已满则返回NULL */
+    log_message_t* get_back() const;
+    /** 生产者提交由get_back取得的槽位，提交后对消费者可见 */
+    void push_back();
+
+    /** 消费者取得第index条待写的日志，index从0开始，如果不存在则返回NULL */
+    log_message_t* get_front(uint32_t index) const;
+    /** 消费者释放最前面的number个槽位 */
+    void pop_front(uint32_t number);
+
+    /** 线程退出后，环被释放，可被新的线程重用 */
+    void release();
+    void reuse();
+    bool is_released() const { return _released; }
+
+private:
+    log_message_t* get_slot(uint32_t position) const;
+
+private:
+    uint32_t _slot_mask;
+    uint32_t _slot_stride;
+    char* _slots;
+    volatile bool _released;
+    // 生产者和消费者各自修改的成员放在不同的Cache Line，以避免伪共享
+    char _head_padding[64];
+    volatile uint32_t _head; // 只有消费者修改
+    char _tail_padding[64];
+    volatile uint32_t _tail; // 只有生产者修改
+    char _end_padding[64];
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -101,10 +165,11 @@ public:
       * @log_filename: 日志文件名，一包括路径部分
       * @log_queue_size: 所有日志队列加起来的总大小
       * @log_queue_number: 日志队列个数
-      * @thread_orderly: 同一个线程的日志是否按时间顺序写
+      * @thread_ring: 是否启用线程日志环模式，启用后log_queue_size为每个线程日志环的槽位个数
+      * @deferred_format: 是否启用延迟格式化的二进制日志，为true时总是启用线程日志环模式
       * @exception: 如果出错抛出CSyscallException异常
       */
-    void create(const char* log_path, const char* log_filename, uint32_t log_queue_size=1000);
+    void create(const char* log_path, const char* log_filename, uint32_t log_queue_size=1000, bool thread_ring=false, bool deferred_format=false);
 
     bool is_registered() const { return _registered; }
     void set_registered(bool registered) { _registered = registered; }
@@ -164,7 +229,30 @@ private:
     bool single_write();
     void do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
     void push_log_message(log_message_t* log_message);
-    
+    int format_log_head(char* buffer, int buffer_size, log_level_t log_level, const char* filename, int lineno, const char* module_name) const;
+    void complete_log_message(log_message_t* log_message) const;
+
+private: // 线程日志环模式
+    bool ring_execute();
+    bool ring_drain_queue();
+    void ring_drain();
+    void ring_flush(const struct iovec* iov_array, int number, CLogRing* const* ring_array, const uint32_t* count_array, int ring_number);
+    void ring_notify();
+    void ring_wake();
+    log_message_t* ring_get_back(CLogRing* log_ring);
+    void ring_log(CLogRing* log_ring, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
+    void ring_log_bin(CLogRing* log_ring, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
+    CLogRing* get_thread_ring();
+    CLogRing* register_thread_ring();
+    void write_iov(const struct iovec* iov_array, int number);
+
+private: // 延迟格式化的二进制日志
+    int format_bin_head(char* buffer, int buffer_size, uint8_t record_type, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format) const;
+    void write_bin_file_head();
+    bool has_bin_strings(const log_message_t* log_message) const;
+    void write_bin_strings(const log_message_t* log_message);
+    void write_bin_string(uint64_t address);
+
 private:    
     int _log_fd;
     bool _auto_adddot;
@@ -185,12 +273,30 @@ private:
     char _log_filename[FILENAME_MAX];
     utils::CArrayQueue<log_message_t*>* _log_queue;
     volatile int _waiter_number; // 等待PUSH消息的线程个数
-    CEvent _queue_event;
-    CLock _queue_lock; // 保护_log_queue的锁
+    CAdaptiveEvent _queue_event;
+    CAdaptiveLock _queue_lock; // 保护_log_queue的锁，竞争情况可由CAdaptiveLock::get_all_stats取得
+
+private: // 线程日志环模式
+    bool _thread_ring_enabled;
+    uint32_t _ring_slot_number;  // 每个线程日志环的槽位个数
+    int _ring_index;             // 在线程本地日志环表中的下标
+    uint64_t _ring_serial;       // 用来识别线程本地日志环表中的过期项
+    CLogRing** _rings;
+    volatile uint32_t _ring_number;
+    volatile int _ring_notified; // 为1表示已通知或者CLogThread正在取日志，生产者无需再唤醒
+    volatile int32_t _ring_drained;       // CLogThread每释放一批槽位加1，环满的生产者在此futex上睡眠
+    volatile int32_t _ring_waiter_number; // 在_ring_drained上睡眠的生产者个数
+    CLock _ring_lock;            // 只在注册线程日志环时使用
+
+private: // 延迟格式化的二进制日志
+    bool _deferred_format_enabled;
+    std::set<uint64_t> _bin_strings; // 当前文件已写入字典的字符串地址，create之后只被CLogThread访问
 
 private: // 所有Logger共享同一个CLogThread
     static CLock _thread_lock; // 保护_log_thread的锁
     static CLogThread* _log_thread;
+    static uint64_t _ring_serial_seed;                 // 受_thread_lock保护
+    static bool _ring_index_used[LOGGER_NUMBER_MAX];  // 受_thread_lock保护
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,296 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ *
+ * 线程本地缓存（magazine），放在共享池（depot）前面，
+ * 每个线程有一个小的空闲对象栈，分配和回收通常只操作自己的栈而不需要加锁，
+ * 栈空时从共享池批量取，栈满时批量还给共享池，只有这时才需要加锁
+ */
+#ifndef MOOON_SYS_MAGAZINE_H
+#define MOOON_SYS_MAGAZINE_H
+#include "mooon/sys/lock.h"
+#include <pthread.h>
+SYS_NAMESPACE_BEGIN
+
+// 线程本地缓存的统计
+typedef struct
+{
+    uint64_t hits;        // 只操作线程本地缓存就完成的分配和回收次数
+    uint64_t misses;      // 需要访问共享池（批量取或批量还）的次数
+    uint64_t contentions; // 访问共享池时，锁正被其它线程持有的次数
+}magazine_stats_t;
+
+/***
+  * 线程本地缓存
+  * DepotClass为共享池，须提供以下两个方法，调用时已持有lock：
+  * 1) uint32_t take_batch(ItemType** items, uint32_t number)，返回实际取到的个数
+  * 2) void put_batch(ItemType** items, uint32_t number)
+  *
+  * 注意：destroy只能在没有其它线程使用时调用
+  */
+template <typename ItemType, class DepotClass>
+class CMagazineCache
+{
+public:
+    enum
+    {
+        MAGAZINE_SIZE_MAX = 256,
+        MAGAZINE_SIZE_DEFAULT = 32
+    };
+
+public:
+    CMagazineCache(DepotClass* depot, CLock* lock) throw ()
+        :_depot(depot)
+        ,_lock(lock)
+        ,_created(false)
+        ,_magazine_size(0)
+        ,_magazine_list(NULL)
+    {
+        clear_stats(&_retired_stats);
+    }
+
+    ~CMagazineCache() throw ()
+    {
+        destroy();
+    }
+
+    /***
+      * 创建线程本地缓存，须在共享池创建之后调用
+      * @magazine_size: 每个线程缓存的最多个数，为0表示不使用线程本地缓存
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void create(uint32_t magazine_size=MAGAZINE_SIZE_DEFAULT) throw (CSyscallException)
+    {
+        destroy();
+        clear_stats(&_retired_stats);
+
+        _magazine_size = (magazine_size > MAGAZINE_SIZE_MAX)? MAGAZINE_SIZE_MAX: magazine_size;
+        if (_magazine_size > 0)
+        {
+            int errcode = pthread_key_create(&_key, on_thread_exit);
+            if (errcode != 0)
+                THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_key_create");
+            _created = true;
+        }
+    }
+
+    /***
+      * 将所有线程缓存的对象还给共享池，须在共享池销毁之前调用
+      */
+    void destroy() throw ()
+    {
+        if (_created)
+        {
+            _created = false;
+            (void)pthread_key_delete(_key);
+
+            LockHelper<CLock> lock_helper(*_lock);
+            while (_magazine_list != NULL)
+                retire(_magazine_list);
+        }
+    }
+
+    /** 是否使用线程本地缓存 */
+    bool enabled() const throw ()
+    {
+        return _created;
+    }
+
+    /***
+      * 从线程本地缓存取一个对象，缓存为空时从共享池批量取
+      * @return: 共享池也为空时返回NULL
+      * @exception: 出错抛出CSyscallException异常
+      */
+    ItemType* get() throw (CSyscallException)
+    {
+        Magazine* magazine = get_magazine();
+
+        if (magazine->count > 0)
+        {
+            ++magazine->stats.hits;
+        }
+        else
+        {
+            ++magazine->stats.misses;
+            lock_depot(magazine);
+            magazine->count = _depot->take_batch(magazine->items, (_magazine_size+1) / 2);
+            _lock->unlock();
+
+            if (0 == magazine->count)
+                return NULL;
+        }
+
+        return magazine->items[--magazine->count];
+    }
+
+    /***
+      * 将一个对象放回线程本地缓存，缓存已满时将一半还给共享池
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void put(ItemType* item) throw (CSyscallException)
+    {
+        Magazine* magazine = get_magazine();
+
+        if (magazine->count < _magazine_size)
+        {
+            ++magazine->stats.hits;
+        }
+        else
+        {
+            // 保留栈底的一半，最近还回的对象更可能还在CPU缓存中，下次优先被取出
+            uint32_t number = _magazine_size / 2;
+
+            ++magazine->stats.misses;
+            lock_depot(magazine);
+            _depot->put_batch(magazine->items+(magazine->count-number), number);
+            _lock->unlock();
+            magazine->count -= number;
+        }
+
+        magazine->items[magazine->count++] = item;
+    }
+
+    /***
+      * 得到统计，包括已退出线程的
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void get_stats(magazine_stats_t* stats) const throw (CSyscallException)
+    {
+        LockHelper<CLock> lock_helper(*_lock);
+
+        *stats = _retired_stats;
+        for (Magazine* magazine=_magazine_list; magazine!=NULL; magazine=magazine->next)
+            add_stats(stats, magazine->stats);
+    }
+
+    /***
+      * 得到所有线程本地缓存中的对象个数，其它线程的个数可能正在变化，只是近似值
+      * @exception: 出错抛出CSyscallException异常
+      */
+    uint32_t get_cached_number() const throw (CSyscallException)
+    {
+        uint32_t cached_number = 0;
+        LockHelper<CLock> lock_helper(*_lock);
+
+        for (Magazine* magazine=_magazine_list; magazine!=NULL; magazine=magazine->next)
+            cached_number += magazine->count;
+        return cached_number;
+    }
+
+private:
+    struct Magazine
+    {
+        CMagazineCache* owner;
+        Magazine* prev;
+        Magazine* next;
+        volatile uint32_t count;
+        magazine_stats_t stats; // 只被所属线程修改
+        ItemType** items;       // 大小为_magazine_size
+    };
+
+    static void clear_stats(magazine_stats_t* stats)
+    {
+        stats->hits = 0;
+        stats->misses = 0;
+        stats->contentions = 0;
+    }
+
+    static void add_stats(magazine_stats_t* stats, const magazine_stats_t& other)
+    {
+        stats->hits += other.hits;
+        stats->misses += other.misses;
+        stats->contentions += other.contentions;
+    }
+
+    // 线程退出时，将它缓存的对象还给共享池
+    static void on_thread_exit(void* param)
+    {
+        Magazine* magazine = static_cast<Magazine*>(param);
+        CMagazineCache* owner = magazine->owner;
+
+        try
+        {
+            LockHelper<CLock> lock_helper(*owner->_lock);
+            owner->retire(magazine);
+        }
+        catch (CSyscallException&)
+        {
+        }
+    }
+
+    Magazine* get_magazine() throw (CSyscallException)
+    {
+        Magazine* magazine = static_cast<Magazine*>(pthread_getspecific(_key));
+
+        if (NULL == magazine)
+        {
+            magazine = new Magazine;
+            magazine->owner = this;
+            magazine->prev = NULL;
+            magazine->count = 0;
+            magazine->items = new ItemType*[_magazine_size];
+            clear_stats(&magazine->stats);
+
+            LockHelper<CLock> lock_helper(*_lock);
+            magazine->next = _magazine_list;
+            if (_magazine_list != NULL)
+                _magazine_list->prev = magazine;
+            _magazine_list = magazine;
+            (void)pthread_setspecific(_key, magazine);
+        }
+
+        return magazine;
+    }
+
+    void lock_depot(Magazine* magazine) throw (CSyscallException)
+    {
+        if (!_lock->try_lock())
+        {
+            ++magazine->stats.contentions;
+            _lock->lock();
+        }
+    }
+
+    // 调用时已持有锁
+    void retire(Magazine* magazine) throw ()
+    {
+        if (magazine->count > 0)
+            _depot->put_batch(magazine->items, magazine->count);
+        add_stats(&_retired_stats, magazine->stats);
+
+        if (magazine->prev != NULL)
+            magazine->prev->next = magazine->next;
+        else
+            _magazine_list = magazine->next;
+        if (magazine->next != NULL)
+            magazine->next->prev = magazine->prev;
+        delete []magazine->items;
+        delete magazine;
+    }
+
+private:
+    DepotClass* _depot;
+    CLock* _lock;
+    bool _created;
+    pthread_key_t _key;
+    uint32_t _magazine_size;
+    Magazine* _magazine_list;          // 所有线程的缓存，用于统计和销毁
+    magazine_stats_t _retired_stats;   // 已退出线程的统计
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_MAGAZINE_H
@@ -18,7 +18,7 @@
  */
 #ifndef MOOON_SYS_MEM_POOL_H
 #define MOOON_SYS_MEM_POOL_H
-#include "mooon/sys/lock.h"
+#include "mooon/sys/magazine.h"
 SYS_NAMESPACE_BEGIN
 
 /***
@@ -41,7 +41,7 @@ public:
       * @guard_size: 警戒大小
       * @guard_flag: 警戒标识
       */
-    void create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap=true, uint8_t guard_size=1, char guard_flag='m') throw ();
+    void create(uint32_t bucket_size, uint32_t bucket_number, bool use_heap=true, uint8_t guard_size=1, char guard_flag='m') throw ();
 
     /***
       * 分配内存内存
@@ -59,6 +59,32 @@ public:
       */
     bool reclaim(void* bucket) throw ();
 
+    /***
+      * 从池中批量分配，不会从堆上分配
+      * @return: 返回实际分配到的个数，池为空时返回0
+      */
+    uint32_t take_batch(void** buckets, uint32_t number) throw ();
+
+    /***
+      * 将take_batch分配的池内存批量回收，要求都是池内存且未被回收过
+      */
+    void put_batch(void** buckets, uint32_t number) throw ();
+
+    /***
+      * 得到池内存在池中的序号
+      * @return: 如果不是池内存或边界不对则返回false
+      */
+    bool get_bucket_index(const void* bucket, uint32_t* index) const throw ();
+
+    /** 判断是否在池内存范围内，不检查边界 */
+    bool is_pool_bucket(const void* bucket) const throw ();
+
+    /***
+      * 检查池内存末尾的警戒值是否被改写
+      * @return: 如果警戒值完好返回true，否则返回false
+      */
+    bool check_guard(const void* bucket) const throw ();
+
     /** 返回当内存池不够用时，是否从堆上分配内存 */
     bool use_heap() const throw ();
 
@@ -69,7 +95,7 @@ public:
     uint32_t get_pool_size() const throw ();
 
     /** 得到内存池可分配的内存大小 */
-    uint16_t get_bucket_size() const throw ();
+    uint32_t get_bucket_size() const throw ();
 
     /** 得到内存池中，当前还可以分配的内存个数 */
     uint32_t get_available_number() const throw ();
@@ -77,7 +103,8 @@ public:
 private:    
     bool _use_heap;             /** 内存池不够时，是否从堆上分配 */
     uint8_t _guard_size;        /** 警戒大小，实际需要的内存大小为: (_guard_size+_bucket_size)*_bucket_number */
-    uint16_t _bucket_size;      /** 内存大小，包含_guard_size部分，所以实际内存大小应当再减去_guard_size */
+    char _guard_flag;           /** 警戒标识 */
+    uint32_t _bucket_size;      /** 内存大小，包含_guard_size部分，所以实际内存大小应当再减去_guard_size */
     uint32_t _bucket_number;    /** 内存个数 */
     volatile uint32_t _stack_top_index;  /** 栈顶索引 */
     volatile uint32_t _available_number; /** 池中还可以分配的内存个数 */
@@ -91,11 +118,16 @@ private:
 
 /***
   * 线程安全的内存池，性能较CRawMemPool要低
+  * 每个线程有自己的缓存，大多数分配和回收不需要加锁，
+  * 只在线程缓存为空或满时，才加锁从CRawMemPool批量分配或批量回收
+  *
+  * 未定义NDEBUG时，回收时会检查警戒值是否被改写，以及是否重复回收
   */
 class CThreadMemPool
 {
 public:
-    CThreadMemPool() throw (CSyscallException) {}
+    CThreadMemPool() throw (CSyscallException);
+    ~CThreadMemPool() throw ();
 
     /** 销毁由create创建的内存池 */
     void destroy() throw (CSyscallException);
@@ -107,8 +139,10 @@ public:
       * @use_heap: 内存池不够时，是否从堆上分配
       * @guard_size: 警戒大小
       * @guard_flag: 警戒标识
+      * @magazine_size: 每个线程最多缓存的内存个数，为0表示不使用线程缓存，每次分配和回收都加锁
       */
-    void create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap=true, uint8_t guard_size=1, char guard_flag='m') throw (CSyscallException);
+    void create(uint32_t bucket_size, uint32_t bucket_number, bool use_heap=true, uint8_t guard_size=1, char guard_flag='m'
+              , uint32_t magazine_size=CMagazineCache<void, CRawMemPool>::MAGAZINE_SIZE_DEFAULT) throw (CSyscallException);
 
     /***
       * 分配内存内存
@@ -126,6 +160,9 @@ public:
       */
     bool reclaim(void* bucket) throw (CSyscallException);
 
+    /** 判断是否为池内存，从堆上分配的返回false，不检查边界 */
+    bool is_pool_bucket(const void* bucket) const throw ();
+
     /** 返回当内存池不够用时，是否从堆上分配内存 */
     bool use_heap() const throw ();
 
@@ -136,14 +173,19 @@ public:
     uint32_t get_pool_size() const throw ();
 
     /** 得到内存池可分配的内存大小 */
-    uint16_t get_bucket_size() const throw ();
+    uint32_t get_bucket_size() const throw ();
+
+    /** 得到内存池中，当前还可以分配的内存个数，包括各线程缓存中的 */
+    uint32_t get_available_number() const throw (CSyscallException);
+
+    /** 得到线程缓存的命中、未命中和锁冲突次数 */
+    void get_stats(magazine_stats_t* stats) const throw (CSyscallException);
 
-    /** 得到内存池中，当前还可以分配的内存个数 */
-    uint32_t get_available_number() const throw ();
-    
 private:
     CLock _lock;
     CRawMemPool _raw_mem_pool;
+    CMagazineCache<void, CRawMemPool> _magazine_cache;
+    volatile uint32_t* _debug_bitmap; /** 仅未定义NDEBUG时使用，位为1表示已分配给使用者，用来发现重复回收 */
 };
 
 SYS_NAMESPACE_END
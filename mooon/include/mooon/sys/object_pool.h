@@ -19,7 +19,7 @@
 #ifndef MOOON_SYS_OBJECT_POOL_H
 #define MOOON_SYS_OBJECT_POOL_H
 #include <mooon/utils/array_queue.h>
-#include "mooon/sys/lock.h"
+#include "mooon/sys/magazine.h"
 SYS_NAMESPACE_BEGIN
 
 /***
@@ -60,8 +60,17 @@ public:
         return _in_pool;
     }
 
+    /***
+      * 原子地将不在池中的对象设置为在池中，用于无锁的归还
+      * @return: 如果对象原本不在池中则返回true，已在池中（重复归还）则返回false
+      */
+    bool mark_in_pool() throw ()
+    {
+        return __sync_bool_compare_and_swap(&_in_pool, false, true);
+    }
+
 private:
-    bool _in_pool;
+    volatile bool _in_pool;
     uint32_t _index;    
 };
 
@@ -179,6 +188,33 @@ public:
         }
     }
 
+    /***
+      * 从池中批量取出对象，不会从堆中创建，也不改变对象是否在池中的状态，
+      * 供CThreadObjectPool的线程缓存使用
+      * @return: 返回实际取出的个数
+      */
+    uint32_t take_batch(ObjectClass** objects, uint32_t number) throw ()
+    {
+        uint32_t i;
+
+        for (i=0; (i<number) && !_object_queue->is_empty(); ++i)
+            objects[i] = _object_queue->pop_front();
+
+        _avaliable_number -= i;
+        return i;
+    }
+
+    /***
+      * 将take_batch取出的对象批量放回池中，这些对象的在池中状态应为true
+      */
+    void put_batch(ObjectClass** objects, uint32_t number) throw ()
+    {
+        for (uint32_t i=0; i<number; ++i)
+            _object_queue->push_back(objects[i]);
+
+        _avaliable_number += number;
+    }
+
     /** 得到总的对象个数，包括已经借出的和未借出的 */
     uint32_t get_pool_size() const throw ()
     {
@@ -202,6 +238,8 @@ private:
 /***
   * 线程安全的对象池，性能较CRawObjectPool低
   * 要求ObjectClass类必须是CPoolObject的子类
+  * 每个线程有自己的缓存，大多数借用和归还不需要加锁，
+  * 只在线程缓存为空或满时，才加锁从CRawObjectPool批量取出或批量放回
   */
 template <class ObjectClass>
 class CThreadObjectPool
@@ -212,23 +250,40 @@ public:
       * @use_heap: 当对象池中无对象时，是否从堆中创建对象
       */
     CThreadObjectPool(bool use_heap) throw (CSyscallException)
-        :_raw_object_pool(use_heap)
+        :_use_heap(use_heap)
+        ,_raw_object_pool(use_heap)
+        ,_magazine_cache(&_raw_object_pool, &_lock)
     {        
     }   
+
+    ~CThreadObjectPool() throw ()
+    {
+        _magazine_cache.destroy();
+    }
     
     /***
       * 创建对象池
       * @object_number: 需要创建的对象个数
+      * @magazine_size: 每个线程最多缓存的对象个数，为0表示不使用线程缓存，每次借用和归还都加锁
       */
-    void create(uint32_t object_number) throw (CSyscallException)
+    void create(uint32_t object_number, uint32_t magazine_size=MagazineCache::MAGAZINE_SIZE_DEFAULT) throw (CSyscallException)
     {
-        LockHelper<CLock> lock_helper(_lock);
-        _raw_object_pool.create(object_number);
+        destroy();
+
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            _raw_object_pool.create(object_number);
+        }
+
+        _magazine_cache.create(magazine_size);
     }
 
     /** 销毁对象池 */
     void destroy() throw (CSyscallException)
     {
+        // 须在加锁前，_magazine_cache.destroy会自己加锁
+        _magazine_cache.destroy();
+
         LockHelper<CLock> lock_helper(_lock);
         _raw_object_pool.destroy();
     }
@@ -236,15 +291,44 @@ public:
     /** 向对象池借用一个对象 */
     ObjectClass* borrow() throw (CSyscallException)
     {
-        LockHelper<CLock> lock_helper(_lock);
-        return _raw_object_pool.borrow();
+        if (!_magazine_cache.enabled())
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            return _raw_object_pool.borrow();
+        }
+
+        ObjectClass* object = _magazine_cache.get();
+        if (object != NULL)
+        {
+            object->set_in_pool(false);
+        }
+        else if (_use_heap)
+        {
+            // 和CRawObjectPool::borrow一样，index为0表示不是对象池中的对象
+            object = new ObjectClass;
+            object->set_index(0);
+        }
+
+        return object;
     }
 
     /** 将一个对象归还给对象池 */
     void pay_back(ObjectClass* object) throw (CSyscallException)
     {
-        LockHelper<CLock> lock_helper(_lock);
-        _raw_object_pool.pay_back(object);
+        if (!_magazine_cache.enabled())
+        {
+            LockHelper<CLock> lock_helper(_lock);
+            _raw_object_pool.pay_back(object);
+        }
+        else if (0 == object->get_index())
+        {
+            delete object;
+        }
+        else if (object->mark_in_pool()) // 在池中的不重复归还，并发的重复归还只有一个成功
+        {
+            object->reset();
+            _magazine_cache.put(object);
+        }
     }
 
     /** 得到总的对象个数，包括已经借出的和未借出的 */
@@ -254,16 +338,27 @@ public:
         return _raw_object_pool.get_pool_size();
     }
     
-    /** 得到对象池中还未借出的对象个数 */
+    /** 得到对象池中还未借出的对象个数，包括各线程缓存中的 */
     volatile uint32_t get_avaliable_number() const throw (CSyscallException)
     {
+        uint32_t cached_number = _magazine_cache.get_cached_number();
         LockHelper<CLock> lock_helper(_lock);
-        return _raw_object_pool.get_avaliable_number();
+        return _raw_object_pool.get_avaliable_number() + cached_number;
+    }
+
+    /** 得到线程缓存的命中、未命中和锁冲突次数 */
+    void get_stats(magazine_stats_t* stats) const throw (CSyscallException)
+    {
+        _magazine_cache.get_stats(stats);
     }
     
 private:
-    CLock _lock;
+    typedef CMagazineCache<ObjectClass, CRawObjectPool<ObjectClass> > MagazineCache;
+
+    bool _use_heap;
+    mutable CLock _lock;
     CRawObjectPool<ObjectClass> _raw_object_pool;
+    MagazineCache _magazine_cache;
 };
 
 SYS_NAMESPACE_END
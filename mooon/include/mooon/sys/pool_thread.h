@@ -111,6 +111,16 @@ public:
       */
     size_t get_stack_size() const throw (CSyscallException);
 
+    /** 设置线程绑定的CPU，由CThreadPool::create根据亲和配置设置，在set_parameter之前
+      * @cpu: CPU编号，为-1表示不绑定
+      */
+    void set_cpu_affinity(int cpu) throw ();
+
+    /** 得到线程绑定的CPU，未绑定返回-1，
+      * 可在before_start中用来决定线程私有数据所在的NUMA结点
+      */
+    int get_cpu_affinity() const throw ();
+
     /** 得到本线程号 */
     uint32_t get_thread_id() const throw ();
 
@@ -0,0 +1,134 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ *
+ * 进程内的RCU（Read-Copy-Update），适用于读多写少的数据，如热加载的配置：
+ * 读者不加锁、不复制，写者复制出新版本后整体替换，旧版本在所有可能看到它的读者离开后才释放。
+ * 基于纪元（epoch）回收：每个读线程有一个私有的纪元记录，进入读区时记下全局纪元，离开时清零，
+ * 写者替换后推进全局纪元，并等待所有记录着旧纪元的读者离开。
+ */
+#ifndef MOOON_SYS_RCU_H
+#define MOOON_SYS_RCU_H
+#include "mooon/sys/config.h"
+SYS_NAMESPACE_BEGIN
+
+/***
+  * RCU读区和宽限期，全进程共用一个域
+  */
+class CRcu
+{
+public:
+    /***
+      * 进入读区，可嵌套。读区内可以安全访问CRcuSnapshot::get()返回的数据，
+      * 读区内不能调用synchronize，否则会死锁
+      */
+    static void read_lock();
+
+    /** 离开读区 */
+    static void read_unlock();
+
+    /***
+      * 等待宽限期结束：调用之前已进入读区的读者都离开了读区，
+      * 之后便可以安全释放调用之前被替换下来的数据。
+      * 写者一般很少，这里直接睡眠等待，不适合在对延迟敏感的线程中调用
+      */
+    static void synchronize();
+};
+
+/***
+  * 读区帮助类，用于自动离开读区
+  */
+class CRcuReadHelper
+{
+public:
+    CRcuReadHelper()
+    {
+        CRcu::read_lock();
+    }
+
+    ~CRcuReadHelper()
+    {
+        CRcu::read_unlock();
+    }
+};
+
+/***
+  * RCU快照，持有一个整体替换的对象，使用示例：
+  * 读者：
+  * {
+  *     sys::CRcuReadHelper rcu_read_helper;
+  *     const Config* config = snapshot.get();
+  *     ...使用config，离开读区后不能再使用
+  * }
+  * 写者：
+  * snapshot.update(new Config(...)); // 返回时旧的已被delete
+  */
+template <class DataType>
+class CRcuSnapshot
+{
+public:
+    explicit CRcuSnapshot(DataType* data=NULL)
+        :_data(data)
+    {
+    }
+
+    /** 析构时不再有读者，直接delete */
+    ~CRcuSnapshot()
+    {
+        delete _data;
+    }
+
+    /** 得到当前版本，只能在读区内调用，返回值只在读区内有效 */
+    const DataType* get() const
+    {
+        return __atomic_load_n(&_data, __ATOMIC_ACQUIRE);
+    }
+
+    /***
+      * 发布新版本，并返回被替换下来的旧版本，
+      * 调用者应在CRcu::synchronize之后才能delete旧版本，
+      * 用于需要在持有其它锁时发布、在锁外等待宽限期的场景
+      */
+    DataType* exchange(DataType* data)
+    {
+        return __atomic_exchange_n(&_data, data, __ATOMIC_SEQ_CST);
+    }
+
+    /***
+      * 发布新版本，等待宽限期后delete旧版本，
+      * 多个写者之间需要调用者自行互斥，不能在读区内调用
+      */
+    void update(DataType* data)
+    {
+        DataType* old_data = exchange(data);
+        if (old_data != NULL)
+        {
+            CRcu::synchronize();
+            delete old_data;
+        }
+    }
+
+private:
+    CRcuSnapshot(const CRcuSnapshot&);
+    CRcuSnapshot& operator =(const CRcuSnapshot&);
+
+private:
+    DataType* volatile _data;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_RCU_H
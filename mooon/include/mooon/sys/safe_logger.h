@@ -20,9 +20,12 @@
 #define MOOON_SYS_SAFE_LOGGER_H
 #include <mooon/sys/log.h>
 #include <mooon/sys/atomic.h>
+#include <mooon/sys/event.h>
 #include <mooon/sys/read_write_lock.h>
 #include <mooon/sys/syscall_exception.h>
 #include <stdio.h>
+#include <sys/uio.h>
+#include <vector>
 SYS_NAMESPACE_BEGIN
 
 // CSafeLogger支持：
@@ -31,7 +34,26 @@ SYS_NAMESPACE_BEGIN
 // 3) 通过环境变量名MOOON_LOG_TRACE来控制是否显示trace日志
 // 4) 通过环境变量名MOOON_LOG_FILESIZE来控制单个日志文件的大小
 // 5) 通过环境变量名MOOON_LOG_BACKUP来控制日志文件备份个数
+//
+// 异步模式（async_buffer_size不为0时启用）：
+// 写日志的线程只将格式化好的日志行追加到有界缓冲区，由后台写线程合并成大批量writev写入，
+// 滚动仍由写入方在文件锁保护下完成，所以多进程共享同一日志文件依然安全。
+// FATAL日志总是等到写入文件后才返回，fork出的子进程自动退回到同步写。
+//
+// 滚动检测：
+// 滚动状态映射自锁文件，由所有进程共享：各进程将写入的字节数累加到共享的估计值上，
+// 只有估计值超过单个文件大小，或者距上次检测超过ROTATE_CHECK_INTERVAL秒时才fstat确认，
+// 而不是每写一行fstat一次；滚动者递增共享的滚动代数，其它进程写日志时发现代数变化即重新打开日志文件，
+// 这些都只是内存操作，不需要系统调用。
 class CSafeLogger;
+class CThreadEngine;
+
+// 异步模式下缓冲区满时的处理策略
+typedef enum
+{
+    ASYNC_OVERFLOW_BLOCK = 0, // 等待后台写线程腾出空间（默认）
+    ASYNC_OVERFLOW_DROP  = 1  // 丢弃日志并计数，丢弃条数会被定期写入日志文件，但FATAL日志仍等待不丢弃
+}async_overflow_policy_t;
 
 // 根据程序文件创建CSafeLogger
 //
@@ -46,8 +68,10 @@ class CSafeLogger;
 // suffix 日志文件名后缀
 // 假设程序名为test，后缀为空则日志文件名为test.log，如果后缀为6789则日志文件名为test_6789.log
 //
+// async_buffer_size 异步模式的缓冲区字节数，为0表示同步写
+//
 // 若因目录和文件名，或者创建、打开文件权限等问题，则会抛出CSyscallException异常
-extern CSafeLogger* create_safe_logger(bool enable_program_path=true, uint16_t log_line_size=SIZE_8K, const std::string& suffix=std::string(""), bool enable_syslog=false) throw (CSyscallException);
+extern CSafeLogger* create_safe_logger(bool enable_program_path=true, uint16_t log_line_size=SIZE_8K, const std::string& suffix=std::string(""), bool enable_syslog=false, uint32_t async_buffer_size=0) throw (CSyscallException);
 
 // 根据程序文件创建CSafeLogger
 // 若因目录和文件名，或者创建、打开文件权限等问题，则会抛出CSyscallException异常
@@ -57,7 +81,7 @@ extern CSafeLogger* create_safe_logger(bool enable_program_path=true, uint16_t l
 // 2) 假设CGI的cpp文件名为mooon.cc，则日志文件名为mooon.log
 // 使用示例：
 // mooon::sys::g_logger = create_safe_logger(logdir, __FILE__);
-extern CSafeLogger* create_safe_logger(const std::string& log_dirpath, const std::string& cpp_filename, uint16_t log_line_size=8192, bool enable_syslog=false) throw (CSyscallException);
+extern CSafeLogger* create_safe_logger(const std::string& log_dirpath, const std::string& cpp_filename, uint16_t log_line_size=8192, bool enable_syslog=false, uint32_t async_buffer_size=0) throw (CSyscallException);
 
 /**
   * 多线程和多进程安全的日志器
@@ -65,9 +89,19 @@ extern CSafeLogger* create_safe_logger(const std::string& log_dirpath, const std
 class CSafeLogger: public ILogger
 {
 public:
-    CSafeLogger(const char* log_dir, const char* log_filename, uint16_t log_line_size=8192, bool enable_syslog=false) throw (CSyscallException);
+    /***
+      * @async_buffer_size: 异步模式的缓冲区字节数，为0表示同步写
+      */
+    CSafeLogger(const char* log_dir, const char* log_filename, uint16_t log_line_size=8192, bool enable_syslog=false, uint32_t async_buffer_size=0) throw (CSyscallException);
     virtual ~CSafeLogger();
 
+    /** 设置异步模式下缓冲区满时的处理策略 */
+    void set_async_overflow_policy(async_overflow_policy_t overflow_policy);
+    /** 得到异步模式下因缓冲区满而丢弃的日志条数 */
+    uint64_t get_async_dropped_number() const;
+    /** 等待异步模式下已缓冲的日志全部写入文件，同步模式时直接返回 */
+    void flush();
+
     virtual int get_log_level() const;
     virtual std::string get_log_dir() const;
     virtual std::string get_log_filename() const;
@@ -146,14 +180,41 @@ public:
     virtual void log_bin(const char* filename, int lineno, const char* module_name, const char* log, uint16_t size);
 
 private:
-    bool need_rotate(int fd) const;
+    bool need_rotate(int fd);
+    bool need_check_rotate(int bytes);
+    void check_rotate(int log_fd);
+    void reopen_log();
+    void map_rotate_state();
+    int format_log_header(void* thread_log_context, log_level_t log_level, const char* filename, int lineno, const char* module_name) const;
     void do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args);
     void rotate_log();
     void write_log(const char* log_line, int log_line_size);
+    void write_log(const struct iovec* iov_array, int iov_number);
 
 private:
     int prepare_log_fd();
 
+private: // 滚动检测
+    struct RotateState
+    {
+        volatile uint64_t generation;     // 滚动代数，每滚动一次加1
+        volatile int64_t estimated_bytes; // 上次fstat得到的文件大小，加上之后所有进程写入的字节数
+    };
+
+private: // 异步模式
+    struct AsyncBuffer
+    {
+        char* data;
+        uint32_t length;
+    };
+
+    bool is_async() const;
+    void create_async_buffers(uint32_t async_buffer_size);
+    void destroy_async_buffers();
+    void async_log(const char* log_line, int log_line_size, bool wait_written);
+    void async_write_thread();
+    void write_dropped_notice(uint64_t dropped_number);
+
 private:
     CReadWriteLock _read_write_lock;
     int _log_fd;
@@ -177,6 +238,31 @@ private:
     const std::string _log_filename;
     const std::string _log_filepath;
     const std::string _log_shortname;
+    const std::string _log_lockpath;   // 滚动时加锁的文件，也存放滚动代数
+
+private: // 滚动检测
+    RotateState* _rotate_state;            // 指向映射自锁文件的共享状态，映射失败时指向_local_rotate_state
+    RotateState _local_rotate_state;       // 只对本进程有效，其它进程的滚动只能靠定期fstat发现
+    volatile uint64_t _log_generation;     // _log_fd对应的滚动代数
+    volatile time_t _last_checked_seconds; // 本进程上次fstat的时间
+
+private: // 异步模式
+    bool _async_enabled;
+    volatile bool _async_stop;
+    pid_t _async_pid;                 // 创建后台写线程的进程
+    async_overflow_policy_t _async_overflow_policy;
+    uint32_t _async_buffer_capacity;  // 单个缓冲块的字节数
+    AsyncBuffer* _async_current;      // 正在被追加的缓冲块
+    std::vector<AsyncBuffer*> _async_free_buffers;
+    std::vector<AsyncBuffer*> _async_full_buffers;
+    std::vector<AsyncBuffer*> _async_writing_buffers; // 只被后台写线程使用
+    uint64_t _async_appended_sequence; // 已追加的日志条数
+    uint64_t _async_written_sequence;  // 已写入文件的日志条数
+    volatile uint64_t _async_dropped_number;
+    CLock _async_lock;
+    CEvent _async_writer_event;        // 唤醒后台写线程
+    CEvent _async_space_event;         // 唤醒等待缓冲区或等待写入完成的线程
+    CThreadEngine* _async_thread;
 };
 
 SYS_NAMESPACE_END
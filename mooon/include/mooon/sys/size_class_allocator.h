@@ -0,0 +1,111 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_SIZE_CLASS_ALLOCATOR_H
+#define MOOON_SYS_SIZE_CLASS_ALLOCATOR_H
+#include "mooon/sys/mem_pool.h"
+#include <vector>
+SYS_NAMESPACE_BEGIN
+
+// 一个大小类的统计
+typedef struct
+{
+    uint32_t class_size;             // 大小类可分配的最大字节数
+    uint32_t pool_size;              // 池内存个数
+    uint32_t available_number;       // 池中（包括各线程缓存中）还可分配的个数，已用个数为pool_size-available_number
+    uint64_t heap_number;            // 池用完后从堆上分配的累计次数
+    magazine_stats_t magazine_stats; // 线程缓存的统计
+}size_class_stats_t;
+
+/***
+  * 按大小分类的内存分配器，线程安全
+  * 32字节到64KB之间按2的幂及两个幂的中间值分成23个大小类，每个大小类一个CThreadMemPool，
+  * 池用完后从堆上分配，超过64KB的直接使用mmap分配，释放时munmap
+  *
+  * 每块内存前有16字节的头，记录所属的大小类，所以返回的内存总是16字节对齐
+  */
+class CSizeClassAllocator
+{
+public:
+    enum
+    {
+        SIZE_CLASS_MIN = 32,
+        SIZE_CLASS_MAX = 65536,
+        SIZE_CLASS_NUMBER = 23,
+        CLASS_MEMORY_DEFAULT = 262144
+    };
+
+public:
+    CSizeClassAllocator() throw ();
+    ~CSizeClassAllocator() throw ();
+
+    /***
+      * 创建分配器
+      * @class_memory: 每个大小类预分配的内存字节数，池内存个数为class_memory除以类大小，至少为1个
+      * @magazine_size: 每个线程为每个大小类缓存的最多个数，为0表示不使用线程缓存
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void create(uint32_t class_memory=CLASS_MEMORY_DEFAULT, uint32_t magazine_size=CMagazineCache<void, CRawMemPool>::MAGAZINE_SIZE_DEFAULT) throw (CSyscallException);
+
+    /***
+      * 销毁分配器，须在没有其它线程使用时调用，
+      * 之后不能再回收之前分配的大小类内存
+      */
+    void destroy() throw (CSyscallException);
+
+    /***
+      * 分配内存
+      * @size: 需要的字节数，可以为0
+      * @return: 返回至少size字节的内存，总是不为NULL
+      * @exception: mmap出错抛出CSyscallException异常
+      */
+    void* allocate(size_t size) throw (CSyscallException);
+
+    /***
+      * 回收由allocate分配的内存
+      * @ptr: 为NULL时什么也不做
+      * @exception: munmap出错抛出CSyscallException异常
+      */
+    void reclaim(void* ptr) throw (CSyscallException);
+
+    /** 得到size字节实际使用的大小类的大小，超过SIZE_CLASS_MAX的返回size本身 */
+    static size_t get_class_size(size_t size) throw ();
+
+    /** 得到各大小类的统计 */
+    void get_class_stats(std::vector<size_class_stats_t>* stats_array) const throw (CSyscallException);
+
+    /***
+      * 得到超过SIZE_CLASS_MAX的，通过mmap分配还未回收的内存统计
+      * @number: 存储内存块数
+      * @bytes: 存储映射的字节数
+      */
+    void get_large_stats(uint64_t* number, uint64_t* bytes) const throw ();
+
+private:
+    static int get_class_index(size_t size) throw ();
+
+private:
+    uint32_t _class_size[SIZE_CLASS_NUMBER];
+    CThreadMemPool _pools[SIZE_CLASS_NUMBER];
+    volatile uint64_t _heap_number[SIZE_CLASS_NUMBER];
+    volatile uint64_t _large_number;
+    volatile uint64_t _large_bytes;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_SIZE_CLASS_ALLOCATOR_H
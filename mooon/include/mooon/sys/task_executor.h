@@ -0,0 +1,346 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_TASK_EXECUTOR_H
+#define MOOON_SYS_TASK_EXECUTOR_H
+#include "mooon/sys/futex.h"
+#include "mooon/sys/lock_free_queue.h"
+#include "mooon/sys/ref_countable.h"
+#include "mooon/sys/thread_engine.h"
+#include "mooon/sys/thread_pool.h"
+#include "mooon/utils/bind.h"
+#include <limits.h>
+SYS_NAMESPACE_BEGIN
+
+/***
+  * 任务基类，由CTaskExecutor的工作线程执行，执行后被delete
+  */
+class CTask
+{
+public:
+    virtual ~CTask() {}
+    virtual void run() = 0;
+};
+
+/***
+  * 任务结果的状态部分，不依赖结果类型
+  */
+class CTaskFutureBase: public CRefCountable
+{
+public:
+    CTaskFutureBase()
+        :_state(task_pending)
+        ,_waiters(0)
+    {
+    }
+
+    /** 任务是否已执行完，包括执行失败 */
+    bool is_done() const
+    {
+        return __atomic_load_n(&_state, __ATOMIC_ACQUIRE) != task_pending;
+    }
+
+    /** 任务是否因抛出异常而失败 */
+    bool is_failed() const
+    {
+        return task_failed == __atomic_load_n(&_state, __ATOMIC_ACQUIRE);
+    }
+
+    /** 等待任务执行完 */
+    void wait()
+    {
+        (void)timed_wait(0);
+    }
+
+    /***
+      * 等待任务执行完
+      * @milliseconds: 最长等待的毫秒数，为0表示一直等待
+      * @return: 执行完返回true，超时返回false
+      */
+    bool timed_wait(uint32_t milliseconds)
+    {
+        if (is_done())
+            return true;
+
+        uint64_t deadline = get_monotonic_milliseconds() + milliseconds;
+        __sync_add_and_fetch(&_waiters, 1);
+        while (!is_done())
+        {
+            uint32_t remaining = 0;
+            if (milliseconds > 0)
+            {
+                uint64_t now = get_monotonic_milliseconds();
+                if (now >= deadline)
+                    break;
+                remaining = static_cast<uint32_t>(deadline - now);
+            }
+
+            futex_wait(&_state, task_pending, remaining);
+        }
+
+        __sync_sub_and_fetch(&_waiters, 1);
+        return is_done();
+    }
+
+protected:
+    // 只由执行任务的线程调用
+    void complete(bool failed)
+    {
+        __atomic_store_n(&_state, failed? task_failed: task_done, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&_waiters, __ATOMIC_SEQ_CST) > 0)
+            futex_wake(&_state, INT_MAX);
+    }
+
+private:
+    enum
+    {
+        task_pending = 0,
+        task_done    = 1,
+        task_failed  = 2
+    };
+
+    volatile int32_t _state;
+    volatile int32_t _waiters;
+};
+
+/***
+  * 任务结果，由CTaskExecutor::submit返回，
+  * 使用引用计数管理，调用者用完后应调用dec_refcount
+  */
+template <typename ReturnType>
+class CTaskFuture: public CTaskFutureBase
+{
+    template <typename> friend class CFutureTask;
+
+public:
+    CTaskFuture()
+        :_result()
+    {
+    }
+
+    /** 等待任务执行完，并返回任务的返回值，任务失败时返回默认值 */
+    const ReturnType& get()
+    {
+        wait();
+        return _result;
+    }
+
+private:
+    void invoke(utils::Functor<ReturnType>& functor)
+    {
+        _result = functor();
+    }
+
+private:
+    ReturnType _result;
+};
+
+template <>
+class CTaskFuture<void>: public CTaskFutureBase
+{
+    template <typename> friend class CFutureTask;
+
+private:
+    void invoke(utils::Functor<void>& functor)
+    {
+        functor();
+    }
+};
+
+/***
+  * 任务完成回调接口，在执行任务的工作线程中被回调
+  */
+template <typename ReturnType>
+class CALLBACK_INTERFACE ITaskCallback
+{
+public:
+    /** 空虚拟析构函数，以屏蔽编译器告警 */
+    virtual ~ITaskCallback() {}
+
+    /** 任务执行完（包括失败）后被回调，此时future->is_done()为true */
+    virtual void on_task_completed(CTaskFuture<ReturnType>* future) = 0;
+};
+
+/***
+  * 带结果的任务，持有future的一个引用
+  */
+template <typename ReturnType>
+class CFutureTask: public CTask
+{
+public:
+    CFutureTask(const utils::Functor<ReturnType>& functor, CTaskFuture<ReturnType>* future, ITaskCallback<ReturnType>* callback)
+        :_functor(functor)
+        ,_future(future)
+        ,_callback(callback)
+    {
+        _future->inc_refcount();
+    }
+
+    ~CFutureTask()
+    {
+        _future->dec_refcount();
+    }
+
+    virtual void run()
+    {
+        bool failed = false;
+
+        try
+        {
+            _future->invoke(_functor);
+        }
+        catch (...)
+        {
+            failed = true;
+        }
+
+        _future->complete(failed);
+        if (_callback != NULL)
+            _callback->on_task_completed(_future);
+    }
+
+private:
+    utils::Functor<ReturnType> _functor;
+    CTaskFuture<ReturnType>* _future;
+    ITaskCallback<ReturnType>* _callback;
+};
+
+/***
+  * 不关心结果的任务，用sys::bind绑定
+  */
+class CFunctorTask: public CTask
+{
+public:
+    CFunctorTask(const Functor& functor)
+        :_functor(functor)
+    {
+    }
+
+    virtual void run()
+    {
+        _functor();
+    }
+
+private:
+    Functor _functor;
+};
+
+/** 执行器统计 */
+typedef struct
+{
+    uint64_t executed_number; /** 执行的任务数 */
+    uint64_t stolen_number;   /** 从其它线程窃取的任务数 */
+    uint64_t parked_number;   /** 因无任务而睡眠的次数 */
+}executor_stats_t;
+
+/***
+  * 工作窃取任务执行器，基于CThreadPool
+  * 每个工作线程有一个CWorkStealingDeque，工作线程中提交的任务放入自己的队列底部，
+  * 其它线程提交的任务放入全局注入队列（CLockFreeQueue）。
+  * 工作线程依次从自己队列底部、注入队列取任务，都没有时随机选择其它线程从其队列顶部窃取，
+  * 仍没有则在futex上睡眠，直到有新任务提交。
+  *
+  * 使用示例：
+  * CTaskExecutor executor;
+  * executor.create(4);
+  * executor.execute(sys::bind(&foo, 1));
+  * CTaskFuture<int>* future = executor.submit(utils::bind<int>(&bar, 2));
+  * int result = future->get();
+  * future->dec_refcount();
+  * executor.destroy();
+  */
+class CExecutorThread;
+class CTaskExecutor
+{
+    friend class CExecutorThread;
+
+public:
+    CTaskExecutor();
+    ~CTaskExecutor();
+
+    /***
+      * 创建执行器，并启动所有工作线程
+      * @thread_count: 工作线程个数
+      * @queue_size: 全局注入队列的大小，工作线程中提交的任务不受此限制
+      * @exception: 出错抛出CSyscallException异常
+      */
+    void create(uint16_t thread_count, uint32_t queue_size=10000) throw (CSyscallException);
+
+    /***
+      * 停止所有工作线程，已提交的任务都会在返回之前执行完
+      */
+    void destroy() throw (CSyscallException);
+
+    /***
+      * 提交一个任务，执行完后delete
+      * @return: 如果注入队列已满，则返回false，调用者负责delete任务
+      */
+    bool push_task(CTask* task);
+
+    /***
+      * 提交一个不关心结果的任务，如：execute(sys::bind(&foo, 1))
+      * @return: 如果注入队列已满，则返回false
+      */
+    bool execute(const Functor& functor);
+
+    /***
+      * 提交一个带结果的任务，如：submit(utils::bind<int>(&bar, 2))
+      * @callback: 任务完成后在工作线程中回调，可为NULL
+      * @return: 返回任务结果，调用者用完后应调用dec_refcount；如果注入队列已满，则返回NULL
+      */
+    template <typename ReturnType>
+    CTaskFuture<ReturnType>* submit(const utils::Functor<ReturnType>& functor, ITaskCallback<ReturnType>* callback=NULL)
+    {
+        CTaskFuture<ReturnType>* future = new CTaskFuture<ReturnType>;
+        future->inc_refcount(); // 调用者的引用
+
+        CTask* task = new CFutureTask<ReturnType>(functor, future, callback);
+        if (!push_task(task))
+        {
+            delete task;
+            future->dec_refcount();
+            return NULL;
+        }
+
+        return future;
+    }
+
+    /** 得到工作线程个数 */
+    uint16_t get_thread_count() const { return _thread_count; }
+
+    /** 得到所有工作线程的统计之和 */
+    void get_stats(executor_stats_t* stats) const;
+
+private:
+    CTask* get_task(CExecutorThread* thread);
+    bool has_task() const;
+    void park(CExecutorThread* thread);
+    void signal();
+    void wakeup_all();
+
+private:
+    CThreadPool<CExecutorThread> _thread_pool;
+    uint16_t _thread_count;
+    CExecutorThread** _thread_array; // 各持有一个引用，线程池逐个停止线程时，其它线程仍可能窃取它的队列
+    CLockFreeQueue<CTask*>* _injection_queue;
+    volatile int32_t _wake_sequence; // 睡眠的工作线程在此futex上等待
+    volatile int32_t _sleepers;      // 正在睡眠或准备睡眠的工作线程个数
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_TASK_EXECUTOR_H
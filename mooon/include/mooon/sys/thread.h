@@ -78,6 +78,15 @@ public:
       */
     size_t get_stack_size() const throw (CSyscallException);
 
+    /** 设置线程绑定的CPU。应当在start之前调用，否则设置无效。
+      * @cpu: CPU编号，为-1表示不绑定（默认）
+      * @exception: 不抛出异常
+      */
+    void set_cpu_affinity(int cpu) throw () { _cpu = cpu; }
+
+    /** 得到线程绑定的CPU，未绑定返回-1 */
+    int get_cpu_affinity() const throw () { return _cpu; }
+
     /** 得到本线程号 */
     uint32_t get_thread_id() const { return _thread; }
     
@@ -130,7 +139,8 @@ private:
 private:
     pthread_t _thread;
     pthread_attr_t _attr;
-    size_t _stack_size;    
+    size_t _stack_size;
+    int _cpu; /** 绑定的CPU，-1表示不绑定 */
 };
 
 
@@ -18,6 +18,7 @@
  */
 #ifndef MOOON_SYS_THREAD_POOL_H
 #define MOOON_SYS_THREAD_POOL_H
+#include "mooon/sys/cpu_affinity.h"
 #include "mooon/sys/utils.h"
 SYS_NAMESPACE_BEGIN
 
@@ -41,17 +42,24 @@ public:
       * 所以需要唤醒它们，用法请参见后面的示例
       * @thread_count: 线程池中的线程个数
       * @parameter: 传递给池线程的参数
+      * @cpu_affinity: CPU亲和配置，为空表示不绑定，格式请参见CCpuAffinity，
+      *                如"spread"、"compact"或"0-3,8"，第i个线程绑定到对应列表中的第i%n个CPU
       * @exception: 可抛出CSyscallException异常，
-      *             如果是因为CPoolThread::before_start返回false，则出错码为0
+      *             如果是因为CPoolThread::before_start返回false，则出错码为0，
+      *             如果是亲和配置无效，则出错码为EINVAL
       */
-    void create(uint16_t thread_count, void* parameter=NULL) throw (CSyscallException)
+    void create(uint16_t thread_count, void* parameter=NULL, const std::string& cpu_affinity="") throw (CSyscallException)
     {
+        CCpuAffinity affinity;
+        affinity.parse(cpu_affinity);
+
         _thread_array = new ThreadClass*[thread_count];
         for (uint16_t i=0; i<thread_count; ++i)
         {
             _thread_array[i] = new ThreadClass;            
             _thread_array[i]->inc_refcount();
             _thread_array[i]->set_index(i);
+            _thread_array[i]->set_cpu_affinity(affinity.get_thread_cpu(i));
             _thread_array[i]->set_parameter(parameter);
         }
         for (uint16_t i=0; i<thread_count; ++i)
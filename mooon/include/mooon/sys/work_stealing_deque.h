@@ -0,0 +1,193 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_SYS_WORK_STEALING_DEQUE_H
+#define MOOON_SYS_WORK_STEALING_DEQUE_H
+#include "mooon/sys/config.h"
+SYS_NAMESPACE_BEGIN
+
+/***
+  * Chase-Lev工作窃取双端队列
+  * 只有属主线程可以调用push_bottom和pop_bottom，在底部后进先出，
+  * 其它线程调用steal_top从顶部窃取，先进先出，属主和窃取者只在队列仅剩一个元素时才竞争。
+  * 容量不足时自动翻倍，旧的数组可能仍被窃取者读取，所以要到析构时才释放。
+  * DataType要求为指针等可原子读写的类型
+  */
+template <typename DataType>
+class CWorkStealingDeque
+{
+private:
+    struct Array
+    {
+        int64_t capacity; // 总是2的幂
+        DataType* elems;
+        Array* retired;   // 被替换下来的旧数组
+
+        Array(int64_t capacity_, Array* retired_)
+            :capacity(capacity_)
+            ,elems(new DataType[capacity_])
+            ,retired(retired_)
+        {
+        }
+
+        ~Array()
+        {
+            delete []elems;
+        }
+
+        DataType get(int64_t index) const
+        {
+            return __atomic_load_n(&elems[index & (capacity-1)], __ATOMIC_RELAXED);
+        }
+
+        void put(int64_t index, DataType elem)
+        {
+            __atomic_store_n(&elems[index & (capacity-1)], elem, __ATOMIC_RELAXED);
+        }
+    };
+
+public:
+    /***
+      * 构造一个工作窃取队列
+      * @capacity: 初始容量，会被调整为2的幂
+      */
+    explicit CWorkStealingDeque(uint32_t capacity=256)
+        :_top(0)
+        ,_bottom(0)
+    {
+        int64_t real_capacity = 2;
+        while (real_capacity < capacity)
+            real_capacity <<= 1;
+
+        _array = new Array(real_capacity, NULL);
+    }
+
+    ~CWorkStealingDeque()
+    {
+        Array* array = _array;
+        while (array != NULL)
+        {
+            Array* retired = array->retired;
+            delete array;
+            array = retired;
+        }
+    }
+
+    /** 在底部放入一个元素，只能由属主线程调用 */
+    void push_bottom(DataType elem)
+    {
+        int64_t bottom = __atomic_load_n(&_bottom, __ATOMIC_RELAXED);
+        int64_t top = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+        Array* array = __atomic_load_n(&_array, __ATOMIC_RELAXED);
+
+        if (bottom - top > array->capacity - 1)
+            array = grow(array, bottom, top);
+
+        array->put(bottom, elem);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        __atomic_store_n(&_bottom, bottom+1, __ATOMIC_RELAXED);
+    }
+
+    /***
+      * 从底部取出一个元素，只能由属主线程调用
+      * @return: 队列为空返回false
+      */
+    bool pop_bottom(DataType& elem)
+    {
+        int64_t bottom = __atomic_load_n(&_bottom, __ATOMIC_RELAXED) - 1;
+        Array* array = __atomic_load_n(&_array, __ATOMIC_RELAXED);
+        __atomic_store_n(&_bottom, bottom, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int64_t top = __atomic_load_n(&_top, __ATOMIC_RELAXED);
+
+        if (top > bottom)
+        {
+            // 空
+            __atomic_store_n(&_bottom, bottom+1, __ATOMIC_RELAXED);
+            return false;
+        }
+
+        elem = array->get(bottom);
+        if (top == bottom)
+        {
+            // 最后一个元素，和窃取者竞争
+            bool won = __atomic_compare_exchange_n(&_top, &top, top+1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+            __atomic_store_n(&_bottom, bottom+1, __ATOMIC_RELAXED);
+            return won;
+        }
+
+        return true;
+    }
+
+    /***
+      * 从顶部窃取一个元素，可由任意线程调用
+      * @return: 队列为空，或和其它线程竞争失败时返回false
+      */
+    bool steal_top(DataType& elem)
+    {
+        int64_t top = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int64_t bottom = __atomic_load_n(&_bottom, __ATOMIC_ACQUIRE);
+
+        if (top >= bottom)
+            return false;
+
+        Array* array = __atomic_load_n(&_array, __ATOMIC_ACQUIRE);
+        elem = array->get(top);
+        return __atomic_compare_exchange_n(&_top, &top, top+1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    }
+
+    /** 队列是否为空，结果只是一个瞬间值 */
+    bool is_empty() const
+    {
+        return size() <= 0;
+    }
+
+    /** 得到队列中元素个数，结果只是一个瞬间值 */
+    int64_t size() const
+    {
+        int64_t bottom = __atomic_load_n(&_bottom, __ATOMIC_ACQUIRE);
+        int64_t top = __atomic_load_n(&_top, __ATOMIC_ACQUIRE);
+        return bottom - top;
+    }
+
+private:
+    Array* grow(Array* array, int64_t bottom, int64_t top)
+    {
+        Array* new_array = new Array(array->capacity * 2, array);
+        for (int64_t i=top; i<bottom; ++i)
+            new_array->put(i, array->get(i));
+
+        __atomic_store_n(&_array, new_array, __ATOMIC_RELEASE);
+        return new_array;
+    }
+
+private:
+    CWorkStealingDeque(const CWorkStealingDeque&);
+    CWorkStealingDeque& operator =(const CWorkStealingDeque&);
+
+private:
+    volatile int64_t _top;
+    char _padding1[64-sizeof(int64_t)]; // 窃取者和属主分别修改_top和_bottom，避免伪共享
+    volatile int64_t _bottom;
+    char _padding2[64-sizeof(int64_t)];
+    Array* _array;
+};
+
+SYS_NAMESPACE_END
+#endif // MOOON_SYS_WORK_STEALING_DEQUE_H
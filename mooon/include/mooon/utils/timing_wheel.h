@@ -0,0 +1,349 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#ifndef MOOON_UTILS_TIMING_WHEEL_H
+#define MOOON_UTILS_TIMING_WHEEL_H
+#include "mooon/utils/timeout_manager.h"
+UTILS_NAMESPACE_BEGIN
+
+template <class TimerClass>
+class CTimingWheel;
+
+/***
+  * 定时轮上的定时器结点基类，使用方法：
+  * class CMyClass: public CTimingWheelNode<CMyClass>
+  * {
+  * };
+  * 和CListable不冲突，一个对象可同时在CListQueue和CTimingWheel中
+  */
+template <class TimerClass>
+class CTimingWheelNode
+{
+    template <class> friend class CTimingWheel;
+
+public:
+    CTimingWheelNode()
+        :_timer_next(NULL)
+        ,_timer_prev(NULL)
+        ,_expire_milliseconds(0)
+    {
+    }
+
+    /** 是否在定时轮中，即定时器是否还未到期也未被删除 */
+    bool is_timer_pending() const { return _timer_next != NULL; }
+
+    /** 得到到期时间（毫秒） */
+    uint64_t get_expire_milliseconds() const { return _expire_milliseconds; }
+
+private:
+    CTimingWheelNode* _timer_next;
+    CTimingWheelNode* _timer_prev;
+    uint64_t _expire_milliseconds;
+};
+
+/***
+  * 分层定时轮，精度为1毫秒，非线程安全类，通常一个线程一个实例
+  * 第0层256个槽，每槽1毫秒；其上4层各64个槽，每槽分别为2^8、2^14、2^20和2^26毫秒，
+  * 总共可表示2^32毫秒（约49天）内的超时。
+  * 插入、删除和重新定时都是O(1)的，只需要链入或解除链接；
+  * 高层的槽在低层转完一圈时整体下移（级联），每个定时器最多级联4次；
+  * 每个毫秒槽中到期的定时器一次摘下后批量回调。
+  *
+  * 和CTimeoutManager不同，每个定时器可以有各自的超时时长，
+  * 因此同一个连接可按所处状态使用空闲、请求或写等不同的超时。
+  * 时间由调用者传入，单位为毫秒，要求单调递增，推荐使用CLOCK_MONOTONIC。
+  */
+template <class TimerClass>
+class CTimingWheel
+{
+private:
+    typedef CTimingWheelNode<TimerClass> NodeType;
+
+    enum
+    {
+        ROOT_BITS = 8,
+        ROOT_SIZE = 1 << ROOT_BITS,
+        ROOT_MASK = ROOT_SIZE - 1,
+        LEVEL_BITS = 6,
+        LEVEL_SIZE = 1 << LEVEL_BITS,
+        LEVEL_MASK = LEVEL_SIZE - 1,
+        LEVEL_NUMBER = 4,
+        BITMAP_WORDS = ROOT_SIZE / 64
+    };
+
+public:
+    CTimingWheel()
+        :_current_tick(0)
+        ,_timer_number(0)
+        ,_timeout_handler(NULL)
+    {
+        for (int i=0; i<ROOT_SIZE; ++i)
+            init_head(&_root_slots[i]);
+        for (int i=0; i<LEVEL_NUMBER; ++i)
+            for (int j=0; j<LEVEL_SIZE; ++j)
+                init_head(&_level_slots[i][j]);
+        for (int i=0; i<BITMAP_WORDS; ++i)
+            _root_bitmap[i] = 0;
+    }
+
+    /** 设置超时处理器 */
+    void set_timeout_handler(ITimeoutHandler<TimerClass>* timeout_handler)
+    {
+        _timeout_handler = timeout_handler;
+    }
+
+    /** 得到定时轮中定时器个数 */
+    uint32_t get_timer_number() const
+    {
+        return _timer_number;
+    }
+
+    /***
+      * 添加一个定时器，如果已在定时轮中，则重新定时
+      * @timer: 指向定时器对象的指针
+      * @current_milliseconds: 当前时间（毫秒）
+      * @timeout_milliseconds: 超时毫秒数，在current_milliseconds+timeout_milliseconds之后到期
+      */
+    void add(TimerClass* timer, uint64_t current_milliseconds, uint32_t timeout_milliseconds)
+    {
+        NodeType* node = timer;
+
+        if (node->is_timer_pending())
+            unlink(node);
+        else
+            ++_timer_number;
+
+        // 定时轮为空时，直接将时钟拨到当前时间，以免check_timeout逐槽追赶
+        if ((1 == _timer_number) && (current_milliseconds > _current_tick))
+            _current_tick = current_milliseconds;
+
+        node->_expire_milliseconds = current_milliseconds + timeout_milliseconds;
+        internal_add(node);
+    }
+
+    /** 重新定时，同add */
+    void update(TimerClass* timer, uint64_t current_milliseconds, uint32_t timeout_milliseconds)
+    {
+        add(timer, current_milliseconds, timeout_milliseconds);
+    }
+
+    /***
+      * 将一个定时器从定时轮中删除，不在定时轮中时什么也不做
+      * @timer: 指向定时器对象的指针
+      */
+    void remove(TimerClass* timer)
+    {
+        NodeType* node = timer;
+
+        if (node->is_timer_pending())
+        {
+            unlink(node);
+            --_timer_number;
+        }
+    }
+
+    /***
+      * 检测哪些定时器到期了，对每个到期的定时器回调ITimeoutHandler的on_timeout_event方法
+      * 回调时定时器已不在定时轮中，回调中可以再次add，也可以remove其它定时器
+      * @current_milliseconds: 当前时间（毫秒）
+      * @return: 返回到期的定时器个数
+      */
+    uint32_t check_timeout(uint64_t current_milliseconds)
+    {
+        uint32_t number = 0;
+
+        while (_current_tick <= current_milliseconds)
+        {
+            if (0 == _timer_number)
+            {
+                _current_tick = current_milliseconds + 1;
+                break;
+            }
+
+            uint32_t index = static_cast<uint32_t>(_current_tick & ROOT_MASK);
+            if (0 == index)
+                cascade();
+
+            // 本圈余下的槽都为空，直接跳到下一圈
+            if (find_root_slot(index) >= ROOT_SIZE)
+            {
+                uint64_t next_tick = (_current_tick | ROOT_MASK) + 1;
+                _current_tick = (next_tick > current_milliseconds)? current_milliseconds + 1: next_tick;
+                continue;
+            }
+
+            NodeType* head = &_root_slots[index];
+            clear_root_bit(index);
+            ++_current_tick;
+            if (head->_timer_next == head)
+                continue;
+
+            // 整槽摘下，在回调中增删定时器不会影响遍历
+            NodeType expired;
+            expired._timer_next = head->_timer_next;
+            expired._timer_prev = head->_timer_prev;
+            expired._timer_next->_timer_prev = &expired;
+            expired._timer_prev->_timer_next = &expired;
+            init_head(head);
+
+            while (expired._timer_next != &expired)
+            {
+                NodeType* node = expired._timer_next;
+                unlink(node);
+                --_timer_number;
+                ++number;
+                _timeout_handler->on_timeout_event(static_cast<TimerClass*>(node));
+            }
+        }
+
+        return number;
+    }
+
+    /***
+      * 得到距下一个定时器可能到期的毫秒数，可作为epoll等的超时参数
+      * 返回值不会晚于实际到期时间，但可能早于，早于时check_timeout什么也不做
+      * @current_milliseconds: 当前时间（毫秒）
+      * @max_milliseconds: 返回的最大值
+      */
+    uint32_t get_wait_milliseconds(uint64_t current_milliseconds, uint32_t max_milliseconds) const
+    {
+        if (0 == _timer_number)
+            return max_milliseconds;
+
+        uint64_t next_tick;
+        uint32_t index = find_root_slot(static_cast<uint32_t>(_current_tick & ROOT_MASK));
+        if (index < ROOT_SIZE)
+            next_tick = (_current_tick & ~static_cast<uint64_t>(ROOT_MASK)) + index;
+        else
+            next_tick = (_current_tick | ROOT_MASK) + 1; // 需要级联
+
+        if (next_tick <= current_milliseconds)
+            return 0;
+        if (next_tick - current_milliseconds >= max_milliseconds)
+            return max_milliseconds;
+        return static_cast<uint32_t>(next_tick - current_milliseconds);
+    }
+
+private:
+    static void init_head(NodeType* head)
+    {
+        head->_timer_next = head;
+        head->_timer_prev = head;
+    }
+
+    static void unlink(NodeType* node)
+    {
+        node->_timer_prev->_timer_next = node->_timer_next;
+        node->_timer_next->_timer_prev = node->_timer_prev;
+        node->_timer_next = NULL;
+        node->_timer_prev = NULL;
+    }
+
+    static void link_tail(NodeType* head, NodeType* node)
+    {
+        node->_timer_next = head;
+        node->_timer_prev = head->_timer_prev;
+        head->_timer_prev->_timer_next = node;
+        head->_timer_prev = node;
+    }
+
+    void internal_add(NodeType* node)
+    {
+        uint64_t expire = node->_expire_milliseconds;
+        if (expire < _current_tick)
+            expire = _current_tick; // 已经过期的，放在下一个要处理的槽
+
+        uint64_t delta = expire - _current_tick;
+        if (delta < ROOT_SIZE)
+        {
+            uint32_t index = static_cast<uint32_t>(expire & ROOT_MASK);
+            link_tail(&_root_slots[index], node);
+            _root_bitmap[index / 64] |= static_cast<uint64_t>(1) << (index % 64);
+            return;
+        }
+
+        int level;
+        for (level=0; level<LEVEL_NUMBER-1; ++level)
+        {
+            if (delta < (static_cast<uint64_t>(1) << (ROOT_BITS + (level+1)*LEVEL_BITS)))
+                break;
+        }
+        if ((LEVEL_NUMBER-1 == level) && (delta >= (static_cast<uint64_t>(1) << (ROOT_BITS + LEVEL_NUMBER*LEVEL_BITS))))
+        {
+            // 超出表示范围的放在最高层的最远处，级联时再重新计算
+            expire = _current_tick + (static_cast<uint64_t>(1) << (ROOT_BITS + LEVEL_NUMBER*LEVEL_BITS)) - 1;
+        }
+
+        uint32_t index = static_cast<uint32_t>((expire >> (ROOT_BITS + level*LEVEL_BITS)) & LEVEL_MASK);
+        link_tail(&_level_slots[level][index], node);
+    }
+
+    // 第0层转完一圈，将上层当前槽中的定时器重新分布到下层
+    void cascade()
+    {
+        for (int level=0; level<LEVEL_NUMBER; ++level)
+        {
+            uint32_t index = static_cast<uint32_t>((_current_tick >> (ROOT_BITS + level*LEVEL_BITS)) & LEVEL_MASK);
+            NodeType* head = &_level_slots[level][index];
+
+            while (head->_timer_next != head)
+            {
+                NodeType* node = head->_timer_next;
+                unlink(node);
+                internal_add(node);
+            }
+
+            // 本层未转完一圈，更上层不需要级联
+            if (index != 0)
+                break;
+        }
+    }
+
+    // 从第0层的index槽开始，找第一个可能非空的槽，没有则返回ROOT_SIZE
+    // 位图只在添加时置位，槽变空时不立即清位，因此置位的槽也可能为空
+    uint32_t find_root_slot(uint32_t index) const
+    {
+        uint32_t word = index / 64;
+        uint64_t bits = _root_bitmap[word] & (~static_cast<uint64_t>(0) << (index % 64));
+
+        for (;;)
+        {
+            if (bits != 0)
+                return word * 64 + static_cast<uint32_t>(__builtin_ctzll(bits));
+            if (++word >= BITMAP_WORDS)
+                return ROOT_SIZE;
+            bits = _root_bitmap[word];
+        }
+    }
+
+    void clear_root_bit(uint32_t index)
+    {
+        _root_bitmap[index / 64] &= ~(static_cast<uint64_t>(1) << (index % 64));
+    }
+
+private:
+    uint64_t _current_tick; // 下一个要处理的毫秒，之前的都已处理
+    uint32_t _timer_number;
+    ITimeoutHandler<TimerClass>* _timeout_handler;
+    uint64_t _root_bitmap[BITMAP_WORDS];
+    NodeType _root_slots[ROOT_SIZE];
+    NodeType _level_slots[LEVEL_NUMBER][LEVEL_SIZE];
+};
+
+UTILS_NAMESPACE_END
+#endif // MOOON_UTILS_TIMING_WHEEL_H
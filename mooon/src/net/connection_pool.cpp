@@ -0,0 +1,134 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "mooon/net/connection_pool.h"
+#include "mooon/net/utils.h"
+#include <time.h>
+NET_NAMESPACE_BEGIN
+
+void init_connection_pool_config(connection_pool_config_t* config)
+{
+    config->min_idle = 0;
+    config->max_idle = 8;
+    config->max_active = 64;
+    config->max_waiters = 64;
+    config->wait_milliseconds = 1000;
+    config->idle_seconds = 60;
+    config->validate_milliseconds = 1000;
+    config->min_backoff_milliseconds = 100;
+    config->max_backoff_milliseconds = 10000;
+}
+
+CConnectionPoolBase::CConnectionPoolBase(const connection_pool_config_t& config)
+    :_config(config), _waiter_number(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void CConnectionPoolBase::get_stats(connection_pool_stats_t* stats) const
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    *stats = _stats;
+}
+
+std::string CConnectionPoolBase::str_stats() const
+{
+    connection_pool_stats_t stats;
+    get_stats(&stats);
+
+    return utils::CStringUtils::format_string(
+            "borrow:%" PRIu64", failure:%" PRIu64", avg_us:%" PRIu64", max_us:%" PRIu64", "
+            "create:%" PRIu64", create_failure:%" PRIu64", invalid:%" PRIu64", broken:%" PRIu64", evict:%" PRIu64", "
+            "exhausted:%" PRIu64", rejected:%" PRIu64", timeout:%" PRIu64", backoff:%" PRIu64,
+            stats.borrow_number, stats.borrow_failure_number,
+            (0 == stats.borrow_number)? 0: stats.borrow_microseconds / stats.borrow_number,
+            stats.max_borrow_microseconds,
+            stats.create_number, stats.create_failure_number, stats.invalid_number, stats.broken_number, stats.evict_number,
+            stats.exhausted_number, stats.rejected_number, stats.timeout_number, stats.backoff_number);
+}
+
+uint64_t CConnectionPoolBase::get_milliseconds()
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + static_cast<uint64_t>(ts.tv_nsec / 1000000);
+}
+
+uint32_t CConnectionPoolBase::get_backoff_milliseconds(uint32_t failure_number) const
+{
+    uint64_t backoff_milliseconds = _config.min_backoff_milliseconds;
+
+    for (uint32_t i=1; (i<failure_number) && (backoff_milliseconds<_config.max_backoff_milliseconds); ++i)
+        backoff_milliseconds *= 2;
+    if (backoff_milliseconds > _config.max_backoff_milliseconds)
+        backoff_milliseconds = _config.max_backoff_milliseconds;
+
+    return static_cast<uint32_t>(backoff_milliseconds);
+}
+
+void CConnectionPoolBase::record_borrow(uint64_t microseconds)
+{
+    ++_stats.borrow_number;
+    _stats.borrow_microseconds += microseconds;
+    if (microseconds > _stats.max_borrow_microseconds)
+        _stats.max_borrow_microseconds = microseconds;
+}
+
+void CConnectionPoolBase::record_borrow_failure()
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    ++_stats.borrow_failure_number;
+}
+
+void CConnectionPoolBase::wakeup_waiters()
+{
+    if (_waiter_number > 0)
+        _event.broadcast();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+CTcpClient* CTcpClientFactory::create(const std::string& host, uint16_t port)
+{
+    CTcpClient* tcp_client = new CTcpClient;
+
+    try
+    {
+        tcp_client->set_peer_ip(host.c_str());
+        tcp_client->set_peer_port(port);
+        tcp_client->set_connect_timeout_milliseconds(_connect_timeout_milliseconds);
+        tcp_client->timed_connect();
+        return tcp_client;
+    }
+    catch (...)
+    {
+        delete tcp_client;
+        throw;
+    }
+}
+
+bool CTcpClientFactory::validate(CTcpClient* tcp_client)
+{
+    return tcp_client->is_connect_established() && CUtils::is_socket_alive(tcp_client->get_fd());
+}
+
+void CTcpClientFactory::destroy(CTcpClient* tcp_client)
+{
+    delete tcp_client;
+}
+
+NET_NAMESPACE_END
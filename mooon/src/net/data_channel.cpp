@@ -20,10 +20,14 @@
 #include <mooon/sys/atomic.h>
 #include <mooon/sys/utils.h>
 #include <mooon/net/utils.h>
+#include <fcntl.h>
+#include <new>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/sendfile.h>
 #include <sys/mmap.h>
+#include <unistd.h>
 NET_NAMESPACE_BEGIN
 
 static atomic_t gs_send_file_bytes;
@@ -57,6 +61,154 @@ long get_recv_buffer_bytes()
     return atomic_read(&gs_recv_buffer_bytes);
 }
 
+//////////////////////////////////////////////////////////////////////////
+// 接收到文件和从文件发送时使用的线程资源，线程退出时释放
+
+enum
+{
+    SPLICE_MIN_SIZE = 64 * 1024,   // 达到此大小才使用splice
+    FILE_BUFFER_SIZE = 256 * 1024, // 不能使用splice和sendfile时的缓冲区大小
+    PIPE_SIZE = 1024 * 1024        // 期望的管道大小，受限于/proc/sys/fs/pipe-max-size
+};
+
+enum
+{
+    splice_finish,      // 全部接收完
+    splice_would_block, // 非阻塞连接暂无数据可接收
+    splice_unsupported  // 不支持splice，剩余部分须经缓冲区
+};
+
+typedef struct
+{
+    char* buffer;     // FILE_BUFFER_SIZE大小的缓冲区
+    int pipe_fd[2];   // splice使用的管道，未创建时为-1
+    size_t pipe_size; // 管道的实际大小
+}file_channel_t;
+
+static __thread file_channel_t* sg_file_channel = NULL;
+static pthread_key_t sg_file_channel_key;
+static pthread_once_t sg_file_channel_once = PTHREAD_ONCE_INIT;
+
+static void close_pipe(file_channel_t* file_channel)
+{
+    if (file_channel->pipe_fd[0] != -1)
+    {
+        close(file_channel->pipe_fd[0]);
+        close(file_channel->pipe_fd[1]);
+        file_channel->pipe_fd[0] = -1;
+        file_channel->pipe_fd[1] = -1;
+    }
+}
+
+static void release_file_channel(void* file_channel)
+{
+    file_channel_t* channel = static_cast<file_channel_t*>(file_channel);
+    close_pipe(channel);
+    delete []channel->buffer;
+    delete channel;
+}
+
+static void create_file_channel_key()
+{
+    (void)pthread_key_create(&sg_file_channel_key, release_file_channel);
+}
+
+static file_channel_t* get_file_channel()
+{
+    if (NULL == sg_file_channel)
+    {
+        char* buffer = new (std::nothrow) char[FILE_BUFFER_SIZE];
+        if (NULL == buffer)
+            return NULL;
+
+        file_channel_t* file_channel = new file_channel_t;
+        file_channel->buffer = buffer;
+        file_channel->pipe_fd[0] = -1;
+        file_channel->pipe_fd[1] = -1;
+        file_channel->pipe_size = 0;
+
+        (void)pthread_once(&sg_file_channel_once, create_file_channel_key);
+        (void)pthread_setspecific(sg_file_channel_key, file_channel);
+        sg_file_channel = file_channel;
+    }
+
+    return sg_file_channel;
+}
+
+static bool open_pipe(file_channel_t* file_channel)
+{
+    if (file_channel->pipe_fd[0] != -1)
+        return true;
+    if (-1 == pipe2(file_channel->pipe_fd, O_CLOEXEC))
+    {
+        file_channel->pipe_fd[0] = -1;
+        file_channel->pipe_fd[1] = -1;
+        return false;
+    }
+
+    // 管道越大，每次splice移动的数据越多，设置失败时使用默认大小（通常为64K）
+    (void)fcntl(file_channel->pipe_fd[1], F_SETPIPE_SZ, PIPE_SIZE);
+    int pipe_size = fcntl(file_channel->pipe_fd[1], F_GETPIPE_SZ);
+    file_channel->pipe_size = (pipe_size > 0)? static_cast<size_t>(pipe_size): 65536;
+    return true;
+}
+
+// 完整写入文件，出错抛出CSyscallException异常
+static void full_pwrite(int file_fd, const char* buffer, size_t size, off_t file_offset)
+{
+    while (size > 0)
+    {
+        ssize_t retval = pwrite(file_fd, buffer, size, file_offset);
+        if (-1 == retval)
+        {
+            if (EINTR == errno) continue;
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "pwrite");
+        }
+        if (0 == retval)
+        {
+            THROW_SYSCALL_EXCEPTION(NULL, EIO, "pwrite");
+        }
+
+        buffer += retval;
+        size -= retval;
+        file_offset += retval;
+    }
+}
+
+// 将管道中的size字节经缓冲区写入文件，用于文件不支持splice写入时，出错返回false
+static bool drain_pipe(file_channel_t* file_channel, int file_fd, size_t size, off_t& file_offset)
+{
+    while (size > 0)
+    {
+        size_t read_size = (size < FILE_BUFFER_SIZE)? size: FILE_BUFFER_SIZE;
+        ssize_t retval = read(file_channel->pipe_fd[0], file_channel->buffer, read_size);
+        if (-1 == retval)
+        {
+            if (EINTR == errno) continue;
+            return false;
+        }
+        if (0 == retval)
+        {
+            return false;
+        }
+
+        try
+        {
+            full_pwrite(file_fd, file_channel->buffer, static_cast<size_t>(retval), file_offset);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            errno = ex.errcode();
+            return false;
+        }
+
+        file_offset += retval;
+        size -= retval;
+    }
+
+    return true;
+}
+
 //////////////////////////////////////////////////////////////////////////
 CDataChannel::CDataChannel()
     :_fd(-1)
@@ -87,7 +239,8 @@ ssize_t CDataChannel::receive(char* buffer, size_t buffer_size)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "recv");
     }
 
-    atomic_add(retval, &gs_recv_buffer_bytes);
+    if (retval > 0)
+        atomic_add(retval, &gs_recv_buffer_bytes);
     // if retval is equal 0
     return retval;
 }
@@ -111,7 +264,8 @@ ssize_t CDataChannel::send(const char* buffer, size_t buffer_size)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "send");
     }
     
-    atomic_add(retval, &gs_send_buffer_bytes);
+    if (retval > 0)
+        atomic_add(retval, &gs_send_buffer_bytes);
     return retval;
 }
 
@@ -221,24 +375,45 @@ ssize_t CDataChannel::send_file(int file_fd, off_t *offset, size_t count)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "sendfile");
     }
 
-    atomic_add(retval, &gs_send_file_bytes);
+    if (retval > 0)
+        atomic_add(retval, &gs_send_file_bytes);
     return retval;
 }
 
 void CDataChannel::full_send_file(int file_fd, off_t *offset, size_t& count)
 {    
     size_t remaining_size = count;
-    while (remaining_size > 0)
+
+    try
     {
-        ssize_t retval = CDataChannel::send_file(file_fd, offset, remaining_size);
-        if (-1 == retval)
+        try
         {
-            count = count - remaining_size;
-            THROW_SYSCALL_EXCEPTION(NULL, errno, "send");
+            while (remaining_size > 0)
+            {
+                // sendfile会更新*offset
+                ssize_t retval = CDataChannel::send_file(file_fd, offset, remaining_size);
+                if (-1 == retval)
+                    THROW_SYSCALL_EXCEPTION(NULL, errno, "sendfile"); // 非阻塞连接不能继续发送
+                if (0 == retval)
+                    THROW_SYSCALL_EXCEPTION(NULL, EIO, "sendfile"); // 文件没有count那么大
+
+                remaining_size -= retval;
+            }
         }
+        catch (sys::CSyscallException& ex)
+        {
+            // 文件不支持sendfile（如部分网络文件系统），剩余部分改用pread加send
+            if ((ex.errcode() != EINVAL) && (ex.errcode() != ENOSYS))
+                throw;
 
-        offset += retval;
-        remaining_size -= retval;        
+            copy_fromfile(file_fd, offset, remaining_size);
+        }
+    }
+    catch (...)
+    {
+        // count只在这里和函数末尾更新，不管是哪一步出错
+        count = count - remaining_size;
+        throw;
     }
 
     count = count - remaining_size;
@@ -276,48 +451,162 @@ bool CDataChannel::full_map_tofile(int file_fd, size_t& size, size_t offset)
 
 bool CDataChannel::full_write_tofile(int file_fd, size_t& size, size_t offset)
 {
-    
-    char* buffer = new char[sys::CUtils::get_page_size()];
-    utils::DeleteHelper<char> dh(buffer, true);    
     size_t remaining_size = size;
-    size_t current_offset = offset;
-     
-    for (;;)
+    off_t file_offset = static_cast<off_t>(offset);
+
+    try
     {
-        ssize_t retval = CDataChannel::receive(buffer, remaining_size);
-        if (0 == retval) 
+        // 较小的不值得多出的splice调用
+        int retval = splice_unsupported;
+        if (remaining_size >= SPLICE_MIN_SIZE)
+            retval = splice_tofile(file_fd, remaining_size, file_offset);
+
+        if (splice_would_block == retval)
         {
-            // 连接被对端关闭
             size = size - remaining_size;
-            THROW_SYSCALL_EXCEPTION(NULL, -1, "recv");
+            return false;
         }
-        else if (-1 == retval)
+        if ((splice_unsupported == retval) && !copy_tofile(file_fd, remaining_size, file_offset))
         {
-            // 连接异常
             size = size - remaining_size;
             return false;
         }
-        else
+    }
+    catch (...)
+    {
+        size = size - remaining_size;
+        throw;
+    }
+
+    size = size - remaining_size;
+    return true;
+}
+
+// 经管道将数据从socket移到文件，返回splice_finish、splice_would_block或splice_unsupported，
+// 返回splice_unsupported时管道为空，剩余部分须改用copy_tofile
+int CDataChannel::splice_tofile(int file_fd, size_t& remaining_size, off_t& file_offset)
+{
+    file_channel_t* file_channel = get_file_channel();
+    if ((NULL == file_channel) || !open_pipe(file_channel))
+        return splice_unsupported;
+
+    while (remaining_size > 0)
+    {
+        // 每次不超过管道的大小，管道总是空的，因此写管道不会阻塞
+        size_t splice_size = (remaining_size < file_channel->pipe_size)? remaining_size: file_channel->pipe_size;
+        ssize_t retval = splice(_fd, NULL, file_channel->pipe_fd[1], NULL, splice_size, SPLICE_F_MOVE|SPLICE_F_MORE);
+        if (0 == retval)
+        {
+            // 连接被对端关闭
+            THROW_SYSCALL_EXCEPTION(NULL, -1, "recv");
+        }
+        if (-1 == retval)
         {
-            int written = pwrite(file_fd, buffer, retval, current_offset);
-            if (written != retval)
+            if (EINTR == errno) continue;
+            if (EWOULDBLOCK == errno) return splice_would_block;
+            if ((EINVAL == errno) || (ENOSYS == errno)) return splice_unsupported;
+
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "splice");
+        }
+
+        atomic_add(retval, &gs_recv_buffer_bytes);
+        size_t pipe_size = static_cast<size_t>(retval);
+        while (pipe_size > 0)
+        {
+            retval = splice(file_channel->pipe_fd[0], NULL, file_fd, &file_offset, pipe_size, SPLICE_F_MOVE);
+            if (retval > 0)
             {
-                size = size - remaining_size;
-                THROW_SYSCALL_EXCEPTION(NULL, (-1 == written)? errno: EIO, "pwrite");
+                pipe_size -= retval;
+                remaining_size -= retval;
+                continue;
             }
+            if ((-1 == retval) && (EINTR == errno))
+                continue;
 
-            current_offset += written;
-            remaining_size -= written;
+            if ((-1 == retval) && ((EINVAL == errno) || (ENOSYS == errno)))
+            {
+                // 文件不支持splice写入，管道中已有的数据经缓冲区写入
+                if (drain_pipe(file_channel, file_fd, pipe_size, file_offset))
+                {
+                    remaining_size -= pipe_size;
+                    return splice_unsupported;
+                }
+            }
 
-            // 全部接收完成
-            if (0 == remaining_size) break;
+            // 管道中残留有数据，不能再使用
+            int errcode = (-1 == retval)? errno: EIO;
+            close_pipe(file_channel);
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "splice");
         }
     }
 
-    size = size - remaining_size;
+    return splice_finish;
+}
+
+// 经线程的缓冲区接收再pwrite，返回false表示非阻塞连接暂无数据可接收
+bool CDataChannel::copy_tofile(int file_fd, size_t& remaining_size, off_t& file_offset)
+{
+    file_channel_t* file_channel = get_file_channel();
+    if (NULL == file_channel)
+        THROW_SYSCALL_EXCEPTION(NULL, ENOMEM, "malloc");
+
+    while (remaining_size > 0)
+    {
+        size_t buffer_size = (remaining_size < FILE_BUFFER_SIZE)? remaining_size: FILE_BUFFER_SIZE;
+        ssize_t retval = CDataChannel::receive(file_channel->buffer, buffer_size);
+        if (0 == retval) 
+        {
+            // 连接被对端关闭
+            THROW_SYSCALL_EXCEPTION(NULL, -1, "recv");
+        }
+        if (-1 == retval)
+        {
+            return false;
+        }
+
+        full_pwrite(file_fd, file_channel->buffer, static_cast<size_t>(retval), file_offset);
+        file_offset += retval;
+        remaining_size -= retval;
+    }
+
     return true;
 }
 
+// 经线程的缓冲区pread再发送
+void CDataChannel::copy_fromfile(int file_fd, off_t* offset, size_t& remaining_size)
+{
+    file_channel_t* file_channel = get_file_channel();
+    if (NULL == file_channel)
+        THROW_SYSCALL_EXCEPTION(NULL, ENOMEM, "malloc");
+
+    while (remaining_size > 0)
+    {
+        size_t buffer_size = (remaining_size < FILE_BUFFER_SIZE)? remaining_size: FILE_BUFFER_SIZE;
+        ssize_t retval = pread(file_fd, file_channel->buffer, buffer_size, *offset);
+        if (-1 == retval)
+        {
+            if (EINTR == errno) continue;
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "pread");
+        }
+        if (0 == retval)
+        {
+            // 文件没有count那么大
+            THROW_SYSCALL_EXCEPTION(NULL, EIO, "pread");
+        }
+
+        for (ssize_t sent_size=0; sent_size<retval;)
+        {
+            ssize_t sent = CDataChannel::send(file_channel->buffer+sent_size, retval-sent_size);
+            if (-1 == sent)
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "send");
+
+            sent_size += sent;
+            *offset += sent;
+            remaining_size -= sent;
+        }
+    }
+}
+
 ssize_t CDataChannel::readv(const struct iovec *iov, int iovcnt)
 {
     ssize_t retval;
@@ -333,7 +622,8 @@ ssize_t CDataChannel::readv(const struct iovec *iov, int iovcnt)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "readv");
     }
 
-    atomic_add(retval, &gs_recv_buffer_bytes);
+    if (retval > 0)
+        atomic_add(retval, &gs_recv_buffer_bytes);
     return retval;
 }
 
@@ -352,7 +642,8 @@ ssize_t CDataChannel::writev(const struct iovec *iov, int iovcnt)
         THROW_SYSCALL_EXCEPTION(NULL, errno, "writev");
     }
 
-    atomic_add(retval, &gs_send_buffer_bytes);
+    if (retval > 0)
+        atomic_add(retval, &gs_send_buffer_bytes);
     return retval;
 }
 
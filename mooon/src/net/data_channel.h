@@ -87,8 +87,16 @@ public:
       * @file_fd: 打开的文件句柄
       * @offset: 文件偏移位置，如果成功则返回新的偏移位置
       * @count: 需要发送的大小
+      * @return: 返回实际发送的字节数；对于非阻塞的连接，如果不能继续发送，则返回-1
       */
     ssize_t send_file(int file_fd, off_t *offset, size_t count);
+
+    /** 完整发送文件，使用sendfile，文件不支持sendfile时改用pread加send
+      * @count: 需要发送的大小，返回实际已经发送了的字节数(不管成功还是失败或异常)
+      * @exception: 如果发生系统调用错误，则抛出CSyscallException异常；
+      *             对于非阻塞连接，不能继续发送时抛出错误码为EAGAIN的CSyscallException异常，
+      *             offset和count为已发送到的位置和字节数；文件比offset+count短时错误码为EIO
+      */
     void full_send_file(int file_fd, off_t *offset, size_t& count);
 
     /** 采用内存映射的方式接收，并将数据存放文件，适合文件不是太大
@@ -100,18 +108,24 @@ public:
       */
     bool full_map_tofile(int file_fd, size_t& size, size_t offset);
 
-    /** 采用write调用的方式接收，并将数据存放文件，适合任意大小的文件，但是大文件会导致该调用长时间阻塞
+    /** 接收数据并写入文件，适合任意大小的文件，但是大文件会导致该调用长时间阻塞，
+      * 较大的数据经管道splice到文件，不经过用户空间，不支持splice时改用线程的缓冲区接收再pwrite
       * @file_fd: 打开的文件句柄
-      * @size: 需要写入文件的大小，返回实际已经接收到的字节数(不管成功还是失败或异常)
+      * @size: 需要写入文件的大小，返回实际已经接收并写入文件的字节数(不管成功还是失败或异常)
       * @offset: 写入文件的偏移值
-      * @return: 如果连接被对端关闭，则返回false否则成功返回true
-      * @exception: 如果发生系统调用错误，则抛出CSyscallException异常
+      * @return: 全部接收完返回true；对于非阻塞连接，如果暂无数据可接收则返回false
+      * @exception: 如果连接被对端关闭或发生系统调用错误，则抛出CSyscallException异常
       */
     bool full_write_tofile(int file_fd, size_t& size, size_t offset);
     
     ssize_t readv(const struct iovec *iov, int iovcnt);
     ssize_t writev(const struct iovec *iov, int iovcnt);
 
+private:
+    int splice_tofile(int file_fd, size_t& remaining_size, off_t& file_offset);
+    bool copy_tofile(int file_fd, size_t& remaining_size, off_t& file_offset);
+    void copy_fromfile(int file_fd, off_t* offset, size_t& remaining_size);
+
 private:
     int _fd;
 };
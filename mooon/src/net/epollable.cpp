@@ -143,6 +143,8 @@ void close_fd(int fd) throw ()
 CEpollable::CEpollable()
     :_fd(-1)
     ,_epoll_events(-1)
+    ,_uring_id(0)
+    ,_pending_index(-1)
 {
 }
 
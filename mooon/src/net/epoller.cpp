@@ -18,10 +18,12 @@
  */
 #include <sys/syscall_exception.h>
 #include "net/epoller.h"
+#include <time.h>
 NET_NAMESPACE_BEGIN
 
 CEpoller::CEpoller()
     :_epfd(-1)
+    ,_uring_poller(NULL)
     ,_epoll_size(0)
     ,_max_events(0)
     ,_events(NULL)
@@ -35,10 +37,33 @@ CEpoller::~CEpoller()
     _events = NULL;
 }
 
-void CEpoller::create(uint32_t epoll_size)
+void CEpoller::create(uint32_t epoll_size, poller_engine_t engine)
 {
     _epoll_size = epoll_size;
 	_max_events = epoll_size;
+
+    if (poller_uring == engine)
+    {
+        CUringPoller* uring_poller = new CUringPoller;
+        try
+        {
+            uring_poller->create(epoll_size);
+            _uring_poller = uring_poller;
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            // 内核不支持或禁用了io_uring，仍使用Epoll
+            delete uring_poller;
+            if ((ex.errcode() != ENOSYS) && (ex.errcode() != EPERM))
+                throw;
+        }
+    }
+    if (_uring_poller != NULL)
+    {
+        _sensor.create();
+        set_events(&_sensor, EPOLLIN);
+        return;
+    }
     
     _events = new struct epoll_event[_epoll_size];
     _epfd = epoll_create(_epoll_size);
@@ -56,6 +81,13 @@ void CEpoller::create(uint32_t epoll_size)
 
 void CEpoller::destroy()
 {    
+    if (_uring_poller != NULL)
+    {
+        // 先关闭io_uring，它持有Sensor的引用
+        delete _uring_poller;
+        _uring_poller = NULL;
+        _sensor.close();
+    }
     if (_epfd != -1)
     {
         _sensor.close();
@@ -66,6 +98,9 @@ void CEpoller::destroy()
 
 int CEpoller::timed_wait(uint32_t milliseconds)
 {
+    if (_uring_poller != NULL)
+        return _uring_poller->timed_wait(milliseconds);
+
     int retval;
     uint32_t remaining_milliseconds = milliseconds;
 
@@ -97,6 +132,15 @@ void CEpoller::set_events(CEpollable* epollable, int events, bool force)
         int old_epoll_events = force? -1: epollable->get_epoll_events();
         if (old_epoll_events == events) return;
 
+        if (_uring_poller != NULL)
+        {
+            // 是否已在本io_uring中由它自己记录，同一对象可能被多个CEpoller共享（如监听者），
+            // 不能按对象上的事件判断，force时传入-1
+            _uring_poller->set_events(epollable, old_epoll_events, events);
+            epollable->set_epoll_events(events);
+            return;
+        }
+
         struct epoll_event event;
         event.data.u64 = 0;
         event.data.ptr = epollable;
@@ -116,6 +160,13 @@ void CEpoller::del_events(CEpollable* epollable)
     int fd = epollable->get_fd();
     if (fd != -1)
     {    
+        if (_uring_poller != NULL)
+        {
+            _uring_poller->del_events(epollable);
+            epollable->set_epoll_events(-1);
+            return;
+        }
+
         int retval = epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, NULL);
         if (-1 == retval)
             THROW_SYSCALL_EXCEPTION(NULL, errno, "epoll_ctl");
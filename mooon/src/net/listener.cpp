@@ -20,6 +20,12 @@
 #include <sys/utils.h>
 #include "net/utils.h"
 #include "net/listener.h"
+
+// 内核3.19开始支持，低版本的头文件可能没有定义
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif // SO_INCOMING_CPU
+
 NET_NAMESPACE_BEGIN
 
 CListener::CListener()
@@ -129,26 +135,26 @@ void CListener::listen(const ip_address_t& ip, uint16_t port, bool nonblock, boo
 void CListener::listen(const ipv4_node_t& ip_node, bool nonblock, bool enabled_address_zero, bool reuse_port) throw (sys::CSyscallException)
 {
     ip_address_t ip = ip_node.ip;
-    listen(ip, ip_node.port, nonblock, enabled_address_zero);
+    listen(ip, ip_node.port, nonblock, enabled_address_zero, reuse_port);
 }
 
 void CListener::listen(const ipv6_node_t& ip_node, bool nonblock, bool enabled_address_zero, bool reuse_port) throw (sys::CSyscallException)
 {
     ip_address_t ip = (uint32_t*)ip_node.ip;
-    listen(ip, ip_node.port, nonblock, enabled_address_zero);
+    listen(ip, ip_node.port, nonblock, enabled_address_zero, reuse_port);
 }
 
-int CListener::accept(ip_address_t& peer_ip, uint16_t& peer_port) throw (sys::CSyscallException)
+int CListener::accept(ip_address_t& peer_ip, uint16_t& peer_port, int flags) throw (sys::CSyscallException)
 {
     struct sockaddr_in6 peer_addr_in6;
     struct sockaddr* peer_addr = (struct sockaddr*)&peer_addr_in6;        
     socklen_t peer_addrlen = sizeof(struct sockaddr_in6); // 使用最大的
 
-    int newfd = ::accept(CEpollable::get_fd(), peer_addr, &peer_addrlen);
+    int newfd = ::accept4(CEpollable::get_fd(), peer_addr, &peer_addrlen, flags);
     if (-1 == newfd) 
     {
         if (sys::Error::code() != EWOULDBLOCK)
-            THROW_SYSCALL_EXCEPTION(NULL, errno, "accept");
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "accept4");
         
         return -1;      
     }
@@ -170,4 +176,10 @@ int CListener::accept(ip_address_t& peer_ip, uint16_t& peer_port) throw (sys::CS
     return newfd;
 }
 
+void CListener::set_incoming_cpu(int cpu) throw (sys::CSyscallException)
+{
+    if (-1 == ::setsockopt(CEpollable::get_fd(), SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "setsockopt");
+}
+
 NET_NAMESPACE_END
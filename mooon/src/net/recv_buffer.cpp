@@ -0,0 +1,98 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/recv_buffer.h"
+#include <string.h>
+NET_NAMESPACE_BEGIN
+
+CRecvBuffer::CRecvBuffer(size_t init_capacity, size_t max_capacity)
+    :_capacity(init_capacity)
+    ,_init_capacity(init_capacity)
+    ,_max_capacity((max_capacity < init_capacity)? init_capacity: max_capacity)
+    ,_read_offset(0)
+    ,_write_offset(0)
+    ,_copied_bytes(0)
+{
+    _buffer = new char[_capacity];
+}
+
+CRecvBuffer::~CRecvBuffer()
+{
+    delete []_buffer;
+}
+
+void CRecvBuffer::consume(size_t size)
+{
+    _read_offset += size;
+    if (_read_offset == _write_offset)
+    {
+        _read_offset = 0;
+        _write_offset = 0;
+    }
+}
+
+bool CRecvBuffer::reserve(size_t size)
+{
+    if (writable() >= size)
+        return true;
+
+    size_t data_size = readable();
+    if (data_size + size > _max_capacity)
+        return false;
+
+    if (data_size + size <= _capacity)
+    {
+        // 回绕：把未处理的数据移回开头
+        memmove(_buffer, _buffer+_read_offset, data_size);
+    }
+    else
+    {
+        // 扩容，至少翻倍，减少之后的扩容次数
+        size_t capacity = _capacity * 2;
+        if (capacity < data_size + size)
+            capacity = data_size + size;
+        if (capacity > _max_capacity)
+            capacity = _max_capacity;
+
+        char* buffer = new char[capacity];
+        memcpy(buffer, _buffer+_read_offset, data_size);
+        delete []_buffer;
+        _buffer = buffer;
+        _capacity = capacity;
+    }
+
+    _copied_bytes += data_size;
+    _read_offset = 0;
+    _write_offset = data_size;
+    return true;
+}
+
+void CRecvBuffer::reset()
+{
+    _read_offset = 0;
+    _write_offset = 0;
+
+    if (_capacity > _init_capacity)
+    {
+        delete []_buffer;
+        _buffer = new char[_init_capacity];
+        _capacity = _init_capacity;
+    }
+}
+
+NET_NAMESPACE_END
@@ -0,0 +1,340 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "mooon/net/resolver.h"
+#include "mooon/net/utils.h"
+#include "mooon/sys/stop_watch.h"
+#include <time.h>
+NET_NAMESPACE_BEGIN
+
+CResolver::CResolver(uint32_t ttl_seconds, uint32_t negative_ttl_seconds, uint32_t stale_seconds)
+    :_ttl_seconds(ttl_seconds)
+    ,_negative_ttl_seconds(negative_ttl_seconds)
+    ,_stale_seconds(stale_seconds)
+    ,_stop(false)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+CResolver::~CResolver()
+{
+    stop();
+}
+
+void CResolver::start(uint16_t thread_number) throw (sys::CSyscallException)
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+
+    for (uint16_t i=0; i<thread_number; ++i)
+    {
+        sys::CThreadEngine* thread = new sys::CThreadEngine(sys::bind(&CResolver::run, this));
+        _threads.push_back(thread);
+    }
+}
+
+void CResolver::stop()
+{
+    std::vector<sys::CThreadEngine*> threads;
+    std::map<std::string, std::vector<waiter_t> > pending_table;
+
+    // 先取走线程，之后的async_resolve会直接以失败完成
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        _stop = true;
+        _threads.swap(threads);
+        _event.broadcast();
+    }
+    for (std::vector<sys::CThreadEngine*>::size_type i=0; i<threads.size(); ++i)
+    {
+        threads[i]->join();
+        delete threads[i];
+    }
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        _pending_table.swap(pending_table);
+        _request_list.clear();
+        _stop = false;
+    }
+
+    const string_ip_array_t ip_array;
+    std::map<std::string, std::vector<waiter_t> >::iterator iter = pending_table.begin();
+    for (; iter!=pending_table.end(); ++iter)
+    {
+        for (std::vector<waiter_t>::size_type i=0; i<iter->second.size(); ++i)
+            complete(iter->second[i], iter->first, false, ip_array, "resolver stopped");
+    }
+}
+
+bool CResolver::resolve(const std::string& hostname, string_ip_array_t* ip_array, std::string* errinfo)
+{
+    std::string errinfo_;
+    if (NULL == errinfo)
+        errinfo = &errinfo_;
+
+    if (CUtils::is_valid_ip(hostname.c_str()))
+    {
+        ip_array->assign(1, hostname);
+        return true;
+    }
+    else
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        entry_state_t state = find_entry(hostname, get_seconds(), ip_array, errinfo);
+
+        if (entry_stale == state)
+            submit(hostname);
+        if (state != entry_missing)
+            return state != entry_negative;
+    }
+
+    return timed_resolve(hostname, ip_array, errinfo);
+}
+
+bool CResolver::lookup(const std::string& hostname, string_ip_array_t* ip_array)
+{
+    if (CUtils::is_valid_ip(hostname.c_str()))
+    {
+        ip_array->assign(1, hostname);
+        return true;
+    }
+
+    std::string errinfo;
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    entry_state_t state = find_entry(hostname, get_seconds(), ip_array, &errinfo);
+
+    // 未命中时预先解析，调用者稍后再lookup即可命中
+    if ((entry_stale == state) || (entry_missing == state))
+        submit(hostname);
+    return (entry_fresh == state) || (entry_stale == state);
+}
+
+void CResolver::async_resolve(const std::string& hostname, CResolveQueue* queue, void* context)
+{
+    waiter_t waiter;
+    waiter.queue = queue;
+    waiter.context = context;
+
+    if (CUtils::is_valid_ip(hostname.c_str()))
+    {
+        complete(waiter, hostname, true, string_ip_array_t(1, hostname), std::string());
+        return;
+    }
+
+    string_ip_array_t ip_array;
+    std::string errinfo;
+    entry_state_t state;
+    {
+        sys::LockHelper<sys::CLock> lock_helper(_lock);
+        state = find_entry(hostname, get_seconds(), &ip_array, &errinfo);
+
+        if (entry_stale == state)
+        {
+            submit(hostname);
+        }
+        else if (entry_missing == state)
+        {
+            if (_threads.empty())
+            {
+                errinfo = "resolver not started";
+            }
+            else
+            {
+                submit(hostname);
+                _pending_table[hostname].push_back(waiter);
+                return;
+            }
+        }
+    }
+
+    // 锁外放入完成队列，调用者通常就是队列的消费者，队列满时等待也不会有空位
+    complete(waiter, hostname, (entry_fresh == state) || (entry_stale == state), ip_array, errinfo);
+}
+
+void CResolver::get_stats(resolver_stats_t* stats) const
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    *stats = _stats;
+}
+
+void CResolver::clear()
+{
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    _cache.clear();
+}
+
+bool CResolver::do_resolve(const std::string& hostname, string_ip_array_t* ip_array, std::string* errinfo)
+{
+    return CUtils::get_ip_address(hostname.c_str(), *ip_array, *errinfo);
+}
+
+// 调用时须持有锁
+CResolver::entry_state_t CResolver::find_entry(const std::string& hostname, uint64_t now, string_ip_array_t* ip_array, std::string* errinfo)
+{
+    std::map<std::string, entry_t>::iterator iter = _cache.find(hostname);
+    if (iter == _cache.end())
+    {
+        ++_stats.miss_number;
+        return entry_missing;
+    }
+
+    const entry_t& entry = iter->second;
+    if (now < entry.expire_seconds)
+    {
+        if (entry.success)
+        {
+            ++_stats.hit_number;
+            *ip_array = entry.ip_array;
+            return entry_fresh;
+        }
+        else
+        {
+            ++_stats.negative_hit_number;
+            *errinfo = entry.errinfo;
+            return entry_negative;
+        }
+    }
+    if (entry.success && (now < entry.stale_seconds))
+    {
+        ++_stats.stale_hit_number;
+        *ip_array = entry.ip_array;
+        return entry_stale;
+    }
+
+    ++_stats.miss_number;
+    _cache.erase(iter);
+    return entry_missing;
+}
+
+// 调用时须持有锁
+void CResolver::store_entry(const std::string& hostname, bool success, const string_ip_array_t& ip_array, const std::string& errinfo)
+{
+    const uint64_t now = get_seconds();
+
+    if (!success && (0 == _negative_ttl_seconds))
+    {
+        _cache.erase(hostname);
+    }
+    else
+    {
+        entry_t& entry = _cache[hostname];
+        entry.success = success;
+        entry.ip_array = ip_array;
+        entry.errinfo = errinfo;
+        entry.expire_seconds = now + (success? _ttl_seconds: _negative_ttl_seconds);
+        entry.stale_seconds = success? entry.expire_seconds + _stale_seconds: entry.expire_seconds;
+    }
+}
+
+// 调用时须持有锁，已提交的不重复提交，没有后台线程时什么也不做
+void CResolver::submit(const std::string& hostname)
+{
+    if (_threads.empty() || _stop)
+        return;
+    if (_pending_table.find(hostname) != _pending_table.end())
+        return;
+
+    _pending_table.insert(std::make_pair(hostname, std::vector<waiter_t>()));
+    _request_list.push_back(hostname);
+    _event.signal();
+}
+
+// 实际解析并更新缓存，解析失败但仍有可用的旧结果时保留旧结果，并以旧结果返回
+bool CResolver::timed_resolve(const std::string& hostname, string_ip_array_t* ip_array, std::string* errinfo)
+{
+    sys::CStopWatch stop_watch;
+    string_ip_array_t new_ip_array;
+    bool success = do_resolve(hostname, &new_ip_array, errinfo);
+    const uint64_t microseconds = stop_watch.get_total_elapsed_microseconds();
+
+    sys::LockHelper<sys::CLock> lock_helper(_lock);
+    ++_stats.resolve_number;
+    _stats.resolve_microseconds += microseconds;
+    if (!success)
+    {
+        ++_stats.resolve_failure_number;
+
+        std::map<std::string, entry_t>::const_iterator iter = _cache.find(hostname);
+        if ((iter != _cache.end()) && iter->second.success && (get_seconds() < iter->second.stale_seconds))
+        {
+            *ip_array = iter->second.ip_array;
+            return true;
+        }
+    }
+
+    store_entry(hostname, success, new_ip_array, *errinfo);
+    ip_array->swap(new_ip_array);
+    return success;
+}
+
+void CResolver::run()
+{
+    for (;;)
+    {
+        std::string hostname;
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            while (!_stop && _request_list.empty())
+                _event.wait(_lock);
+            if (_stop)
+                break;
+
+            hostname = _request_list.front();
+            _request_list.pop_front();
+        }
+
+        string_ip_array_t ip_array;
+        std::string errinfo;
+        bool success = timed_resolve(hostname, &ip_array, &errinfo);
+
+        std::vector<waiter_t> waiters;
+        {
+            sys::LockHelper<sys::CLock> lock_helper(_lock);
+            std::map<std::string, std::vector<waiter_t> >::iterator iter = _pending_table.find(hostname);
+            if (iter != _pending_table.end())
+            {
+                waiters.swap(iter->second);
+                _pending_table.erase(iter);
+            }
+        }
+
+        for (std::vector<waiter_t>::size_type i=0; i<waiters.size(); ++i)
+            complete(waiters[i], hostname, success, ip_array, errinfo);
+    }
+}
+
+uint64_t CResolver::get_seconds()
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec);
+}
+
+void CResolver::complete(const waiter_t& waiter, const std::string& hostname, bool success, const string_ip_array_t& ip_array, const std::string& errinfo)
+{
+    resolve_result_t* result = new resolve_result_t;
+    result->hostname = hostname;
+    result->success = success;
+    result->ip_array = ip_array;
+    result->errinfo = errinfo;
+    result->context = waiter.context;
+
+    // 完成队列不限大小，总能放入
+    (void)waiter.queue->push_back(result);
+}
+
+NET_NAMESPACE_END
@@ -0,0 +1,272 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "mooon/net/tcp_info_sampler.h"
+#include <linux/sockios.h>
+#include <map>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+NET_NAMESPACE_BEGIN
+
+// 全局登记表，使用静态初始化的pthread锁，不受全局对象构造顺序的影响
+static pthread_mutex_t sg_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CTcpInfoSampler* sg_registry_head = NULL;
+
+static inline int get_bucket_index(uint32_t value)
+{
+    return (0 == value)? 0: 32 - __builtin_clz(value);
+}
+
+// 第index个桶的上界（包含）
+static inline uint32_t get_bucket_upper(int index)
+{
+    return (index >= 32)? 0xFFFFFFFFu: (1u << index) - 1;
+}
+
+CTcpInfoSampler::CTcpInfoSampler()
+    :_interval_milliseconds(0)
+    ,_max_samples_per_second(0)
+    ,_current_second(0)
+    ,_current_samples(0)
+    ,_prev(NULL)
+    ,_next(NULL)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+CTcpInfoSampler::~CTcpInfoSampler()
+{
+    if (!_name.empty())
+        deregister_stats();
+}
+
+void CTcpInfoSampler::set_name(const std::string& name)
+{
+    if (name.empty() || !_name.empty())
+        return;
+
+    _name = name;
+    register_stats();
+}
+
+void CTcpInfoSampler::set_sampling(uint32_t interval_milliseconds, uint32_t max_samples_per_second)
+{
+    _max_samples_per_second = max_samples_per_second;
+    _interval_milliseconds = interval_milliseconds;
+}
+
+void CTcpInfoSampler::add_sample(const tcp_info_sample_t& sample)
+{
+    // 统计只由所在线程更新，读取的线程使用原子读，读到的可能不是最新的，但对观察足够了
+    ++_stats.sample_number;
+    for (int i=0; i<tcp_info_metric_number; ++i)
+    {
+        tcp_info_histogram_t& histogram = _stats.histograms[i];
+        const uint32_t value = sample.values[i];
+
+        ++histogram.buckets[get_bucket_index(value)];
+        histogram.sum += value;
+        if (value > histogram.max)
+            histogram.max = value;
+    }
+}
+
+void CTcpInfoSampler::get_stats(tcp_info_stats_t* stats) const
+{
+    stats->sample_number = __atomic_load_n(&_stats.sample_number, __ATOMIC_RELAXED);
+    stats->failure_number = __atomic_load_n(&_stats.failure_number, __ATOMIC_RELAXED);
+    stats->skip_number = __atomic_load_n(&_stats.skip_number, __ATOMIC_RELAXED);
+
+    for (int i=0; i<tcp_info_metric_number; ++i)
+    {
+        const tcp_info_histogram_t& from = _stats.histograms[i];
+        tcp_info_histogram_t& to = stats->histograms[i];
+
+        for (int j=0; j<TCP_INFO_BUCKET_NUMBER; ++j)
+            to.buckets[j] = __atomic_load_n(&from.buckets[j], __ATOMIC_RELAXED);
+        to.sum = __atomic_load_n(&from.sum, __ATOMIC_RELAXED);
+        to.max = __atomic_load_n(&from.max, __ATOMIC_RELAXED);
+    }
+}
+
+bool CTcpInfoSampler::get_tcp_info(int fd, tcp_info_sample_t* sample)
+{
+    struct tcp_info info;
+    socklen_t info_length = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+    if (-1 == getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &info_length))
+        return false;
+
+    // SIOCOUTQNSD为还未发送的字节数，不包括已发送未确认的（SIOCOUTQ包括），老内核不支持时为0
+    int send_queue = 0;
+    if (-1 == ioctl(fd, SIOCOUTQNSD, &send_queue))
+        send_queue = 0;
+
+    sample->values[tcp_info_rtt] = info.tcpi_rtt;
+    sample->values[tcp_info_rttvar] = info.tcpi_rttvar;
+    sample->values[tcp_info_retransmits] = info.tcpi_retrans;
+    sample->values[tcp_info_cwnd] = info.tcpi_snd_cwnd;
+    sample->values[tcp_info_unacked] = info.tcpi_unacked * info.tcpi_snd_mss;
+    sample->values[tcp_info_send_queue] = static_cast<uint32_t>(send_queue);
+    return true;
+}
+
+void CTcpInfoSampler::get_all_stats(std::vector<std::pair<std::string, tcp_info_stats_t> >* all_stats)
+{
+    std::map<std::string, tcp_info_stats_t> stats_table;
+
+    pthread_mutex_lock(&sg_registry_mutex);
+    for (CTcpInfoSampler* sampler=sg_registry_head; sampler!=NULL; sampler=sampler->_next)
+    {
+        tcp_info_stats_t stats;
+        sampler->get_stats(&stats);
+
+        std::map<std::string, tcp_info_stats_t>::iterator iter = stats_table.find(sampler->_name);
+        if (iter == stats_table.end())
+        {
+            stats_table.insert(std::make_pair(sampler->_name, stats));
+        }
+        else
+        {
+            tcp_info_stats_t& total = iter->second;
+
+            total.sample_number += stats.sample_number;
+            total.failure_number += stats.failure_number;
+            total.skip_number += stats.skip_number;
+            for (int i=0; i<tcp_info_metric_number; ++i)
+            {
+                for (int j=0; j<TCP_INFO_BUCKET_NUMBER; ++j)
+                    total.histograms[i].buckets[j] += stats.histograms[i].buckets[j];
+                total.histograms[i].sum += stats.histograms[i].sum;
+                if (stats.histograms[i].max > total.histograms[i].max)
+                    total.histograms[i].max = stats.histograms[i].max;
+            }
+        }
+    }
+    pthread_mutex_unlock(&sg_registry_mutex);
+
+    all_stats->assign(stats_table.begin(), stats_table.end());
+}
+
+uint32_t CTcpInfoSampler::get_percentile(const tcp_info_histogram_t& histogram, uint64_t sample_number, double percentile)
+{
+    if (0 == sample_number)
+        return 0;
+
+    // 第rank个（从1开始）采样值所在的桶
+    uint64_t rank = static_cast<uint64_t>(sample_number * percentile / 100 + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > sample_number)
+        rank = sample_number;
+
+    uint64_t count = 0;
+    for (int i=0; i<TCP_INFO_BUCKET_NUMBER; ++i)
+    {
+        count += histogram.buckets[i];
+        if (count >= rank)
+        {
+            const uint32_t upper = get_bucket_upper(i);
+            return (upper < histogram.max)? upper: histogram.max;
+        }
+    }
+
+    return histogram.max;
+}
+
+void CTcpInfoSampler::subtract_stats(const tcp_info_stats_t& after, const tcp_info_stats_t& before, tcp_info_stats_t* delta)
+{
+    delta->sample_number = after.sample_number - before.sample_number;
+    delta->failure_number = after.failure_number - before.failure_number;
+    delta->skip_number = after.skip_number - before.skip_number;
+
+    for (int i=0; i<tcp_info_metric_number; ++i)
+    {
+        tcp_info_histogram_t& histogram = delta->histograms[i];
+
+        histogram.max = 0;
+        for (int j=0; j<TCP_INFO_BUCKET_NUMBER; ++j)
+        {
+            histogram.buckets[j] = after.histograms[i].buckets[j] - before.histograms[i].buckets[j];
+            if (histogram.buckets[j] > 0)
+                histogram.max = get_bucket_upper(j);
+        }
+        if (histogram.max > after.histograms[i].max)
+            histogram.max = after.histograms[i].max;
+        histogram.sum = after.histograms[i].sum - before.histograms[i].sum;
+    }
+}
+
+bool CTcpInfoSampler::do_sample(int fd, uint64_t* next_sample_milliseconds, uint64_t now_milliseconds)
+{
+    // 无论是否采样，该连接在一个间隔内都不再尝试，跳过的不会在下一个事件时又被计数
+    *next_sample_milliseconds = now_milliseconds + _interval_milliseconds;
+
+    const uint64_t current_second = now_milliseconds / 1000;
+    if (current_second != _current_second)
+    {
+        _current_second = current_second;
+        _current_samples = 0;
+    }
+    if ((_max_samples_per_second > 0) && (_current_samples >= _max_samples_per_second))
+    {
+        ++_stats.skip_number;
+        return false;
+    }
+
+    ++_current_samples;
+    tcp_info_sample_t sample;
+    if (!get_tcp_info(fd, &sample))
+    {
+        ++_stats.failure_number;
+        return false;
+    }
+
+    add_sample(sample);
+    return true;
+}
+
+void CTcpInfoSampler::register_stats()
+{
+    pthread_mutex_lock(&sg_registry_mutex);
+    _prev = NULL;
+    _next = sg_registry_head;
+    if (sg_registry_head != NULL)
+        sg_registry_head->_prev = this;
+    sg_registry_head = this;
+    pthread_mutex_unlock(&sg_registry_mutex);
+}
+
+void CTcpInfoSampler::deregister_stats()
+{
+    pthread_mutex_lock(&sg_registry_mutex);
+    if (_prev != NULL)
+        _prev->_next = _next;
+    else
+        sg_registry_head = _next;
+    if (_next != NULL)
+        _next->_prev = _prev;
+    pthread_mutex_unlock(&sg_registry_mutex);
+}
+
+NET_NAMESPACE_END
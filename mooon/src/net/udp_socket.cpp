@@ -18,9 +18,13 @@
  */
 #include "mooon/net/udp_socket.h"
 #include "mooon/net/utils.h"
+#include <algorithm>
 #include <unistd.h>
 NET_NAMESPACE_BEGIN
 
+// 批量收发时，每次系统调用使用的mmsghdr个数，放在栈上，超过时分多次调用
+#define UDP_BATCH_CHUNK 64
+
 CUdpSocket::CUdpSocket() throw (sys::CSyscallException)
 {
     int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
@@ -144,4 +148,113 @@ int CUdpSocket::timed_receive_from(void* buffer, size_t buffer_size, struct sock
     return receive_from(buffer, buffer_size, from_addr);
 }
 
+// 分段调用recvmmsg，第一段使用调用者指定的flags，
+// 之后的段只在前一段收满时才继续，且都使用MSG_DONTWAIT，不再等待
+static int recvmmsg_chunks(int fd, udp_datagram_t* datagrams, int number, int flags) throw (sys::CSyscallException)
+{
+    int received = 0;
+    struct mmsghdr msgs[UDP_BATCH_CHUNK];
+    struct iovec iovs[UDP_BATCH_CHUNK];
+
+    while (received < number)
+    {
+        const int chunk = std::min(number - received, UDP_BATCH_CHUNK);
+        udp_datagram_t* batch = datagrams + received;
+
+        for (int i=0; i<chunk; ++i)
+        {
+            iovs[i].iov_base = batch[i].buffer;
+            iovs[i].iov_len = batch[i].buffer_size;
+            memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_name = &batch[i].addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_len = 0;
+        }
+
+        int n = ::recvmmsg(fd, msgs, chunk, flags, NULL);
+        if (-1 == n)
+        {
+            if (EINTR == errno)
+                continue;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "recvmmsg");
+            break;
+        }
+
+        for (int i=0; i<n; ++i)
+        {
+            batch[i].bytes = msgs[i].msg_len;
+            batch[i].flags = msgs[i].msg_hdr.msg_flags;
+        }
+
+        received += n;
+        if (n < chunk)
+            break;
+        flags = (flags & ~MSG_WAITFORONE) | MSG_DONTWAIT;
+    }
+
+    return (0 == received)? -1: received;
+}
+
+int CUdpSocket::receive_batch(udp_datagram_t* datagrams, int number, bool wait_for_one) throw (sys::CSyscallException)
+{
+    return recvmmsg_chunks(get_fd(), datagrams, number, wait_for_one? MSG_WAITFORONE: 0);
+}
+
+int CUdpSocket::timed_receive_batch(udp_datagram_t* datagrams, int number, uint32_t milliseconds) throw (sys::CSyscallException)
+{
+    if (!CUtils::timed_poll(get_fd(), POLLIN, milliseconds))
+        THROW_SYSCALL_EXCEPTION("receive timeout", ETIMEDOUT, "pool");
+
+    return recvmmsg_chunks(get_fd(), datagrams, number, MSG_DONTWAIT);
+}
+
+int CUdpSocket::send_batch(udp_datagram_t* datagrams, int number) throw (sys::CSyscallException)
+{
+    int sent = 0;
+    struct mmsghdr msgs[UDP_BATCH_CHUNK];
+    struct iovec iovs[UDP_BATCH_CHUNK];
+
+    while (sent < number)
+    {
+        const int chunk = std::min(number - sent, UDP_BATCH_CHUNK);
+        udp_datagram_t* batch = datagrams + sent;
+
+        for (int i=0; i<chunk; ++i)
+        {
+            iovs[i].iov_base = batch[i].buffer;
+            iovs[i].iov_len = batch[i].buffer_size;
+            memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_name = &batch[i].addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_len = 0;
+        }
+
+        int n = ::sendmmsg(get_fd(), msgs, chunk, 0);
+        if (-1 == n)
+        {
+            if (EINTR == errno)
+                continue;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+                THROW_SYSCALL_EXCEPTION(NULL, errno, "sendmmsg");
+            break;
+        }
+
+        for (int i=0; i<n; ++i)
+            batch[i].bytes = msgs[i].msg_len;
+
+        // sendmmsg发送某个数据报出错时，返回之前已发送的个数，
+        // 如果一个也没有发出，才返回-1，因此下一次调用会返回该错误
+        sent += n;
+        if (n < chunk)
+            break;
+    }
+
+    return (0 == sent)? -1: sent;
+}
+
 NET_NAMESPACE_END
@@ -0,0 +1,651 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "net/uring_poller.h"
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#if MOOON_HAVE_IO_URING==1
+#include <linux/io_uring.h>
+#endif // MOOON_HAVE_IO_URING
+NET_NAMESPACE_BEGIN
+
+// 请求的类型记录在user_data的低两位，CEpollable对象至少按8字节对齐
+#define URING_POLL       0 // 就绪通知
+#define URING_ACCEPT     1 // 多次accept
+#define URING_RECV       2 // 多次recv
+#define URING_IGNORE     3 // 内部请求和被del_events丢弃的事件
+#define URING_TYPE_MASK  3
+
+// 提交队列大小的范围，提交队列满时会提前提交，不影响正确性
+#define URING_MIN_ENTRIES 64
+#define URING_MAX_ENTRIES 4096
+
+// 接收Buffer的组号
+#define URING_BUFFER_GROUP 0
+
+// 分配io_uring的标识，0保留给未登记的对象
+static volatile uint32_t sg_uring_id = 0;
+
+static uint32_t get_monotonic_milliseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+CUringPoller::CUringPoller()
+    :_ring_fd(-1)
+    ,_id(0)
+    ,_disabled(false)
+    ,_max_events(0)
+    ,_enter_number(0)
+    ,_events(NULL)
+    ,_results(NULL)
+    ,_buffers(NULL)
+    ,_sq_ring(NULL)
+    ,_sq_ring_size(0)
+    ,_cq_ring(NULL)
+    ,_cq_ring_size(0)
+    ,_sqes(NULL)
+    ,_sqes_size(0)
+    ,_sq_head(NULL)
+    ,_sq_tail(NULL)
+    ,_sq_mask(0)
+    ,_sq_entries(0)
+    ,_sq_array(NULL)
+    ,_sq_local_tail(0)
+    ,_cq_head(NULL)
+    ,_cq_tail(NULL)
+    ,_cq_mask(0)
+    ,_cqes(NULL)
+    ,_buffer_ring(NULL)
+    ,_buffer_ring_size(0)
+    ,_buffer_pool(NULL)
+    ,_buffer_number(0)
+    ,_buffer_size(0)
+    ,_buffer_tail(0)
+{
+}
+
+CUringPoller::~CUringPoller()
+{
+    destroy();
+}
+
+#if MOOON_HAVE_IO_URING==1 && defined(IORING_RECV_MULTISHOT)
+
+void CUringPoller::create(uint32_t max_events, uint16_t buffer_number, uint32_t buffer_size)
+{
+    // 重新create时换一个标识，之前登记的对象记录的状态不再有效
+    do
+    {
+        _id = __sync_add_and_fetch(&sg_uring_id, 1);
+    } while (0 == _id);
+
+    uint32_t entries = URING_MIN_ENTRIES;
+    while ((entries < max_events) && (entries < URING_MAX_ENTRIES))
+        entries <<= 1;
+
+    if ((buffer_number > 0) && (((buffer_number & (buffer_number-1)) != 0) || (0 == buffer_size)))
+        THROW_SYSCALL_EXCEPTION("buffer number must be power of 2", EINVAL, "io_uring_setup");
+
+    // 完成队列比提交队列大，多次accept和recv可能一轮产生很多事件
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP | IORING_SETUP_SUBMIT_ALL;
+    params.cq_entries = entries * 4;
+
+    // 完成事件只在io_uring_enter中处理（Linux 6.1），不打断运行中的线程，
+    // 要求只有一个线程提交，通常是在别的线程中创建，因此先禁用，第一次提交时由提交线程启用
+    params.flags |= IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_R_DISABLED;
+    _ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    if ((-1 == _ring_fd) && (EINVAL == errno))
+    {
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP | IORING_SETUP_SUBMIT_ALL;
+        params.cq_entries = entries * 4;
+        _ring_fd = syscall(__NR_io_uring_setup, entries, &params);
+    }
+    if (-1 == _ring_fd)
+    {
+        // EINVAL表示内核版本过低，不认识SUBMIT_ALL等标志
+        int errcode = (EINVAL == errno)? ENOSYS: errno;
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "io_uring_setup");
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+    {
+        destroy();
+        THROW_SYSCALL_EXCEPTION("kernel too old", ENOSYS, "io_uring_setup");
+    }
+
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (_cq_ring_size > _sq_ring_size)
+            _sq_ring_size = _cq_ring_size;
+        _cq_ring_size = 0;
+    }
+
+    _sq_ring = mmap(NULL, _sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == _sq_ring)
+    {
+        int errcode = errno;
+        _sq_ring = NULL;
+        destroy();
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "mmap");
+    }
+    if (0 == _cq_ring_size)
+    {
+        _cq_ring = _sq_ring;
+    }
+    else
+    {
+        _cq_ring = mmap(NULL, _cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == _cq_ring)
+        {
+            int errcode = errno;
+            _cq_ring = NULL;
+            destroy();
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "mmap");
+        }
+    }
+
+    _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = mmap(NULL, _sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    if (MAP_FAILED == _sqes)
+    {
+        int errcode = errno;
+        _sqes = NULL;
+        destroy();
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "mmap");
+    }
+
+    char* sq_ring = static_cast<char*>(_sq_ring);
+    _sq_head = reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.head);
+    _sq_tail = reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.tail);
+    _sq_mask = *reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.ring_mask);
+    _sq_entries = params.sq_entries;
+    _sq_array = reinterpret_cast<uint32_t*>(sq_ring + params.sq_off.array);
+    _sq_local_tail = *_sq_tail;
+
+    char* cq_ring = static_cast<char*>(_cq_ring);
+    _cq_head = reinterpret_cast<uint32_t*>(cq_ring + params.cq_off.head);
+    _cq_tail = reinterpret_cast<uint32_t*>(cq_ring + params.cq_off.tail);
+    _cq_mask = *reinterpret_cast<uint32_t*>(cq_ring + params.cq_off.ring_mask);
+    _cqes = cq_ring + params.cq_off.cqes;
+
+    if (buffer_number > 0)
+    {
+        // 接收Buffer环，内核从中取Buffer，用完后由timed_wait归还
+        _buffer_ring_size = buffer_number * sizeof(struct io_uring_buf);
+        _buffer_ring = mmap(NULL, _buffer_ring_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == _buffer_ring)
+        {
+            int errcode = errno;
+            _buffer_ring = NULL;
+            destroy();
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "mmap");
+        }
+
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(_buffer_ring);
+        reg.ring_entries = buffer_number;
+        reg.bgid = URING_BUFFER_GROUP;
+        if (-1 == syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1))
+        {
+            int errcode = (EINVAL == errno)? ENOSYS: errno;
+            destroy();
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "io_uring_register");
+        }
+
+        _buffer_number = buffer_number;
+        _buffer_size = buffer_size;
+        _buffer_pool = new char[(size_t)buffer_number * buffer_size];
+        for (uint16_t bid=0; bid<buffer_number; ++bid)
+            _used_buffers.push_back(bid);
+        recycle_buffers();
+    }
+
+    _disabled = (params.flags & IORING_SETUP_R_DISABLED) != 0;
+    _max_events = max_events;
+    _events = new struct epoll_event[max_events];
+    _results = new int[max_events];
+    _buffers = new const char*[max_events];
+}
+
+void CUringPoller::destroy()
+{
+    // 关闭io_uring时内核取消所有未完成的请求
+    if (_sqes != NULL)
+        munmap(_sqes, _sqes_size);
+    if ((_cq_ring != NULL) && (_cq_ring != _sq_ring))
+        munmap(_cq_ring, _cq_ring_size);
+    if (_sq_ring != NULL)
+        munmap(_sq_ring, _sq_ring_size);
+    if (_ring_fd != -1)
+        ::close(_ring_fd);
+    if (_buffer_ring != NULL)
+        munmap(_buffer_ring, _buffer_ring_size);
+
+    delete []_buffer_pool;
+    delete []_events;
+    delete []_results;
+    delete []_buffers;
+
+    _ring_fd = -1;
+    _disabled = false;
+    _sqes = NULL;
+    _cq_ring = NULL;
+    _sq_ring = NULL;
+    _buffer_ring = NULL;
+    _buffer_pool = NULL;
+    _buffer_number = 0;
+    _buffer_tail = 0;
+    _events = NULL;
+    _results = NULL;
+    _buffers = NULL;
+    _pending_array.clear();
+    _shared_table.clear();
+    _used_buffers.clear();
+}
+
+int CUringPoller::timed_wait(uint32_t milliseconds)
+{
+    // 上一轮返回的接收Buffer已被调用者用完，归还给内核
+    recycle_buffers();
+
+    // 上一轮触发过的对象重新提交POLL_ADD，和等待一起提交
+    for (std::vector<CEpollable*>::size_type i=0; i<_pending_array.size(); ++i)
+    {
+        CEpollable* epollable = _pending_array[i];
+        if (NULL == epollable)
+            continue;
+
+        if ((epollable->get_fd() != -1) && (epollable->get_epoll_events() != -1))
+        {
+            *find_state(epollable) = -1;
+            prep_poll(epollable, epollable->get_epoll_events());
+        }
+        else
+        {
+            // 已被关闭，不再在本io_uring中，之后set_events时重新加入
+            _pending_array[i] = NULL;
+            remove_state(epollable);
+        }
+    }
+    _pending_array.clear();
+
+    uint32_t remaining_milliseconds = milliseconds;
+    uint32_t begin_milliseconds = get_monotonic_milliseconds();
+    for (;;)
+    {
+        submit(1, remaining_milliseconds, true);
+
+        // 只有内部请求的完成事件时继续等待
+        int retval = reap();
+        if (retval > 0)
+            return retval;
+
+        uint32_t gone_milliseconds = get_monotonic_milliseconds() - begin_milliseconds;
+        if (gone_milliseconds >= milliseconds)
+            return 0;
+        remaining_milliseconds = milliseconds - gone_milliseconds;
+    }
+}
+
+void CUringPoller::set_events(CEpollable* epollable, int old_events, int events)
+{
+    int* pending_index = find_state(epollable);
+    if (NULL == pending_index)
+    {
+        // 不在本io_uring中，不管在其它io_uring中的状态
+        *add_state(epollable) = -1;
+        prep_poll(epollable, events);
+    }
+    else if (-1 == old_events)
+    {
+        // 句柄被重新打开或强制重新加入：丢弃待重新提交状态，取消内核中原有的POLL_ADD后重新提交
+        if (*pending_index != -1)
+            _pending_array[*pending_index] = NULL;
+        else
+            prep_poll_remove(epollable, events, false);
+        *pending_index = -1;
+        prep_poll(epollable, events);
+    }
+    else if (-1 == *pending_index)
+    {
+        // 修改内核中未触发的POLL_ADD，内核会按新的事件立即检查一次
+        prep_poll_remove(epollable, events, true);
+    }
+    // 已触发的在下一次timed_wait时按新的事件重新提交
+}
+
+void CUringPoller::del_events(CEpollable* epollable)
+{
+    remove_state(epollable);
+
+    // 取消该句柄上的所有请求，包括多次accept和recv，并立即提交
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(get_sqe());
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = epollable->get_fd();
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = URING_IGNORE;
+    submit(0, 0, false);
+
+    // 已在完成队列中、尚未取走的事件不能再交给调用者，对象可能随后被销毁
+    uint32_t head = *_cq_head;
+    uint32_t tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    struct io_uring_cqe* cqes = static_cast<struct io_uring_cqe*>(_cqes);
+    for (; head != tail; ++head)
+    {
+        struct io_uring_cqe* cqe = &cqes[head & _cq_mask];
+        if ((cqe->user_data & ~(uint64_t)URING_TYPE_MASK) == reinterpret_cast<uint64_t>(epollable))
+            cqe->user_data = URING_IGNORE; // 保留flags，其中的接收Buffer仍要归还
+    }
+}
+
+void CUringPoller::accept_multishot(CEpollable* listener)
+{
+    prep_multishot(listener, URING_ACCEPT);
+}
+
+void CUringPoller::recv_multishot(CEpollable* epollable)
+{
+    if (0 == _buffer_number)
+        THROW_SYSCALL_EXCEPTION("no buffer registered", EINVAL, "io_uring_enter");
+    prep_multishot(epollable, URING_RECV);
+}
+
+void* CUringPoller::get_sqe()
+{
+    // 提交队列满了，先提交已有的请求
+    if (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries)
+        submit(0, 0, false);
+
+    uint32_t index = _sq_local_tail & _sq_mask;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(_sqes) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    _sq_array[index] = index;
+    ++_sq_local_tail;
+    return sqe;
+}
+
+void CUringPoller::submit(uint32_t min_complete, uint32_t milliseconds, bool wait)
+{
+    if (_disabled)
+    {
+        if (-1 == syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "io_uring_register");
+        _disabled = false;
+    }
+
+    // 未被内核取走的请求，包括上次因EBUSY等没有提交成功的
+    uint32_t to_submit = _sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+
+    // 总是带上GETEVENTS，让已就绪的完成事件在返回前进入完成队列
+    unsigned int flags = IORING_ENTER_GETEVENTS;
+    struct timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (wait)
+    {
+        ts.tv_sec = milliseconds / 1000;
+        ts.tv_nsec = (milliseconds % 1000) * 1000000;
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    else
+    {
+        min_complete = 0;
+    }
+
+    ++_enter_number;
+    int retval = syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete, flags
+                       , wait? &arg: NULL, wait? sizeof(arg): 0);
+    if (-1 == retval)
+    {
+        // ETIME为超时，EINTR由调用者重新等待，EBUSY和EAGAIN表示完成队列积压，取走事件后再提交
+        if ((errno != ETIME) && (errno != EINTR) && (errno != EBUSY) && (errno != EAGAIN))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "io_uring_enter");
+    }
+}
+
+void CUringPoller::prep_poll(CEpollable* epollable, int events)
+{
+    // 单次POLL_ADD，不使用IORING_POLL_ADD_MULTI：多次的是边缘触发的，
+    // 而现有的handle_epoll_event都是按水平触发写的，不一定一次读完
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(get_sqe());
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = epollable->get_fd();
+    sqe->poll32_events = events;
+    sqe->user_data = reinterpret_cast<uint64_t>(epollable) | URING_POLL;
+}
+
+void CUringPoller::prep_poll_remove(CEpollable* epollable, int events, bool update)
+{
+    // 按user_data找到内核中的POLL_ADD，不存在时返回ENOENT，结果被忽略
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(get_sqe());
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(epollable) | URING_POLL;
+    if (update)
+    {
+        sqe->len = IORING_POLL_UPDATE_EVENTS;
+        sqe->poll32_events = events;
+    }
+    sqe->user_data = URING_IGNORE;
+}
+
+// 对象在本io_uring中的状态，不在本io_uring中时返回NULL，
+// 否则返回它在待重新提交队列中的位置，-1表示POLL_ADD在内核中
+int* CUringPoller::find_state(CEpollable* epollable)
+{
+    if (epollable->_uring_id == _id)
+        return &epollable->_pending_index;
+    if (_shared_table.empty())
+        return NULL;
+
+    std::map<CEpollable*, int>::iterator iter = _shared_table.find(epollable);
+    return (iter == _shared_table.end())? NULL: &iter->second;
+}
+
+int* CUringPoller::add_state(CEpollable* epollable)
+{
+    // 通常只属于一个io_uring，状态直接记在对象中，不需要查表
+    if (0 == epollable->_uring_id)
+    {
+        epollable->_uring_id = _id;
+        return &epollable->_pending_index;
+    }
+
+    return &_shared_table[epollable];
+}
+
+void CUringPoller::remove_state(CEpollable* epollable)
+{
+    int* pending_index = find_state(epollable);
+    if (NULL == pending_index)
+        return;
+    if (*pending_index != -1)
+        _pending_array[*pending_index] = NULL;
+
+    if (epollable->_uring_id == _id)
+    {
+        epollable->_uring_id = 0;
+        epollable->_pending_index = -1;
+    }
+    else
+    {
+        _shared_table.erase(epollable);
+    }
+}
+
+void CUringPoller::prep_multishot(CEpollable* epollable, int type)
+{
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(get_sqe());
+    sqe->fd = epollable->get_fd();
+    sqe->user_data = reinterpret_cast<uint64_t>(epollable) | type;
+
+    if (URING_ACCEPT == type)
+    {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUFFER_GROUP;
+    }
+}
+
+int CUringPoller::reap()
+{
+    int number = 0;
+    uint32_t head = *_cq_head;
+    uint32_t tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    struct io_uring_cqe* cqes = static_cast<struct io_uring_cqe*>(_cqes);
+
+    for (; (head != tail) && ((uint32_t)number < _max_events); ++head)
+    {
+        struct io_uring_cqe* cqe = &cqes[head & _cq_mask];
+        int type = static_cast<int>(cqe->user_data & URING_TYPE_MASK);
+        CEpollable* epollable = reinterpret_cast<CEpollable*>(cqe->user_data & ~(uint64_t)URING_TYPE_MASK);
+        bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+        int result = cqe->res;
+
+        const char* buffer = NULL;
+        if (cqe->flags & IORING_CQE_F_BUFFER)
+        {
+            uint16_t bid = static_cast<uint16_t>(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            buffer = _buffer_pool + (size_t)bid * _buffer_size;
+            _used_buffers.push_back(bid);
+        }
+
+        // 被取消的请求，对象可能已被销毁，不能再访问
+        if ((URING_IGNORE == type) || (-ECANCELED == result))
+            continue;
+
+        uint32_t events = EPOLLIN;
+        if (URING_POLL == type)
+        {
+            events = (result < 0)? EPOLLERR: (uint32_t)result;
+            result = 0;
+
+            int* pending_index = find_state(epollable);
+            if (pending_index != NULL)
+            {
+                *pending_index = (int)_pending_array.size();
+                _pending_array.push_back(epollable);
+            }
+        }
+        else if (URING_ACCEPT == type)
+        {
+            // 内核结束了多次accept（如完成队列溢出），重新提交
+            if (!more && (result >= 0))
+                prep_multishot(epollable, URING_ACCEPT);
+        }
+        else
+        {
+            // Buffer用完时内核结束多次recv，下一轮归还Buffer后再提交
+            if (!more && ((result > 0) || (-ENOBUFS == result)))
+                prep_multishot(epollable, URING_RECV);
+            if (-ENOBUFS == result)
+                continue;
+        }
+
+        _events[number].data.ptr = epollable;
+        _events[number].events = events;
+        _results[number] = result;
+        _buffers[number] = buffer;
+        ++number;
+    }
+
+    __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+    return number;
+}
+
+void CUringPoller::recycle_buffers()
+{
+    if (_used_buffers.empty())
+        return;
+
+    // 环的tail和第一个元素的resv字段重叠，只能逐个字段写
+    struct io_uring_buf* bufs = static_cast<struct io_uring_buf*>(_buffer_ring);
+    for (std::vector<uint16_t>::size_type i=0; i<_used_buffers.size(); ++i)
+    {
+        uint16_t bid = _used_buffers[i];
+        struct io_uring_buf* buf = &bufs[_buffer_tail & (_buffer_number-1)];
+        buf->addr = reinterpret_cast<uint64_t>(_buffer_pool + (size_t)bid * _buffer_size);
+        buf->len = _buffer_size;
+        buf->bid = bid;
+        ++_buffer_tail;
+    }
+
+    __atomic_store_n(&bufs[0].resv, _buffer_tail, __ATOMIC_RELEASE);
+    _used_buffers.clear();
+}
+
+#else // MOOON_HAVE_IO_URING
+
+void CUringPoller::create(uint32_t max_events, uint16_t buffer_number, uint32_t buffer_size)
+{
+    THROW_SYSCALL_EXCEPTION("io_uring not supported", ENOSYS, "io_uring_setup");
+}
+
+void CUringPoller::destroy()
+{
+}
+
+int CUringPoller::timed_wait(uint32_t milliseconds)
+{
+    THROW_SYSCALL_EXCEPTION("io_uring not supported", ENOSYS, "io_uring_enter");
+}
+
+void CUringPoller::set_events(CEpollable* epollable, int old_events, int events)
+{
+    THROW_SYSCALL_EXCEPTION("io_uring not supported", ENOSYS, "io_uring_enter");
+}
+
+void CUringPoller::del_events(CEpollable* epollable)
+{
+    THROW_SYSCALL_EXCEPTION("io_uring not supported", ENOSYS, "io_uring_enter");
+}
+
+void CUringPoller::accept_multishot(CEpollable* listener)
+{
+    THROW_SYSCALL_EXCEPTION("io_uring not supported", ENOSYS, "io_uring_enter");
+}
+
+void CUringPoller::recv_multishot(CEpollable* epollable)
+{
+    THROW_SYSCALL_EXCEPTION("io_uring not supported", ENOSYS, "io_uring_enter");
+}
+
+#endif // MOOON_HAVE_IO_URING
+
+NET_NAMESPACE_END
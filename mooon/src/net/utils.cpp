@@ -369,6 +369,21 @@ bool CUtils::timed_poll(int fd, int events_requested, int milliseconds, int* eve
     return true;
 }
 
+bool CUtils::is_socket_alive(int fd)
+{
+    struct pollfd fds[1];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+
+    int retval = poll(fds, sizeof(fds)/sizeof(struct pollfd), 0);
+    if (-1 == retval)
+        return (EINTR == errno);
+
+    // 可读（包括对端关闭）、POLLERR、POLLHUP和POLLNVAL都视为不可用
+    return 0 == retval;
+}
+
 std::string to_string(const struct in_addr& sin_addr)
 {
     return std::string(inet_ntoa(sin_addr));
@@ -0,0 +1,275 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/adaptive_lock.h"
+#include <limits.h>
+#include <map>
+#include <pthread.h>
+#include <string.h>
+SYS_NAMESPACE_BEGIN
+
+// 全局登记表，使用静态初始化的pthread锁，不受全局对象构造顺序的影响
+static pthread_mutex_t sg_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static CAdaptiveLock* sg_registry_head = NULL;
+
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause" ::: "memory");
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+static inline uint64_t get_monotonic_nanoseconds()
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// 单CPU时自旋没有意义，持有锁的线程不可能同时在运行
+static bool is_multi_cpu()
+{
+    static int cpu_number = 0;
+    if (0 == cpu_number)
+        cpu_number = static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+    return cpu_number > 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CAdaptiveLock
+
+CAdaptiveLock::CAdaptiveLock(const char* name, uint32_t spin_number) throw ()
+    :_state(unlocked)
+    ,_spin_number(is_multi_cpu()? spin_number: 0)
+    ,_name(NULL)
+    ,_prev(NULL)
+    ,_next(NULL)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    if (name != NULL)
+        enable_stats(name);
+}
+
+CAdaptiveLock::~CAdaptiveLock()
+{
+    if (_name != NULL)
+        deregister_stats();
+}
+
+void CAdaptiveLock::lock() throw (CSyscallException)
+{
+    if (__sync_bool_compare_and_swap(&_state, unlocked, locked))
+    {
+        if (_name != NULL)
+            ++_stats.acquire_number;
+    }
+    else
+    {
+        (void)lock_contended(0);
+    }
+}
+
+void CAdaptiveLock::unlock() throw (CSyscallException)
+{
+    if (locked_with_waiters == __atomic_exchange_n(&_state, unlocked, __ATOMIC_RELEASE))
+        futex_wake(&_state, 1);
+}
+
+bool CAdaptiveLock::try_lock() throw (CSyscallException)
+{
+    if (!__sync_bool_compare_and_swap(&_state, unlocked, locked))
+        return false;
+
+    if (_name != NULL)
+        ++_stats.acquire_number;
+    return true;
+}
+
+bool CAdaptiveLock::timed_lock(uint32_t millisecond) throw (CSyscallException)
+{
+    if (__sync_bool_compare_and_swap(&_state, unlocked, locked))
+    {
+        if (_name != NULL)
+            ++_stats.acquire_number;
+        return true;
+    }
+
+    return lock_contended(millisecond);
+}
+
+bool CAdaptiveLock::lock_contended(uint32_t millisecond)
+{
+    bool parked = false;
+    uint64_t start_nanoseconds = (NULL == _name)? 0: get_monotonic_nanoseconds();
+
+    // 自旋阶段，持有者通常很快释放，避免睡眠和唤醒的两次系统调用
+    for (uint32_t i=0; i<_spin_number; ++i)
+    {
+        cpu_relax();
+        if ((unlocked == _state) && __sync_bool_compare_and_swap(&_state, unlocked, locked))
+            goto acquired;
+    }
+
+    {
+        uint64_t deadline = (0 == millisecond)? 0: get_monotonic_milliseconds() + millisecond;
+
+        // 置为locked_with_waiters，让持有者解锁时唤醒；拿到锁时也保持这个状态，
+        // 因为可能还有其它睡眠者，代价只是一次多余的futex_wake
+        while (__atomic_exchange_n(&_state, locked_with_waiters, __ATOMIC_ACQUIRE) != unlocked)
+        {
+            uint32_t remaining = 0;
+            if (deadline > 0)
+            {
+                uint64_t now = get_monotonic_milliseconds();
+                if (now >= deadline)
+                    return false;
+                remaining = static_cast<uint32_t>(deadline - now);
+            }
+
+            parked = true;
+            futex_wait(&_state, locked_with_waiters, remaining);
+        }
+    }
+
+acquired:
+    if (_name != NULL)
+    {
+        ++_stats.acquire_number;
+        ++_stats.contended_number;
+        if (parked)
+            ++_stats.parked_number;
+        _stats.wait_nanoseconds += get_monotonic_nanoseconds() - start_nanoseconds;
+    }
+
+    return true;
+}
+
+void CAdaptiveLock::enable_stats(const char* name) throw ()
+{
+    if ((NULL == name) || (_name != NULL))
+        return;
+
+    _name = name;
+    register_stats();
+}
+
+void CAdaptiveLock::get_stats(lock_stats_t* stats) const
+{
+    // 统计由持有锁的线程更新，这里读到的可能不是最新的，但对观察足够了
+    stats->acquire_number = __atomic_load_n(&_stats.acquire_number, __ATOMIC_RELAXED);
+    stats->contended_number = __atomic_load_n(&_stats.contended_number, __ATOMIC_RELAXED);
+    stats->parked_number = __atomic_load_n(&_stats.parked_number, __ATOMIC_RELAXED);
+    stats->wait_nanoseconds = __atomic_load_n(&_stats.wait_nanoseconds, __ATOMIC_RELAXED);
+}
+
+void CAdaptiveLock::get_all_stats(std::vector<std::pair<std::string, lock_stats_t> >* all_stats)
+{
+    std::map<std::string, lock_stats_t> stats_table;
+
+    pthread_mutex_lock(&sg_registry_mutex);
+    for (CAdaptiveLock* lock=sg_registry_head; lock!=NULL; lock=lock->_next)
+    {
+        lock_stats_t stats;
+        lock->get_stats(&stats);
+
+        std::map<std::string, lock_stats_t>::iterator iter = stats_table.find(lock->_name);
+        if (iter == stats_table.end())
+        {
+            stats_table.insert(std::make_pair(std::string(lock->_name), stats));
+        }
+        else
+        {
+            iter->second.acquire_number += stats.acquire_number;
+            iter->second.contended_number += stats.contended_number;
+            iter->second.parked_number += stats.parked_number;
+            iter->second.wait_nanoseconds += stats.wait_nanoseconds;
+        }
+    }
+    pthread_mutex_unlock(&sg_registry_mutex);
+
+    all_stats->assign(stats_table.begin(), stats_table.end());
+}
+
+void CAdaptiveLock::register_stats()
+{
+    pthread_mutex_lock(&sg_registry_mutex);
+    _prev = NULL;
+    _next = sg_registry_head;
+    if (sg_registry_head != NULL)
+        sg_registry_head->_prev = this;
+    sg_registry_head = this;
+    pthread_mutex_unlock(&sg_registry_mutex);
+}
+
+void CAdaptiveLock::deregister_stats()
+{
+    pthread_mutex_lock(&sg_registry_mutex);
+    if (_prev != NULL)
+        _prev->_next = _next;
+    else
+        sg_registry_head = _next;
+    if (_next != NULL)
+        _next->_prev = _prev;
+    pthread_mutex_unlock(&sg_registry_mutex);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CAdaptiveEvent
+
+CAdaptiveEvent::CAdaptiveEvent() throw ()
+    :_sequence(0)
+    ,_waiters(0)
+{
+}
+
+void CAdaptiveEvent::wait(CAdaptiveLock& lock) throw (CSyscallException)
+{
+    (void)timed_wait(lock, 0);
+}
+
+bool CAdaptiveEvent::timed_wait(CAdaptiveLock& lock, uint32_t millisecond) throw (CSyscallException)
+{
+    // 在持有锁时取序号，之后的signal都会改变序号，所以解锁后不会错过唤醒
+    int32_t sequence = __atomic_load_n(&_sequence, __ATOMIC_ACQUIRE);
+
+    __sync_add_and_fetch(&_waiters, 1);
+    lock.unlock();
+    bool woken = futex_wait(&_sequence, sequence, millisecond);
+    __sync_sub_and_fetch(&_waiters, 1);
+    lock.lock();
+
+    return woken;
+}
+
+void CAdaptiveEvent::signal() throw (CSyscallException)
+{
+    __sync_add_and_fetch(&_sequence, 1);
+    if (__atomic_load_n(&_waiters, __ATOMIC_SEQ_CST) > 0)
+        futex_wake(&_sequence, 1);
+}
+
+void CAdaptiveEvent::broadcast() throw (CSyscallException)
+{
+    __sync_add_and_fetch(&_sequence, 1);
+    if (__atomic_load_n(&_waiters, __ATOMIC_SEQ_CST) > 0)
+        futex_wake(&_sequence, INT_MAX);
+}
+
+SYS_NAMESPACE_END
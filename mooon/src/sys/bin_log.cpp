@@ -0,0 +1,462 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/bin_log.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+SYS_NAMESPACE_BEGIN
+
+// 参数类型
+enum
+{
+    ARG_NONE,        // %%，不消耗参数
+    ARG_INT,         // d、i、o、u、x、X、c
+    ARG_DOUBLE,      // e、E、f、F、g、G、a、A
+    ARG_LONG_DOUBLE, // 带L修饰的浮点数
+    ARG_STRING,      // s
+    ARG_POINTER,     // p
+    ARG_COUNT,       // n，消耗参数但不输出
+    ARG_ERRNO        // m，不消耗参数，写日志时即转成字符串
+};
+
+// 长度修饰
+enum
+{
+    MOD_NONE, MOD_HH, MOD_H, MOD_L, MOD_LL, MOD_J, MOD_Z, MOD_T, MOD_BIG_L
+};
+
+// 一个转换说明，如“%-8.*lld”
+typedef struct
+{
+    int length;          // 转换说明的长度，包含'%'
+    int arg_type;
+    int modifier;
+    int star_number;     // 宽度和精度中'*'的个数，每个'*'消耗一个int参数
+    bool precision_star; // 精度是否为'*'，如果是则为最后一个'*'
+    int precision;       // 精度，-1表示未指定
+}conversion_t;
+
+// 解析以'%'开始的转换说明，不支持的（如宽字符和%1$d形式）返回false
+static bool parse_conversion(const char* spec, conversion_t* conversion)
+{
+    const char* p = spec + 1;
+
+    conversion->modifier = MOD_NONE;
+    conversion->star_number = 0;
+    conversion->precision_star = false;
+    conversion->precision = -1;
+    if ('%' == *p)
+    {
+        conversion->length = 2;
+        conversion->arg_type = ARG_NONE;
+        return true;
+    }
+
+    while ((*p != '\0') && (strchr("-+ #0'I", *p) != NULL))
+        ++p;
+    if ('*' == *p)
+    {
+        ++conversion->star_number;
+        ++p;
+    }
+    else
+    {
+        while (isdigit(*p))
+            ++p;
+        if ('$' == *p)
+            return false;
+    }
+    if ('.' == *p)
+    {
+        ++p;
+        if ('*' == *p)
+        {
+            ++conversion->star_number;
+            conversion->precision_star = true;
+            ++p;
+        }
+        else
+        {
+            conversion->precision = 0;
+            for (; isdigit(*p); ++p)
+                conversion->precision = conversion->precision * 10 + (*p - '0');
+        }
+    }
+
+    switch (*p)
+    {
+    case 'h':
+        conversion->modifier = ('h' == p[1])? MOD_HH: MOD_H;
+        p += ('h' == p[1])? 2: 1;
+        break;
+    case 'l':
+        conversion->modifier = ('l' == p[1])? MOD_LL: MOD_L;
+        p += ('l' == p[1])? 2: 1;
+        break;
+    case 'q':
+        conversion->modifier = MOD_LL;
+        ++p;
+        break;
+    case 'L':
+        conversion->modifier = MOD_BIG_L;
+        ++p;
+        break;
+    case 'j':
+        conversion->modifier = MOD_J;
+        ++p;
+        break;
+    case 'z':
+    case 'Z':
+        conversion->modifier = MOD_Z;
+        ++p;
+        break;
+    case 't':
+        conversion->modifier = MOD_T;
+        ++p;
+        break;
+    }
+
+    switch (*p)
+    {
+    case 'c': // %lc的参数为wint_t，和int一样大小
+        conversion->modifier = MOD_NONE;
+        conversion->arg_type = ARG_INT;
+        break;
+    case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+        conversion->arg_type = ARG_INT;
+        break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        conversion->arg_type = (MOD_BIG_L == conversion->modifier)? ARG_LONG_DOUBLE: ARG_DOUBLE;
+        break;
+    case 's':
+        if (MOD_L == conversion->modifier)
+            return false;
+        conversion->arg_type = ARG_STRING;
+        break;
+    case 'p':
+        conversion->arg_type = ARG_POINTER;
+        break;
+    case 'n':
+        conversion->arg_type = ARG_COUNT;
+        break;
+    case 'm':
+        conversion->arg_type = ARG_ERRNO;
+        break;
+    default:
+        return false;
+    }
+
+    conversion->length = static_cast<int>(p + 1 - spec);
+    return true;
+}
+
+static bool append_value(char* buffer, int buffer_size, int* offset, const void* value, int value_size)
+{
+    if (*offset + value_size > buffer_size)
+        return false;
+
+    memcpy(buffer + *offset, value, value_size);
+    *offset += value_size;
+    return true;
+}
+
+// 字符串以2字节长度加内容存储，空间不够时截断，截断时返回false
+static bool append_string(char* buffer, int buffer_size, int* offset, const char* str, int precision)
+{
+    if (*offset + static_cast<int>(sizeof(uint16_t)) > buffer_size)
+        return false;
+
+    // 指定了精度时字符串可以没有结尾符
+    size_t length = (precision < 0)? strlen(str): strnlen(str, precision);
+    size_t space = buffer_size - *offset - sizeof(uint16_t);
+    bool truncated = length > space;
+    uint16_t length_ = static_cast<uint16_t>(truncated? space: length);
+
+    memcpy(buffer + *offset, &length_, sizeof(length_));
+    memcpy(buffer + *offset + sizeof(length_), str, length_);
+    *offset += static_cast<int>(sizeof(length_)) + length_;
+    return !truncated;
+}
+
+static int64_t get_int_arg(va_list& args, int modifier)
+{
+    switch (modifier)
+    {
+    case MOD_L:
+        return va_arg(args, long);
+    case MOD_LL:
+    case MOD_BIG_L:
+        return va_arg(args, long long);
+    case MOD_J:
+        return va_arg(args, intmax_t);
+    case MOD_Z:
+        return va_arg(args, size_t);
+    case MOD_T:
+        return va_arg(args, ptrdiff_t);
+    default: // char和short被提升为int
+        return va_arg(args, int);
+    }
+}
+
+int encode_bin_log_args(char* buffer, int buffer_size, const char* format, va_list& args)
+{
+    int offset = 0;
+    int errcode = errno; // %m需要的是调用者的errno
+    conversion_t conversion;
+
+    for (const char* p=strchr(format, '%'); p!=NULL; p=strchr(p+conversion.length, '%'))
+    {
+        // 不支持的转换说明之后的参数类型无法确定，只能放弃
+        if (!parse_conversion(p, &conversion))
+            break;
+
+        int precision = conversion.precision;
+        for (int i=0; i<conversion.star_number; ++i)
+        {
+            int64_t value = va_arg(args, int);
+            if (!append_value(buffer, buffer_size, &offset, &value, sizeof(value)))
+                return offset;
+            if (conversion.precision_star && (i == conversion.star_number-1))
+                precision = static_cast<int>(value);
+        }
+
+        bool appended = true;
+        switch (conversion.arg_type)
+        {
+        case ARG_INT:
+        {
+            int64_t value = get_int_arg(args, conversion.modifier);
+            appended = append_value(buffer, buffer_size, &offset, &value, sizeof(value));
+            break;
+        }
+        case ARG_DOUBLE:
+        {
+            double value = va_arg(args, double);
+            appended = append_value(buffer, buffer_size, &offset, &value, sizeof(value));
+            break;
+        }
+        case ARG_LONG_DOUBLE:
+        {
+            long double value = va_arg(args, long double);
+            appended = append_value(buffer, buffer_size, &offset, &value, sizeof(value));
+            break;
+        }
+        case ARG_POINTER:
+        {
+            uint64_t value = reinterpret_cast<uintptr_t>(va_arg(args, void*));
+            appended = append_value(buffer, buffer_size, &offset, &value, sizeof(value));
+            break;
+        }
+        case ARG_STRING:
+        {
+            const char* value = va_arg(args, const char*);
+            appended = append_string(buffer, buffer_size, &offset, (NULL == value)? "(null)": value, precision);
+            break;
+        }
+        case ARG_ERRNO:
+            appended = append_string(buffer, buffer_size, &offset, strerror(errcode), -1);
+            break;
+        case ARG_COUNT:
+            (void)va_arg(args, void*);
+            break;
+        }
+        if (!appended)
+            break;
+    }
+
+    return offset;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+static void append_format(std::string* text, const char* spec, ...) __attribute__((format(printf, 2, 3)));
+static void append_format(std::string* text, const char* spec, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_list args_copy;
+
+    va_start(args, spec);
+    va_copy(args_copy, args);
+    int length = vsnprintf(buffer, sizeof(buffer), spec, args);
+    if (length < static_cast<int>(sizeof(buffer)))
+    {
+        text->append(buffer, length);
+    }
+    else if (length > 0)
+    {
+        std::string str(length+1, '\0');
+        (void)vsnprintf(&str[0], length+1, spec, args_copy);
+        text->append(str.data(), length);
+    }
+    va_end(args_copy);
+    va_end(args);
+}
+
+static bool read_value(const char* args, int args_size, int* offset, void* value, int value_size)
+{
+    if (*offset + value_size > args_size)
+        return false;
+
+    memcpy(value, args + *offset, value_size);
+    *offset += value_size;
+    return true;
+}
+
+static bool read_string(const char* args, int args_size, int* offset, std::string* str)
+{
+    uint16_t length;
+    if (!read_value(args, args_size, offset, &length, sizeof(length)))
+        return false;
+    if (*offset + length > args_size)
+        return false;
+
+    str->assign(args + *offset, length);
+    *offset += length;
+    return true;
+}
+
+// 按写日志时的类型还原整数，保证传给printf的参数类型和转换说明一致
+static void append_int(std::string* text, const char* spec, int modifier, int64_t value)
+{
+    switch (modifier)
+    {
+    case MOD_L:
+        append_format(text, spec, static_cast<long>(value));
+        break;
+    case MOD_LL:
+    case MOD_BIG_L:
+        append_format(text, spec, static_cast<long long>(value));
+        break;
+    case MOD_J:
+        append_format(text, spec, static_cast<intmax_t>(value));
+        break;
+    case MOD_Z:
+        append_format(text, spec, static_cast<size_t>(value));
+        break;
+    case MOD_T:
+        append_format(text, spec, static_cast<ptrdiff_t>(value));
+        break;
+    default:
+        append_format(text, spec, static_cast<int>(value));
+        break;
+    }
+}
+
+bool decode_bin_log_args(std::string* text, const char* format, const char* args, int args_size)
+{
+    bool complete = true;
+    int offset = 0;
+    const char* p = format;
+    conversion_t conversion;
+
+    for (const char* q=strchr(p, '%'); q!=NULL; q=strchr(p, '%'))
+    {
+        text->append(p, q-p);
+        if (!parse_conversion(q, &conversion))
+        {
+            // 写日志时也在这里停止了编码
+            text->append(q);
+            return complete;
+        }
+
+        p = q + conversion.length;
+        if (ARG_NONE == conversion.arg_type)
+        {
+            text->append(1, '%');
+            continue;
+        }
+
+        // 将'*'替换成写日志时的值，%m替换成%s
+        bool ok = true;
+        std::string spec;
+        for (const char* s=q; s<p; ++s)
+        {
+            if (*s != '*')
+            {
+                spec.append(1, *s);
+            }
+            else
+            {
+                int64_t value;
+                ok = read_value(args, args_size, &offset, &value, sizeof(value));
+                if (!ok) break;
+                append_format(&spec, "%d", static_cast<int>(value));
+            }
+        }
+        if (ARG_ERRNO == conversion.arg_type)
+            spec[spec.size()-1] = 's';
+
+        switch (conversion.arg_type)
+        {
+        case ARG_INT:
+        {
+            int64_t value;
+            ok = ok && read_value(args, args_size, &offset, &value, sizeof(value));
+            if (ok) append_int(text, spec.c_str(), conversion.modifier, value);
+            break;
+        }
+        case ARG_DOUBLE:
+        {
+            double value;
+            ok = ok && read_value(args, args_size, &offset, &value, sizeof(value));
+            if (ok) append_format(text, spec.c_str(), value);
+            break;
+        }
+        case ARG_LONG_DOUBLE:
+        {
+            long double value;
+            ok = ok && read_value(args, args_size, &offset, &value, sizeof(value));
+            if (ok) append_format(text, spec.c_str(), value);
+            break;
+        }
+        case ARG_POINTER:
+        {
+            uint64_t value;
+            ok = ok && read_value(args, args_size, &offset, &value, sizeof(value));
+            if (ok) append_format(text, spec.c_str(), reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+            break;
+        }
+        case ARG_STRING:
+        case ARG_ERRNO:
+        {
+            std::string value;
+            ok = ok && read_string(args, args_size, &offset, &value);
+            if (ok) append_format(text, spec.c_str(), value.c_str());
+            break;
+        }
+        case ARG_COUNT:
+            break;
+        }
+
+        if (!ok)
+        {
+            complete = false;
+            text->append(q, conversion.length);
+            offset = args_size; // 之后的参数都不可用
+        }
+    }
+
+    text->append(p);
+    return complete;
+}
+
+SYS_NAMESPACE_END
@@ -0,0 +1,285 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/cpu_affinity.h"
+#include "sys/close_helper.h"
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+// 读取sysfs中的CPU列表文件，如/sys/devices/system/node/node0/cpulist
+static bool read_cpu_list(const char* filepath, std::vector<int>* cpus)
+{
+    FILE* fp = fopen(filepath, "r");
+    if (NULL == fp)
+        return false;
+
+    char line[1024];
+    sys::CloseHelper<FILE*> ch(fp);
+    if (NULL == fgets(line, sizeof(line), fp))
+        return false;
+
+    size_t length = strlen(line);
+    while ((length > 0) && (('\n' == line[length-1]) || (' ' == line[length-1])))
+        line[--length] = '\0';
+
+    return CCpuAffinity::parse_cpu_list(line, cpus);
+}
+
+// 是否为物理核上的第一个逻辑CPU，无法确定时当作是
+static bool is_primary_cpu(int cpu)
+{
+    char filepath[128];
+    std::vector<int> siblings;
+
+    snprintf(filepath, sizeof(filepath), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    if (!read_cpu_list(filepath, &siblings) || siblings.empty())
+        return true;
+
+    return siblings[0] == cpu;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CCpuAffinity
+
+void CCpuAffinity::parse(const std::string& affinity) throw (CSyscallException)
+{
+    std::vector<std::vector<int> > node_cpus;
+
+    _cpus.clear();
+    if (affinity.empty())
+        return;
+
+    get_node_cpus(&node_cpus);
+    if ("compact" == affinity)
+    {
+        for (size_t i=0; i<node_cpus.size(); ++i)
+            _cpus.insert(_cpus.end(), node_cpus[i].begin(), node_cpus[i].end());
+    }
+    else if ("spread" == affinity)
+    {
+        // 轮流从各结点取一个
+        for (size_t round=0; ; ++round)
+        {
+            bool found = false;
+            for (size_t i=0; i<node_cpus.size(); ++i)
+            {
+                if (round < node_cpus[i].size())
+                {
+                    _cpus.push_back(node_cpus[i][round]);
+                    found = true;
+                }
+            }
+            if (!found)
+                break;
+        }
+    }
+    else
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        if (-1 == sched_getaffinity(0, sizeof(cpu_set), &cpu_set))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "sched_getaffinity");
+
+        if (!parse_cpu_list(affinity, &_cpus))
+            THROW_SYSCALL_EXCEPTION(std::string("invalid cpu affinity: ") + affinity, EINVAL, "parse");
+        for (size_t i=0; i<_cpus.size(); ++i)
+        {
+            if ((_cpus[i] >= CPU_SETSIZE) || !CPU_ISSET(_cpus[i], &cpu_set))
+                THROW_SYSCALL_EXCEPTION(std::string("unavailable cpu in affinity: ") + affinity, EINVAL, "parse");
+        }
+    }
+
+    if (_cpus.empty())
+        THROW_SYSCALL_EXCEPTION(std::string("no cpu for affinity: ") + affinity, EINVAL, "parse");
+}
+
+int CCpuAffinity::get_thread_cpu(uint16_t thread_index) const
+{
+    if (_cpus.empty())
+        return -1;
+
+    return _cpus[thread_index % _cpus.size()];
+}
+
+bool CCpuAffinity::parse_cpu_list(const std::string& cpu_list, std::vector<int>* cpus)
+{
+    const char* str = cpu_list.c_str();
+
+    while (*str != '\0')
+    {
+        char* end;
+        long first = strtol(str, &end, 10);
+        if ((end == str) || (first < 0))
+            return false;
+
+        long last = first;
+        str = end;
+        if ('-' == *str)
+        {
+            ++str;
+            last = strtol(str, &end, 10);
+            if ((end == str) || (last < first))
+                return false;
+            str = end;
+        }
+
+        if (last >= CPU_SETSIZE)
+            return false;
+        for (long cpu=first; cpu<=last; ++cpu)
+            cpus->push_back(static_cast<int>(cpu));
+
+        if (',' == *str)
+            ++str;
+        else if (*str != '\0')
+            return false;
+    }
+
+    return true;
+}
+
+int CCpuAffinity::get_numa_node_number()
+{
+    std::vector<int> nodes;
+
+    if (!read_cpu_list("/sys/devices/system/node/online", &nodes) || nodes.empty())
+        return 1;
+
+    return nodes.back() + 1;
+}
+
+int CCpuAffinity::get_cpu_numa_node(int cpu)
+{
+    if (cpu < 0)
+        return -1;
+
+    int node_number = get_numa_node_number();
+    for (int node=0; node<node_number; ++node)
+    {
+        char filepath[128];
+        std::vector<int> cpus;
+
+        snprintf(filepath, sizeof(filepath), "/sys/devices/system/node/node%d/cpulist", node);
+        if (!read_cpu_list(filepath, &cpus))
+            continue;
+
+        for (size_t i=0; i<cpus.size(); ++i)
+        {
+            if (cpu == cpus[i])
+                return node;
+        }
+    }
+
+    return -1;
+}
+
+void CCpuAffinity::set_current_thread_cpu(int cpu) throw (CSyscallException)
+{
+    cpu_set_t cpu_set;
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    int errcode = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (errcode != 0)
+        THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_setaffinity_np");
+}
+
+int CCpuAffinity::get_current_cpu()
+{
+    return sched_getcpu();
+}
+
+void CCpuAffinity::get_node_cpus(std::vector<std::vector<int> >* node_cpus)
+{
+    cpu_set_t cpu_set;
+    int node_number = get_numa_node_number();
+
+    CPU_ZERO(&cpu_set);
+    if (-1 == sched_getaffinity(0, sizeof(cpu_set), &cpu_set))
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "sched_getaffinity");
+
+    for (int node=0; node<node_number; ++node)
+    {
+        char filepath[128];
+        std::vector<int> cpus;
+        std::vector<int> primaries;
+        std::vector<int> secondaries;
+
+        snprintf(filepath, sizeof(filepath), "/sys/devices/system/node/node%d/cpulist", node);
+        if (!read_cpu_list(filepath, &cpus))
+        {
+            // 非NUMA系统，所有CPU都当作结点0的
+            if (node > 0)
+                continue;
+            for (int cpu=0; cpu<CPU_SETSIZE; ++cpu)
+                cpus.push_back(cpu);
+        }
+
+        for (size_t i=0; i<cpus.size(); ++i)
+        {
+            if ((cpus[i] >= CPU_SETSIZE) || !CPU_ISSET(cpus[i], &cpu_set))
+                continue;
+
+            if (is_primary_cpu(cpus[i]))
+                primaries.push_back(cpus[i]);
+            else
+                secondaries.push_back(cpus[i]);
+        }
+
+        primaries.insert(primaries.end(), secondaries.begin(), secondaries.end());
+        if (!primaries.empty())
+            node_cpus->push_back(primaries);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CNumaPolicyHelper
+
+CNumaPolicyHelper::CNumaPolicyHelper(int numa_node)
+    :_changed(false)
+    ,_old_mode(MPOL_DEFAULT)
+{
+    const unsigned long maxnode = sizeof(_old_nodemask) * 8;
+
+    memset(_old_nodemask, 0, sizeof(_old_nodemask));
+    if ((numa_node < 0) || (static_cast<unsigned long>(numa_node) >= maxnode))
+        return;
+    if (CCpuAffinity::get_numa_node_number() < 2)
+        return;
+    if (syscall(SYS_get_mempolicy, &_old_mode, _old_nodemask, maxnode, NULL, 0) != 0)
+        return;
+
+    unsigned long nodemask[sizeof(_old_nodemask)/sizeof(_old_nodemask[0])];
+    memset(nodemask, 0, sizeof(nodemask));
+    nodemask[numa_node / (sizeof(unsigned long) * 8)] = 1UL << (numa_node % (sizeof(unsigned long) * 8));
+    _changed = (0 == syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask, maxnode));
+}
+
+CNumaPolicyHelper::~CNumaPolicyHelper()
+{
+    if (_changed)
+        (void)syscall(SYS_set_mempolicy, _old_mode, _old_nodemask, sizeof(_old_nodemask) * 8);
+}
+
+SYS_NAMESPACE_END
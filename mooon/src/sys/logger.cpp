@@ -17,12 +17,20 @@
  * Author: eyjian@qq.com or eyjian@gmail.com
  */
 #include "sys/logger.h"
+#include "sys/bin_log.h"
 #include "sys/datetime_utils.h"
 #include "sys/dir_utils.h"
+#include "sys/futex.h"
 #include "sys/utils.h"
 #include "utils/string_utils.h"
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #if HAVE_UIO_H==1 // 需要使用sys_config.h中定义的HAVE_UIO_H宏
@@ -155,9 +163,215 @@ void set_log_backup_by_env(ILogger* logger)
     }
 }
 
+// 有过被抑制日志的限流器组成的链表，只增不减（限流器均为静态变量）
+static log_limiter_t* volatile sg_limiter_list = NULL;
+// 串行化补记，补记时会写日志，日志器又会调用log_limiter_tick()，所以tick只trylock
+static pthread_mutex_t sg_limiter_mutex = PTHREAD_MUTEX_INITIALIZER;
+// 下一次log_limiter_tick()执行补记的时间（微秒）
+static volatile uint64_t sg_limiter_next_tick = 0;
+
+// 每秒最多检查一次不再记录的调用点
+#define LOG_LIMITER_TICK_INTERVAL 1000000
+
+static uint64_t get_monotonic_microseconds()
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 限流器两条日志之间的最小间隔（微秒）
+static uint64_t get_limiter_interval(const log_limiter_t* limiter)
+{
+    if (LOG_LIMITER_PERIOD == limiter->type)
+        return static_cast<uint64_t>((0 == limiter->rate)? 1: limiter->rate) * 1000;
+    return 1000000 / ((0 == limiter->rate)? 1: limiter->rate);
+}
+
+bool log_limiter_allow(log_limiter_t* limiter, uint32_t* suppressed)
+{
+    bool allowed = false;
+
+    if (LOG_LIMITER_SAMPLE == limiter->type)
+    {
+        uint64_t count = __sync_fetch_and_add(&limiter->state, 1);
+        allowed = (limiter->rate <= 1) || (0 == count % limiter->rate);
+    }
+    else
+    {
+        // GCRA形式的令牌桶，只需一个64位状态，一次CAS即可完成取令牌
+        uint64_t now = get_monotonic_microseconds();
+        uint64_t interval = get_limiter_interval(limiter);
+        uint64_t tolerance = interval * ((0 == limiter->burst)? 0: limiter->burst-1);
+
+        for (;;)
+        {
+            uint64_t state = limiter->state;
+            uint64_t tat = (state > now)? state: now;
+            if (tat - now > tolerance)
+                break; // 令牌已用完
+            if (__sync_bool_compare_and_swap(&limiter->state, state, tat+interval))
+            {
+                allowed = true;
+                break;
+            }
+        }
+    }
+
+    if (!allowed)
+    {
+        __sync_add_and_fetch(&limiter->suppressed, 1);
+        return false;
+    }
+
+    *suppressed = (0 == limiter->suppressed)? 0: __sync_lock_test_and_set(&limiter->suppressed, 0);
+    return true;
+}
+
+void log_limiter_suppressed(log_limiter_t* limiter, ILogger* logger, int level, const char* module_name, const char* filename, int lineno)
+{
+    limiter->logger = logger;
+    if (limiter->registered)
+        return;
+
+    if (__sync_bool_compare_and_swap(&limiter->registered, 0, 1))
+    {
+        limiter->level = level;
+        limiter->lineno = lineno;
+        limiter->filename = filename;
+        limiter->module_name = module_name;
+
+        // CAS为全屏障，其它线程从链表中看到它时，以上字段均已写好
+        log_limiter_t* head;
+        do
+        {
+            head = sg_limiter_list;
+            limiter->next = head;
+        } while (!__sync_bool_compare_and_swap(&sg_limiter_list, head, limiter));
+    }
+}
+
+// 补记一条汇总日志，调用者须持有sg_limiter_mutex
+static void report_suppressed(log_limiter_t* limiter)
+{
+    uint32_t suppressed = __sync_lock_test_and_set(&limiter->suppressed, 0);
+    if (0 == suppressed)
+        return; // 调用点自己已补记
+
+    ILogger* logger = limiter->logger;
+    const char* format = "suppressed %u messages\n";
+    if (NULL == logger)
+    {
+        if (g_null_print_screen)
+            fprintf(stderr, "[%s:%d]suppressed %u messages\n", limiter->filename, limiter->lineno, suppressed);
+        return;
+    }
+
+    switch (limiter->level)
+    {
+    case LOG_LEVEL_DETAIL:
+        logger->log_detail(limiter->filename, limiter->lineno, limiter->module_name, format, suppressed);
+        break;
+    case LOG_LEVEL_DEBUG:
+        logger->log_debug(limiter->filename, limiter->lineno, limiter->module_name, format, suppressed);
+        break;
+    case LOG_LEVEL_INFO:
+        logger->log_info(limiter->filename, limiter->lineno, limiter->module_name, format, suppressed);
+        break;
+    case LOG_LEVEL_WARN:
+        logger->log_warn(limiter->filename, limiter->lineno, limiter->module_name, format, suppressed);
+        break;
+    case LOG_LEVEL_ERROR:
+        logger->log_error(limiter->filename, limiter->lineno, limiter->module_name, format, suppressed);
+        break;
+    case LOG_LEVEL_FATAL:
+        logger->log_fatal(limiter->filename, limiter->lineno, limiter->module_name, format, suppressed);
+        break;
+    case LOG_LEVEL_STATE:
+        logger->log_state(limiter->filename, limiter->lineno, limiter->module_name, format, suppressed);
+        break;
+    default:
+        logger->log_trace(limiter->filename, limiter->lineno, limiter->module_name, format, suppressed);
+        break;
+    }
+}
+
+// 调用者须持有sg_limiter_mutex
+static void do_limiter_flush(bool force)
+{
+    uint64_t now = get_monotonic_microseconds();
+    for (log_limiter_t* limiter=sg_limiter_list; limiter!=NULL; limiter=limiter->next)
+    {
+        bool quiet = force;
+        if (LOG_LIMITER_SAMPLE == limiter->type)
+        {
+            // 两次检查之间没有被调用过
+            uint64_t state = limiter->state;
+            quiet = quiet || (state == limiter->flushed_state);
+            limiter->flushed_state = state;
+        }
+        else
+        {
+            // 又可以记录了却没有记录，和调用点同时补记时由suppressed的交换保证只补记一次
+            quiet = quiet || (now >= limiter->state);
+        }
+
+        if (quiet && (limiter->suppressed > 0))
+            report_suppressed(limiter);
+    }
+}
+
+void log_limiter_flush(bool force)
+{
+    if (NULL == sg_limiter_list)
+        return;
+
+    (void)pthread_mutex_lock(&sg_limiter_mutex);
+    do_limiter_flush(force);
+    (void)pthread_mutex_unlock(&sg_limiter_mutex);
+}
+
+void log_limiter_tick()
+{
+    // 从没有日志被抑制过时，只有这一次读
+    if (NULL == sg_limiter_list)
+        return;
+
+    uint64_t now = get_monotonic_microseconds();
+    uint64_t next_tick = sg_limiter_next_tick;
+    if ((now < next_tick) || !__sync_bool_compare_and_swap(&sg_limiter_next_tick, next_tick, now+LOG_LIMITER_TICK_INTERVAL))
+        return;
+
+    // 补记时写日志又会进入这里，此时已持有锁，不能等待
+    if (0 == pthread_mutex_trylock(&sg_limiter_mutex))
+    {
+        do_limiter_flush(false);
+        (void)pthread_mutex_unlock(&sg_limiter_mutex);
+    }
+}
+
+void log_limiter_detach(ILogger* logger)
+{
+    if (NULL == sg_limiter_list)
+        return;
+
+    (void)pthread_mutex_lock(&sg_limiter_mutex);
+    for (log_limiter_t* limiter=sg_limiter_list; limiter!=NULL; limiter=limiter->next)
+    {
+        if (limiter->logger == logger)
+        {
+            if (limiter->suppressed > 0)
+                report_suppressed(limiter);
+            (void)__sync_bool_compare_and_swap(&limiter->logger, logger, (ILogger*)NULL);
+        }
+    }
+    (void)pthread_mutex_unlock(&sg_limiter_mutex);
+}
+
 //////////////////////////////////////////////////////////////////////////
 // CLogProber
 CLogProber::CLogProber()
+    :_eventfd_used(false)
 {
     if (-1 == pipe(_pipe_fd))
         THROW_SYSCALL_EXCEPTION(NULL, errno, "pipe");
@@ -168,17 +382,34 @@ CLogProber::~CLogProber()
     if (_pipe_fd[0] != -1)
     {
         close(_pipe_fd[0]);
-        close(_pipe_fd[1]);
+        if (_pipe_fd[1] != _pipe_fd[0])
+            close(_pipe_fd[1]);
     }
 }
 
+void CLogProber::use_eventfd()
+{
+    int fd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+    if (-1 == fd)
+        THROW_SYSCALL_EXCEPTION(NULL, errno, "eventfd");
+
+    close(_pipe_fd[0]);
+    close(_pipe_fd[1]);
+    _pipe_fd[0] = fd;
+    _pipe_fd[1] = fd;
+    _eventfd_used = true;
+}
+
 void CLogProber::send_signal()
 {
     char c = 'x';
+    uint64_t value = 1;
+    const void* buffer = _eventfd_used? static_cast<const void*>(&value): static_cast<const void*>(&c);
+    size_t buffer_size = _eventfd_used? sizeof(value): sizeof(c);
 
     while (true)
     {
-        if (-1 == write(_pipe_fd[1], &c, 1))
+        if (-1 == write(_pipe_fd[1], buffer, buffer_size))
         {
             if (EINTR == Error::code()) continue;
             THROW_SYSCALL_EXCEPTION(NULL, errno, "write");
@@ -192,6 +423,14 @@ void CLogProber::read_signal(int signal_number)
 {
     char signals[LOG_NUMBER_WRITED_ONCE];
 
+    if (_eventfd_used)
+    {
+        // eventfd为非阻塞的，一次读走所有信号
+        uint64_t value;
+        while ((-1 == read(_pipe_fd[0], &value, sizeof(value))) && (EINTR == Error::code()));
+        return;
+    }
+
     while (true)
     {
         if (-1 == read(_pipe_fd[0], reinterpret_cast<void*>(signals), static_cast<size_t>(signal_number)))
@@ -204,9 +443,113 @@ void CLogProber::read_signal(int signal_number)
     }
 }
 
+//////////////////////////////////////////////////////////////////////////
+// CLogRing
+CLogRing::CLogRing(uint32_t slot_number, uint16_t slot_size)
+    :_released(false)
+    ,_head(0)
+    ,_tail(0)
+{
+    uint32_t slot_number_ = 2;
+    while (slot_number_ < slot_number)
+        slot_number_ <<= 1;
+
+    // 多预留3个字节，用于自动添加的点号、换行符和结尾符，并按8字节对齐
+    _slot_mask = slot_number_ - 1;
+    _slot_stride = (offsetof(log_message_t, content) + slot_size + 3 + 7) & ~7;
+    _slots = new char[_slot_stride * slot_number_];
+}
+
+CLogRing::~CLogRing()
+{
+    delete []_slots;
+}
+
+log_message_t* CLogRing::get_back() const
+{
+    if (_tail - _head > _slot_mask)
+        return NULL; // 已满
+
+    return get_slot(_tail);
+}
+
+void CLogRing::push_back()
+{
+    // 保证槽位内容先于_tail对消费者可见
+    __sync_synchronize();
+    _tail = _tail + 1;
+}
+
+log_message_t* CLogRing::get_front(uint32_t index) const
+{
+    if (_tail - _head <= index)
+        return NULL;
+
+    // 读_tail之后才能读槽位内容
+    __sync_synchronize();
+    return get_slot(_head + index);
+}
+
+void CLogRing::pop_front(uint32_t number)
+{
+    // 保证槽位内容已被读走后，生产者才能看到新的_head
+    __sync_synchronize();
+    _head = _head + number;
+}
+
+void CLogRing::release()
+{
+    _released = true;
+    dec_refcount();
+}
+
+void CLogRing::reuse()
+{
+    inc_refcount();
+    _released = false;
+}
+
+log_message_t* CLogRing::get_slot(uint32_t position) const
+{
+    return reinterpret_cast<log_message_t*>(_slots + (position & _slot_mask) * _slot_stride);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 线程本地日志环表，以Logger的_ring_index为下标，
+// 通过_ring_serial识别下标被新Logger重用后的过期项
+typedef struct
+{
+    uint64_t serial[LOGGER_NUMBER_MAX];
+    CLogRing* ring[LOGGER_NUMBER_MAX];
+}thread_log_rings_t;
+
+static __thread thread_log_rings_t* sg_thread_log_rings = NULL;
+static pthread_key_t sg_thread_log_rings_key;
+static pthread_once_t sg_thread_log_rings_once = PTHREAD_ONCE_INIT;
+
+// 线程退出时释放它占用的所有日志环，使之可被新线程重用
+static void release_thread_log_rings(void* thread_log_rings)
+{
+    thread_log_rings_t* log_rings = static_cast<thread_log_rings_t*>(thread_log_rings);
+    for (int i=0; i<LOGGER_NUMBER_MAX; ++i)
+    {
+        if (log_rings->ring[i] != NULL)
+            log_rings->ring[i]->release();
+    }
+
+    delete log_rings;
+}
+
+static void create_thread_log_rings_key()
+{
+    (void)pthread_key_create(&sg_thread_log_rings_key, release_thread_log_rings);
+}
+
 //////////////////////////////////////////////////////////////////////////
 CLock CLogger::_thread_lock;
 CLogThread* CLogger::_log_thread = NULL;
+uint64_t CLogger::_ring_serial_seed = 0;
+bool CLogger::_ring_index_used[LOGGER_NUMBER_MAX] = { false };
 
 CLogger::CLogger(uint16_t log_line_size)
     :_log_fd(-1)
@@ -220,6 +563,17 @@ CLogger::CLogger(uint16_t log_line_size)
     ,_current_bytes(0)
     ,_log_queue(NULL)
     ,_waiter_number(0)
+    ,_queue_lock("sys.logger.queue")
+    ,_thread_ring_enabled(false)
+    ,_ring_slot_number(0)
+    ,_ring_index(-1)
+    ,_ring_serial(0)
+    ,_rings(NULL)
+    ,_ring_number(0)
+    ,_ring_notified(0)
+    ,_ring_drained(0)
+    ,_ring_waiter_number(0)
+    ,_deferred_format_enabled(false)
 {    
     atomic_set(&_max_bytes, DEFAULT_LOG_FILE_SIZE);
     atomic_set(&_log_level, LOG_LEVEL_INFO);
@@ -231,11 +585,20 @@ CLogger::CLogger(uint16_t log_line_size)
 
 CLogger::~CLogger()
 {    
+    // 先补记限流日志，之后限流器不再引用本日志器
+    log_limiter_detach(this);
+
     //destroy(); 
     // 删除队列
     delete _log_queue;
     _log_queue = NULL;
 
+    // 线程仍持有的日志环，由线程退出时释放
+    for (uint32_t i=0; i<_ring_number; ++i)
+        _rings[i]->dec_refcount();
+    delete []_rings;
+    _rings = NULL;
+
     if (_log_fd != -1)
     {
         close(_log_fd);
@@ -246,7 +609,7 @@ CLogger::~CLogger()
 void CLogger::destroy()
 {       
     { // _queue_lock
-        LockHelper<CLock> lh(_queue_lock);
+        LockHelper<CAdaptiveLock> lh(_queue_lock);
 
         // 停止Logger的日志，长度为0
         log_message_t* log_message = (log_message_t*)malloc(sizeof(log_message_t));
@@ -262,6 +625,10 @@ void CLogger::destroy()
     { // CLogger::_thread_lock
         LockHelper<CLock> lh(CLogger::_thread_lock);
 
+        // 归还线程本地日志环表的下标
+        if (_ring_index != -1)
+            CLogger::_ring_index_used[_ring_index] = false;
+
         // 决定是否需要删除线程
         if (2 == CLogger::_log_thread->get_refcount())
         {
@@ -272,7 +639,7 @@ void CLogger::destroy()
     } // CLogger::_thread_lock
 }
 
-void CLogger::create(const char* log_path, const char* log_filename, uint32_t log_queue_size)
+void CLogger::create(const char* log_path, const char* log_filename, uint32_t log_queue_size, bool thread_ring, bool deferred_format)
 {
     // 日志文件路径和文件名
     snprintf(_log_path, sizeof(_log_path), "%s", log_path);
@@ -287,6 +654,31 @@ void CLogger::create(const char* log_path, const char* log_filename, uint32_t lo
     // 创建和启动日志线程
     create_thread();
 
+    if (thread_ring || deferred_format)
+    {
+        LockHelper<CLock> lh(CLogger::_thread_lock);
+        for (int i=0; i<LOGGER_NUMBER_MAX; ++i)
+        {
+            if (!CLogger::_ring_index_used[i])
+            {
+                CLogger::_ring_index_used[i] = true;
+                _ring_index = i;
+                break;
+            }
+        }
+
+        // 下标用完时，仍使用队列方式
+        if (_ring_index != -1)
+        {
+            use_eventfd();
+            _ring_serial = ++CLogger::_ring_serial_seed;
+            _ring_slot_number = log_queue_size_;
+            _rings = new CLogRing*[LOG_RING_NUMBER_MAX];
+            _thread_ring_enabled = true;
+            _deferred_format_enabled = deferred_format;
+        }
+    }
+
     // 创建日志文件
     inc_refcount(); // 和destroy一一对应
     create_logfile(false);
@@ -330,6 +722,8 @@ bool CLogger::execute()
         }
         if (_log_fd != -1)
         {
+            if (_thread_ring_enabled)
+                return ring_execute();
 #if HAVE_UIO_H==1
             return batch_write();
 #else
@@ -368,7 +762,7 @@ bool CLogger::single_write()
     log_message_t* log_message = NULL;
     
     { // 限定锁的范围
-        LockHelper<CLock> lh(_queue_lock);        
+        LockHelper<CAdaptiveLock> lh(_queue_lock);        
         log_message = _log_queue->pop_front();
         if (_waiter_number > 0)
             _queue_event.signal();        
@@ -426,7 +820,7 @@ bool CLogger::batch_write()
     struct iovec iov_array[LOG_NUMBER_WRITED_ONCE];
     
     { // 空括号用来限定_queue_lock的范围
-        LockHelper<CLock> lh(_queue_lock);
+        LockHelper<CAdaptiveLock> lh(_queue_lock);
 
         // 批量取出消息
         int i = 0;
@@ -591,32 +985,41 @@ bool CLogger::enabled_trace()
 
 void CLogger::do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
 {    
+    log_limiter_tick();
+
+    if (_thread_ring_enabled)
+    {
+        CLogRing* log_ring = get_thread_ring();
+        if (log_ring != NULL)
+        {
+            ring_log(log_ring, log_level, filename, lineno, module_name, format, args);
+            return;
+        }
+    }
+
+    if (_deferred_format_enabled)
+    {
+        // 取不到线程日志环时，二进制记录同样放入队列
+        log_message_t* log_message = (log_message_t*)malloc(_log_line_size+sizeof(log_message_t)+1);
+        int head_length = format_bin_head(log_message->content, _log_line_size, BIN_LOG_RECORD_TEXT, log_level, filename, lineno, module_name, format);
+        log_message->length = head_length + encode_bin_log_args(log_message->content+head_length, _log_line_size-head_length, format, args);
+        memcpy(log_message->content, &log_message->length, sizeof(log_message->length)); // 记录头的size
+
+        LockHelper<CAdaptiveLock> lh(_queue_lock);
+        if (_destroying)
+            free(log_message);
+        else
+            push_log_message(log_message);
+        return;
+    }
+
     va_list args_copy;
     va_copy(args_copy, args);
     utils::VaListHelper vh(args_copy);
     log_message_t* log_message = (log_message_t*)malloc(_log_line_size+sizeof(log_message_t)+1);
 
-    char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
-    get_formatted_current_datetime(datetime, sizeof(datetime));
-    
-    // 模块名称
-    std::string module_name_field;
-    if (module_name != NULL)
-    {
-        module_name_field = std::string("[") + module_name + std::string("]");
-    }
-
     // 在构造时，已经保证_log_line_size不会小于指定的值，所以下面的操作是安全的
-    int head_length = utils::CStringUtils::fix_snprintf(
-            log_message->content
-          , _log_line_size
-          , "[%s][0x%08x][%s]%s[%s:%d]"
-          , datetime
-          , CThread::get_current_thread_id()
-          , get_log_level_name(log_level)
-          , module_name_field.c_str()
-          , filename
-          , lineno);
+    int head_length = format_log_head(log_message->content, _log_line_size, log_level, filename, lineno, module_name);
     int log_line_length = vsnprintf(log_message->content+head_length, _log_line_size-head_length, format, args);
 
     if (log_line_length < _log_line_size-head_length)
@@ -642,12 +1045,48 @@ void CLogger::do_log(log_level_t log_level, const char* filename, int lineno, co
             log_message = new_log_message;
                                     
             // 这里不需要关心返回值了
-            head_length  = utils::CStringUtils::fix_snprintf(log_message->content, new_line_length, "[%s][0x%08x][%s]", datetime, CThread::get_current_thread_id(), get_log_level_name(log_level));
+            head_length = format_log_head(log_message->content, new_line_length, log_level, filename, lineno, module_name);
             log_line_length = utils::CStringUtils::fix_vsnprintf(log_message->content+head_length, new_line_length-head_length, format, args_copy);            
-            log_message->length = head_length + log_line_length;
+            log_message->length = head_length + log_line_length - 1;
         }
     }
     
+    complete_log_message(log_message);
+    
+    // 日志消息放入队列中
+    LockHelper<CAdaptiveLock> lh(_queue_lock);
+    if (!_destroying)
+    {
+        push_log_message(log_message);
+    }
+}
+
+int CLogger::format_log_head(char* buffer, int buffer_size, log_level_t log_level, const char* filename, int lineno, const char* module_name) const
+{
+    char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
+    get_formatted_current_datetime(datetime, sizeof(datetime));
+
+    // 模块名称，不使用std::string以免分配内存
+    const char* module_name_head = (NULL == module_name)? "": "[";
+    const char* module_name_tail = (NULL == module_name)? "": "]";
+
+    // fix_snprintf()的返回值包含了结尾符
+    return utils::CStringUtils::fix_snprintf(
+            buffer
+          , buffer_size
+          , "[%s][0x%08x][%s]%s%s%s[%s:%d]"
+          , datetime
+          , CThread::get_current_thread_id()
+          , get_log_level_name(log_level)
+          , module_name_head
+          , (NULL == module_name)? "": module_name
+          , module_name_tail
+          , filename
+          , lineno) - 1;
+}
+
+void CLogger::complete_log_message(log_message_t* log_message) const
+{
     // 自动添加结尾点号
     if (_auto_adddot 
      && (log_message->content[log_message->length-1] != '.')
@@ -671,13 +1110,6 @@ void CLogger::do_log(log_level_t log_level, const char* filename, int lineno, co
     {
         (void)write(STDOUT_FILENO, log_message->content, log_message->length);
     }
-    
-    // 日志消息放入队列中
-    LockHelper<CLock> lh(_queue_lock);
-    if (!_destroying)
-    {
-        push_log_message(log_message);
-    }
 }
 
 void CLogger::push_log_message(log_message_t* log_message)
@@ -691,7 +1123,350 @@ void CLogger::push_log_message(log_message_t* log_message)
 
     CLogger::_log_thread->inc_log_number();
     _log_queue->push_back(log_message);    
-    send_signal();
+    if (_thread_ring_enabled)
+        ring_notify();
+    else
+        send_signal();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// 线程日志环模式
+
+void CLogger::ring_log(CLogRing* log_ring, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
+{
+    if (_destroying)
+        return;
+    if (_deferred_format_enabled)
+    {
+        ring_log_bin(log_ring, log_level, filename, lineno, module_name, format, args);
+        return;
+    }
+
+    // 环满时等待CLogThread取走日志
+    log_message_t* log_message = ring_get_back(log_ring);
+
+    // 直接格式化到槽位中，超出槽位大小的部分被截断
+    int head_length = format_log_head(log_message->content, _log_line_size, log_level, filename, lineno, module_name);
+    int log_line_length = utils::CStringUtils::fix_vsnprintf(log_message->content+head_length, _log_line_size-head_length, format, args);
+    log_message->length = head_length + log_line_length - 1;
+    complete_log_message(log_message);
+
+    log_ring->push_back();
+    ring_notify();
+}
+
+void CLogger::ring_log_bin(CLogRing* log_ring, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
+{
+    log_message_t* log_message = ring_get_back(log_ring);
+
+    // 只复制参数的原始字节，格式化由解码工具完成
+    int head_length = format_bin_head(log_message->content, _log_line_size, BIN_LOG_RECORD_TEXT, log_level, filename, lineno, module_name, format);
+    log_message->length = head_length + encode_bin_log_args(log_message->content+head_length, _log_line_size-head_length, format, args);
+    memcpy(log_message->content, &log_message->length, sizeof(log_message->length)); // 记录头的size
+
+    log_ring->push_back();
+    ring_notify();
+}
+
+void CLogger::ring_notify()
+{
+    // 和ring_execute中的屏障配对：要么CLogThread能看到刚提交的日志，要么这里能看到_ring_notified为0
+    __sync_synchronize();
+    if ((0 == _ring_notified) && __sync_bool_compare_and_swap(&_ring_notified, 0, 1))
+    {
+        send_signal();
+    }
+}
+
+log_message_t* CLogger::ring_get_back(CLogRing* log_ring)
+{
+    log_message_t* log_message = log_ring->get_back();
+
+    // 环满时先短暂让出CPU，CLogThread通常很快就能取走日志
+    for (int i=0; (NULL == log_message) && (i < LOG_RING_SPIN_NUMBER); ++i)
+    {
+        ring_notify();
+        sched_yield();
+        log_message = log_ring->get_back();
+    }
+
+    // 仍然满则在futex上睡眠，直到CLogThread释放了槽位，
+    // 先增加等待者个数并取得_ring_drained，再检查环，和ring_wake配对，不会漏掉唤醒
+    while (NULL == log_message)
+    {
+        __sync_add_and_fetch(&_ring_waiter_number, 1);
+        int32_t drained = __atomic_load_n(&_ring_drained, __ATOMIC_SEQ_CST);
+        log_message = log_ring->get_back();
+        if (NULL == log_message)
+        {
+            ring_notify();
+            (void)futex_wait(&_ring_drained, drained);
+            log_message = log_ring->get_back();
+        }
+        __sync_sub_and_fetch(&_ring_waiter_number, 1);
+    }
+
+    return log_message;
+}
+
+void CLogger::ring_wake()
+{
+    // 槽位已释放，先改变_ring_drained再检查等待者，以免生产者在检查环之后、睡眠之前错过唤醒
+    __sync_add_and_fetch(&_ring_drained, 1);
+    if (__atomic_load_n(&_ring_waiter_number, __ATOMIC_SEQ_CST) > 0)
+        futex_wake(&_ring_drained, INT_MAX);
+}
+
+bool CLogger::ring_execute()
+{
+    // 读走所有信号
+    read_signal(1);
+
+    ring_drain();
+    bool to_destroy_logger = ring_drain_queue();
+
+    // 重置后再取一次，以免遗漏重置前提交但未发信号的日志
+    _ring_notified = 0;
+    __sync_synchronize();
+    ring_drain();
+    if (ring_drain_queue())
+        to_destroy_logger = true;
+
+    return !to_destroy_logger;
+}
+
+void CLogger::ring_drain()
+{
+    int number = 0;      // iov_array中的日志条数
+    int ring_number = 0; // ring_array中的日志环个数
+    struct iovec iov_array[LOG_RING_WRITED_ONCE];
+    CLogRing* ring_array[LOG_RING_WRITED_ONCE];
+    uint32_t count_array[LOG_RING_WRITED_ONCE];
+    const uint32_t ring_total = _ring_number;
+
+    for (uint32_t i=0; i<ring_total; ++i)
+    {
+        CLogRing* log_ring = _rings[i];
+        log_message_t* log_message;
+        uint32_t count = 0;   // 该日志环中待释放的槽位数
+        uint32_t drained = 0; // 每次最多取一圈，以免一个忙碌的线程独占CLogThread
+
+        while ((drained < _ring_slot_number) && ((log_message = log_ring->get_front(count)) != NULL))
+        {
+            if (_deferred_format_enabled && !has_bin_strings(log_message))
+            {
+                // 字典项须先于引用它的日志写入文件，先写出已取到的日志
+                if (count > 0)
+                {
+                    ring_array[ring_number] = log_ring;
+                    count_array[ring_number++] = count;
+                }
+                if (number > 0)
+                {
+                    ring_flush(iov_array, number, ring_array, count_array, ring_number);
+                }
+
+                number = 0;
+                ring_number = 0;
+                count = 0;
+                write_bin_strings(log_message);
+            }
+
+            iov_array[number].iov_base = log_message->content;
+            iov_array[number].iov_len = log_message->length;
+            ++number;
+            ++count;
+            ++drained;
+
+            if (LOG_RING_WRITED_ONCE == number)
+            {
+                ring_array[ring_number] = log_ring;
+                count_array[ring_number++] = count;
+                ring_flush(iov_array, number, ring_array, count_array, ring_number);
+
+                number = 0;
+                ring_number = 0;
+                count = 0;
+            }
+        }
+        if (count > 0)
+        {
+            ring_array[ring_number] = log_ring;
+            count_array[ring_number++] = count;
+        }
+    }
+
+    if (number > 0)
+    {
+        ring_flush(iov_array, number, ring_array, count_array, ring_number);
+    }
+}
+
+void CLogger::ring_flush(const struct iovec* iov_array, int number, CLogRing* const* ring_array, const uint32_t* count_array, int ring_number)
+{
+    try
+    {
+        write_iov(iov_array, number);
+    }
+    catch (CSyscallException& ex)
+    {
+        // 出错时也要释放槽位，以免生产者一直等待
+        for (int i=0; i<ring_number; ++i)
+            ring_array[i]->pop_front(count_array[i]);
+        ring_wake();
+        throw;
+    }
+
+    for (int i=0; i<ring_number; ++i)
+        ring_array[i]->pop_front(count_array[i]);
+    ring_wake();
+}
+
+bool CLogger::ring_drain_queue()
+{
+    // 取不到线程日志环时退回到了队列方式，以及destroy放入的结束消息
+    bool to_destroy_logger = false;
+
+    while (!to_destroy_logger)
+    {
+        int number = 0;
+        struct iovec iov_array[LOG_NUMBER_WRITED_ONCE];
+
+        { // 限定锁的范围
+            LockHelper<CAdaptiveLock> lh(_queue_lock);
+            while ((number < LOG_NUMBER_WRITED_ONCE) && !_log_queue->is_empty())
+            {
+                log_message_t* log_message = _log_queue->pop_front();
+                CLogger::_log_thread->dec_log_number(1);
+
+                if (0 == log_message->length)
+                {
+                    // 需要销毁Logger了
+                    free(log_message);
+                    to_destroy_logger = true;
+                    break;
+                }
+
+                iov_array[number].iov_base = log_message->content;
+                iov_array[number].iov_len = log_message->length;
+                ++number;
+            }
+            if (_waiter_number > 0)
+            {
+                _queue_event.broadcast();
+            }
+        }
+        if (0 == number)
+        {
+            break;
+        }
+
+        try
+        {
+            int first = 0;
+            for (int i=0; _deferred_format_enabled && (i<number); ++i)
+            {
+                const log_message_t* log_message = get_struct_head_address(log_message_t, content, iov_array[i].iov_base);
+                if (!has_bin_strings(log_message))
+                {
+                    if (i > first)
+                        write_iov(iov_array+first, i-first);
+                    write_bin_strings(log_message);
+                    first = i;
+                }
+            }
+
+            write_iov(iov_array+first, number-first);
+        }
+        catch (CSyscallException& ex)
+        {
+            while (number-- > 0)
+                free(get_struct_head_address(log_message_t, content, iov_array[number].iov_base));
+            throw;
+        }
+        while (number-- > 0)
+            free(get_struct_head_address(log_message_t, content, iov_array[number].iov_base));
+    }
+
+    return to_destroy_logger;
+}
+
+void CLogger::write_iov(const struct iovec* iov_array, int number)
+{
+    for (;;)
+    {
+        int retval = writev(_log_fd, iov_array, number);
+        if (-1 == retval)
+        {
+            if (EINTR == Error::code())
+                continue;
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "writev");
+        }
+
+        // 更新当前日志文件大小
+        _current_bytes += static_cast<uint32_t>(retval);
+        break;
+    }
+}
+
+CLogRing* CLogger::get_thread_ring()
+{
+    thread_log_rings_t* log_rings = sg_thread_log_rings;
+    if ((log_rings != NULL) && (log_rings->serial[_ring_index] == _ring_serial))
+        return log_rings->ring[_ring_index];
+
+    return register_thread_ring();
+}
+
+CLogRing* CLogger::register_thread_ring()
+{
+    thread_log_rings_t* log_rings = sg_thread_log_rings;
+    if (NULL == log_rings)
+    {
+        // 每个线程只会分配一次
+        (void)pthread_once(&sg_thread_log_rings_once, create_thread_log_rings_key);
+        log_rings = new thread_log_rings_t;
+        memset(log_rings, 0, sizeof(thread_log_rings_t));
+        (void)pthread_setspecific(sg_thread_log_rings_key, log_rings);
+        sg_thread_log_rings = log_rings;
+    }
+
+    // 下标上的日志环属于已销毁的Logger
+    if (log_rings->ring[_ring_index] != NULL)
+    {
+        log_rings->ring[_ring_index]->release();
+        log_rings->ring[_ring_index] = NULL;
+    }
+
+    CLogRing* log_ring = NULL;
+    LockHelper<CLock> lh(_ring_lock);
+
+    // 优先重用已退出线程的日志环
+    for (uint32_t i=0; i<_ring_number; ++i)
+    {
+        if (_rings[i]->is_released())
+        {
+            log_ring = _rings[i];
+            log_ring->reuse();
+            break;
+        }
+    }
+    if ((NULL == log_ring) && (_ring_number < LOG_RING_NUMBER_MAX))
+    {
+        log_ring = new CLogRing(_ring_slot_number, _log_line_size);
+        log_ring->inc_refcount(); // Logger持有的引用
+        log_ring->inc_refcount(); // 线程持有的引用
+        _rings[_ring_number] = log_ring;
+
+        // 保证CLogThread看到新的_ring_number时，_rings中对应的项已有效
+        __sync_synchronize();
+        _ring_number = _ring_number + 1;
+    }
+
+    // 为NULL时该线程退回到队列方式
+    log_rings->serial[_ring_index] = _ring_serial;
+    log_rings->ring[_ring_index] = log_ring;
+    return log_ring;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -794,10 +1569,44 @@ void CLogger::log_trace(const char* filename, int lineno, const char* module_nam
 
 void CLogger::log_bin(const char* filename, int lineno, const char* module_name, const char* log, uint16_t size)
 {
-    if (enabled_bin())
-    {        
-        //set_log_length(log, size);
-        //_log_thread->push_log(log);
+    // 只有延迟格式化模式下的二进制日志文件才能容纳原始数据
+    if (enabled_bin() && _deferred_format_enabled)
+    {
+        CLogRing* log_ring = get_thread_ring();
+        log_message_t* log_message = NULL;
+
+        if (log_ring != NULL)
+        {
+            if (_destroying)
+                return;
+
+            log_message = ring_get_back(log_ring);
+        }
+        else
+        {
+            log_message = (log_message_t*)malloc(_log_line_size+sizeof(log_message_t)+1);
+        }
+
+        // 超出日志行大小的部分被截断
+        int head_length = format_bin_head(log_message->content, _log_line_size, BIN_LOG_RECORD_RAW, LOG_LEVEL_BIN, filename, lineno, module_name, NULL);
+        int log_size = (size < _log_line_size-head_length)? size: _log_line_size-head_length;
+        memcpy(log_message->content+head_length, log, log_size);
+        log_message->length = head_length + log_size;
+        memcpy(log_message->content, &log_message->length, sizeof(log_message->length)); // 记录头的size
+
+        if (log_ring != NULL)
+        {
+            log_ring->push_back();
+            ring_notify();
+        }
+        else
+        {
+            LockHelper<CAdaptiveLock> lh(_queue_lock);
+            if (_destroying)
+                free(log_message);
+            else
+                push_log_message(log_message);
+        }
     }
 }
 
@@ -833,6 +1642,8 @@ void CLogger::create_logfile(bool truncate)
     }       
            
     _current_bytes = st.st_size;
+    if (_deferred_format_enabled)
+        write_bin_file_head();
     CLogger::_log_thread->register_logger(this);    
 }
 
@@ -864,6 +1675,100 @@ bool CLogger::need_create_file() const
     return 0 == st.st_nlink;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// 延迟格式化的二进制日志
+
+int CLogger::format_bin_head(char* buffer, int buffer_size, uint8_t record_type, log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format) const
+{
+    struct timeval current;
+    bin_log_text_t text;
+    uint16_t module_name_length = (NULL == module_name)? 0: static_cast<uint16_t>(strnlen(module_name, SIZE_64));
+
+    (void)gettimeofday(&current, NULL);
+    text.head.size = 0; // 由调用者在写完整条记录后设置
+    text.head.type = record_type;
+    text.head.level = static_cast<uint8_t>(log_level);
+    text.head.lineno = static_cast<uint32_t>(lineno);
+    text.thread_id = CThread::get_current_thread_id();
+    text.reserved = 0;
+    text.timestamp = static_cast<uint64_t>(current.tv_sec) * 1000000 + current.tv_usec;
+    text.filename = reinterpret_cast<uintptr_t>(filename);
+    text.format = reinterpret_cast<uintptr_t>(format);
+
+    // 模块名可能不是常量，所以复制内容，而不是只记录地址，
+    // 在构造时已保证buffer_size不小于LOG_LINE_SIZE_MIN，能够容纳头部和模块名
+    memcpy(buffer, &text, sizeof(text));
+    memcpy(buffer+sizeof(text), &module_name_length, sizeof(module_name_length));
+    if (module_name_length > 0)
+        memcpy(buffer+sizeof(text)+sizeof(module_name_length), module_name, module_name_length);
+    return static_cast<int>(sizeof(text) + sizeof(module_name_length) + module_name_length);
+}
+
+void CLogger::write_bin_file_head()
+{
+    bin_log_file_t file_head;
+    struct iovec iov;
+
+    memset(&file_head, 0, sizeof(file_head));
+    file_head.head.size = sizeof(file_head);
+    file_head.head.type = BIN_LOG_RECORD_FILE;
+    memcpy(file_head.magic, BIN_LOG_MAGIC, sizeof(file_head.magic));
+    file_head.version = BIN_LOG_VERSION;
+    file_head.pid = static_cast<uint32_t>(getpid());
+    file_head.flags = (_auto_adddot? BIN_LOG_FLAG_AUTO_ADDDOT: 0) | (_auto_newline? BIN_LOG_FLAG_AUTO_NEWLINE: 0);
+
+    // 新文件需要重新写入字典
+    _bin_strings.clear();
+    iov.iov_base = &file_head;
+    iov.iov_len = sizeof(file_head);
+    write_iov(&iov, 1);
+}
+
+bool CLogger::has_bin_strings(const log_message_t* log_message) const
+{
+    bin_log_text_t text;
+    memcpy(&text, log_message->content, sizeof(text));
+
+    if (_bin_strings.find(text.filename) == _bin_strings.end())
+        return false;
+    if ((text.format != 0) && (_bin_strings.find(text.format) == _bin_strings.end()))
+        return false;
+    return true;
+}
+
+void CLogger::write_bin_strings(const log_message_t* log_message)
+{
+    bin_log_text_t text;
+    memcpy(&text, log_message->content, sizeof(text));
+
+    if (_bin_strings.find(text.filename) == _bin_strings.end())
+        write_bin_string(text.filename);
+    if ((text.format != 0) && (_bin_strings.find(text.format) == _bin_strings.end()))
+        write_bin_string(text.format);
+}
+
+void CLogger::write_bin_string(uint64_t address)
+{
+    // 格式串和文件名为字符串常量，在进程生命期内一直有效
+    const char* str = reinterpret_cast<const char*>(static_cast<uintptr_t>(address));
+    size_t length = (NULL == str)? 0: strnlen(str, UINT16_MAX - sizeof(bin_log_string_t));
+    bin_log_string_t string_head;
+    struct iovec iov_array[2];
+
+    string_head.head.size = static_cast<uint16_t>(sizeof(string_head) + length);
+    string_head.head.type = BIN_LOG_RECORD_STRING;
+    string_head.head.level = 0;
+    string_head.head.lineno = 0;
+    string_head.address = address;
+    iov_array[0].iov_base = &string_head;
+    iov_array[0].iov_len = sizeof(string_head);
+    iov_array[1].iov_base = const_cast<char*>(str);
+    iov_array[1].iov_len = length;
+
+    write_iov(iov_array, (length > 0)? 2: 1);
+    _bin_strings.insert(address);
+}
+
 //////////////////////////////////////////////////////////////////////////
 CLogThread::CLogThread()  
     :_epoll_fd(-1)
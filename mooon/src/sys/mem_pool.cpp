@@ -23,6 +23,7 @@ SYS_NAMESPACE_BEGIN
 CRawMemPool::CRawMemPool() throw ()
     :_use_heap(false)
     ,_guard_size(0)
+    ,_guard_flag(0)
     ,_bucket_size(0)
     ,_bucket_number(0)   
     ,_stack_top_index(0)
@@ -65,7 +66,7 @@ void CRawMemPool::destroy() throw ()
     }
 }
 
-void CRawMemPool::create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap, uint8_t guard_size, char guard_flag) throw ()
+void CRawMemPool::create(uint32_t bucket_size, uint32_t bucket_number, bool use_heap, uint8_t guard_size, char guard_flag) throw ()
 {
     // 释放之前已经创建的
     destroy();
@@ -73,27 +74,28 @@ void CRawMemPool::create(uint16_t bucket_size, uint32_t bucket_number, bool use_
     // 保存对象大小和个数值
     _use_heap = use_heap;
     _guard_size = guard_size;
+    _guard_flag = guard_flag;
     _bucket_size = (bucket_size > 0)? bucket_size: 1;
     _bucket_number = (bucket_number > 0)? bucket_number: 1;
 
     // 有了guard_size更容易分析出是否有内存越界之类的行为
     _bucket_size += _guard_size;
     
-    _bucket_stack = new char*[bucket_number];
-    _stack_bottom = new char[_bucket_size * bucket_number];
-    _stack_top = _stack_bottom + _bucket_size * (bucket_number - 1);
-    _stack_top_index = bucket_number;
-    _available_number = bucket_number;
+    _bucket_stack = new char*[_bucket_number];
+    _stack_bottom = new char[static_cast<size_t>(_bucket_size) * _bucket_number];
+    _stack_top = _stack_bottom + static_cast<size_t>(_bucket_size) * (_bucket_number - 1);
+    _stack_top_index = _bucket_number;
+    _available_number = _bucket_number;
 
     // 设置警戒标识
-    memset(_stack_bottom, guard_flag, bucket_number * _bucket_size);
+    memset(_stack_bottom, guard_flag, static_cast<size_t>(_bucket_size) * _bucket_number);
     
     for (uint32_t i=0; i<_bucket_number; ++i)    
-        _bucket_stack[i] = _stack_bottom + _bucket_size * i; 
+        _bucket_stack[i] = _stack_bottom + static_cast<size_t>(_bucket_size) * i; 
         
-    // 初始化为1，加8是为了不四舍五入
-    _bucket_bitmap = new char[(bucket_number+8) / 8];
-    memset(_bucket_bitmap, 1, (bucket_number+8) / 8);
+    // 位为1表示已分配，初始全部在池中，加8是为了不四舍五入
+    _bucket_bitmap = new char[(_bucket_number+8) / 8];
+    memset(_bucket_bitmap, 0, (_bucket_number+8) / 8);
 }
 
 void* CRawMemPool::allocate() throw ()
@@ -134,6 +136,13 @@ bool CRawMemPool::reclaim(void* bucket) throw ()
     }
 
     uint32_t bitmap_index = (ptr - _stack_bottom) / _bucket_size;
+#ifndef NDEBUG
+    if (!check_guard(ptr))
+    {
+        // 越界写坏了警戒值，不再放回池中
+        return false;
+    }
+#endif // NDEBUG
     if (utils::CBitUtils::test(_bucket_bitmap, bitmap_index))
     {
         ++_available_number;
@@ -144,6 +153,69 @@ bool CRawMemPool::reclaim(void* bucket) throw ()
     return true;
 }
 
+uint32_t CRawMemPool::take_batch(void** buckets, uint32_t number) throw ()
+{
+    uint32_t i;
+
+    for (i=0; (i<number) && (_stack_top_index>0); ++i)
+    {
+        char* ptr = _bucket_stack[--_stack_top_index];
+        uint32_t bitmap_index = (ptr - _stack_bottom) / _bucket_size;
+
+        utils::CBitUtils::set_bit(_bucket_bitmap, bitmap_index, false);
+        buckets[i] = ptr;
+    }
+
+    _available_number -= i;
+    return i;
+}
+
+void CRawMemPool::put_batch(void** buckets, uint32_t number) throw ()
+{
+    for (uint32_t i=0; i<number; ++i)
+    {
+        char* ptr = static_cast<char*>(buckets[i]);
+        uint32_t bitmap_index = (ptr - _stack_bottom) / _bucket_size;
+
+        _bucket_stack[_stack_top_index++] = ptr;
+        utils::CBitUtils::set_bit(_bucket_bitmap, bitmap_index, true);
+    }
+
+    _available_number += number;
+}
+
+bool CRawMemPool::get_bucket_index(const void* bucket, uint32_t* index) const throw ()
+{
+    const char* ptr = static_cast<const char*>(bucket);
+
+    if ((ptr < _stack_bottom) || (ptr > _stack_top))
+        return false;
+
+    // 只做一次除法，回收时它在热路径上
+    size_t offset = ptr - _stack_bottom;
+    *index = offset / _bucket_size;
+    return static_cast<size_t>(*index) * _bucket_size == offset;
+}
+
+bool CRawMemPool::is_pool_bucket(const void* bucket) const throw ()
+{
+    const char* ptr = static_cast<const char*>(bucket);
+    return (ptr >= _stack_bottom) && (ptr <= _stack_top);
+}
+
+bool CRawMemPool::check_guard(const void* bucket) const throw ()
+{
+    const char* guard = static_cast<const char*>(bucket) + (_bucket_size - _guard_size);
+
+    for (uint8_t i=0; i<_guard_size; ++i)
+    {
+        if (guard[i] != _guard_flag)
+            return false;
+    }
+
+    return true;
+}
+
 bool CRawMemPool::use_heap() const throw ()
 {
     return _use_heap;
@@ -159,7 +231,7 @@ uint32_t CRawMemPool::get_pool_size() const throw ()
     return _bucket_number;
 }
 
-uint16_t CRawMemPool::get_bucket_size() const throw ()
+uint32_t CRawMemPool::get_bucket_size() const throw ()
 {
     return _bucket_size;
 }
@@ -172,28 +244,108 @@ uint32_t CRawMemPool::get_available_number() const throw ()
 //////////////////////////////////////////////////////////////////////////
 // CThreadMemPool
 
+CThreadMemPool::CThreadMemPool() throw (CSyscallException)
+    :_magazine_cache(&_raw_mem_pool, &_lock)
+    ,_debug_bitmap(NULL)
+{
+}
+
+CThreadMemPool::~CThreadMemPool() throw ()
+{
+    _magazine_cache.destroy();
+    delete [](uint32_t*)_debug_bitmap;
+}
+
 void CThreadMemPool::destroy() throw (CSyscallException)
 {
+    // 须在加锁前，_magazine_cache.destroy会自己加锁
+    _magazine_cache.destroy();
+
     LockHelper<CLock> lock_helper(_lock);
     _raw_mem_pool.destroy();
+    delete [](uint32_t*)_debug_bitmap;
+    _debug_bitmap = NULL;
 }
 
-void CThreadMemPool::create(uint16_t bucket_size, uint32_t bucket_number, bool use_heap, uint8_t guard_size, char guard_flag) throw (CSyscallException)
+void CThreadMemPool::create(uint32_t bucket_size, uint32_t bucket_number, bool use_heap, uint8_t guard_size, char guard_flag, uint32_t magazine_size) throw (CSyscallException)
 {
-    LockHelper<CLock> lock_helper(_lock);
-    _raw_mem_pool.create(bucket_size, bucket_number, use_heap, guard_size, guard_flag);
+    destroy();
+
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        _raw_mem_pool.create(bucket_size, bucket_number, use_heap, guard_size, guard_flag);
+
+#ifndef NDEBUG
+        uint32_t words = (_raw_mem_pool.get_pool_size() + 31) / 32;
+        _debug_bitmap = new uint32_t[words];
+        memset((uint32_t*)_debug_bitmap, 0, words * sizeof(uint32_t));
+#endif // NDEBUG
+    }
+
+    _magazine_cache.create(magazine_size);
 }
 
 void* CThreadMemPool::allocate() throw (CSyscallException)
 {
-    LockHelper<CLock> lock_helper(_lock);
-    return _raw_mem_pool.allocate();
+    if (!_magazine_cache.enabled())
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        return _raw_mem_pool.allocate();
+    }
+
+    void* bucket = _magazine_cache.get();
+    if (NULL == bucket)
+    {
+        // 池已空，和CRawMemPool::allocate一样从堆上分配，不需要加锁
+        return _raw_mem_pool.use_heap()? new char[_raw_mem_pool.get_bucket_size()]: NULL;
+    }
+
+#ifndef NDEBUG
+    uint32_t index;
+    (void)_raw_mem_pool.get_bucket_index(bucket, &index);
+    __sync_fetch_and_or(&_debug_bitmap[index / 32], 1U << (index % 32));
+#endif // NDEBUG
+    return bucket;
 }
 
 bool CThreadMemPool::reclaim(void* bucket) throw (CSyscallException)
 {
-    LockHelper<CLock> lock_helper(_lock);
-    return _raw_mem_pool.reclaim(bucket);
+    if (!_magazine_cache.enabled())
+    {
+        LockHelper<CLock> lock_helper(_lock);
+        return _raw_mem_pool.reclaim(bucket);
+    }
+
+    uint32_t index;
+    if (!_raw_mem_pool.get_bucket_index(bucket, &index))
+    {
+        // 不是池内存（从堆上分配的直接释放）或边界不对，
+        // 这两种情况CRawMemPool::reclaim都不会修改池的状态，所以不需要加锁
+        return _raw_mem_pool.reclaim(bucket);
+    }
+
+#ifndef NDEBUG
+    if (!_raw_mem_pool.check_guard(bucket))
+    {
+        // 越界写坏了警戒值，不再放回池中
+        return false;
+    }
+
+    uint32_t mask = 1U << (index % 32);
+    if (0 == (__sync_fetch_and_and(&_debug_bitmap[index / 32], ~mask) & mask))
+    {
+        // 重复回收
+        return false;
+    }
+#endif // NDEBUG
+
+    _magazine_cache.put(bucket);
+    return true;
+}
+
+bool CThreadMemPool::is_pool_bucket(const void* bucket) const throw ()
+{
+    return _raw_mem_pool.is_pool_bucket(bucket);
 }
 
 bool CThreadMemPool::use_heap() const throw ()
@@ -211,14 +363,19 @@ uint32_t CThreadMemPool::get_pool_size() const throw ()
     return _raw_mem_pool.get_pool_size();
 }
 
-uint16_t CThreadMemPool::get_bucket_size() const throw ()
+uint32_t CThreadMemPool::get_bucket_size() const throw ()
 {
     return _raw_mem_pool.get_bucket_size();
 }
 
-uint32_t CThreadMemPool::get_available_number() const throw ()
+uint32_t CThreadMemPool::get_available_number() const throw (CSyscallException)
+{
+    return _raw_mem_pool.get_available_number() + _magazine_cache.get_cached_number();
+}
+
+void CThreadMemPool::get_stats(magazine_stats_t* stats) const throw (CSyscallException)
 {
-    return _raw_mem_pool.get_available_number();
+    _magazine_cache.get_stats(stats);
 }
 
 SYS_NAMESPACE_END
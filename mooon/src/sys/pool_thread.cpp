@@ -101,6 +101,16 @@ size_t CPoolThread::get_stack_size() const throw (CSyscallException)
     return _pool_thread_helper->get_stack_size();
 }
 
+void CPoolThread::set_cpu_affinity(int cpu) throw ()
+{
+    _pool_thread_helper->set_cpu_affinity(cpu);
+}
+
+int CPoolThread::get_cpu_affinity() const throw ()
+{
+    return _pool_thread_helper->get_cpu_affinity();
+}
+
 uint32_t CPoolThread::get_thread_id() const throw ()
 {
     return _pool_thread_helper->get_thread_id();
@@ -0,0 +1,145 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/rcu.h"
+#include <pthread.h>
+#include <new>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+SYS_NAMESPACE_BEGIN
+
+// 读线程的纪元记录，独占一个cache line，读者之间互不干扰。
+// 记录只增不删，线程退出后留给新线程复用，这样synchronize遍历时不需要加锁，
+// 也就不会因读区内的线程等待一个正在注册的线程而死锁
+typedef struct RcuReader
+{
+    volatile uint64_t epoch; // 进入读区时的全局纪元，不在读区时为0
+    uint32_t nesting;        // 读区嵌套层数，只被本线程访问
+    bool in_use;             // 是否被线程占用，由sg_rcu_mutex保护
+    struct RcuReader* next;  // 加入链表后不再改变
+}__attribute__((aligned(64))) rcu_reader_t;
+
+static volatile uint64_t sg_rcu_epoch = 1;
+static pthread_mutex_t sg_rcu_mutex = PTHREAD_MUTEX_INITIALIZER; // 只用于读者的注册和注销
+static rcu_reader_t* volatile sg_rcu_readers = NULL;
+static pthread_once_t sg_rcu_once = PTHREAD_ONCE_INIT;
+static pthread_key_t sg_rcu_key;
+static __thread rcu_reader_t* sg_current_reader = NULL;
+
+// 线程退出时注销读者
+static void unregister_reader(void* value)
+{
+    rcu_reader_t* reader = static_cast<rcu_reader_t*>(value);
+
+    __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&sg_rcu_mutex);
+    reader->in_use = false;
+    pthread_mutex_unlock(&sg_rcu_mutex);
+}
+
+static void create_key()
+{
+    (void)pthread_key_create(&sg_rcu_key, unregister_reader);
+}
+
+static rcu_reader_t* register_reader()
+{
+    rcu_reader_t* reader = NULL;
+
+    pthread_mutex_lock(&sg_rcu_mutex);
+    for (reader=sg_rcu_readers; reader!=NULL; reader=reader->next)
+    {
+        if (!reader->in_use)
+            break;
+    }
+    if (NULL == reader)
+    {
+        void* memory = NULL;
+        if (posix_memalign(&memory, sizeof(rcu_reader_t), sizeof(rcu_reader_t)) != 0)
+        {
+            pthread_mutex_unlock(&sg_rcu_mutex);
+            throw std::bad_alloc();
+        }
+
+        reader = static_cast<rcu_reader_t*>(memory);
+        reader->epoch = 0;
+        reader->next = sg_rcu_readers;
+        __atomic_store_n(&sg_rcu_readers, reader, __ATOMIC_RELEASE);
+    }
+
+    reader->nesting = 0;
+    reader->in_use = true;
+    pthread_mutex_unlock(&sg_rcu_mutex);
+
+    (void)pthread_once(&sg_rcu_once, create_key);
+    (void)pthread_setspecific(sg_rcu_key, reader);
+    sg_current_reader = reader;
+    return reader;
+}
+
+void CRcu::read_lock()
+{
+    rcu_reader_t* reader = sg_current_reader;
+    if (NULL == reader)
+        reader = register_reader();
+
+    if (0 == reader->nesting++)
+    {
+        __atomic_store_n(&reader->epoch, __atomic_load_n(&sg_rcu_epoch, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+        // 保证记下纪元之后才读取数据指针，和synchronize中的屏障配对
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+void CRcu::read_unlock()
+{
+    rcu_reader_t* reader = sg_current_reader;
+
+    if (0 == --reader->nesting)
+        __atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+void CRcu::synchronize()
+{
+    // 保证新版本已发布之后才推进纪元
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    uint64_t epoch = __sync_add_and_fetch(&sg_rcu_epoch, 1);
+
+    // 之后注册的读者不可能看到旧版本，不需要等待
+    for (rcu_reader_t* reader=__atomic_load_n(&sg_rcu_readers, __ATOMIC_ACQUIRE); reader!=NULL; reader=reader->next)
+    {
+        // 记录的纪元小于新纪元，说明它在推进之前进入读区，可能看到的是旧版本
+        for (int i=0; ; ++i)
+        {
+            uint64_t reader_epoch = __atomic_load_n(&reader->epoch, __ATOMIC_ACQUIRE);
+            if ((0 == reader_epoch) || (reader_epoch >= epoch))
+                break;
+
+            if (i < 10)
+                sched_yield();
+            else
+                usleep(1000);
+        }
+    }
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+SYS_NAMESPACE_END
@@ -21,25 +21,143 @@
 #include "mooon/sys/datetime_utils.h"
 #include "mooon/sys/file_locker.h"
 #include "mooon/sys/file_utils.h"
+#include "mooon/sys/thread_engine.h"
 #include "mooon/utils/scoped_ptr.h"
 #include "mooon/utils/string_utils.h"
 #include <libgen.h>
+#include <limits.h>
 #include <pthread.h>
-#include <sstream>
+#include <sys/mman.h>
+#include <sys/time.h>
 #include <syslog.h>
 #include <unistd.h>
 SYS_NAMESPACE_BEGIN
 
+// 异步模式下单个缓冲块的最小字节数
+enum { ASYNC_BUFFER_CAPACITY_MIN = 65536 };
+
+// 文件大小的估计值未超过时，也每隔这么多秒fstat一次，以计入其它进程写入的字节数
+enum { ROTATE_CHECK_INTERVAL = 1 };
+
 static uint64_t get_current_thread_id()
 {
     return static_cast<uint64_t>(pthread_self());
 }
 
-CSafeLogger* create_safe_logger(bool enable_program_path, uint16_t log_line_size, const std::string& suffix, bool enable_syslog) throw (CSyscallException)
+// fork后子进程中没有后台写线程，通过比较进程ID退回到同步写，
+// 用pthread_atfork更新，避免每条日志都调用一次getpid()
+static volatile pid_t sg_current_pid = 0;
+static pthread_once_t sg_atfork_once = PTHREAD_ONCE_INIT;
+
+static void update_current_pid()
+{
+    sg_current_pid = getpid();
+}
+
+static void register_atfork()
+{
+    update_current_pid();
+    (void)pthread_atfork(NULL, NULL, update_current_pid);
+}
+
+// 每个线程一份的日志格式化上下文，避免每条日志都分配内存和重复格式化不变的部分
+typedef struct
+{
+    char log_line[LOG_LINE_SIZE_MAX+1];
+    time_t seconds;                         // datetime对应的秒数
+    char datetime[SIZE_64];                 // 格式为：[YYYY-MM-DD hh:mm:ss/
+    pid_t pid;                              // thread对应的进程ID，fork后需要重新生成
+    int thread_length;
+    char thread[sizeof("[18446744073709551615/4294967295]")];
+}thread_log_context_t;
+
+static __thread thread_log_context_t* sg_thread_log_context = NULL;
+static pthread_key_t sg_thread_log_context_key;
+static pthread_once_t sg_thread_log_context_once = PTHREAD_ONCE_INIT;
+
+static void delete_thread_log_context(void* log_context)
+{
+    delete static_cast<thread_log_context_t*>(log_context);
+}
+
+static void create_thread_log_context_key()
+{
+    (void)pthread_key_create(&sg_thread_log_context_key, delete_thread_log_context);
+}
+
+static thread_log_context_t* get_thread_log_context()
+{
+    thread_log_context_t* log_context = sg_thread_log_context;
+
+    if (NULL == log_context)
+    {
+        (void)pthread_once(&sg_thread_log_context_once, create_thread_log_context_key);
+        log_context = new thread_log_context_t;
+        log_context->seconds = -1;
+        log_context->pid = 0;
+        log_context->thread_length = 0;
+        (void)pthread_setspecific(sg_thread_log_context_key, log_context);
+        sg_thread_log_context = log_context;
+    }
+    if (log_context->pid != sg_current_pid)
+    {
+        log_context->pid = sg_current_pid;
+        log_context->thread_length = snprintf(log_context->thread, sizeof(log_context->thread), "[%" PRIu64"/%u]", get_current_thread_id(), static_cast<unsigned int>(log_context->pid));
+    }
+
+    return log_context;
+}
+
+// 每秒只需调用一次localtime_r
+static void update_cached_datetime(thread_log_context_t* log_context, time_t seconds)
+{
+    if (seconds != log_context->seconds)
+    {
+        struct tm result;
+        localtime_r(&seconds, &result);
+        snprintf(log_context->datetime, sizeof(log_context->datetime)
+            , "[%04d-%02d-%02d %02d:%02d:%02d/"
+            , result.tm_year+1900, result.tm_mon+1, result.tm_mday
+            , result.tm_hour, result.tm_min, result.tm_sec);
+        log_context->seconds = seconds;
+    }
+}
+
+// 追加字符串，最多追加到end为止（不包含end）
+static char* append_string(char* p, const char* end, const char* str)
+{
+    while ((p < end) && (*str != '\0'))
+        *p++ = *str++;
+    return p;
+}
+
+static char* append_string(char* p, const char* end, const char* str, int str_length)
+{
+    if (str_length > end - p)
+        str_length = static_cast<int>(end - p);
+    memcpy(p, str, str_length);
+    return p + str_length;
+}
+
+static char* append_uint(char* p, const char* end, unsigned int value)
+{
+    char digits[sizeof("4294967295")];
+    int i = sizeof(digits);
+
+    do
+    {
+        digits[--i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    return append_string(p, end, digits+i, static_cast<int>(sizeof(digits)) - i);
+}
+
+CSafeLogger* create_safe_logger(bool enable_program_path, uint16_t log_line_size, const std::string& suffix, bool enable_syslog, uint32_t async_buffer_size) throw (CSyscallException)
 {
     const std::string& log_dirpath = get_log_dirpath(enable_program_path);
     const std::string& log_filename = get_log_filename(suffix);
-    CSafeLogger* logger = new CSafeLogger(log_dirpath.c_str(), log_filename.c_str(), log_line_size, enable_syslog);
+    CSafeLogger* logger = new CSafeLogger(log_dirpath.c_str(), log_filename.c_str(), log_line_size, enable_syslog, async_buffer_size);
 
     set_log_level_by_env(logger);
     enable_screen_log_by_env(logger);
@@ -50,11 +168,11 @@ CSafeLogger* create_safe_logger(bool enable_program_path, uint16_t log_line_size
     return logger;
 }
 
-CSafeLogger* create_safe_logger(const std::string& log_dirpath, const std::string& cpp_filename, uint16_t log_line_size, bool enable_syslog) throw (CSyscallException)
+CSafeLogger* create_safe_logger(const std::string& log_dirpath, const std::string& cpp_filename, uint16_t log_line_size, bool enable_syslog, uint32_t async_buffer_size) throw (CSyscallException)
 {
     const std::string& only_filename = utils::CStringUtils::extract_filename(cpp_filename);
     const std::string& log_filename = utils::CStringUtils::replace_suffix(only_filename, ".log");
-    CSafeLogger* logger = new CSafeLogger(log_dirpath.c_str(), log_filename.c_str(), log_line_size, enable_syslog);
+    CSafeLogger* logger = new CSafeLogger(log_dirpath.c_str(), log_filename.c_str(), log_line_size, enable_syslog, async_buffer_size);
 
     set_log_level_by_env(logger);
     enable_screen_log_by_env(logger);
@@ -66,7 +184,7 @@ CSafeLogger* create_safe_logger(const std::string& log_dirpath, const std::strin
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-CSafeLogger::CSafeLogger(const char* log_dir, const char* log_filename, uint16_t log_line_size, bool enable_syslog) throw (CSyscallException)
+CSafeLogger::CSafeLogger(const char* log_dir, const char* log_filename, uint16_t log_line_size, bool enable_syslog, uint32_t async_buffer_size) throw (CSyscallException)
     :_log_fd(-1)
     ,_auto_adddot(false)
     ,_auto_newline(true)
@@ -80,10 +198,27 @@ CSafeLogger::CSafeLogger(const char* log_dir, const char* log_filename, uint16_t
     ,_log_filename(log_filename)
     ,_log_filepath(_log_dir + std::string("/") + _log_filename)
     ,_log_shortname(mooon::utils::CStringUtils::remove_suffix(log_filename))
+    ,_log_lockpath(_log_dir + std::string("/.") + _log_filename + std::string(".lock"))
+    ,_rotate_state(&_local_rotate_state)
+    ,_log_generation(0)
+    ,_last_checked_seconds(0)
+    ,_async_enabled(false)
+    ,_async_stop(false)
+    ,_async_pid(0)
+    ,_async_overflow_policy(ASYNC_OVERFLOW_BLOCK)
+    ,_async_buffer_capacity(0)
+    ,_async_current(NULL)
+    ,_async_appended_sequence(0)
+    ,_async_written_sequence(0)
+    ,_async_dropped_number(0)
+    ,_async_thread(NULL)
 {
     atomic_set(&_max_bytes, DEFAULT_LOG_FILE_SIZE);
     atomic_set(&_log_level, LOG_LEVEL_INFO);
     atomic_set(&_backup_number, DEFAULT_LOG_FILE_BACKUP_NUMBER);
+    _local_rotate_state.generation = 0;
+    _local_rotate_state.estimated_bytes = 0;
+    (void)pthread_once(&sg_atfork_once, register_atfork);
 
     // 保证日志行最大长度不小于指定值
     _log_line_size = (log_line_size < LOG_LINE_SIZE_MIN)? LOG_LINE_SIZE_MIN: log_line_size;
@@ -98,6 +233,8 @@ CSafeLogger::CSafeLogger(const char* log_dir, const char* log_filename, uint16_t
         openlog("mooon-safe-logger", LOG_CONS|LOG_PID, 0);
     }
 
+    // 先取滚动代数再打开，这样打开之后发生的滚动一定能被发现
+    map_rotate_state();
     _log_fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
     if (-1 == _log_fd)
     {
@@ -105,12 +242,61 @@ CSafeLogger::CSafeLogger(const char* log_dir, const char* log_filename, uint16_t
         if (_sys_log_enabled)
             syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errcode));
 
+        if (_rotate_state != &_local_rotate_state)
+            (void)munmap(_rotate_state, sizeof(RotateState));
         THROW_SYSCALL_EXCEPTION(_log_filepath, errcode, "open");
     }
+    try
+    {
+        (void)need_rotate(_log_fd); // 取得文件大小的初始值
+    }
+    catch (CSyscallException& syscall_ex)
+    {
+        // 下次写日志时再确认
+    }
+
+    if (async_buffer_size > 0)
+    {
+        create_async_buffers(async_buffer_size);
+
+        try
+        {
+            _async_thread = new CThreadEngine(bind(&CSafeLogger::async_write_thread, this));
+        }
+        catch (CSyscallException& syscall_ex)
+        {
+            destroy_async_buffers();
+            close(_log_fd);
+            _log_fd = -1;
+            if (_rotate_state != &_local_rotate_state)
+                (void)munmap(_rotate_state, sizeof(RotateState));
+            throw;
+        }
+    }
 }
 
 CSafeLogger::~CSafeLogger()
 {
+    // 先补记限流日志，之后限流器不再引用本日志器
+    log_limiter_detach(this);
+
+    if (_async_thread != NULL)
+    {
+        // fork出的子进程中没有后台写线程，不能join
+        if (is_async())
+        {
+            {
+                LockHelper<CLock> lh(_async_lock);
+                _async_stop = true;
+                _async_writer_event.signal();
+            }
+
+            delete _async_thread;
+            destroy_async_buffers();
+        }
+        _async_thread = NULL;
+    }
+
     if (_log_fd != -1)
     {
         if (close(_log_fd) != 0)
@@ -120,6 +306,12 @@ CSafeLogger::~CSafeLogger()
         }
     }
 
+    if (_rotate_state != &_local_rotate_state)
+    {
+        (void)munmap(_rotate_state, sizeof(RotateState));
+        _rotate_state = &_local_rotate_state;
+    }
+
     if (_sys_log_enabled)
         closelog();
 }
@@ -196,6 +388,24 @@ void CSafeLogger::set_backup_number(uint16_t backup_number)
     atomic_set(&_backup_number, backup_number);
 }
 
+void CSafeLogger::set_async_overflow_policy(async_overflow_policy_t overflow_policy)
+{
+    _async_overflow_policy = overflow_policy;
+}
+
+uint64_t CSafeLogger::get_async_dropped_number() const
+{
+    return _async_dropped_number;
+}
+
+void CSafeLogger::flush()
+{
+    if (is_async())
+    {
+        async_log(NULL, 0, true);
+    }
+}
+
 bool CSafeLogger::enabled_bin()
 {
     return _bin_log_enabled;
@@ -424,24 +634,44 @@ void CSafeLogger::log_bin(const char* filename, int lineno, const char* module_n
     }
 }
 
-bool CSafeLogger::need_rotate(int fd) const
+bool CSafeLogger::need_rotate(int fd)
 {
     off_t file_size = CFileUtils::get_file_size(fd);
+
+    // 以实际大小校正估计值，和其它进程的累加存在竞争，但下次校正时会被纠正
+    _rotate_state->estimated_bytes = static_cast<int64_t>(file_size);
+    _last_checked_seconds = time(NULL);
     return file_size > static_cast<off_t>(atomic_read(&_max_bytes));
 }
 
+bool CSafeLogger::need_check_rotate(int bytes)
+{
+    int64_t estimated_bytes = __sync_add_and_fetch(&_rotate_state->estimated_bytes, static_cast<int64_t>(bytes));
+    if (estimated_bytes > static_cast<int64_t>(atomic_read(&_max_bytes)))
+        return true;
+
+    // time()通过vDSO实现，不会陷入内核
+    return time(NULL) - _last_checked_seconds >= ROTATE_CHECK_INTERVAL;
+}
+
 void CSafeLogger::do_log(log_level_t log_level, const char* filename, int lineno, const char* module_name, const char* format, va_list& args)
 {
+    log_limiter_tick();
+
     int log_real_size = 0;
-    std::string log_line(_log_line_size+1, '\0');
-    char* log_line_p = const_cast<char*>(log_line.data());
+    thread_log_context_t* log_context = get_thread_log_context();
+    char* log_line_p = log_context->log_line;
 
     if (LOG_LEVEL_RAW == log_level)
     {
         if (_raw_record_time)
         {
-            char datetime[sizeof("[2012-12-12 12:12:12]")];
-            CDatetimeUtils::get_current_datetime(log_line_p, sizeof(datetime), "[%04d-%02d-%02d %02d:%02d:%02d]");
+            // 格式为：[YYYY-MM-DD hh:mm:ss]
+            struct timeval current;
+            gettimeofday(&current, NULL);
+            update_cached_datetime(log_context, current.tv_sec);
+            memcpy(log_line_p, log_context->datetime, sizeof("[YYYY-MM-DD hh:mm:ss")-1);
+            log_line_p[sizeof("[YYYY-MM-DD hh:mm:ss")-1] = ']';
             log_real_size = sizeof("[YYYY-MM-DD hh:mm:ss]") - 1;
         }
 
@@ -451,28 +681,16 @@ void CSafeLogger::do_log(log_level_t log_level, const char* filename, int lineno
     }
     else
     {
-        std::stringstream log_header; // 每条日志的头
-        char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
-        get_formatted_current_datetime(datetime, sizeof(datetime));
-
         // 日志头内容：[日期][线程ID/进程ID][日志级别][模块名][代码文件名][代码行号]
-        log_header << "[" << datetime << "]"
-                   << "[" << get_current_thread_id() << "/" << getpid() << "]"
-                   << "[" << get_log_level_name(log_level) << "]";
-        if (module_name != NULL)
-            log_header << "[" << module_name << "]";
-        if (filename != NULL)
-            log_header << "[" << utils::CStringUtils::extract_filename(filename) << ":" << lineno << "]";
-
-        int m, n;
-        // 注意fix_snprintf()的返回值大小包含了结尾符
-        m = utils::CStringUtils::fix_snprintf(log_line_p, _log_line_size, "%s", log_header.str().c_str());
+        int m = format_log_header(log_context, log_level, filename, lineno, module_name);
+        int n;
 
+        // 注意fix_snprintf()的返回值大小包含了结尾符
         if (LOG_LEVEL_BIN == log_level)
-            n = utils::CStringUtils::fix_snprintf(log_line_p+m-1, _log_line_size-m, "%s", format);
+            n = utils::CStringUtils::fix_snprintf(log_line_p+m, _log_line_size-m-1, "%s", format);
         else
-            n = utils::CStringUtils::fix_vsnprintf(log_line_p+m-1, _log_line_size-m, format, args);
-        log_real_size = m + n - 2; // 减去2个结尾符
+            n = utils::CStringUtils::fix_vsnprintf(log_line_p+m, _log_line_size-m-1, format, args);
+        log_real_size = m + n - 1; // 减去结尾符
     }
 
     // 是否自动添加结尾用的点号
@@ -499,10 +717,10 @@ void CSafeLogger::do_log(log_level_t log_level, const char* filename, int lineno
         (void)write(STDOUT_FILENO, log_line_p, log_real_size);
     }
 
-    if (false)
+    if (is_async())
     {
-        // 异步写入日志文件
-        //log_line.release();
+        // 异步写入日志文件，FATAL日志需等到写入文件后才返回
+        async_log(log_line_p, log_real_size, LOG_LEVEL_FATAL == log_level);
     }
     else
     {
@@ -511,6 +729,45 @@ void CSafeLogger::do_log(log_level_t log_level, const char* filename, int lineno
     }
 }
 
+int CSafeLogger::format_log_header(void* thread_log_context, log_level_t log_level, const char* filename, int lineno, const char* module_name) const
+{
+    thread_log_context_t* log_context = static_cast<thread_log_context_t*>(thread_log_context);
+    char* log_line_p = log_context->log_line;
+    const char* end = log_line_p + _log_line_size / 2; // 日志头最多占一半
+    char* p = log_line_p;
+
+    struct timeval current;
+    gettimeofday(&current, NULL);
+    update_cached_datetime(log_context, current.tv_sec);
+
+    // 只有微秒部分需要每次格式化
+    p = append_string(p, end, log_context->datetime, sizeof("[YYYY-MM-DD hh:mm:ss/")-1);
+    p = append_uint(p, end, static_cast<unsigned int>(current.tv_usec));
+    p = append_string(p, end, "]", 1);
+    p = append_string(p, end, log_context->thread, log_context->thread_length);
+    p = append_string(p, end, "[", 1);
+    p = append_string(p, end, get_log_level_name(log_level));
+    p = append_string(p, end, "]", 1);
+    if (module_name != NULL)
+    {
+        p = append_string(p, end, "[", 1);
+        p = append_string(p, end, module_name);
+        p = append_string(p, end, "]", 1);
+    }
+    if (filename != NULL)
+    {
+        // 日志宏传入的已是编译期取得的文件名，这里只是兼容直接传入路径的调用
+        const char* slash = strrchr(filename, '/');
+        p = append_string(p, end, "[", 1);
+        p = append_string(p, end, (NULL == slash)? filename: slash+1);
+        p = append_string(p, end, ":", 1);
+        p = append_uint(p, end, static_cast<unsigned int>(lineno));
+        p = append_string(p, end, "]", 1);
+    }
+
+    return static_cast<int>(p - log_line_p);
+}
+
 void CSafeLogger::rotate_log()
 {
     std::string new_path;  // 滚动后的文件路径，包含目录和文件名
@@ -565,6 +822,14 @@ void CSafeLogger::rotate_log()
 }
 
 void CSafeLogger::write_log(const char* log_line, int log_line_size)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(log_line);
+    iov.iov_len = log_line_size;
+    write_log(&iov, 1);
+}
+
+void CSafeLogger::write_log(const struct iovec* iov_array, int iov_number)
 {
     CloseHelper<int> log_fd(prepare_log_fd());
     if (-1 == log_fd.get())
@@ -572,7 +837,8 @@ void CSafeLogger::write_log(const char* log_line, int log_line_size)
         return; // 没法继续
     }
 
-    int bytes = write(log_fd.get(), log_line, log_line_size);
+    // 以O_APPEND方式打开，一次writev的内容不会和其它进程写入的交错
+    int bytes = writev(log_fd.get(), iov_array, iov_number);
     if (-1 == bytes)
     {
         if (_sys_log_enabled)
@@ -585,50 +851,130 @@ void CSafeLogger::write_log(const char* log_line, int log_line_size)
     }
     else if (bytes > 0)
     {
-        try
+        // 其它进程或线程已滚动，只需重新打开，不用加锁，也不用fstat
+        if (_rotate_state->generation != _log_generation)
+            reopen_log();
+        else if (need_check_rotate(bytes))
+            check_rotate(log_fd.get());
+    }
+}
+
+void CSafeLogger::check_rotate(int log_fd)
+{
+    try
+    {
+        // 判断是否需要滚动
+        if (need_rotate(log_fd))
         {
-            // 判断是否需要滚动
-            if (need_rotate(log_fd.get()))
-            {
-                std::string lock_path = _log_dir + std::string("/.") + _log_filename + std::string(".lock");
-                FileLocker file_locker(lock_path.c_str(), true); // 确保这里一定加锁
+            FileLocker file_locker(_log_lockpath.c_str(), true); // 确保这里一定加锁
 
-                // _fd可能已被其它进程或线程滚动了，所以这里需要重新open一下
-                int new_log_fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
-                if (-1 == new_log_fd)
-                {
-                    if (_sys_log_enabled)
-                        syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
-                }
-                else
+            // _fd可能已被其它进程或线程滚动了，所以这里需要重新open一下
+            int new_log_fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
+            if (-1 == new_log_fd)
+            {
+                if (_sys_log_enabled)
+                    syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+            }
+            else
+            {
+                try
                 {
-                    try
-                    {
-                        if (need_rotate(new_log_fd))
-                            rotate_log();
-
-                        // 不管谁滚动的，都需要重设_log_fd，
-                        // 原因是如果是由其它进程滚动的，则当前进程的_log_fd是不会变化的
-                        WriteLockHelper rlh(_read_write_lock);
-                        if (0 == close(_log_fd))
-                            _log_fd = new_log_fd;
-                        else
-                            close(new_log_fd);
-                    }
-                    catch (CSyscallException& syscall_ex)
+                    if (need_rotate(new_log_fd))
                     {
-                        if (_sys_log_enabled)
-                            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+                        rotate_log();
+
+                        // new_log_fd指向的已是滚动后的文件，需要打开新文件
+                        int rotated_log_fd = new_log_fd;
+                        new_log_fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
+                        close(rotated_log_fd);
+                        if (-1 == new_log_fd)
+                        {
+                            if (_sys_log_enabled)
+                                syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+                            return;
+                        }
+
+                        // 通知其它进程重新打开
+                        _rotate_state->estimated_bytes = 0;
+                        __sync_add_and_fetch(&_rotate_state->generation, 1);
                     }
+
+                    // 不管谁滚动的，都需要重设_log_fd，
+                    // 原因是如果是由其它进程滚动的，则当前进程的_log_fd是不会变化的
+                    WriteLockHelper rlh(_read_write_lock);
+                    _log_generation = _rotate_state->generation;
+                    if (0 == close(_log_fd))
+                        _log_fd = new_log_fd;
+                    else
+                        close(new_log_fd);
+                }
+                catch (CSyscallException& syscall_ex)
+                {
+                    close(new_log_fd);
+                    if (_sys_log_enabled)
+                        syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
                 }
             }
         }
-        catch (CSyscallException& syscall_ex)
+    }
+    catch (CSyscallException& syscall_ex)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+    }
+}
+
+void CSafeLogger::reopen_log()
+{
+    // 先取代数再打开，打开之后再发生的滚动留到下次处理
+    uint64_t rotate_generation = _rotate_state->generation;
+    int new_log_fd = open(_log_filepath.c_str(), O_WRONLY|O_CREAT|O_APPEND, FILE_DEFAULT_PERM);
+    if (-1 == new_log_fd)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+        return;
+    }
+
+    WriteLockHelper rlh(_read_write_lock);
+    if ((_log_generation != rotate_generation) && (0 == close(_log_fd)))
+    {
+        _log_fd = new_log_fd;
+        _log_generation = rotate_generation;
+    }
+    else
+    {
+        // 已被其它线程重新打开
+        close(new_log_fd);
+    }
+}
+
+void CSafeLogger::map_rotate_state()
+{
+    // 和FileLocker使用同一个锁文件，滚动状态占用它的开头部分
+    int fd = open(_log_lockpath.c_str(), O_RDWR|O_CREAT, FILE_DEFAULT_PERM);
+    if (-1 == fd)
+    {
+        if (_sys_log_enabled)
+            syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] open failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_lockpath.c_str(), strerror(errno));
+        return;
+    }
+
+    // 多个进程同时扩展为相同大小是安全的，已有的内容不会被清零
+    struct stat st;
+    if ((0 == fstat(fd, &st)) && ((st.st_size >= static_cast<off_t>(sizeof(RotateState))) || (0 == ftruncate(fd, sizeof(RotateState)))))
+    {
+        void* addr = mmap(NULL, sizeof(RotateState), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED)
         {
-            if (_sys_log_enabled)
-                syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_filepath.c_str(), strerror(errno));
+            _rotate_state = static_cast<RotateState*>(addr);
+            _log_generation = _rotate_state->generation;
         }
     }
+    if ((&_local_rotate_state == _rotate_state) && _sys_log_enabled)
+        syslog(LOG_ERR, "[%s:%d][%u][%" PRIu64"][%s] map rotate state failed: %s\n", __FILE__, __LINE__, getpid(), get_current_thread_id(), _log_lockpath.c_str(), strerror(errno));
+
+    close(fd);
 }
 
 int CSafeLogger::prepare_log_fd()
@@ -667,4 +1013,188 @@ int CSafeLogger::prepare_log_fd()
     return log_fd;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// 异步模式
+
+bool CSafeLogger::is_async() const
+{
+    return _async_enabled && (_async_pid == sg_current_pid);
+}
+
+void CSafeLogger::create_async_buffers(uint32_t async_buffer_size)
+{
+    // 每个缓冲块至少能容纳两行最长的日志，块数受IOV_MAX限制
+    _async_buffer_capacity = static_cast<uint32_t>(_log_line_size) * 2;
+    if (_async_buffer_capacity < ASYNC_BUFFER_CAPACITY_MIN)
+        _async_buffer_capacity = ASYNC_BUFFER_CAPACITY_MIN;
+    uint32_t buffer_number = async_buffer_size / _async_buffer_capacity;
+    if (buffer_number < 2)
+        buffer_number = 2;
+    else if (buffer_number > IOV_MAX)
+        buffer_number = IOV_MAX;
+
+    // 预先分配好，之后追加日志时不会再分配内存
+    _async_free_buffers.reserve(buffer_number);
+    _async_full_buffers.reserve(buffer_number);
+    _async_writing_buffers.reserve(buffer_number);
+    for (uint32_t i=0; i<buffer_number; ++i)
+    {
+        AsyncBuffer* async_buffer = new AsyncBuffer;
+        async_buffer->data = new char[_async_buffer_capacity];
+        async_buffer->length = 0;
+        _async_free_buffers.push_back(async_buffer);
+    }
+
+    _async_pid = sg_current_pid;
+    _async_current = _async_free_buffers.back();
+    _async_free_buffers.pop_back();
+    _async_enabled = true;
+}
+
+void CSafeLogger::destroy_async_buffers()
+{
+    _async_enabled = false;
+    if (_async_current != NULL)
+        _async_free_buffers.push_back(_async_current);
+    _async_current = NULL;
+    _async_free_buffers.insert(_async_free_buffers.end(), _async_full_buffers.begin(), _async_full_buffers.end());
+    _async_full_buffers.clear();
+
+    for (std::vector<AsyncBuffer*>::size_type i=0; i<_async_free_buffers.size(); ++i)
+    {
+        delete []_async_free_buffers[i]->data;
+        delete _async_free_buffers[i];
+    }
+    _async_free_buffers.clear();
+}
+
+void CSafeLogger::async_log(const char* log_line, int log_line_size, bool wait_written)
+{
+    LockHelper<CLock> lh(_async_lock);
+
+    while (log_line_size > 0)
+    {
+        if ((_async_current != NULL) && (_async_current->length + log_line_size <= _async_buffer_capacity))
+        {
+            memcpy(_async_current->data + _async_current->length, log_line, log_line_size);
+            _async_current->length += log_line_size;
+            ++_async_appended_sequence;
+
+            // 只在有缓冲块写满时才唤醒后台写线程，其余靠它定时醒来
+            if (!_async_full_buffers.empty())
+                _async_writer_event.signal();
+            break;
+        }
+
+        if ((_async_current != NULL) && (_async_current->length > 0))
+        {
+            _async_full_buffers.push_back(_async_current);
+            _async_current = NULL;
+            _async_writer_event.signal();
+        }
+        if ((NULL == _async_current) && !_async_free_buffers.empty())
+        {
+            _async_current = _async_free_buffers.back();
+            _async_free_buffers.pop_back();
+            continue;
+        }
+
+        // 没有空闲的缓冲块了，须等待写入的（如FATAL日志，进程可能随即退出）不能丢弃
+        if ((ASYNC_OVERFLOW_DROP == _async_overflow_policy) && !wait_written)
+        {
+            __sync_add_and_fetch(&_async_dropped_number, 1);
+            return;
+        }
+        _async_space_event.wait(_async_lock);
+    }
+
+    if (wait_written)
+    {
+        const uint64_t sequence = _async_appended_sequence;
+        while (_async_written_sequence < sequence)
+        {
+            _async_writer_event.signal();
+            _async_space_event.wait(_async_lock);
+        }
+    }
+}
+
+void CSafeLogger::async_write_thread()
+{
+    uint64_t dropped_number = 0; // 已报告过的丢弃条数
+
+    while (true)
+    {
+        bool to_stop;
+        uint64_t sequence;
+
+        {
+            LockHelper<CLock> lh(_async_lock);
+            if (!_async_stop && _async_full_buffers.empty())
+            {
+                // 最多等待1秒，以保证未满的缓冲块也能及时写入文件
+                (void)_async_writer_event.timed_wait(_async_lock, 1000);
+            }
+
+            if ((_async_current != NULL) && (_async_current->length > 0))
+            {
+                _async_full_buffers.push_back(_async_current);
+                _async_current = NULL;
+                if (!_async_free_buffers.empty())
+                {
+                    _async_current = _async_free_buffers.back();
+                    _async_free_buffers.pop_back();
+                }
+            }
+
+            _async_writing_buffers.swap(_async_full_buffers);
+            sequence = _async_appended_sequence;
+            to_stop = _async_stop;
+        }
+
+        if (!_async_writing_buffers.empty())
+        {
+            // 合并成一次writev写入
+            struct iovec iov_array[IOV_MAX];
+            for (std::vector<AsyncBuffer*>::size_type i=0; i<_async_writing_buffers.size(); ++i)
+            {
+                iov_array[i].iov_base = _async_writing_buffers[i]->data;
+                iov_array[i].iov_len = _async_writing_buffers[i]->length;
+            }
+            write_log(iov_array, static_cast<int>(_async_writing_buffers.size()));
+        }
+        if (_async_dropped_number != dropped_number)
+        {
+            write_dropped_notice(_async_dropped_number - dropped_number);
+            dropped_number = _async_dropped_number;
+        }
+
+        {
+            LockHelper<CLock> lh(_async_lock);
+            for (std::vector<AsyncBuffer*>::size_type i=0; i<_async_writing_buffers.size(); ++i)
+            {
+                _async_writing_buffers[i]->length = 0;
+                _async_free_buffers.push_back(_async_writing_buffers[i]);
+            }
+            _async_writing_buffers.clear();
+            _async_written_sequence = sequence;
+            _async_space_event.broadcast();
+
+            if (to_stop && (NULL == _async_current || 0 == _async_current->length) && _async_full_buffers.empty())
+                break;
+        }
+    }
+}
+
+void CSafeLogger::write_dropped_notice(uint64_t dropped_number)
+{
+    char datetime[sizeof("2012-12-12 12:12:12/0123456789")];
+    get_formatted_current_datetime(datetime, sizeof(datetime));
+
+    char notice[SIZE_256];
+    int notice_size = snprintf(notice, sizeof(notice), "[%s][%" PRIu64"/%u][%s]async buffer full, dropped %" PRIu64" lines\n"
+        , datetime, get_current_thread_id(), getpid(), get_log_level_name(LOG_LEVEL_WARN), dropped_number);
+    write_log(notice, notice_size);
+}
+
 SYS_NAMESPACE_END
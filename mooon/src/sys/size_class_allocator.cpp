@@ -0,0 +1,172 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/size_class_allocator.h"
+#include <sys/mman.h>
+SYS_NAMESPACE_BEGIN
+
+// 每块内存前的头，大小为16字节，以保证返回的内存16字节对齐
+typedef struct
+{
+    uint32_t class_index; // 所属的大小类，为SIZE_CLASS_NUMBER表示是mmap分配的
+    uint32_t reserved;
+    uint64_t size;        // mmap分配的，为映射的字节数（含头）
+}block_head_t;
+
+CSizeClassAllocator::CSizeClassAllocator() throw ()
+    :_large_number(0)
+    ,_large_bytes(0)
+{
+    for (int i=0; i<SIZE_CLASS_NUMBER; ++i)
+    {
+        // 偶数序号为2的幂，奇数序号为两个幂的中间值
+        _class_size[i] = (0 == i%2)? (SIZE_CLASS_MIN << (i/2)): ((SIZE_CLASS_MIN+SIZE_CLASS_MIN/2) << (i/2));
+        _heap_number[i] = 0;
+    }
+}
+
+CSizeClassAllocator::~CSizeClassAllocator() throw ()
+{
+    try
+    {
+        destroy();
+    }
+    catch (CSyscallException&)
+    {
+    }
+}
+
+void CSizeClassAllocator::create(uint32_t class_memory, uint32_t magazine_size) throw (CSyscallException)
+{
+    for (int i=0; i<SIZE_CLASS_NUMBER; ++i)
+    {
+        uint32_t bucket_number = class_memory / _class_size[i];
+        if (0 == bucket_number)
+            bucket_number = 1;
+
+        // 不设置警戒值，越界检查由使用者负责
+        _pools[i].create(sizeof(block_head_t)+_class_size[i], bucket_number, true, 0, 0, magazine_size);
+        _heap_number[i] = 0;
+    }
+}
+
+void CSizeClassAllocator::destroy() throw (CSyscallException)
+{
+    for (int i=0; i<SIZE_CLASS_NUMBER; ++i)
+        _pools[i].destroy();
+}
+
+void* CSizeClassAllocator::allocate(size_t size) throw (CSyscallException)
+{
+    block_head_t* head;
+    int class_index = get_class_index(size);
+
+    if (class_index < 0)
+    {
+        // 太大的直接mmap，释放时可以立即还给系统
+        size_t bytes = sizeof(block_head_t) + size;
+        void* addr = mmap(NULL, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == addr)
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "mmap");
+
+        __sync_add_and_fetch(&_large_number, 1);
+        __sync_add_and_fetch(&_large_bytes, bytes);
+        head = static_cast<block_head_t*>(addr);
+        head->class_index = SIZE_CLASS_NUMBER;
+        head->size = bytes;
+    }
+    else
+    {
+        CThreadMemPool& pool = _pools[class_index];
+
+        head = static_cast<block_head_t*>(pool.allocate());
+        if (!pool.is_pool_bucket(head)) // 池已用完
+            __sync_add_and_fetch(&_heap_number[class_index], 1);
+        head->class_index = static_cast<uint32_t>(class_index);
+    }
+
+    return head + 1;
+}
+
+void CSizeClassAllocator::reclaim(void* ptr) throw (CSyscallException)
+{
+    if (NULL == ptr)
+        return;
+
+    block_head_t* head = static_cast<block_head_t*>(ptr) - 1;
+    if (head->class_index < SIZE_CLASS_NUMBER)
+    {
+        (void)_pools[head->class_index].reclaim(head);
+    }
+    else
+    {
+        size_t bytes = head->size;
+        if (-1 == munmap(head, bytes))
+            THROW_SYSCALL_EXCEPTION(NULL, errno, "munmap");
+
+        __sync_sub_and_fetch(&_large_number, 1);
+        __sync_sub_and_fetch(&_large_bytes, bytes);
+    }
+}
+
+size_t CSizeClassAllocator::get_class_size(size_t size) throw ()
+{
+    int class_index = get_class_index(size);
+    if (class_index < 0)
+        return size;
+
+    return (0 == class_index%2)? (SIZE_CLASS_MIN << (class_index/2)): ((SIZE_CLASS_MIN+SIZE_CLASS_MIN/2) << (class_index/2));
+}
+
+void CSizeClassAllocator::get_class_stats(std::vector<size_class_stats_t>* stats_array) const throw (CSyscallException)
+{
+    stats_array->resize(SIZE_CLASS_NUMBER);
+
+    for (int i=0; i<SIZE_CLASS_NUMBER; ++i)
+    {
+        size_class_stats_t& stats = (*stats_array)[i];
+
+        stats.class_size = _class_size[i];
+        stats.pool_size = _pools[i].get_pool_size();
+        stats.available_number = _pools[i].get_available_number();
+        stats.heap_number = _heap_number[i];
+        _pools[i].get_stats(&stats.magazine_stats);
+    }
+}
+
+void CSizeClassAllocator::get_large_stats(uint64_t* number, uint64_t* bytes) const throw ()
+{
+    *number = _large_number;
+    *bytes = _large_bytes;
+}
+
+int CSizeClassAllocator::get_class_index(size_t size) throw ()
+{
+    if (size <= SIZE_CLASS_MIN)
+        return 0;
+    if (size > SIZE_CLASS_MAX)
+        return -1;
+
+    // 2^k < size <= 2^(k+1)，SIZE_CLASS_MIN为2^5
+    int k = 63 - __builtin_clzll(static_cast<unsigned long long>(size - 1));
+    if (size <= (static_cast<size_t>(3) << (k-1)))
+        return 2 * (k-5) + 1;
+    return 2 * (k-4);
+}
+
+SYS_NAMESPACE_END
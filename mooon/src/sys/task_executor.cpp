@@ -0,0 +1,316 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include "sys/task_executor.h"
+#include "sys/pool_thread.h"
+#include "sys/work_stealing_deque.h"
+#include <stdlib.h>
+SYS_NAMESPACE_BEGIN
+
+// 睡眠的最长毫秒数，只是为了防备意外，正常总是被signal唤醒
+#define PARK_TIMEOUT_MILLISECONDS 100
+
+//////////////////////////////////////////////////////////////////////////
+// CExecutorThread
+
+class CExecutorThread: public CPoolThread
+{
+    friend class CTaskExecutor;
+
+public:
+    CExecutorThread()
+        :_executor(NULL)
+        ,_seed(0)
+    {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    CTaskExecutor* get_executor() const { return _executor; }
+    CWorkStealingDeque<CTask*>* get_deque() { return &_deque; }
+    virtual void set_parameter(void* parameter);
+
+private:
+    virtual bool before_run() throw ();
+    virtual void after_run() throw ();
+    virtual void before_stop() throw (utils::CException, CSyscallException);
+    virtual void run();
+
+    void run_task(CTask* task);
+
+private:
+    CTaskExecutor* _executor;
+    unsigned int _seed; // 用于随机选择窃取对象
+    executor_stats_t _stats;
+    CWorkStealingDeque<CTask*> _deque;
+};
+
+// 当前线程如果是工作线程，则指向它，用于将任务放入自己的队列
+static __thread CExecutorThread* sg_current_thread = NULL;
+
+void CExecutorThread::set_parameter(void* parameter)
+{
+    _executor = static_cast<CTaskExecutor*>(parameter);
+    _seed = static_cast<unsigned int>(get_index()) + 1;
+}
+
+bool CExecutorThread::before_run() throw ()
+{
+    sg_current_thread = this;
+    return true;
+}
+
+void CExecutorThread::after_run() throw ()
+{
+    // 执行完自己队列中余下的任务，执行中提交的新任务也在自己的队列中
+    CTask* task;
+    while (_deque.pop_bottom(task))
+        run_task(task);
+
+    sg_current_thread = NULL;
+}
+
+void CExecutorThread::before_stop() throw (utils::CException, CSyscallException)
+{
+    _executor->wakeup_all();
+}
+
+void CExecutorThread::run()
+{
+    CTask* task = _executor->get_task(this);
+
+    if (NULL == task)
+        _executor->park(this);
+    else
+        run_task(task);
+}
+
+void CExecutorThread::run_task(CTask* task)
+{
+    try
+    {
+        task->run();
+    }
+    catch (...)
+    {
+        // 不让任务的异常导致工作线程退出
+    }
+
+    delete task;
+    ++_stats.executed_number;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// CTaskExecutor
+
+CTaskExecutor::CTaskExecutor()
+    :_thread_count(0)
+    ,_thread_array(NULL)
+    ,_injection_queue(NULL)
+    ,_wake_sequence(0)
+    ,_sleepers(0)
+{
+}
+
+CTaskExecutor::~CTaskExecutor()
+{
+    destroy();
+}
+
+void CTaskExecutor::create(uint16_t thread_count, uint32_t queue_size) throw (CSyscallException)
+{
+    _injection_queue = new CLockFreeQueue<CTask*>(queue_size);
+
+    try
+    {
+        _thread_pool.create(thread_count, this);
+
+        // 线程在activate之前都处于等待状态，不会访问_thread_array
+        _thread_count = _thread_pool.get_thread_count();
+        _thread_array = new CExecutorThread*[_thread_count];
+        for (uint16_t i=0; i<_thread_count; ++i)
+        {
+            _thread_array[i] = _thread_pool.get_thread(i);
+            _thread_array[i]->inc_refcount();
+        }
+
+        _thread_pool.activate();
+    }
+    catch (...)
+    {
+        delete _injection_queue;
+        _injection_queue = NULL;
+        throw;
+    }
+}
+
+void CTaskExecutor::destroy() throw (CSyscallException)
+{
+    if (NULL == _injection_queue)
+        return;
+
+    // 每个工作线程退出前会执行完自己队列中的任务
+    _thread_pool.destroy();
+    for (uint16_t i=0; i<_thread_count; ++i)
+        _thread_array[i]->dec_refcount();
+    delete []_thread_array;
+    _thread_array = NULL;
+    _thread_count = 0;
+
+    // 注入队列中余下的任务由调用者执行，执行中提交的新任务仍会进入注入队列
+    CTask* task;
+    while (_injection_queue->try_pop(task))
+    {
+        try
+        {
+            task->run();
+        }
+        catch (...)
+        {
+        }
+
+        delete task;
+    }
+
+    delete _injection_queue;
+    _injection_queue = NULL;
+}
+
+bool CTaskExecutor::push_task(CTask* task)
+{
+    CExecutorThread* thread = sg_current_thread;
+
+    if ((thread != NULL) && (thread->get_executor() == this))
+    {
+        thread->get_deque()->push_bottom(task);
+    }
+    else if (!_injection_queue->try_push(task))
+    {
+        return false;
+    }
+
+    signal();
+    return true;
+}
+
+bool CTaskExecutor::execute(const Functor& functor)
+{
+    CTask* task = new CFunctorTask(functor);
+
+    if (!push_task(task))
+    {
+        delete task;
+        return false;
+    }
+
+    return true;
+}
+
+void CTaskExecutor::get_stats(executor_stats_t* stats) const
+{
+    memset(stats, 0, sizeof(executor_stats_t));
+    for (uint16_t i=0; i<_thread_count; ++i)
+    {
+        const executor_stats_t& thread_stats = _thread_array[i]->_stats;
+        stats->executed_number += thread_stats.executed_number;
+        stats->stolen_number += thread_stats.stolen_number;
+        stats->parked_number += thread_stats.parked_number;
+    }
+}
+
+CTask* CTaskExecutor::get_task(CExecutorThread* thread)
+{
+    CTask* task;
+
+    // 先取自己最近放入的，局部性最好
+    if (thread->_deque.pop_bottom(task))
+        return task;
+
+    if (_injection_queue->try_pop(task))
+    {
+        // 还有更多任务，唤醒另一个睡眠的线程来分担
+        if (!_injection_queue->is_empty())
+            signal();
+        return task;
+    }
+
+    // 从随机位置开始，依次尝试窃取其它线程的任务
+    uint16_t start = static_cast<uint16_t>(rand_r(&thread->_seed) % _thread_count);
+    for (uint16_t i=0; i<_thread_count; ++i)
+    {
+        CExecutorThread* victim = _thread_array[(start + i) % _thread_count];
+        if (victim == thread)
+            continue;
+
+        if (victim->_deque.steal_top(task))
+        {
+            ++thread->_stats.stolen_number;
+            if (!victim->_deque.is_empty())
+                signal();
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+bool CTaskExecutor::has_task() const
+{
+    if (!_injection_queue->is_empty())
+        return true;
+
+    for (uint16_t i=0; i<_thread_count; ++i)
+    {
+        if (!_thread_array[i]->_deque.is_empty())
+            return true;
+    }
+
+    return false;
+}
+
+void CTaskExecutor::park(CExecutorThread* thread)
+{
+    int32_t sequence = __atomic_load_n(&_wake_sequence, __ATOMIC_ACQUIRE);
+
+    // 先登记再检查，和signal中先放任务再检查_sleepers配对，保证不会错过唤醒
+    __sync_add_and_fetch(&_sleepers, 1);
+    if (!has_task())
+    {
+        ++thread->_stats.parked_number;
+        futex_wait(&_wake_sequence, sequence, PARK_TIMEOUT_MILLISECONDS);
+    }
+
+    __sync_sub_and_fetch(&_sleepers, 1);
+}
+
+void CTaskExecutor::signal()
+{
+    __sync_synchronize();
+    if (__atomic_load_n(&_sleepers, __ATOMIC_ACQUIRE) > 0)
+    {
+        __sync_add_and_fetch(&_wake_sequence, 1);
+        futex_wake(&_wake_sequence, 1);
+    }
+}
+
+void CTaskExecutor::wakeup_all()
+{
+    __sync_add_and_fetch(&_wake_sequence, 1);
+    futex_wake(&_wake_sequence, INT_MAX);
+}
+
+SYS_NAMESPACE_END
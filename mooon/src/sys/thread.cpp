@@ -35,6 +35,7 @@ CThread::CThread() throw (utils::CException, CSyscallException)
     ,_current_state(state_sleeping)
     ,_thread(0)
     ,_stack_size(0)
+    ,_cpu(-1)
 {
     int errcode = pthread_attr_init(&_attr);
     if (errcode != 0)
@@ -66,6 +67,17 @@ void CThread::start(bool detach) throw (utils::CException, CSyscallException)
             THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_attr_setstacksize");
     }
 
+    // 设置CPU亲和，线程从一开始就运行在指定的CPU上
+    if (_cpu >= 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(_cpu, &cpu_set);
+        errcode = pthread_attr_setaffinity_np(&_attr, sizeof(cpu_set), &cpu_set);
+        if (errcode != 0)
+            THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_attr_setaffinity_np");
+    }
+
     errcode = pthread_attr_setdetachstate(&_attr, detach?PTHREAD_CREATE_DETACHED:PTHREAD_CREATE_JOINABLE);
     if (errcode != 0)
         THROW_SYSCALL_EXCEPTION(NULL, errcode, "pthread_attr_setdetachstate");
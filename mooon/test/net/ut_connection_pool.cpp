@@ -0,0 +1,247 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CConnectionPool的测试：复用、惰性检查、等待队列、退避和空闲回收
+#include "mooon/net/connection_pool.h"
+#include "mooon/sys/thread_engine.h"
+#include "mooon/sys/utils.h"
+#include "../ut_utils.h"
+#include <stdlib.h>
+#include <unistd.h>
+using namespace mooon;
+
+typedef net::CConnectionPool<net::CTcpClient, net::CTcpClientFactory> CTcpPool;
+typedef net::CPooledConnection<net::CTcpClient, net::CTcpClientFactory> CTcpConnection;
+
+static net::connection_pool_config_t get_config()
+{
+    net::connection_pool_config_t config;
+    net::init_connection_pool_config(&config);
+    return config;
+}
+
+static net::connection_pool_stats_t get_stats(const CTcpPool& pool)
+{
+    net::connection_pool_stats_t stats;
+    pool.get_stats(&stats);
+    return stats;
+}
+
+static void test_reuse()
+{
+    uint16_t port;
+    int listen_fd = listen_any(&port);
+    net::connection_pool_config_t config = get_config();
+    config.validate_milliseconds = 0; // 每次借出都检查
+    CTcpPool pool(config);
+
+    net::CTcpClient* first = pool.borrow("127.0.0.1", port);
+    pool.give_back(first);
+    net::CTcpClient* second = pool.borrow("127.0.0.1", port);
+    CHECK(first == second);
+    CHECK(1 == get_stats(pool).create_number);
+
+    // 对端关闭了空闲的连接，借出前的检查发现后重建
+    int peer_fd = accept(listen_fd, NULL, NULL);
+    CHECK(peer_fd != -1);
+    pool.give_back(second);
+    close(peer_fd);
+    sys::CUtils::millisleep(10);
+
+    net::CTcpClient* third = pool.borrow("127.0.0.1", port);
+    CHECK(1 == get_stats(pool).invalid_number);
+    CHECK(2 == get_stats(pool).create_number);
+    pool.give_back(third, true);
+    CHECK(1 == get_stats(pool).broken_number);
+
+    uint32_t idle_number, active_number;
+    pool.get_connection_number("127.0.0.1", port, &idle_number, &active_number);
+    CHECK(0 == idle_number);
+    CHECK(0 == active_number);
+    close(listen_fd);
+}
+
+static void give_back_later(CTcpPool* pool, net::CTcpClient* tcp_client)
+{
+    sys::CUtils::millisleep(50);
+    pool->give_back(tcp_client);
+}
+
+static void test_wait()
+{
+    uint16_t port;
+    int listen_fd = listen_any(&port);
+    net::connection_pool_config_t config = get_config();
+    config.max_active = 2;
+    config.max_waiters = 1;
+    config.wait_milliseconds = 20;
+    CTcpPool pool(config);
+
+    net::CTcpClient* a = pool.borrow("127.0.0.1", port);
+    net::CTcpClient* b = pool.borrow("127.0.0.1", port);
+
+    // 用完，等待超时
+    try
+    {
+        pool.borrow("127.0.0.1", port);
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(ETIMEDOUT == ex.errcode());
+    }
+    CHECK(1 == get_stats(pool).exhausted_number);
+    CHECK(1 == get_stats(pool).timeout_number);
+    CHECK(1 == get_stats(pool).borrow_failure_number);
+
+    // 另一个线程归还后，等待者被唤醒并得到该连接
+    {
+        net::connection_pool_config_t wait_config = config;
+        wait_config.wait_milliseconds = 2000;
+        CTcpPool wait_pool(wait_config);
+        net::CTcpClient* c = wait_pool.borrow("127.0.0.1", port);
+        net::CTcpClient* d = wait_pool.borrow("127.0.0.1", port);
+
+        sys::CThreadEngine giver(sys::bind(give_back_later, &wait_pool, c));
+        {
+            CTcpConnection e(&wait_pool, "127.0.0.1", port);
+            CHECK(e.get() == c);
+        }
+        giver.join();
+        CHECK(1 == get_stats(wait_pool).exhausted_number);
+        CHECK(0 == get_stats(wait_pool).timeout_number);
+        CHECK(get_stats(wait_pool).max_borrow_microseconds < 2000000);
+        wait_pool.give_back(d);
+    }
+
+    // 不允许等待时直接失败
+    config.max_waiters = 0;
+    CTcpPool reject_pool(config);
+    net::CTcpClient* f = reject_pool.borrow("127.0.0.1", port);
+    net::CTcpClient* g = reject_pool.borrow("127.0.0.1", port);
+    try
+    {
+        reject_pool.borrow("127.0.0.1", port);
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(EBUSY == ex.errcode());
+    }
+    CHECK(1 == get_stats(reject_pool).rejected_number);
+    reject_pool.give_back(f);
+    reject_pool.give_back(g);
+
+    pool.give_back(a);
+    pool.give_back(b);
+    close(listen_fd);
+}
+
+static void test_backoff()
+{
+    // 监听后立即关闭，得到一个不可连接的端口
+    uint16_t port;
+    close(listen_any(&port));
+
+    net::connection_pool_config_t config = get_config();
+    config.min_backoff_milliseconds = 50;
+    CTcpPool pool(config);
+
+    try
+    {
+        pool.borrow("127.0.0.1", port);
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(ECONNREFUSED == ex.errcode());
+    }
+
+    // 退避期内不再尝试连接
+    try
+    {
+        pool.borrow("127.0.0.1", port);
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(EAGAIN == ex.errcode());
+    }
+    CHECK(1 == get_stats(pool).create_failure_number);
+    CHECK(1 == get_stats(pool).backoff_number);
+
+    // 退避期过后再次尝试
+    sys::CUtils::millisleep(60);
+    try
+    {
+        pool.borrow("127.0.0.1", port);
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(ECONNREFUSED == ex.errcode());
+    }
+    CHECK(2 == get_stats(pool).create_failure_number);
+}
+
+static void test_evict()
+{
+    uint16_t port;
+    int listen_fd = listen_any(&port);
+    net::connection_pool_config_t config = get_config();
+    config.min_idle = 1;
+    config.max_idle = 3;
+    config.idle_seconds = 0; // 归还即超时
+    CTcpPool pool(config);
+
+    net::CTcpClient* a = pool.borrow("127.0.0.1", port);
+    net::CTcpClient* b = pool.borrow("127.0.0.1", port);
+    pool.give_back(a);
+    pool.give_back(b);
+
+    // 保留min_idle个
+    uint32_t idle_number, active_number;
+    pool.get_connection_number("127.0.0.1", port, &idle_number, &active_number);
+    CHECK(1 == idle_number);
+    CHECK(1 == active_number);
+    CHECK(1 == get_stats(pool).evict_number);
+
+    // maintain补足min_idle
+    config.min_idle = 3;
+    config.idle_seconds = 60;
+    CTcpPool fill_pool(config);
+    fill_pool.give_back(fill_pool.borrow("127.0.0.1", port));
+    fill_pool.maintain();
+    fill_pool.get_connection_number("127.0.0.1", port, &idle_number, &active_number);
+    CHECK(3 == idle_number);
+    CHECK(3 == active_number);
+    fprintf(stdout, "%s\n", fill_pool.str_stats().c_str());
+
+    close(listen_fd);
+}
+
+int main()
+{
+    test_reuse();
+    test_wait();
+    test_backoff();
+    test_evict();
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,403 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// full_write_tofile和full_send_file的测试，以及和逐页recv加pwrite的回环吞吐对比，
+// 可带一个参数指定吞吐测试的MB数，默认为256
+#include "mooon/net/tcp_waiter.h"
+#include "mooon/sys/stop_watch.h"
+#include "mooon/sys/thread_engine.h"
+#include "mooon/sys/utils.h"
+#include "../ut_utils.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+using namespace mooon;
+
+// 在回环地址上建立一个TCP连接，两端分别关联到sender和receiver
+static void connect_loopback(net::CTcpWaiter* sender, net::CTcpWaiter* receiver)
+{
+    int client_fd, server_fd;
+    uint16_t port = connect_loopback(&client_fd, &server_fd);
+
+    sender->attach(client_fd, "127.0.0.1", port);
+    receiver->attach(server_fd, "127.0.0.1", 0);
+}
+
+static int create_tmpfile()
+{
+    char filename[] = "/tmp/ut_data_channel_XXXXXX";
+    int fd = mkstemp(filename);
+    CHECK(fd != -1);
+    unlink(filename);
+    return fd;
+}
+
+static void fill_pattern(std::vector<char>* data, size_t size)
+{
+    data->resize(size);
+    for (size_t i=0; i<size; ++i)
+        (*data)[i] = static_cast<char>(i * 131 + i / 4096);
+}
+
+static void send_data(net::CTcpWaiter* sender, std::vector<char>* data)
+{
+    size_t size = data->size();
+    sender->full_send(&(*data)[0], size);
+}
+
+// 接收到文件后，读回比较
+static void test_write_tofile(size_t size, size_t offset)
+{
+    net::CTcpWaiter sender, receiver;
+    connect_loopback(&sender, &receiver);
+
+    std::vector<char> data;
+    fill_pattern(&data, size);
+    sys::CThreadEngine thread(sys::bind(send_data, &sender, &data));
+
+    int file_fd = create_tmpfile();
+    size_t received_size = size;
+    CHECK(receiver.full_write_tofile(file_fd, received_size, offset));
+    CHECK(size == received_size);
+    thread.join();
+
+    std::vector<char> file_data(size);
+    CHECK(static_cast<ssize_t>(size) == pread(file_fd, &file_data[0], size, offset));
+    CHECK(0 == memcmp(&data[0], &file_data[0], size));
+    close(file_fd);
+}
+
+static void test_write_tofile_error()
+{
+    // 对端发送一部分后关闭
+    {
+        net::CTcpWaiter sender, receiver;
+        connect_loopback(&sender, &receiver);
+
+        std::vector<char> data;
+        fill_pattern(&data, 100000);
+        size_t send_size = data.size();
+        sender.full_send(&data[0], send_size);
+        sender.close();
+
+        int file_fd = create_tmpfile();
+        size_t received_size = 200000;
+        try
+        {
+            receiver.full_write_tofile(file_fd, received_size, 0);
+            CHECK(false);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+        }
+        CHECK(100000 == received_size);
+        close(file_fd);
+    }
+
+    // 非阻塞连接暂无数据
+    {
+        net::CTcpWaiter sender, receiver;
+        connect_loopback(&sender, &receiver);
+        receiver.set_nonblock(true);
+
+        int file_fd = create_tmpfile();
+        size_t received_size = 100000;
+        CHECK(!receiver.full_write_tofile(file_fd, received_size, 0));
+        CHECK(0 == received_size);
+
+        received_size = 1000;
+        CHECK(!receiver.full_write_tofile(file_fd, received_size, 0));
+        CHECK(0 == received_size);
+        close(file_fd);
+    }
+}
+
+static void receive_data(net::CTcpWaiter* receiver, std::vector<char>* data)
+{
+    size_t size = data->size();
+    CHECK(receiver->full_receive(&(*data)[0], size));
+}
+
+static void test_send_file()
+{
+    std::vector<char> data;
+    fill_pattern(&data, 3000000);
+    int file_fd = create_tmpfile();
+    CHECK(static_cast<ssize_t>(data.size()) == pwrite(file_fd, &data[0], data.size(), 0));
+
+    net::CTcpWaiter sender, receiver;
+    connect_loopback(&sender, &receiver);
+
+    // 从中间开始发送，offset须被更新为发送结束的位置
+    std::vector<char> received(data.size() - 12345);
+    sys::CThreadEngine thread(sys::bind(receive_data, &receiver, &received));
+    off_t offset = 12345;
+    size_t count = received.size();
+    sender.full_send_file(file_fd, &offset, count);
+    thread.join();
+
+    CHECK(received.size() == count);
+    CHECK(static_cast<off_t>(data.size()) == offset);
+    CHECK(0 == memcmp(&data[12345], &received[0], received.size()));
+    close(file_fd);
+}
+
+// 非阻塞连接发不动时抛EAGAIN，offset和count为已发送到的位置和字节数，之后可接着发送
+static void test_send_file_would_block()
+{
+    std::vector<char> data;
+    fill_pattern(&data, 4000000);
+    int file_fd = create_tmpfile();
+    CHECK(static_cast<ssize_t>(data.size()) == pwrite(file_fd, &data[0], data.size(), 0));
+
+    net::CTcpWaiter sender, receiver;
+    connect_loopback(&sender, &receiver);
+    int buffer_size = 4096;
+    CHECK(0 == setsockopt(sender.get_fd(), SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size)));
+    CHECK(0 == setsockopt(receiver.get_fd(), SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size)));
+    sender.set_nonblock(true);
+
+    off_t offset = 100;
+    size_t count = data.size() - 100;
+    try
+    {
+        sender.full_send_file(file_fd, &offset, count);
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(EAGAIN == ex.errcode());
+    }
+    CHECK((count > 0) && (count < data.size() - 100));
+    CHECK(static_cast<off_t>(100 + count) == offset);
+
+    std::vector<char> received(data.size() - 100);
+    sys::CThreadEngine thread(sys::bind(receive_data, &receiver, &received));
+    sender.set_nonblock(false);
+    size_t remaining_size = data.size() - 100 - count;
+    sender.full_send_file(file_fd, &offset, remaining_size);
+    thread.join();
+
+    CHECK(data.size() - 100 - count == remaining_size);
+    CHECK(static_cast<off_t>(data.size()) == offset);
+    CHECK(0 == memcmp(&data[100], &received[0], received.size()));
+    close(file_fd);
+}
+
+// 文件比count短时抛EIO，count仍为已发送的字节数
+static void test_send_file_short()
+{
+    // sendfile
+    {
+        std::vector<char> data;
+        fill_pattern(&data, 1000);
+        int file_fd = create_tmpfile();
+        CHECK(static_cast<ssize_t>(data.size()) == pwrite(file_fd, &data[0], data.size(), 0));
+
+        net::CTcpWaiter sender, receiver;
+        connect_loopback(&sender, &receiver);
+        off_t offset = 10;
+        size_t count = 5000;
+        try
+        {
+            sender.full_send_file(file_fd, &offset, count);
+            CHECK(false);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            CHECK(EIO == ex.errcode());
+        }
+        CHECK(990 == count);
+        CHECK(1000 == offset);
+
+        std::vector<char> received(990);
+        receive_data(&receiver, &received);
+        CHECK(0 == memcmp(&data[10], &received[0], received.size()));
+        close(file_fd);
+    }
+
+    // /proc下的文件不支持sendfile，走pread加send
+    {
+        int file_fd = open("/proc/self/status", O_RDONLY);
+        CHECK(file_fd != -1);
+
+        net::CTcpWaiter sender, receiver;
+        connect_loopback(&sender, &receiver);
+        off_t offset = 0;
+        size_t count = 1048576;
+        try
+        {
+            sender.full_send_file(file_fd, &offset, count);
+            CHECK(false);
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            CHECK(EIO == ex.errcode());
+        }
+        CHECK((count > 0) && (count < 1048576));
+        CHECK(static_cast<off_t>(count) == offset);
+        sender.close();
+
+        size_t received_size = 0;
+        char buffer[4096];
+        for (;;)
+        {
+            ssize_t retval = receiver.receive(buffer, sizeof(buffer));
+            CHECK(retval >= 0);
+            if (0 == retval)
+                break;
+            received_size += retval;
+        }
+        CHECK(count == received_size);
+        close(file_fd);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 吞吐对比，旧的实现为逐页recv再pwrite
+
+static void send_zero(net::CTcpWaiter* sender, size_t size)
+{
+    std::vector<char> buffer(256 * 1024);
+    while (size > 0)
+    {
+        size_t send_size = (size < buffer.size())? size: buffer.size();
+        sender->full_send(&buffer[0], send_size);
+        size -= send_size;
+    }
+}
+
+static void recv_pagewise(net::CTcpWaiter* receiver, int file_fd, size_t size)
+{
+    std::vector<char> buffer(sys::CUtils::get_page_size());
+    off_t offset = 0;
+    while (size > 0)
+    {
+        size_t receive_size = (size < buffer.size())? size: buffer.size();
+        ssize_t retval = receiver->receive(&buffer[0], receive_size);
+        CHECK(retval > 0);
+        CHECK(retval == pwrite(file_fd, &buffer[0], retval, offset));
+        offset += retval;
+        size -= retval;
+    }
+}
+
+static void print_throughput(const char* name, size_t size, uint64_t microseconds)
+{
+    fprintf(stdout, "%-36s %8.1f MB/s\n", name, (size / 1048576.0) / (microseconds / 1000000.0));
+}
+
+static void benchmark_receive(size_t size)
+{
+    for (int i=0; i<2; ++i)
+    {
+        net::CTcpWaiter sender, receiver;
+        connect_loopback(&sender, &receiver);
+        int file_fd = create_tmpfile();
+
+        sys::CStopWatch stop_watch;
+        sys::CThreadEngine thread(sys::bind(send_zero, &sender, size));
+        if (0 == i)
+        {
+            recv_pagewise(&receiver, file_fd, size);
+        }
+        else
+        {
+            size_t received_size = size;
+            CHECK(receiver.full_write_tofile(file_fd, received_size, 0));
+        }
+        thread.join();
+
+        print_throughput((0 == i)? "socket->file recv+pwrite (page)": "socket->file full_write_tofile", size, stop_watch.get_total_elapsed_microseconds());
+        close(file_fd);
+    }
+}
+
+static void drain(net::CTcpWaiter* receiver, size_t size)
+{
+    std::vector<char> buffer(256 * 1024);
+    while (size > 0)
+    {
+        ssize_t retval = receiver->receive(&buffer[0], buffer.size());
+        CHECK(retval > 0);
+        size -= retval;
+    }
+}
+
+static void benchmark_send(size_t size)
+{
+    int file_fd = create_tmpfile();
+    CHECK(0 == ftruncate(file_fd, size));
+
+    for (int i=0; i<2; ++i)
+    {
+        net::CTcpWaiter sender, receiver;
+        connect_loopback(&sender, &receiver);
+
+        sys::CStopWatch stop_watch;
+        sys::CThreadEngine thread(sys::bind(drain, &receiver, size));
+        if (0 == i)
+        {
+            std::vector<char> buffer(sys::CUtils::get_page_size());
+            for (off_t offset=0; offset<static_cast<off_t>(size);)
+            {
+                ssize_t retval = pread(file_fd, &buffer[0], buffer.size(), offset);
+                CHECK(retval > 0);
+                size_t send_size = retval;
+                sender.full_send(&buffer[0], send_size);
+                offset += retval;
+            }
+        }
+        else
+        {
+            off_t offset = 0;
+            size_t count = size;
+            sender.full_send_file(file_fd, &offset, count);
+        }
+        thread.join();
+
+        print_throughput((0 == i)? "file->socket pread+send (page)": "file->socket full_send_file", size, stop_watch.get_total_elapsed_microseconds());
+    }
+
+    close(file_fd);
+}
+
+int main(int argc, char* argv[])
+{
+    test_write_tofile(1000, 0);         // 经缓冲区
+    test_write_tofile(65536, 100);      // splice
+    test_write_tofile(5000000, 4096);   // splice，多于管道大小
+    test_write_tofile_error();
+    test_send_file();
+    test_send_file_would_block();
+    test_send_file_short();
+
+    size_t megabytes = (argc > 1)? static_cast<size_t>(atoi(argv[1])): 256;
+    benchmark_receive(megabytes * 1048576);
+    benchmark_send(megabytes * 1048576);
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CEpollableQueue、CEventfdQueue和CSpscEventfdQueue的比较测试：
+// 一个生产者线程入队，Epoll线程被唤醒后取走队列中所有元素
+#include "mooon/net/epoller.h"
+#include "mooon/net/epollable_queue.h"
+#include "mooon/sys/stop_watch.h"
+#include "mooon/sys/thread_engine.h"
+#include "mooon/utils/array_queue.h"
+#include "../ut_utils.h"
+#include <stdlib.h>
+using namespace mooon;
+
+static const int sg_times = 1000000;
+
+template <class QueueClass>
+class CTester
+{
+public:
+    CTester()
+        :_queue(10000)
+        ,_wakeups(0)
+        ,_sum(0)
+        ,_number(0)
+    {
+    }
+
+    void run(const char* name)
+    {
+        sys::CStopWatch stop_watch;
+        sys::CThreadEngine consumer(sys::bind(&CTester::consume, this));
+        sys::CThreadEngine producer(sys::bind(&CTester::produce, this));
+
+        producer.join();
+        consumer.join();
+
+        unsigned int elapsed = stop_watch.get_elapsed_microseconds();
+        fprintf(stdout, "[%s] %.1f ns/message, %d epoll wakeups, %.1f messages/wakeup\n"
+            , name, elapsed * 1000.0 / sg_times, _wakeups, static_cast<double>(_number) / _wakeups);
+        CHECK(_number == sg_times);
+        CHECK(_sum == static_cast<int64_t>(sg_times) * (sg_times + 1) / 2);
+    }
+
+private:
+    void produce()
+    {
+        for (int i=1; i<=sg_times; ++i)
+            CHECK(_queue.push_back(i, 1000));
+        CHECK(_queue.push_back(-1, 1000)); // 结束标志
+    }
+
+    void consume()
+    {
+        net::CEpoller epoller;
+        epoller.create(10);
+        epoller.set_events(&_queue, EPOLLIN);
+
+        while (true)
+        {
+            int n = epoller.timed_wait(1000);
+            CHECK(n >= 0);
+            if (0 == n)
+                continue;
+
+            // 一次唤醒取走所有元素
+            ++_wakeups;
+            int elems[256];
+            uint32_t number;
+            do
+            {
+                number = sizeof(elems) / sizeof(elems[0]);
+                _queue.pop_front(elems, number);
+
+                for (uint32_t i=0; i<number; ++i)
+                {
+                    if (-1 == elems[i])
+                    {
+                        epoller.del_events(&_queue);
+                        epoller.destroy();
+                        return;
+                    }
+
+                    _sum += elems[i];
+                    ++_number;
+                }
+            } while (number == sizeof(elems) / sizeof(elems[0]));
+        }
+    }
+
+private:
+    QueueClass _queue;
+    int _wakeups;
+    int64_t _sum;
+    int _number;
+};
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        CTester<net::CEpollableQueue<utils::CArrayQueue<int> > >().run("CEpollableQueue");
+        CTester<net::CEventfdQueue<utils::CArrayQueue<int> > >().run("CEventfdQueue");
+        CTester<net::CSpscEventfdQueue<int> >().run("CSpscEventfdQueue");
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "exception: %s\n", ex.str().c_str());
+        exit(1);
+    }
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
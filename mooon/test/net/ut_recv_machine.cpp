@@ -0,0 +1,203 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CRecvMachine小消息吞吐的比较测试：
+// 逐段喂数据、处理者自己拼包 vs 就地解析CRecvBuffer、处理者直接引用消息
+// 用法：ut_recv_machine [消息体字节数] [每次接收的字节数]
+#include "mooon/net/inttypes.h"
+#include "mooon/net/recv_machine.h"
+#include "mooon/sys/stop_watch.h"
+#include "../ut_utils.h"
+#include <stdlib.h>
+#include <string>
+using namespace mooon;
+
+static const int sg_messages = 2000000;
+
+class CProcessor
+{
+public:
+    CProcessor(bool copy_body)
+        :_copy_body(copy_body)
+        ,_number(0)
+        ,_sum(0)
+    {
+    }
+
+    bool on_header(const net::TCommonMessageHeader& header)
+    {
+        if (_copy_body)
+            _body.clear();
+        return true;
+    }
+
+    bool on_message(const net::TCommonMessageHeader& header, size_t finished_size, const char* buffer, size_t buffer_size)
+    {
+        const char* body = buffer;
+        if (_copy_body)
+        {
+            // 逐段收到的消息体，处理者通常要先拼成完整的
+            _body.append(buffer, buffer_size);
+            if (finished_size+buffer_size < header.size)
+                return true;
+            body = _body.data();
+        }
+
+        CHECK(header.size == 0 || body[0] == static_cast<char>(header.command));
+        CHECK(header.size == 0 || body[header.size-1] == static_cast<char>(header.command));
+        ++_number;
+        _sum += header.command;
+        return true;
+    }
+
+    int number() const { return _number; }
+    uint64_t sum() const { return _sum; }
+
+private:
+    bool _copy_body;
+    int _number;
+    uint64_t _sum;
+    std::string _body;
+};
+
+// 生成sg_messages个消息，消息体大小在[1, 2*body_size)之间变化
+static void make_stream(size_t body_size, std::string* stream, uint64_t* sum)
+{
+    *sum = 0;
+    for (int i=0; i<sg_messages; ++i)
+    {
+        uint32_t size = static_cast<uint32_t>(1 + (i * 7) % (2 * body_size));
+        net::TCommonMessageHeader header;
+        header.size = size;
+        header.command = i % 128;
+
+        stream->append(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream->append(size, static_cast<char>(i % 128));
+        *sum += i % 128;
+    }
+}
+
+static void test_copy(const std::string& stream, size_t recv_size, uint64_t sum)
+{
+    CProcessor processor(true);
+    net::CRecvMachine<net::TCommonMessageHeader, CProcessor> recv_machine(&processor);
+    char* buffer = new char[recv_size];
+    sys::CStopWatch stop_watch;
+
+    for (size_t offset=0; offset<stream.size(); offset+=recv_size)
+    {
+        size_t size = (stream.size()-offset < recv_size)? stream.size()-offset: recv_size;
+        memcpy(buffer, stream.data()+offset, size); // 模拟recv
+        CHECK(recv_machine.work(buffer, size) != utils::handle_error);
+    }
+
+    unsigned int elapsed = stop_watch.get_elapsed_microseconds();
+    fprintf(stdout, "[copy] %d messages: %u us, %.1f M/s\n", processor.number(), elapsed, processor.number() / (elapsed + 1.0));
+    CHECK(sg_messages == processor.number());
+    CHECK(sum == processor.sum());
+    delete []buffer;
+}
+
+static void test_view(const std::string& stream, size_t recv_size, uint64_t sum)
+{
+    CProcessor processor(false);
+    net::CRecvMachine<net::TCommonMessageHeader, CProcessor> recv_machine(&processor);
+    net::CRecvBuffer recv_buffer(4096);
+    sys::CStopWatch stop_watch;
+
+    for (size_t offset=0; offset<stream.size(); )
+    {
+        size_t size = (stream.size()-offset < recv_size)? stream.size()-offset: recv_size;
+        if (size > recv_buffer.writable())
+            size = recv_buffer.writable();
+        memcpy(recv_buffer.write_ptr(), stream.data()+offset, size); // 模拟recv
+        recv_buffer.commit(size);
+        offset += size;
+        CHECK(recv_machine.work(&recv_buffer) != utils::handle_error);
+    }
+
+    unsigned int elapsed = stop_watch.get_elapsed_microseconds();
+    fprintf(stdout, "[view] %d messages: %u us, %.1f M/s, copied %.1f%% of stream by wrapping\n"
+        , processor.number(), elapsed, processor.number() / (elapsed + 1.0)
+        , recv_buffer.get_copied_bytes() * 100.0 / stream.size());
+    CHECK(sg_messages == processor.number());
+    CHECK(sum == processor.sum());
+    CHECK(0 == recv_buffer.readable());
+}
+
+static void test_large_message()
+{
+    // 比初始容量大的消息，Buffer扩容后仍是连续的
+    CProcessor processor(false);
+    net::CRecvMachine<net::TCommonMessageHeader, CProcessor> recv_machine(&processor);
+    net::CRecvBuffer recv_buffer(64, 1024*1024);
+
+    uint64_t sum = 0;
+    std::string stream;
+    for (int i=0; i<10; ++i)
+    {
+        uint32_t size = 100000 + i;
+        net::TCommonMessageHeader header;
+        header.size = size;
+        header.command = i;
+        stream.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.append(size, static_cast<char>(i));
+        sum += i;
+    }
+
+    for (size_t offset=0; offset<stream.size(); )
+    {
+        size_t size = (stream.size()-offset < 1000)? stream.size()-offset: 1000;
+        if (size > recv_buffer.writable())
+            size = recv_buffer.writable();
+        CHECK(size > 0);
+        memcpy(recv_buffer.write_ptr(), stream.data()+offset, size);
+        recv_buffer.commit(size);
+        offset += size;
+        CHECK(recv_machine.work(&recv_buffer) != utils::handle_error);
+    }
+    CHECK(10 == processor.number());
+    CHECK(sum == processor.sum());
+
+    // 超过最大容量
+    net::CRecvBuffer small_buffer(64, 1024);
+    net::TCommonMessageHeader header;
+    header.size = 2000;
+    header.command = 0;
+    memcpy(small_buffer.write_ptr(), &header, sizeof(header));
+    small_buffer.commit(sizeof(header));
+    CHECK(utils::handle_error == recv_machine.work(&small_buffer));
+}
+
+int main(int argc, char* argv[])
+{
+    size_t body_size = (argc > 1)? atoi(argv[1]): 32;
+    size_t recv_size = (argc > 2)? atoi(argv[2]): 1460;
+    CHECK((body_size > 0) && (recv_size > 0));
+
+    uint64_t sum;
+    std::string stream;
+    make_stream(body_size, &stream, &sum);
+
+    test_copy(stream, recv_size, sum);
+    test_view(stream, recv_size, sum);
+    test_large_message();
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
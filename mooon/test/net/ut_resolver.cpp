@@ -0,0 +1,283 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CResolver的测试：缓存、负缓存、过期后后台刷新，以及通过Epoll完成的异步解析
+#include "mooon/net/epoller.h"
+#include "mooon/net/resolver.h"
+#include "mooon/sys/stop_watch.h"
+#include "mooon/sys/utils.h"
+#include "../ut_utils.h"
+#include <stdlib.h>
+using namespace mooon;
+
+// 不访问DNS，以bad开头的域名解析失败，可模拟解析慢和DNS不可用
+class CFakeResolver: public net::CResolver
+{
+public:
+    CFakeResolver(uint32_t ttl_seconds, uint32_t negative_ttl_seconds, uint32_t stale_seconds)
+        :net::CResolver(ttl_seconds, negative_ttl_seconds, stale_seconds)
+        ,_resolve_number(0)
+        ,_delay_milliseconds(0)
+        ,_unavailable(false)
+    {
+    }
+
+    ~CFakeResolver()
+    {
+        // 须在派生类析构前停止后台线程，否则线程可能调用到基类的do_resolve
+        stop();
+    }
+
+    int get_resolve_number() const { return __sync_fetch_and_add(const_cast<volatile int*>(&_resolve_number), 0); }
+    void set_delay_milliseconds(uint32_t milliseconds) { _delay_milliseconds = milliseconds; }
+    void set_unavailable(bool unavailable) { _unavailable = unavailable; }
+
+private:
+    virtual bool do_resolve(const std::string& hostname, net::string_ip_array_t* ip_array, std::string* errinfo)
+    {
+        __sync_fetch_and_add(&_resolve_number, 1);
+        if (_delay_milliseconds > 0)
+            sys::CUtils::millisleep(_delay_milliseconds);
+
+        if (_unavailable || (0 == hostname.compare(0, 3, "bad")))
+        {
+            *errinfo = "host not found";
+            return false;
+        }
+
+        ip_array->push_back("10.0.0.1");
+        ip_array->push_back("10.0.0.2");
+        return true;
+    }
+
+private:
+    volatile int _resolve_number;
+    volatile uint32_t _delay_milliseconds;
+    volatile bool _unavailable;
+};
+
+static net::resolver_stats_t get_stats(const net::CResolver& resolver)
+{
+    net::resolver_stats_t stats;
+    resolver.get_stats(&stats);
+    return stats;
+}
+
+static void test_cache()
+{
+    CFakeResolver resolver(60, 60, 0);
+    net::string_ip_array_t ip_array;
+    std::string errinfo;
+
+    // IP不解析
+    CHECK(resolver.resolve("127.0.0.1", &ip_array));
+    CHECK((1 == ip_array.size()) && ("127.0.0.1" == ip_array[0]));
+    CHECK(0 == resolver.get_resolve_number());
+
+    CHECK(resolver.resolve("www.example.test", &ip_array));
+    CHECK(2 == ip_array.size());
+    CHECK(resolver.resolve("www.example.test", &ip_array));
+    CHECK(2 == ip_array.size());
+    CHECK(1 == resolver.get_resolve_number());
+    CHECK(1 == get_stats(resolver).hit_number);
+
+    // 负缓存
+    CHECK(!resolver.resolve("bad.example.test", &ip_array, &errinfo));
+    CHECK(!resolver.resolve("bad.example.test", &ip_array, &errinfo));
+    CHECK("host not found" == errinfo);
+    CHECK(2 == resolver.get_resolve_number());
+    CHECK(1 == get_stats(resolver).negative_hit_number);
+
+    // 未start时lookup不解析
+    CHECK(!resolver.lookup("new.example.test", &ip_array));
+    CHECK(2 == resolver.get_resolve_number());
+}
+
+static void test_stale()
+{
+    // ttl为0，结果立即过期，但60秒内仍可用
+    CFakeResolver resolver(0, 0, 60);
+    net::string_ip_array_t ip_array;
+    resolver.start();
+
+    CHECK(resolver.resolve("www.example.test", &ip_array));
+    CHECK(1 == resolver.get_resolve_number());
+
+    // 使用旧结果，同时后台刷新，即使刷新慢也不阻塞
+    resolver.set_delay_milliseconds(200);
+    ip_array.clear();
+    CHECK(resolver.lookup("www.example.test", &ip_array));
+    CHECK(2 == ip_array.size());
+    CHECK(1 == get_stats(resolver).stale_hit_number);
+    for (int i=0; (i<100) && (resolver.get_resolve_number()<2); ++i)
+        sys::CUtils::millisleep(10);
+    CHECK(2 == resolver.get_resolve_number());
+
+    // DNS不可用时刷新失败，仍保留旧结果
+    resolver.set_delay_milliseconds(0);
+    resolver.set_unavailable(true);
+    sys::CUtils::millisleep(250);
+    CHECK(resolver.lookup("www.example.test", &ip_array));
+    for (int i=0; (i<100) && (get_stats(resolver).resolve_failure_number<1); ++i)
+        sys::CUtils::millisleep(10);
+    CHECK(resolver.resolve("www.example.test", &ip_array));
+    CHECK(2 == ip_array.size());
+
+    // 不缓存失败的结果（negative_ttl_seconds为0）
+    std::string errinfo;
+    CHECK(!resolver.resolve("bad.example.test", &ip_array, &errinfo));
+    const int resolve_number = resolver.get_resolve_number();
+    CHECK(!resolver.resolve("bad.example.test", &ip_array, &errinfo));
+    CHECK(resolve_number+1 == resolver.get_resolve_number());
+}
+
+static void test_async()
+{
+    CFakeResolver resolver(60, 60, 0);
+    net::CResolveQueue queue(100);
+    net::CEpoller epoller;
+    resolver.set_delay_milliseconds(50);
+    resolver.start(2);
+    epoller.create(10);
+    epoller.set_events(&queue, EPOLLIN);
+
+    // 同一域名的并发请求只解析一次
+    int contexts[4] = { 0, 1, 2, 3 };
+    resolver.async_resolve("www.example.test", &queue, &contexts[0]);
+    resolver.async_resolve("www.example.test", &queue, &contexts[1]);
+    resolver.async_resolve("bad.example.test", &queue, &contexts[2]);
+    resolver.async_resolve("127.0.0.1", &queue, &contexts[3]);
+
+    int completed = 0;
+    int mask = 0;
+    while (completed < 4)
+    {
+        CHECK(epoller.timed_wait(2000) > 0);
+
+        net::resolve_result_t* results[10];
+        uint32_t number = sizeof(results) / sizeof(results[0]);
+        queue.pop_front(results, number);
+        for (uint32_t i=0; i<number; ++i)
+        {
+            int index = *static_cast<int*>(results[i]->context);
+            mask |= 1 << index;
+            CHECK(results[i]->success == (index != 2));
+            if (3 == index)
+                CHECK("127.0.0.1" == results[i]->ip_array[0]);
+            else if (index != 2)
+                CHECK(2 == results[i]->ip_array.size());
+            delete results[i];
+        }
+        completed += number;
+    }
+    CHECK(0xf == mask);
+    CHECK(2 == resolver.get_resolve_number());
+
+    // 已缓存的直接完成，不经过后台线程
+    resolver.async_resolve("www.example.test", &queue, &contexts[0]);
+    CHECK(1 == queue.size());
+    net::resolve_result_t* result = NULL;
+    CHECK(queue.pop_front(result));
+    CHECK(result->success);
+    delete result;
+    CHECK(2 == resolver.get_resolve_number());
+
+    // 停止时未完成的请求以失败完成
+    resolver.set_delay_milliseconds(300);
+    resolver.async_resolve("a.example.test", &queue, &contexts[0]);
+    resolver.async_resolve("b.example.test", &queue, &contexts[1]);
+    resolver.async_resolve("c.example.test", &queue, &contexts[2]);
+    resolver.stop();
+    CHECK(3 == queue.size());
+    while (queue.pop_front(result))
+    {
+        CHECK((result->success) || ("resolver stopped" == result->errinfo));
+        delete result;
+    }
+
+    // 停止后直接失败
+    resolver.async_resolve("d.example.test", &queue, &contexts[0]);
+    CHECK(queue.pop_front(result));
+    CHECK(!result->success);
+    delete result;
+}
+
+// 完成队列不限大小，结果不会被丢弃，在消费队列的线程中stop也不会死锁
+static void test_unbounded()
+{
+    net::CResolveQueue queue(1);
+    CFakeResolver resolver(60, 5, 300);
+    resolver.start();
+    int contexts[3] = { 0, 1, 2 };
+
+    resolver.async_resolve("www.example.test", &queue, &contexts[0]);
+    while (queue.is_empty())
+        sys::CUtils::millisleep(10);
+
+    // 已缓存的在本线程中完成
+    resolver.async_resolve("www.example.test", &queue, &contexts[1]);
+    CHECK(2 == queue.size());
+
+    sys::CStopWatch stop_watch;
+    resolver.set_delay_milliseconds(300);
+    resolver.async_resolve("y.example.test", &queue, &contexts[2]);
+    resolver.stop();
+    CHECK(stop_watch.get_elapsed_microseconds() < 900000);
+    CHECK(3 == queue.size());
+
+    int mask = 0;
+    net::resolve_result_t* result = NULL;
+    while (queue.pop_front(result))
+    {
+        mask |= 1 << *static_cast<int*>(result->context);
+        delete result;
+    }
+    CHECK(7 == mask);
+}
+
+static void test_localhost()
+{
+    // 实际调用getaddrinfo，localhost通常由/etc/hosts解析
+    net::CResolver resolver;
+    net::string_ip_array_t ip_array;
+    std::string errinfo;
+
+    if (resolver.resolve("localhost", &ip_array, &errinfo))
+    {
+        CHECK(!ip_array.empty());
+        CHECK(resolver.resolve("localhost", &ip_array, &errinfo));
+        CHECK(1 == get_stats(resolver).resolve_number);
+        fprintf(stdout, "localhost: %s (%" PRIu64"us)\n", ip_array[0].c_str(), get_stats(resolver).resolve_microseconds);
+    }
+    else
+    {
+        fprintf(stdout, "resolve localhost failed: %s\n", errinfo.c_str());
+    }
+}
+
+int main()
+{
+    test_cache();
+    test_stale();
+    test_async();
+    test_unbounded();
+    test_localhost();
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 多个SO_REUSEPORT监听者共享同一端口，并用accept4批量接受连接
+// 用法：ut_reuse_port [监听者个数]
+#include "mooon/net/listen_manager.h"
+#include "mooon/net/listener.h"
+#include "mooon/net/utils.h"
+#include "mooon/sys/cpu_affinity.h"
+#include "../ut_utils.h"
+#include <fcntl.h>
+#include <stdlib.h>
+using namespace mooon;
+
+static const int sg_clients = 200;
+
+// 建立sg_clients个连接，各监听者一直接受到没有待接受的连接为止，返回接受到连接的监听者个数
+static int connect_and_accept(net::CListener* listener_array[], int listeners, uint16_t port)
+{
+    std::vector<int> client_fds;
+    for (int i=0; i<sg_clients; ++i)
+        client_fds.push_back(connect_to(port));
+
+    int accepted = 0;
+    int busy_listeners = 0;
+    for (int i=0; i<listeners; ++i)
+    {
+        int number = 0;
+        for (;;)
+        {
+            uint16_t peer_port;
+            net::ip_address_t peer_ip;
+            int newfd = listener_array[i]->accept(peer_ip, peer_port, SOCK_NONBLOCK|SOCK_CLOEXEC);
+            if (-1 == newfd)
+                break;
+
+            CHECK(fcntl(newfd, F_GETFL) & O_NONBLOCK);
+            CHECK(fcntl(newfd, F_GETFD) & FD_CLOEXEC);
+            CHECK(peer_ip.to_string() == "127.0.0.1");
+            net::close_fd(newfd);
+            ++number;
+        }
+
+        fprintf(stdout, "listener[%d] accepted %d\n", i, number);
+        accepted += number;
+        if (number > 0)
+            ++busy_listeners;
+    }
+
+    CHECK(sg_clients == accepted);
+    for (int i=0; i<sg_clients; ++i)
+        net::close_fd(client_fds[i]);
+    return busy_listeners;
+}
+
+int main(int argc, char* argv[])
+{
+    int listeners = (argc > 1)? atoi(argv[1]): 4;
+    CHECK((listeners > 1) && (listeners <= 64));
+
+    try
+    {
+        // 第一个监听者由内核分配端口，其它监听者加入同一个端口
+        net::CListener first_listener;
+        first_listener.listen(net::ip_address_t("127.0.0.1"), 0, true, false, true);
+
+        struct sockaddr_in addr_in;
+        socklen_t addr_len = sizeof(addr_in);
+        CHECK(0 == getsockname(first_listener.get_fd(), (struct sockaddr*)&addr_in, &addr_len));
+        uint16_t port = ntohs(addr_in.sin_port);
+
+        net::CListener* listener_array[64];
+        net::CListenManager<net::CListener> listen_manager[64];
+        listener_array[0] = &first_listener;
+        for (int i=1; i<listeners; ++i)
+        {
+            listen_manager[i].add(net::ip_address_t("127.0.0.1"), port);
+            listen_manager[i].create(true, true);
+            listener_array[i] = listen_manager[i].get_listener_array();
+        }
+
+        // 内核按四元组的哈希在监听者间分配
+        fprintf(stdout, "without SO_INCOMING_CPU:\n");
+        CHECK(connect_and_accept(listener_array, listeners, port) > 1);
+
+        // 设置SO_INCOMING_CPU后，在该CPU上收到的连接都交给这个监听者
+        try
+        {
+            sys::CCpuAffinity::set_current_thread_cpu(0);
+            first_listener.set_incoming_cpu(0);
+
+            fprintf(stdout, "with SO_INCOMING_CPU:\n");
+            CHECK(1 == connect_and_accept(listener_array, listeners, port));
+        }
+        catch (sys::CSyscallException& ex)
+        {
+            // 低版本内核不支持
+            CHECK(ENOPROTOOPT == ex.errcode());
+            fprintf(stdout, "SO_INCOMING_CPU not supported\n");
+        }
+
+        for (int i=1; i<listeners; ++i)
+            listen_manager[i].destroy();
+        first_listener.close();
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "exception: %s\n", ex.str().c_str());
+        exit(1);
+    }
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,194 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CSendMachine发送队列的测试：部分写跨越消息边界，消息只在完全发出后才释放
+#include "mooon/net/send_machine.h"
+#include "../ut_utils.h"
+#include <stdlib.h>
+#include <string>
+using namespace mooon;
+
+// 每次最多写入_window字节，模拟Socket发送缓冲区
+class CConnector
+{
+public:
+    CConnector()
+        :_window(0)
+        ,_writev_number(0)
+    {
+    }
+
+    ssize_t send(const char* buffer, size_t buffer_size)
+    {
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>(buffer);
+        iov.iov_len = buffer_size;
+        return writev(&iov, 1);
+    }
+
+    ssize_t writev(const struct iovec* iov, int iovcnt)
+    {
+        CHECK(iovcnt <= IOV_MAX);
+        if (0 == _window)
+            return -1;
+
+        ++_writev_number;
+        size_t written = 0;
+        for (int i=0; (i<iovcnt) && (_window>0); ++i)
+        {
+            size_t size = (iov[i].iov_len < _window)? iov[i].iov_len: _window;
+            _output.append(static_cast<const char*>(iov[i].iov_base), size);
+            _window -= size;
+            written += size;
+        }
+
+        return (ssize_t)written;
+    }
+
+    void open_window(size_t window) { _window = window; }
+    int get_writev_number() const { return _writev_number; }
+    const std::string& get_output() const { return _output; }
+
+private:
+    size_t _window;
+    int _writev_number;
+    std::string _output;
+};
+
+class CSharedMessage: public sys::CRefCountable
+{
+public:
+    CSharedMessage(const std::string& data, bool* deleted)
+        :_data(data)
+        ,_deleted(deleted)
+    {
+    }
+
+    ~CSharedMessage()
+    {
+        *_deleted = true;
+    }
+
+    const std::string& data() const { return _data; }
+
+private:
+    std::string _data;
+    bool* _deleted;
+};
+
+static char* new_message(const std::string& data)
+{
+    char* message = new char[data.size()];
+    memcpy(message, data.data(), data.size());
+    return message;
+}
+
+static void test_partial_write()
+{
+    CConnector connector;
+    net::CSendMachine<CConnector> send_machine(&connector);
+
+    bool deleted = false;
+    CSharedMessage* shared_message = new CSharedMessage("shared-message", &deleted);
+    shared_message->inc_refcount(); // 本测试持有一个引用
+
+    std::string borrowed = "borrowed";
+    std::string expected;
+
+    send_machine.push(new_message("owned-1"), 7, true);
+    send_machine.push(borrowed.data(), borrowed.size(), false);
+    send_machine.push(shared_message->data().data(), shared_message->data().size(), shared_message);
+    send_machine.push(new_message("owned-2"), 7, true);
+    expected = std::string("owned-1") + borrowed + shared_message->data() + "owned-2";
+    CHECK(4 == send_machine.get_queued_number());
+    CHECK(expected.size() == send_machine.get_queued_bytes());
+    CHECK(2 == shared_message->get_refcount());
+
+    // 不可写
+    CHECK(utils::handle_continue == send_machine.flush());
+    CHECK(!send_machine.is_finish());
+
+    // 写到共享消息的中间：前两个消息释放，共享消息仍被引用
+    connector.open_window(7 + borrowed.size() + 3);
+    CHECK(utils::handle_continue == send_machine.flush());
+    CHECK(2 == send_machine.get_queued_number());
+    CHECK(2 == shared_message->get_refcount());
+
+    // 一次只写一个字节，跨越消息边界
+    for (int i=0; i<100 && !send_machine.is_finish(); ++i)
+    {
+        connector.open_window(1);
+        send_machine.flush();
+    }
+    CHECK(send_machine.is_finish());
+    CHECK(0 == send_machine.get_queued_bytes());
+    CHECK(1 == shared_message->get_refcount());
+    CHECK(expected == connector.get_output());
+
+    CHECK(shared_message->dec_refcount());
+    CHECK(deleted);
+}
+
+static void test_gather()
+{
+    // 大量小消息，每次writev至多IOV_MAX段
+    const int number = IOV_MAX * 3 + 5;
+    CConnector connector;
+    net::CSendMachine<CConnector> send_machine(&connector);
+    std::string expected;
+
+    for (int i=0; i<number; ++i)
+    {
+        char message[32];
+        int size = snprintf(message, sizeof(message), "[%d]", i);
+        send_machine.push(new_message(message), size, true);
+        expected.append(message, size);
+    }
+
+    connector.open_window(expected.size());
+    CHECK(utils::handle_finish == send_machine.flush());
+    CHECK(expected == connector.get_output());
+    CHECK((number + IOV_MAX - 1) / IOV_MAX == connector.get_writev_number());
+    fprintf(stdout, "%d messages in %d writev\n", number, connector.get_writev_number());
+}
+
+static void test_reset()
+{
+    // reset释放未发送的消息
+    CConnector connector;
+    net::CSendMachine<CConnector> send_machine(&connector);
+    bool deleted = false;
+    CSharedMessage* shared_message = new CSharedMessage("shared", &deleted);
+
+    send_machine.push(shared_message->data().data(), shared_message->data().size(), shared_message);
+    send_machine.push(new_message("owned"), 5, true);
+    CHECK(!deleted);
+    send_machine.reset(false);
+    CHECK(deleted);
+    CHECK(send_machine.is_finish());
+}
+
+int main()
+{
+    test_partial_write();
+    test_gather();
+    test_reset();
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
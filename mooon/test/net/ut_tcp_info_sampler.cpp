@@ -0,0 +1,182 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CTcpInfoSampler的测试：直方图、百分位数、采样间隔和每秒采样数限制
+#include "mooon/net/tcp_info_sampler.h"
+#include "../ut_utils.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using namespace mooon;
+
+static void test_histogram()
+{
+    net::CTcpInfoSampler sampler;
+    net::tcp_info_sample_t sample;
+    memset(&sample, 0, sizeof(sample));
+
+    // RTT为1到100
+    for (uint32_t i=1; i<=100; ++i)
+    {
+        sample.values[net::tcp_info_rtt] = i;
+        sampler.add_sample(sample);
+    }
+
+    net::tcp_info_stats_t stats;
+    sampler.get_stats(&stats);
+    const net::tcp_info_histogram_t& rtt = stats.histograms[net::tcp_info_rtt];
+    CHECK(100 == stats.sample_number);
+    CHECK(5050 == rtt.sum);
+    CHECK(100 == rtt.max);
+    CHECK(1 == rtt.buckets[1]);  // 1
+    CHECK(2 == rtt.buckets[2]);  // 2-3
+    CHECK(32 == rtt.buckets[6]); // 32-63
+    CHECK(37 == rtt.buckets[7]); // 64-100
+
+    // 百分位数为所在桶的上界，不超过最大值
+    CHECK(63 == net::CTcpInfoSampler::get_percentile(rtt, stats.sample_number, 50));
+    CHECK(100 == net::CTcpInfoSampler::get_percentile(rtt, stats.sample_number, 99));
+    CHECK(1 == net::CTcpInfoSampler::get_percentile(rtt, stats.sample_number, 0));
+    CHECK(0 == net::CTcpInfoSampler::get_percentile(stats.histograms[net::tcp_info_cwnd], stats.sample_number, 99));
+
+    // 增量
+    net::tcp_info_stats_t before = stats;
+    sample.values[net::tcp_info_rtt] = 5;
+    sampler.add_sample(sample);
+    sampler.get_stats(&stats);
+
+    net::tcp_info_stats_t delta;
+    net::CTcpInfoSampler::subtract_stats(stats, before, &delta);
+    CHECK(1 == delta.sample_number);
+    CHECK(5 == delta.histograms[net::tcp_info_rtt].sum);
+    CHECK(7 == delta.histograms[net::tcp_info_rtt].max);
+    CHECK(7 == net::CTcpInfoSampler::get_percentile(delta.histograms[net::tcp_info_rtt], delta.sample_number, 99));
+
+    // 最大的值
+    sample.values[net::tcp_info_rtt] = 0xFFFFFFFFu;
+    sampler.add_sample(sample);
+    sampler.get_stats(&stats);
+    CHECK(1 == stats.histograms[net::tcp_info_rtt].buckets[TCP_INFO_BUCKET_NUMBER-1]);
+}
+
+static void test_sample()
+{
+    int client_fd, server_fd;
+    connect_loopback(&client_fd, &server_fd);
+
+    // 发送一些数据，对端不读，使发送缓冲区有数据
+    char buffer[4096];
+    memset(buffer, 0, sizeof(buffer));
+    CHECK(sizeof(buffer) == write(client_fd, buffer, sizeof(buffer)));
+
+    net::tcp_info_sample_t sample;
+    CHECK(net::CTcpInfoSampler::get_tcp_info(client_fd, &sample));
+    CHECK(sample.values[net::tcp_info_cwnd] > 0);
+    fprintf(stdout, "rtt:%uus, rttvar:%uus, retransmits:%u, cwnd:%u, unacked:%u, send_queue:%u\n"
+        , sample.values[net::tcp_info_rtt], sample.values[net::tcp_info_rttvar]
+        , sample.values[net::tcp_info_retransmits], sample.values[net::tcp_info_cwnd]
+        , sample.values[net::tcp_info_unacked], sample.values[net::tcp_info_send_queue]);
+
+    // 不是TCP连接
+    int pipe_fd[2];
+    CHECK(0 == pipe(pipe_fd));
+    CHECK(!net::CTcpInfoSampler::get_tcp_info(pipe_fd[0], &sample));
+
+    net::CTcpInfoSampler sampler;
+    uint64_t next_sample_milliseconds = 0;
+    CHECK(!sampler.is_enabled());
+    CHECK(!sampler.sample(client_fd, &next_sample_milliseconds, 1000));
+
+    // 同一连接在间隔内只采样一次
+    sampler.set_sampling(100, 0);
+    CHECK(sampler.sample(client_fd, &next_sample_milliseconds, 1000));
+    CHECK(1100 == next_sample_milliseconds);
+    CHECK(!sampler.sample(client_fd, &next_sample_milliseconds, 1099));
+    CHECK(sampler.sample(client_fd, &next_sample_milliseconds, 1100));
+
+    uint64_t pipe_next_sample_milliseconds = 0;
+    CHECK(!sampler.sample(pipe_fd[0], &pipe_next_sample_milliseconds, 1100));
+
+    net::tcp_info_stats_t stats;
+    sampler.get_stats(&stats);
+    CHECK(2 == stats.sample_number);
+    CHECK(1 == stats.failure_number);
+
+    // 每秒最多采样2次，跳过的连接要过一个间隔才再尝试
+    sampler.set_sampling(100, 2);
+    uint64_t next_sample_milliseconds_array[4] = { 0, 0, 0, 0 };
+    int sampled = 0;
+    for (int i=0; i<4; ++i)
+        sampled += sampler.sample(server_fd, &next_sample_milliseconds_array[i], 5000)? 1: 0;
+    CHECK(2 == sampled);
+    CHECK(5100 == next_sample_milliseconds_array[3]);
+    CHECK(!sampler.sample(server_fd, &next_sample_milliseconds_array[3], 5500)); // 本秒已用完
+    CHECK(sampler.sample(server_fd, &next_sample_milliseconds_array[3], 6000)); // 下一秒
+    sampler.get_stats(&stats);
+    CHECK(5 == stats.sample_number);
+    CHECK(3 == stats.skip_number);
+
+    close(pipe_fd[0]);
+    close(pipe_fd[1]);
+    close(client_fd);
+    close(server_fd);
+}
+
+static void test_registry()
+{
+    net::tcp_info_sample_t sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.values[net::tcp_info_cwnd] = 10;
+
+    net::CTcpInfoSampler a, b, c, unnamed;
+    a.set_name("ut.x");
+    b.set_name("ut.x");
+    c.set_name("ut.y");
+    a.add_sample(sample);
+    b.add_sample(sample);
+    c.add_sample(sample);
+    unnamed.add_sample(sample);
+
+    {
+        net::CTcpInfoSampler d;
+        d.set_name("ut.z");
+    }
+
+    std::vector<std::pair<std::string, net::tcp_info_stats_t> > all_stats;
+    net::CTcpInfoSampler::get_all_stats(&all_stats);
+    CHECK(2 == all_stats.size());
+    CHECK("ut.x" == all_stats[0].first);
+    CHECK(2 == all_stats[0].second.sample_number);
+    CHECK(20 == all_stats[0].second.histograms[net::tcp_info_cwnd].sum);
+    CHECK("ut.y" == all_stats[1].first);
+    CHECK(1 == all_stats[1].second.sample_number);
+}
+
+int main()
+{
+    test_histogram();
+    test_sample();
+    test_registry();
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
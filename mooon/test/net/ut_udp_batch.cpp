@@ -0,0 +1,201 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CUdpSocket批量收发的测试，以及单个收发和批量收发的UDP Echo性能对比
+// 用法：ut_udp_batch [seconds] [batch]
+#include "mooon/net/udp_socket.h"
+#include "mooon/sys/stop_watch.h"
+#include "../ut_utils.h"
+#include <stdlib.h>
+#include <string>
+#include <vector>
+using namespace mooon;
+
+#define DATAGRAM_SIZE 64
+
+static struct sockaddr_in local_addr(net::CUdpSocket* udp_socket)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    CHECK(0 == getsockname(udp_socket->get_fd(), (struct sockaddr*)&addr, &addr_len));
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    return addr;
+}
+
+// 每个数据报一块Buffer
+class CDatagrams
+{
+public:
+    CDatagrams(int number, size_t buffer_size)
+        :_buffers(number * buffer_size)
+        ,_datagrams(number)
+    {
+        for (int i=0; i<number; ++i)
+        {
+            _datagrams[i].buffer = &_buffers[i * buffer_size];
+            _datagrams[i].buffer_size = buffer_size;
+            _datagrams[i].bytes = 0;
+            _datagrams[i].flags = 0;
+        }
+    }
+
+    net::udp_datagram_t* get() { return &_datagrams[0]; }
+    net::udp_datagram_t& operator [](int index) { return _datagrams[index]; }
+
+private:
+    std::vector<char> _buffers;
+    std::vector<net::udp_datagram_t> _datagrams;
+};
+
+static void test_batch()
+{
+    const int number = 100; // 超过一次系统调用的个数，需分段
+    net::CUdpSocket receiver;
+    net::CUdpSocket sender;
+    receiver.listen("127.0.0.1", 0, true);
+    const struct sockaddr_in to_addr = local_addr(&receiver);
+
+    CDatagrams in(number, 16);
+    CDatagrams out(number, 16);
+
+    // 非阻塞，没有数据
+    CHECK(-1 == receiver.receive_batch(in.get(), number));
+
+    // 超时
+    try
+    {
+        receiver.timed_receive_batch(in.get(), number, 10);
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(ETIMEDOUT == ex.errcode());
+    }
+
+    for (int i=0; i<number; ++i)
+    {
+        out[i].buffer_size = snprintf(static_cast<char*>(out[i].buffer), 16, "%d", i);
+        out[i].addr = to_addr;
+    }
+    CHECK(number == sender.send_batch(out.get(), number));
+    for (int i=0; i<number; ++i)
+        CHECK(out[i].bytes == out[i].buffer_size);
+
+    // 分两次收完
+    CHECK(30 == receiver.timed_receive_batch(in.get(), 30, 1000));
+    CHECK(number-30 == receiver.receive_batch(in.get()+30, number-30));
+    for (int i=0; i<number; ++i)
+    {
+        CHECK(in[i].bytes == out[i].buffer_size);
+        CHECK(0 == memcmp(in[i].buffer, out[i].buffer, in[i].bytes));
+        CHECK(0 == in[i].flags);
+        CHECK(in[0].addr.sin_port == in[i].addr.sin_port);
+    }
+    CHECK(-1 == receiver.receive_batch(in.get(), number));
+
+    // 数据报比Buffer大，被截断
+    std::string large(100, 'x');
+    sender.send_to(large.data(), large.size(), to_addr);
+    CHECK(1 == receiver.timed_receive_batch(in.get(), number, 1000));
+    CHECK(16 == in[0].bytes);
+    CHECK(MSG_TRUNC == (in[0].flags & MSG_TRUNC));
+
+    // 阻塞模式，MSG_WAITFORONE收到一个即返回
+    receiver.set_nonblock(false);
+    CHECK(2 == sender.send_batch(out.get(), 2));
+    CHECK(2 == receiver.receive_batch(in.get(), number, true));
+}
+
+// 同一线程内的Echo：客户端发出batch个，服务端收到后原样返回，客户端再收回
+static void benchmark(bool batched, int seconds, int batch)
+{
+    net::CUdpSocket server;
+    net::CUdpSocket client;
+    server.listen("127.0.0.1", 0, false);
+    client.listen("127.0.0.1", 0, false);
+    const struct sockaddr_in server_addr = local_addr(&server);
+
+    CDatagrams requests(batch, DATAGRAM_SIZE);
+    CDatagrams datagrams(batch, DATAGRAM_SIZE);
+    for (int i=0; i<batch; ++i)
+    {
+        memset(requests[i].buffer, 'a' + i % 26, DATAGRAM_SIZE);
+        requests[i].addr = server_addr;
+    }
+
+    uint64_t packets = 0;
+    uint64_t syscalls = 0;
+    sys::CStopWatch stop_watch;
+    while (stop_watch.get_total_elapsed_microseconds() < static_cast<uint64_t>(seconds) * 1000000)
+    {
+        if (batched)
+        {
+            CHECK(batch == client.send_batch(requests.get(), batch));
+            for (int received=0; received<batch;)
+            {
+                int n = server.receive_batch(datagrams.get(), batch-received);
+                for (int i=0; i<n; ++i)
+                    datagrams[i].buffer_size = datagrams[i].bytes;
+                CHECK(n == server.send_batch(datagrams.get(), n));
+                for (int i=0; i<n; ++i)
+                    datagrams[i].buffer_size = DATAGRAM_SIZE;
+                received += n;
+                syscalls += 2;
+            }
+            for (int received=0; received<batch; ++syscalls)
+                received += client.receive_batch(datagrams.get(), batch-received);
+            ++syscalls;
+        }
+        else
+        {
+            char buffer[DATAGRAM_SIZE];
+            struct sockaddr_in from_addr;
+            for (int i=0; i<batch; ++i)
+                client.send_to(requests[i].buffer, DATAGRAM_SIZE, server_addr);
+            for (int i=0; i<batch; ++i)
+            {
+                int bytes = server.receive_from(buffer, sizeof(buffer), &from_addr);
+                server.send_to(buffer, bytes, from_addr);
+            }
+            for (int i=0; i<batch; ++i)
+                client.receive_from(buffer, sizeof(buffer), &from_addr);
+            syscalls += batch * 4;
+        }
+
+        packets += batch;
+    }
+
+    uint64_t microseconds = stop_watch.get_total_elapsed_microseconds();
+    fprintf(stdout, "%-8s: %" PRIu64" echo/s, %.2f syscalls/echo\n",
+            batched? "batched": "single",
+            packets * 1000000 / microseconds,
+            static_cast<double>(syscalls) / packets);
+}
+
+int main(int argc, char* argv[])
+{
+    int seconds = (argc > 1)? atoi(argv[1]): 1;
+    int batch = (argc > 2)? atoi(argv[2]): 32;
+
+    test_batch();
+    benchmark(false, seconds, batch);
+    benchmark(true, seconds, batch);
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,426 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CUringPoller的测试：和Epoll一致的水平触发语义、del_events丢弃未取走的事件、多次accept和recv，
+// 以及Ping-Pong吞吐的比较：Epoll、io_uring就绪通知（CEpoller可切换的方式）、io_uring多次recv
+// 用法：ut_uring_poller [连接数] [消息字节数] [每种方式运行的秒数]
+#include "mooon/net/epoller.h"
+#include "mooon/sys/stop_watch.h"
+#include "../ut_utils.h"
+#include <stdlib.h>
+#include <string>
+using namespace mooon;
+
+class CSocket: public net::CEpollable
+{
+public:
+    void attach(int fd) { set_fd(fd); }
+
+private:
+    virtual net::epoll_event_t handle_epoll_event(void* input_ptr, uint32_t events, void* ouput_ptr)
+    {
+        return net::epoll_none;
+    }
+};
+
+static void test_level_triggered(net::poller_engine_t engine)
+{
+    // 只取一个事件，第二个对象的事件留在内核中
+    net::CEpoller epoller;
+    epoller.create(1, engine);
+    CHECK(engine == epoller.get_engine());
+
+    int fds[2][2];
+    CSocket sockets[2];
+    for (int i=0; i<2; ++i)
+    {
+        CHECK(0 == socketpair(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK, 0, fds[i]));
+        sockets[i].attach(fds[i][0]);
+    }
+
+    epoller.set_events(&sockets[0], EPOLLIN);
+    CHECK(0 == epoller.timed_wait(10));
+    CHECK(1 == write(fds[0][1], "x", 1));
+
+    // 不读取数据，每一轮都会再次通知
+    for (int i=0; i<3; ++i)
+    {
+        CHECK(1 == epoller.timed_wait(1000));
+        CHECK(&sockets[0] == epoller.get(0));
+        CHECK(epoller.get_events(0) & EPOLLIN);
+    }
+
+    char c;
+    CHECK(1 == read(fds[0][0], &c, 1));
+    CHECK(0 == epoller.timed_wait(10));
+
+    // 修改事件
+    epoller.set_events(&sockets[0], EPOLLOUT);
+    CHECK(1 == epoller.timed_wait(1000));
+    CHECK(epoller.get_events(0) & EPOLLOUT);
+    epoller.set_events(&sockets[0], EPOLLIN);
+    CHECK(0 == epoller.timed_wait(10));
+
+    // 唤醒
+    epoller.wakeup();
+    CHECK(1 == epoller.timed_wait(1000));
+    CHECK(&sockets[0] != epoller.get(0));
+    CHECK(net::epoll_none == epoller.get(0)->handle_epoll_event(NULL, epoller.get_events(0), NULL));
+
+    // 两个对象都有事件，取走一个后删除另一个，不会再返回被删除的
+    epoller.set_events(&sockets[1], EPOLLIN);
+    CHECK(1 == write(fds[0][1], "x", 1));
+    CHECK(1 == write(fds[1][1], "x", 1));
+    CHECK(1 == epoller.timed_wait(1000));
+    CSocket* deleted = (epoller.get(0) == &sockets[0])? &sockets[1]: &sockets[0];
+    epoller.del_events(deleted);
+    for (int i=0; i<3; ++i)
+    {
+        CHECK(1 == epoller.timed_wait(1000));
+        CHECK(deleted != epoller.get(0));
+    }
+
+    // 删除后关闭
+    epoller.del_events((deleted == &sockets[0])? &sockets[1]: &sockets[0]);
+    for (int i=0; i<2; ++i)
+    {
+        sockets[i].close();
+        ::close(fds[i][1]);
+    }
+    CHECK(0 == epoller.timed_wait(10));
+}
+
+// 同一个监听者加入两个CEpoller（非reuse_port时工作线程共享监听者），两个都要能收到连接事件
+static void test_shared_listener(net::poller_engine_t engine)
+{
+    net::CEpoller epollers[2];
+    uint16_t port;
+    CSocket listener;
+    listener.attach(listen_any(&port, 1024));
+    listener.set_nonblock(true);
+    for (int i=0; i<2; ++i)
+    {
+        epollers[i].create(16, engine);
+        epollers[i].set_events(&listener, EPOLLIN, true);
+    }
+    CHECK(0 == epollers[0].timed_wait(10));
+    CHECK(0 == epollers[1].timed_wait(10));
+
+    int client_fd = connect_to(port);
+    for (int round=0; round<2; ++round)
+    {
+        for (int i=0; i<2; ++i)
+        {
+            CHECK(1 == epollers[i].timed_wait(1000));
+            CHECK(&listener == epollers[i].get(0));
+            CHECK(epollers[i].get_events(0) & EPOLLIN);
+        }
+    }
+
+    // 一个取走连接后，两个都不再有事件；
+    // io_uring允许再次强制加入（Epoll会报EEXIST），不会重复提交POLL_ADD
+    int fd = accept(listener.get_fd(), NULL, NULL);
+    CHECK(fd != -1);
+    ::close(fd);
+    ::close(client_fd);
+    if (net::poller_uring == engine)
+        epollers[1].set_events(&listener, EPOLLIN, true);
+    CHECK(0 == epollers[0].timed_wait(10));
+    CHECK(0 == epollers[1].timed_wait(10));
+
+    // 第二个连接两个仍都能收到，各自只收到一次
+    client_fd = connect_to(port);
+    for (int i=0; i<2; ++i)
+    {
+        CHECK(1 == epollers[i].timed_wait(1000));
+        CHECK(&listener == epollers[i].get(0));
+    }
+
+    for (int i=0; i<2; ++i)
+        epollers[i].del_events(&listener);
+    CHECK(0 == epollers[0].timed_wait(10));
+    CHECK(0 == epollers[1].timed_wait(10));
+    ::close(client_fd);
+}
+
+static void test_multishot()
+{
+    net::CUringPoller uring_poller;
+    uring_poller.create(16, 8, 64);
+
+    uint16_t port;
+    CSocket listener;
+    listener.attach(listen_any(&port, 1024));
+    uring_poller.accept_multishot(&listener);
+
+    // 多次accept：一个请求接受所有连接
+    int client_fds[3];
+    CSocket accepted[3];
+    for (int i=0; i<3; ++i)
+        client_fds[i] = connect_to(port);
+    for (int i=0; i<3; )
+    {
+        int n = uring_poller.timed_wait(1000);
+        CHECK(n > 0);
+        for (int j=0; j<n; ++j, ++i)
+        {
+            CHECK(&listener == uring_poller.get(j));
+            CHECK(uring_poller.get_result(j) >= 0);
+            accepted[i].attach(uring_poller.get_result(j));
+            uring_poller.recv_multishot(&accepted[i]);
+        }
+    }
+
+    // 多次recv：数据比全部Buffer还多，Buffer用完后下一轮自动恢复
+    std::string sent;
+    for (int i=0; i<100; ++i)
+        sent.append(std::string(10, 'a' + i % 26));
+    CHECK((ssize_t)sent.size() == write(client_fds[0], sent.data(), sent.size()));
+    ::close(client_fds[0]);
+
+    std::string received;
+    for (bool closed=false; !closed; )
+    {
+        int n = uring_poller.timed_wait(1000);
+        CHECK(n > 0);
+        for (int j=0; j<n; ++j)
+        {
+            CHECK(&accepted[0] == uring_poller.get(j));
+            if (0 == uring_poller.get_result(j))
+            {
+                closed = true;
+                break;
+            }
+            CHECK(uring_poller.get_result(j) > 0);
+            CHECK(uring_poller.get_result(j) <= 64);
+            received.append(uring_poller.get_buffer(j), uring_poller.get_result(j));
+        }
+    }
+    CHECK(sent == received);
+
+    // 删除后不再有事件
+    for (int i=0; i<3; ++i)
+    {
+        uring_poller.del_events(&accepted[i]);
+        accepted[i].close();
+    }
+    uring_poller.del_events(&listener);
+    CHECK(1 == write(client_fds[1], "x", 1));
+    CHECK(-1 != connect_to(port));
+    CHECK(0 == uring_poller.timed_wait(10));
+    ::close(client_fds[1]);
+    ::close(client_fds[2]);
+}
+
+// Ping-Pong：每个连接的两端都把收到的数据原样发回，同时在途的数据始终是一个消息
+class CPingPong
+{
+public:
+    CPingPong(int connections, int message_size)
+        :_connections(connections)
+        ,_message_size(message_size)
+        ,_bytes(0)
+    {
+        uint16_t port;
+        int listen_fd = listen_any(&port, 1024);
+        _sockets = new CSocket[connections * 2];
+        for (int i=0; i<connections; ++i)
+        {
+            _sockets[i*2].attach(connect_to(port));
+            _sockets[i*2+1].attach(accept(listen_fd, NULL, NULL));
+            net::set_nodelay(_sockets[i*2].get_fd(), true);
+            net::set_nodelay(_sockets[i*2+1].get_fd(), true);
+            _sockets[i*2].set_nonblock(true);
+            _sockets[i*2+1].set_nonblock(true);
+        }
+        ::close(listen_fd);
+        _buffer = new char[message_size];
+        memset(_buffer, 'p', message_size);
+        _messages = new char[(size_t)connections * 2 * message_size];
+        _message_sizes = new ssize_t[connections * 2];
+    }
+
+    ~CPingPong()
+    {
+        delete []_sockets;
+        delete []_buffer;
+        delete []_messages;
+        delete []_message_sizes;
+    }
+
+    /***
+      * @switch_events: 按server::CWorkThread的方式，收到后改为等待可写，发送后再改回等待可读，
+      *                 每个消息要修改两次事件
+      */
+    void run(const char* name, net::poller_engine_t engine, uint32_t seconds, bool switch_events)
+    {
+        net::CEpoller epoller;
+        epoller.create(_connections * 2, engine);
+        CHECK(engine == epoller.get_engine());
+        for (int i=0; i<_connections*2; ++i)
+            epoller.set_events(&_sockets[i], EPOLLIN);
+        start();
+
+        sys::CStopWatch stop_watch;
+        uint64_t waits = 0;
+        while (stop_watch.get_total_elapsed_microseconds() < seconds * 1000000)
+        {
+            int n = epoller.timed_wait(1000);
+            ++waits;
+            for (int i=0; i<n; ++i)
+            {
+                net::CEpollable* epollable = epoller.get(i);
+                if (!switch_events)
+                {
+                    ssize_t bytes = recv(epollable->get_fd(), _buffer, _message_size, 0);
+                    if (bytes > 0)
+                        echo(epollable, _buffer, bytes);
+                    continue;
+                }
+
+                int index = static_cast<CSocket*>(epollable) - _sockets;
+                char* message = _messages + (size_t)index * _message_size;
+                if (epoller.get_events(i) & EPOLLIN)
+                {
+                    ssize_t bytes = recv(epollable->get_fd(), message, _message_size, 0);
+                    if (bytes > 0)
+                    {
+                        _message_sizes[index] = bytes;
+                        epoller.set_events(epollable, EPOLLOUT);
+                    }
+                }
+                else if (epoller.get_events(i) & EPOLLOUT)
+                {
+                    echo(epollable, message, _message_sizes[index]);
+                    epoller.set_events(epollable, EPOLLIN);
+                }
+            }
+        }
+
+        report(name, stop_watch.get_total_elapsed_microseconds(), waits);
+        for (int i=0; i<_connections*2; ++i)
+            epoller.del_events(&_sockets[i]);
+        drain();
+    }
+
+    void run_multishot(uint32_t seconds)
+    {
+        // 每个连接在途一个消息，按消息大小和连接数准备Buffer
+        uint16_t buffer_number = 1;
+        while (buffer_number < _connections * 4)
+            buffer_number <<= 1;
+        net::CUringPoller uring_poller;
+        uring_poller.create(_connections * 2, buffer_number, _message_size);
+        for (int i=0; i<_connections*2; ++i)
+            uring_poller.recv_multishot(&_sockets[i]);
+        start();
+
+        sys::CStopWatch stop_watch;
+        uint64_t waits = 0;
+        while (stop_watch.get_total_elapsed_microseconds() < seconds * 1000000)
+        {
+            int n = uring_poller.timed_wait(1000);
+            ++waits;
+            for (int i=0; i<n; ++i)
+            {
+                CHECK(uring_poller.get_result(i) > 0);
+                echo(uring_poller.get(i), uring_poller.get_buffer(i), uring_poller.get_result(i));
+            }
+        }
+
+        report("uring-multishot", stop_watch.get_total_elapsed_microseconds(), waits);
+        for (int i=0; i<_connections*2; ++i)
+            uring_poller.del_events(&_sockets[i]);
+        drain();
+    }
+
+private:
+    void start()
+    {
+        _bytes = 0;
+        for (int i=0; i<_connections; ++i)
+            echo(&_sockets[i*2], _buffer, _message_size);
+    }
+
+    void echo(net::CEpollable* epollable, const char* data, ssize_t size)
+    {
+        // 在途的数据不超过一个消息，不会超过Socket的发送缓冲区
+        CHECK(size == send(epollable->get_fd(), data, size, 0));
+        _bytes += size;
+    }
+
+    void report(const char* name, unsigned int elapsed, uint64_t waits)
+    {
+        fprintf(stdout, "[%s] %d connections, %d bytes: %.1f MB/s, %.0f messages/s, %.2f messages per wait\n"
+            , name, _connections, _message_size
+            , _bytes / (elapsed + 1.0)
+            , _bytes / (double)_message_size / (elapsed / 1000000.0)
+            , (_bytes / (double)_message_size) / (waits + 1.0));
+    }
+
+    void drain()
+    {
+        // 丢弃在途的消息，下一种方式从干净的状态开始
+        usleep(10000);
+        for (int i=0; i<_connections*2; ++i)
+            while (recv(_sockets[i].get_fd(), _buffer, _message_size, 0) > 0);
+    }
+
+private:
+    int _connections;
+    int _message_size;
+    uint64_t _bytes;
+    CSocket* _sockets;
+    char* _buffer;
+    char* _messages; // switch_events时每个连接收到的待发送消息
+    ssize_t* _message_sizes;
+};
+
+int main(int argc, char* argv[])
+{
+    int connections = (argc > 1)? atoi(argv[1]): 100;
+    int message_size = (argc > 2)? atoi(argv[2]): 1024;
+    uint32_t seconds = (argc > 3)? atoi(argv[3]): 2;
+    CHECK((connections > 0) && (message_size > 0));
+
+    test_level_triggered(net::poller_epoll);
+    test_shared_listener(net::poller_epoll);
+    try
+    {
+        net::CUringPoller uring_poller;
+        uring_poller.create(1);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stdout, "io_uring not available: %s\nSUCCESS\n", ex.str().c_str());
+        return 0;
+    }
+    test_level_triggered(net::poller_uring);
+    test_shared_listener(net::poller_uring);
+    test_multishot();
+
+    CPingPong ping_pong(connections, message_size);
+    ping_pong.run("epoll", net::poller_epoll, seconds, false);
+    ping_pong.run("uring-poll", net::poller_uring, seconds, false);
+    ping_pong.run("epoll-switch", net::poller_epoll, seconds, true);
+    ping_pong.run("uring-poll-switch", net::poller_uring, seconds, true);
+    ping_pong.run_multishot(seconds);
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
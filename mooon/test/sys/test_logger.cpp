@@ -0,0 +1,90 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+#include <mooon/sys/logger.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/utils/args_parser.h>
+
+// 队列方式：./test_logger --threads=30 --lines=100000 --ring=0
+// 线程日志环：./test_logger --threads=30 --lines=100000 --ring=1
+// 延迟格式化：./test_logger --threads=30 --lines=100000 --deferred=1
+// 执行完后可用“wc -l test_logger.log”核对日志条数是否为threads*lines，
+// 延迟格式化时需先用“bin_log_decoder test_logger.log”还原成文本
+INTEGER_ARG_DEFINE(int, threads, 10, 1, 1000, "number of threads");
+INTEGER_ARG_DEFINE(int, lines, 100000, 1, 100000000, "number of lines per thread");
+INTEGER_ARG_DEFINE(uint32_t, queue, 1000, 1, 1000000, "size of log queue or slots of per-thread ring");
+INTEGER_ARG_DEFINE(uint8_t, ring, 1, 0, 1, "enable per-thread log ring");
+INTEGER_ARG_DEFINE(uint8_t, deferred, 0, 0, 1, "enable deferred-format binary log");
+STRING_ARG_DEFINE(dir, ".", "directory of log file");
+MOOON_NAMESPACE_USE
+
+static void foo(sys::CLogger* logger, int index)
+{
+    for (int i=0; i<argument::lines->value(); ++i)
+    {
+        __MYLOG_INFO(logger, "test", "thread[%d] line[%d]: %s %.2f\n", index, i, "hello", i/100.0);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        exit(1);
+    }
+
+    try
+    {
+        sys::CLogger* logger = new sys::CLogger;
+        logger->create(argument::dir->c_value(), "test_logger.log", argument::queue->value(), 1==argument::ring->value(), 1==argument::deferred->value());
+        logger->set_single_filesize(1024*1024*1024);
+
+        sys::CStopWatch stop_watch;
+        sys::CThreadEngine** threads = new sys::CThreadEngine*[argument::threads->value()];
+        for (int i=0; i<argument::threads->value(); ++i)
+        {
+            threads[i] = new sys::CThreadEngine(sys::bind(&foo, logger, i));
+        }
+        for (int i=0; i<argument::threads->value(); ++i)
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+        delete []threads;
+
+        unsigned int elapsed_microseconds = stop_watch.get_elapsed_microseconds();
+        int total_lines = argument::lines->value() * argument::threads->value();
+        fprintf(stdout, "%s: %d lines, %u microseconds, %.2f lines/second\n"
+            , (1==argument::deferred->value())? "deferred": ((1==argument::ring->value())? "ring": "queue")
+            , total_lines, elapsed_microseconds
+            , (elapsed_microseconds > 0)? total_lines * 1000000.0 / elapsed_microseconds: 0.0);
+
+        // 等待日志线程将所有日志写入文件后退出
+        logger->destroy();
+    }
+    catch (sys::CSyscallException& syscall_ex)
+    {
+        fprintf(stderr, "%s\n", syscall_ex.str().c_str());
+        exit(1);
+    }
+
+    return 0;
+}
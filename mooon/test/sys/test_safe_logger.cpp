@@ -37,6 +37,8 @@
 // 压测滚动6：./test_safe_logger --lines=1000 --size=1024000 --processes=2 --threads=10
 // 压测滚动7：./test_safe_logger --lines=2000 --size=1024000 --processes=10 --threads=10
 // 压测滚动8：./test_safe_logger --lines=5000 --size=1024000 --processes=10 --threads=10
+// 异步模式：./test_safe_logger --lines=10000 --size=1024000 --processes=2 --threads=10 --async=8388608
+// 异步丢弃：./test_safe_logger --lines=10000 --size=1024000 --processes=1 --threads=10 --async=131072 --drop=1
 
 INTEGER_ARG_DEFINE(int, threads, 10, 1, 100, "number of threads");
 INTEGER_ARG_DEFINE(int, processes, 10, 1, 100, "number of processes");
@@ -44,6 +46,8 @@ INTEGER_ARG_DEFINE(int, lines, 10000, 1, 100000000, "number of lines");
 INTEGER_ARG_DEFINE(uint32_t, size, 1024*1024*800, 1024, 1024*1024*2000, "size of a single log file");
 INTEGER_ARG_DEFINE(uint16_t, backup, 1000, 1, 10000, "backup number of log file");
 INTEGER_ARG_DEFINE(uint8_t, enable_syslog, 0, 0, 1, "enable write syslog when error");
+INTEGER_ARG_DEFINE(uint32_t, async, 0, 0, 1024*1024*1024, "async buffer size, 0 to write synchronously");
+INTEGER_ARG_DEFINE(uint8_t, drop, 0, 0, 1, "drop lines when async buffer is full");
 STRING_ARG_DEFINE(suffix, "", "suffix of log filename");
 MOOON_NAMESPACE_USE
 
@@ -87,6 +91,9 @@ static void foo(int index)
         ++lines;
     }
 
+    // 异步丢弃模式下FATAL日志也不能丢，日志文件中应有processes*threads行"finished"
+    MYLOG_FATAL("thread %d finished\n", index);
+
     delete []str;
     //fprintf(stdout, "thread(%u,%lu) exit now: %d\n", getpid(), pthread_self(), lines);
 }
@@ -103,7 +110,10 @@ int main(int argc, char* argv[])
     try
     {
         pid_t pid;
-        ::mooon::sys::g_logger = sys::create_safe_logger(true, SIZE_8K, argument::suffix->value(), 1==mooon::argument::enable_syslog->value());
+        sys::CSafeLogger* logger = sys::create_safe_logger(true, SIZE_8K, argument::suffix->value(), 1==mooon::argument::enable_syslog->value(), argument::async->value());
+        if (1 == argument::drop->value())
+            logger->set_async_overflow_policy(sys::ASYNC_OVERFLOW_DROP);
+        ::mooon::sys::g_logger = logger;
         sys::g_logger->set_single_filesize(argument::size->value());
         sys::g_logger->set_backup_number(argument::backup->value());
         sys::g_logger->set_log_level(sys::LOG_LEVEL_DETAIL);
@@ -139,6 +149,7 @@ int main(int argc, char* argv[])
 
                 if (argument::processes->value() > 1)
                 {
+                    logger->flush();
                     exit(0);
                 }
             }
@@ -146,6 +157,7 @@ int main(int argc, char* argv[])
 
         MYLOG_INFO("hello\n");
         MYLOG_ERROR("%s\n", "world");
+        fprintf(stdout, "dropped lines: %" PRIu64"\n", logger->get_async_dropped_number());
         delete ::mooon::sys::g_logger;
         ::mooon::sys::g_logger = NULL;
 
@@ -178,10 +190,12 @@ int main(int argc, char* argv[])
         int thread_lines = mooon::argument::lines->value();
         int all_threads_lines = thread_lines * argument::threads->value();
         int all_processes_lines = all_threads_lines * mooon::argument::processes->value();
-        int total_lines = 2 + all_processes_lines;
+        int fatal_lines = argument::threads->value() * mooon::argument::processes->value();
+        int total_lines = 2 + all_processes_lines + fatal_lines;
         fprintf(stdout, "thread lines: %d\n", thread_lines);
         fprintf(stdout, "all threads lines: %d\n", all_threads_lines);
         fprintf(stdout, "all processes lines: %d\n", all_processes_lines);
+        fprintf(stdout, "fatal lines: %d\n", fatal_lines);
         fprintf(stdout, "total lines: %d\n", total_lines);
         fprintf(stdout, "press ENTER to exit\n");
         //getchar();
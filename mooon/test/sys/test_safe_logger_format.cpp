@@ -0,0 +1,92 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: jian yi, eyjian@qq.com or eyjian@gmail.com or eyjian@live.com
+ */
+// CSafeLogger::do_log格式化开销的微基准测试，
+// 日志级别为INFO，每轮交替写一条DEBUG（被过滤）和一条INFO日志，
+// 异步模式下写文件由后台线程完成，测得的主要是格式化和追加到缓冲区的开销
+//
+// 同步：./test_safe_logger_format --lines=1000000 --dir=/dev/shm
+// 异步：./test_safe_logger_format --lines=1000000 --dir=/dev/shm --async=67108864
+#include <mooon/sys/safe_logger.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/utils/args_parser.h>
+
+INTEGER_ARG_DEFINE(int, threads, 1, 1, 100, "number of threads");
+INTEGER_ARG_DEFINE(int, lines, 1000000, 1, 100000000, "number of INFO lines per thread");
+INTEGER_ARG_DEFINE(uint32_t, async, 0, 0, 1024*1024*1024, "async buffer size, 0 to write synchronously");
+STRING_ARG_DEFINE(dir, "/tmp", "directory of log file");
+MOOON_NAMESPACE_USE
+
+static void foo(int index)
+{
+    for (int i=0; i<argument::lines->value(); ++i)
+    {
+        MYLOG_DEBUG("thread[%d] debug line[%d]\n", index, i);
+        MYLOG_INFO("thread[%d] info line[%d]: %s\n", index, i, "hello world");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string errmsg;
+    if (!utils::parse_arguments(argc, argv, &errmsg))
+    {
+        fprintf(stderr, "%s\n", errmsg.c_str());
+        exit(1);
+    }
+
+    try
+    {
+        sys::CSafeLogger* logger = new sys::CSafeLogger(argument::dir->c_value(), "test_safe_logger_format.log", SIZE_8K, false, argument::async->value());
+        logger->set_single_filesize(2000000000);
+        logger->set_log_level(sys::LOG_LEVEL_INFO);
+        sys::g_logger = logger;
+
+        sys::CStopWatch stop_watch;
+        sys::CThreadEngine** threads = new sys::CThreadEngine*[argument::threads->value()];
+        for (int i=0; i<argument::threads->value(); ++i)
+        {
+            threads[i] = new sys::CThreadEngine(sys::bind(&foo, i));
+        }
+        for (int i=0; i<argument::threads->value(); ++i)
+        {
+            threads[i]->join();
+            delete threads[i];
+        }
+        delete []threads;
+        unsigned int elapsed_microseconds = stop_watch.get_elapsed_microseconds();
+
+        // 不计入异步模式最后一次写文件的时间
+        sys::g_logger = NULL;
+        delete logger;
+
+        long long total_lines = static_cast<long long>(argument::lines->value()) * argument::threads->value();
+        fprintf(stdout, "%s, %d threads: %lld lines, %u microseconds, %.1f ns/line\n"
+            , (argument::async->value() > 0)? "async": "sync"
+            , argument::threads->value(), total_lines, elapsed_microseconds
+            , elapsed_microseconds * 1000.0 * argument::threads->value() / total_lines);
+    }
+    catch (sys::CSyscallException& syscall_ex)
+    {
+        fprintf(stderr, "%s\n", syscall_ex.str().c_str());
+        exit(1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,182 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CAdaptiveLock和CAdaptiveEvent的测试，并和CLock比较竞争下的性能
+// 用法：ut_adaptive_lock [线程数]
+#include <mooon/sys/adaptive_lock.h>
+#include <mooon/sys/event.h>
+#include <mooon/sys/lock.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/sys/utils.h>
+#include "../ut_utils.h"
+#include <stdlib.h>
+MOOON_NAMESPACE_USE
+
+static const int sg_loops = 200000;
+static int64_t sg_counter = 0;
+
+template <class LockClass>
+static void increase(LockClass* lock)
+{
+    for (int i=0; i<sg_loops; ++i)
+    {
+        sys::LockHelper<LockClass> lh(*lock);
+        ++sg_counter;
+    }
+}
+
+template <class LockClass>
+static unsigned int contend(LockClass* lock, int threads)
+{
+    sys::CStopWatch stop_watch;
+    sys::CThreadEngine** engines = new sys::CThreadEngine*[threads];
+
+    sg_counter = 0;
+    for (int i=0; i<threads; ++i)
+        engines[i] = new sys::CThreadEngine(sys::bind(&increase<LockClass>, lock));
+    for (int i=0; i<threads; ++i)
+    {
+        engines[i]->join();
+        delete engines[i];
+    }
+    delete []engines;
+
+    CHECK(sg_counter == static_cast<int64_t>(sg_loops) * threads);
+    return stop_watch.get_elapsed_microseconds();
+}
+
+static void test_lock(int threads)
+{
+    sys::CLock lock;
+    sys::CAdaptiveLock adaptive_lock("ut.adaptive_lock");
+
+    unsigned int elapsed = contend(&lock, threads);
+    fprintf(stdout, "[CLock] %d threads x %d: %u us\n", threads, sg_loops, elapsed);
+
+    elapsed = contend(&adaptive_lock, threads);
+    sys::lock_stats_t stats;
+    adaptive_lock.get_stats(&stats);
+    fprintf(stdout, "[CAdaptiveLock] %d threads x %d: %u us, contended=%llu, parked=%llu, wait=%llu ns\n"
+        , threads, sg_loops, elapsed
+        , (unsigned long long)stats.contended_number, (unsigned long long)stats.parked_number, (unsigned long long)stats.wait_nanoseconds);
+    CHECK(stats.acquire_number == static_cast<uint64_t>(sg_loops) * threads);
+    CHECK(stats.contended_number >= stats.parked_number);
+
+    // try_lock和timed_lock
+    CHECK(adaptive_lock.try_lock());
+    CHECK(!adaptive_lock.try_lock());
+    uint64_t start = sys::get_monotonic_milliseconds();
+    CHECK(!adaptive_lock.timed_lock(50));
+    CHECK(sys::get_monotonic_milliseconds() - start >= 50);
+    adaptive_lock.unlock();
+    CHECK(adaptive_lock.timed_lock(50));
+    adaptive_lock.unlock();
+}
+
+static void test_all_stats()
+{
+    sys::CAdaptiveLock* locks = new sys::CAdaptiveLock[10];
+    for (int i=0; i<10; ++i)
+    {
+        locks[i].enable_stats("ut.lock_array");
+        locks[i].lock();
+        locks[i].unlock();
+    }
+
+    sys::CAdaptiveLock unnamed_lock;
+    unnamed_lock.lock();
+    unnamed_lock.unlock();
+
+    std::vector<std::pair<std::string, sys::lock_stats_t> > all_stats;
+    sys::CAdaptiveLock::get_all_stats(&all_stats);
+    CHECK(1 == all_stats.size());
+    CHECK("ut.lock_array" == all_stats[0].first);
+    CHECK(10 == all_stats[0].second.acquire_number);
+
+    delete []locks;
+    sys::CAdaptiveLock::get_all_stats(&all_stats);
+    CHECK(all_stats.empty());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 生产者消费者，验证CAdaptiveEvent不会丢失唤醒
+
+static sys::CAdaptiveLock sg_queue_lock;
+static sys::CAdaptiveEvent sg_queue_event;
+static int sg_queue_size = 0;
+static int sg_consumed = 0;
+
+static void produce(int number)
+{
+    for (int i=0; i<number; ++i)
+    {
+        sys::LockHelper<sys::CAdaptiveLock> lh(sg_queue_lock);
+        ++sg_queue_size;
+        sg_queue_event.signal();
+    }
+}
+
+static void consume(int number)
+{
+    for (int i=0; i<number; ++i)
+    {
+        sys::LockHelper<sys::CAdaptiveLock> lh(sg_queue_lock);
+        while (0 == sg_queue_size)
+            sg_queue_event.wait(sg_queue_lock);
+        --sg_queue_size;
+        ++sg_consumed;
+    }
+}
+
+static void test_event(int threads)
+{
+    const int number = 100000;
+    sys::CThreadEngine** consumers = new sys::CThreadEngine*[threads];
+
+    for (int i=0; i<threads; ++i)
+        consumers[i] = new sys::CThreadEngine(sys::bind(&consume, number));
+    sys::CThreadEngine producer(sys::bind(&produce, number * threads));
+
+    producer.join();
+    for (int i=0; i<threads; ++i)
+    {
+        consumers[i]->join();
+        delete consumers[i];
+    }
+    delete []consumers;
+    CHECK(number * threads == sg_consumed);
+    CHECK(0 == sg_queue_size);
+
+    // 超时
+    sys::LockHelper<sys::CAdaptiveLock> lh(sg_queue_lock);
+    CHECK(!sg_queue_event.timed_wait(sg_queue_lock, 20));
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = (argc > 1)? atoi(argv[1]): 4;
+    CHECK(threads > 0);
+
+    test_lock(threads);
+    test_all_stats();
+    test_event(threads);
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CCpuAffinity的测试，以及CThreadPool按亲和配置绑定线程
+#include <mooon/sys/cpu_affinity.h>
+#include <mooon/sys/pool_thread.h>
+#include <mooon/sys/thread_pool.h>
+#include <mooon/utils/string_utils.h>
+#include "../ut_utils.h"
+#include <stdlib.h>
+MOOON_NAMESPACE_USE
+
+static void test_parse_cpu_list()
+{
+    std::vector<int> cpus;
+
+    CHECK(sys::CCpuAffinity::parse_cpu_list("0-3,8,10-11", &cpus));
+    CHECK(7 == cpus.size());
+    CHECK((0 == cpus[0]) && (3 == cpus[3]) && (8 == cpus[4]) && (11 == cpus[6]));
+
+    cpus.clear();
+    CHECK(sys::CCpuAffinity::parse_cpu_list("", &cpus));
+    CHECK(cpus.empty());
+
+    CHECK(!sys::CCpuAffinity::parse_cpu_list("3-1", &cpus));
+    CHECK(!sys::CCpuAffinity::parse_cpu_list("a", &cpus));
+    CHECK(!sys::CCpuAffinity::parse_cpu_list("1;2", &cpus));
+    CHECK(!sys::CCpuAffinity::parse_cpu_list("-1", &cpus));
+}
+
+static void test_parse()
+{
+    sys::CCpuAffinity affinity;
+
+    affinity.parse("");
+    CHECK(!affinity.is_enabled());
+    CHECK(-1 == affinity.get_thread_cpu(0));
+
+    // 两种策略都应包含所有可用的CPU，只是顺序不同
+    affinity.parse("spread");
+    std::vector<int> spread_cpus = affinity.get_cpus();
+    affinity.parse("compact");
+    std::vector<int> compact_cpus = affinity.get_cpus();
+    CHECK(!spread_cpus.empty());
+    CHECK(spread_cpus.size() == compact_cpus.size());
+    fprintf(stdout, "numa nodes: %d, cpus: %d\n", sys::CCpuAffinity::get_numa_node_number(), (int)spread_cpus.size());
+    for (size_t i=0; i<spread_cpus.size(); ++i)
+    {
+        fprintf(stdout, "spread[%d]=%d(node%d), compact[%d]=%d(node%d)\n"
+            , (int)i, spread_cpus[i], sys::CCpuAffinity::get_cpu_numa_node(spread_cpus[i])
+            , (int)i, compact_cpus[i], sys::CCpuAffinity::get_cpu_numa_node(compact_cpus[i]));
+    }
+
+    // 超过CPU个数的线程循环使用
+    uint16_t n = static_cast<uint16_t>(compact_cpus.size());
+    CHECK(affinity.get_thread_cpu(n) == affinity.get_thread_cpu(0));
+
+    affinity.parse(utils::CStringUtils::int_tostring(spread_cpus[0]));
+    CHECK(1 == affinity.get_cpus().size());
+
+    try
+    {
+        affinity.parse("0-x");
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(EINVAL == ex.errcode());
+    }
+
+    try
+    {
+        affinity.parse("1000"); // 不可用的CPU
+        CHECK(false);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        CHECK(EINVAL == ex.errcode());
+    }
+}
+
+class CTestThread: public sys::CPoolThread
+{
+public:
+    CTestThread()
+        :cpu(-2)
+    {
+    }
+
+private:
+    virtual void run()
+    {
+        cpu = sys::CCpuAffinity::get_current_cpu();
+        do_millisleep(-1);
+    }
+
+public:
+    volatile int cpu;
+};
+
+static void test_thread_pool()
+{
+    sys::CCpuAffinity affinity;
+    sys::CThreadPool<CTestThread> thread_pool;
+    uint16_t thread_count = 4;
+
+    affinity.parse("compact");
+    thread_pool.create(thread_count, NULL, "compact");
+    thread_pool.activate();
+
+    CTestThread** threads = thread_pool.get_thread_array();
+    for (uint16_t i=0; i<thread_count; ++i)
+    {
+        while (-2 == threads[i]->cpu)
+            sys::CUtils::millisleep(1);
+
+        CHECK(threads[i]->get_cpu_affinity() == affinity.get_thread_cpu(i));
+        CHECK(threads[i]->cpu == affinity.get_thread_cpu(i));
+    }
+
+    thread_pool.destroy();
+}
+
+static void test_numa_policy()
+{
+    // 不管是否NUMA系统，都不应影响内存分配
+    sys::CNumaPolicyHelper numa_policy_helper(sys::CCpuAffinity::get_cpu_numa_node(0));
+    char* buffer = new char[1024*1024];
+    memset(buffer, 0, 1024*1024);
+    delete []buffer;
+}
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        test_parse_cpu_list();
+        test_parse();
+        test_thread_pool();
+        test_numa_policy();
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "exception: %s\n", ex.str().c_str());
+        exit(1);
+    }
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
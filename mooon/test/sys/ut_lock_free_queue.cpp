@@ -0,0 +1,158 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CLockFreeEventQueue的测试：多生产者多消费者下不丢不重，并和CEventQueue比较吞吐
+// 用法：ut_lock_free_queue [生产者个数] [消费者个数]
+#include <mooon/sys/event_queue.h>
+#include <mooon/sys/lock_free_queue.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/utils/array_queue.h>
+#include "../ut_utils.h"
+#include <stdlib.h>
+MOOON_NAMESPACE_USE
+
+static const int sg_times = 1000000; // 每个生产者入队的个数
+
+template <class QueueClass>
+class CTester
+{
+public:
+    CTester(int producers, int consumers)
+        :_producers(producers)
+        ,_consumers(consumers)
+        ,_queue(1024, 1000, 1000)
+        ,_sum(0)
+        ,_number(0)
+    {
+    }
+
+    void run(const char* name)
+    {
+        sys::CStopWatch stop_watch;
+        sys::CThreadEngine** engines = new sys::CThreadEngine*[_producers+_consumers];
+
+        for (int i=0; i<_consumers; ++i)
+            engines[i] = new sys::CThreadEngine(sys::bind(&CTester::consume, this));
+        for (int i=0; i<_producers; ++i)
+            engines[_consumers+i] = new sys::CThreadEngine(sys::bind(&CTester::produce, this));
+        for (int i=_consumers; i<_producers+_consumers; ++i)
+        {
+            engines[i]->join();
+            delete engines[i];
+        }
+
+        // 所有生产者结束后，再为每个消费者放一个结束标志
+        for (int i=0; i<_consumers; ++i)
+        {
+            while (!_queue.push_back(-1))
+                ;
+        }
+        for (int i=0; i<_consumers; ++i)
+        {
+            engines[i]->join();
+            delete engines[i];
+        }
+        delete []engines;
+
+        unsigned int elapsed = stop_watch.get_elapsed_microseconds();
+        int64_t n = static_cast<int64_t>(_producers) * sg_times;
+        fprintf(stdout, "[%s] %d producers, %d consumers: %.1f ns/message, %.0f messages/s\n"
+            , name, _producers, _consumers, elapsed * 1000.0 / n, n * 1000000.0 / elapsed);
+
+        // 每个值恰好被消费一次
+        CHECK(_number == n);
+        CHECK(_sum == static_cast<int64_t>(_producers) * sg_times * (sg_times - 1) / 2);
+    }
+
+private:
+    void produce()
+    {
+        for (int i=0; i<sg_times; ++i)
+        {
+            while (!_queue.push_back(i))
+                ;
+        }
+    }
+
+    void consume()
+    {
+        int64_t sum = 0;
+        int64_t number = 0;
+
+        while (true)
+        {
+            int elem;
+            if (!_queue.pop_front(elem))
+                continue;
+            if (-1 == elem)
+                break;
+
+            sum += elem;
+            ++number;
+        }
+
+        __sync_add_and_fetch(&_sum, sum);
+        __sync_add_and_fetch(&_number, number);
+    }
+
+private:
+    int _producers;
+    int _consumers;
+    QueueClass _queue;
+    volatile int64_t _sum;
+    volatile int64_t _number;
+};
+
+static void test_timeout()
+{
+    sys::CLockFreeEventQueue<int> queue(2, 100, 100);
+    int elem;
+
+    sys::CStopWatch stop_watch;
+    CHECK(!queue.pop_front(elem));
+    CHECK(stop_watch.get_elapsed_microseconds() >= 100000);
+
+    CHECK(queue.push_back(1));
+    CHECK(queue.push_back(2));
+    CHECK(queue.is_full());
+    stop_watch.restart();
+    CHECK(!queue.push_back(3));
+    CHECK(stop_watch.get_elapsed_microseconds() >= 100000);
+
+    CHECK(queue.pop_front(elem) && (1 == elem));
+    CHECK(queue.pop_front(elem) && (2 == elem));
+    CHECK(queue.is_empty());
+}
+
+int main(int argc, char* argv[])
+{
+    int producers = (argc > 1)? atoi(argv[1]): 4;
+    int consumers = (argc > 2)? atoi(argv[2]): 4;
+    CHECK((producers > 0) && (consumers > 0));
+
+    test_timeout();
+
+    // 作为CEventQueue的RawQueueClass使用
+    CTester<sys::CEventQueue<sys::CLockFreeQueue<int> > >(producers, consumers).run("CEventQueue<CLockFreeQueue>");
+    CTester<sys::CEventQueue<utils::CArrayQueue<int> > >(producers, consumers).run("CEventQueue<CArrayQueue>");
+    CTester<sys::CLockFreeEventQueue<int> >(producers, consumers).run("CLockFreeEventQueue");
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
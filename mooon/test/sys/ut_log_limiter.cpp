@@ -0,0 +1,232 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 限流和采样日志宏的测试，用一个只计数的ILogger代替真实的日志器
+#include <mooon/sys/atomic.h>
+#include <mooon/sys/log.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include <mooon/sys/utils.h>
+#include <stdarg.h>
+#include <string.h>
+MOOON_NAMESPACE_USE
+
+class CCountLogger: public sys::ILogger
+{
+public:
+    CCountLogger()
+    {
+        atomic_set(&_lines, 0);
+        atomic_set(&_suppressed, 0);
+    }
+
+    void reset()
+    {
+        atomic_set(&_lines, 0);
+        atomic_set(&_suppressed, 0);
+    }
+
+    int lines() const { return atomic_read(&_lines); }
+    int suppressed() const { return atomic_read(&_suppressed); }
+
+    virtual bool enabled_error() { return true; }
+    virtual bool enabled_info() { return true; }
+
+    virtual void log_error(const char* filename, int lineno, const char* module_name, const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        count(format, args);
+        va_end(args);
+    }
+
+    virtual void log_info(const char* filename, int lineno, const char* module_name, const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        count(format, args);
+        va_end(args);
+    }
+
+private:
+    void count(const char* format, va_list& args)
+    {
+        if (0 == strncmp(format, "suppressed ", sizeof("suppressed ")-1))
+            atomic_add(va_arg(args, unsigned int), &_suppressed);
+        else
+            atomic_inc(&_lines);
+    }
+
+private:
+    atomic_t _lines;
+    atomic_t _suppressed;
+};
+
+static CCountLogger* sg_logger = NULL;
+
+static void rate_limited(int times)
+{
+    for (int i=0; i<times; ++i)
+        __MYLOG_RATELIMIT(ERROR, sg_logger, NULL, 100, 10, "error %d\n", i);
+}
+
+static void sampled(int times)
+{
+    for (int i=0; i<times; ++i)
+        __MYLOG_SAMPLE(INFO, sg_logger, NULL, 100, "info %d\n", i);
+}
+
+// 每200毫秒最多1条
+static void every_200ms(int times)
+{
+    for (int i=0; i<times; ++i)
+        __MYLOG_EVERY(ERROR, sg_logger, NULL, 200, "error %d\n", i);
+}
+
+static void rate_1ps(int times)
+{
+    for (int i=0; i<times; ++i)
+        __MYLOG_RATELIMIT(ERROR, sg_logger, NULL, 1, 1, "error %d\n", i);
+}
+
+static void sample_1000(int times)
+{
+    for (int i=0; i<times; ++i)
+        __MYLOG_SAMPLE(INFO, sg_logger, NULL, 1000, "info %d\n", i);
+}
+
+static void check(bool ok, const char* tag)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "[%s] FAILURE: lines %d, suppressed %d\n", tag, sg_logger->lines(), sg_logger->suppressed());
+        exit(1);
+    }
+}
+
+// 低于每秒1条的频率：1.1秒内每10毫秒调用一次，只记录6条
+static void test_period()
+{
+    sg_logger->reset();
+    for (int i=0; i<110; ++i)
+    {
+        every_200ms(1);
+        sys::CUtils::millisleep(10);
+    }
+
+    fprintf(stdout, "[PERIOD] lines: %d, suppressed reported: %d\n", sg_logger->lines(), sg_logger->suppressed());
+    check((sg_logger->lines() >= 5) && (sg_logger->lines() <= 7), "PERIOD");
+    check(sg_logger->suppressed() > 90, "PERIOD");
+    check(sg_logger->lines() + sg_logger->suppressed() <= 110, "PERIOD");
+}
+
+// 调用点不再记录日志后，被抑制的条数由log_limiter_flush()补记
+static void test_flush_quiet()
+{
+    sys::log_limiter_flush(true); // 清掉之前测试遗留的
+    sg_logger->reset();
+
+    rate_1ps(100);
+    sample_1000(100);
+    check(2 == sg_logger->lines(), "FLUSH");
+
+    // 限流的调用点在又可以记录之前、采样的调用点在第一次检查时都还不算停止
+    sys::log_limiter_flush();
+    check(0 == sg_logger->suppressed(), "FLUSH");
+
+    sys::CUtils::millisleep(1100);
+    sys::log_limiter_flush();
+    fprintf(stdout, "[FLUSH] lines: %d, suppressed reported: %d\n", sg_logger->lines(), sg_logger->suppressed());
+    check(2 == sg_logger->lines(), "FLUSH");
+    check(99 + 99 == sg_logger->suppressed(), "FLUSH");
+
+    // 已补记的不会再补记
+    sys::log_limiter_flush(true);
+    check(99 + 99 == sg_logger->suppressed(), "FLUSH");
+}
+
+// 日志器析构时补记，之后限流器不再引用它
+static void test_detach()
+{
+    CCountLogger* logger = sg_logger;
+    logger->reset();
+    sample_1000(10);
+    check(0 == logger->suppressed(), "DETACH");
+
+    sys::log_limiter_detach(logger);
+    check(10 == logger->suppressed(), "DETACH");
+
+    sg_logger = new CCountLogger;
+    sys::log_limiter_flush(true);
+    check(0 == sg_logger->suppressed(), "DETACH");
+    delete logger;
+}
+
+static void run_threads(void (*func)(int), int threads, int times)
+{
+    sys::CThreadEngine** engines = new sys::CThreadEngine*[threads];
+    for (int i=0; i<threads; ++i)
+        engines[i] = new sys::CThreadEngine(sys::bind(func, times));
+    for (int i=0; i<threads; ++i)
+    {
+        engines[i]->join();
+        delete engines[i];
+    }
+    delete []engines;
+}
+
+int main(int argc, char* argv[])
+{
+    const int threads = 8;
+    const int times = 1000000;
+    sg_logger = new CCountLogger;
+
+    // 1-in-100采样：记录的条数是确定的，汇总的被抑制条数加上记录的条数应等于调用次数
+    run_threads(&sampled, threads, times);
+    __MYLOG_SAMPLE(INFO, sg_logger, NULL, 1, "info\n"); // n为1时总是记录
+    fprintf(stdout, "[SAMPLE] lines: %d (expected %d), suppressed reported: %d\n"
+        , sg_logger->lines(), threads*times/100+1, sg_logger->suppressed());
+    if (sg_logger->lines() != threads*times/100+1)
+    {
+        fprintf(stderr, "[SAMPLE] FAILURE\n");
+        exit(1);
+    }
+
+    // 每秒100条、突发10条的限流：记录的条数不应超过10+100*秒数
+    sg_logger->reset();
+    sys::CStopWatch stop_watch;
+    run_threads(&rate_limited, threads, times);
+    unsigned int elapsed_microseconds = stop_watch.get_elapsed_microseconds();
+    int lines_max = 10 + static_cast<int>(100.0 * elapsed_microseconds / 1000000) + 1;
+    fprintf(stdout, "[RATE] lines: %d (max %d), suppressed reported: %d, %u microseconds, %.1f ns/call\n"
+        , sg_logger->lines(), lines_max, sg_logger->suppressed(), elapsed_microseconds
+        , elapsed_microseconds * 1000.0 / times);
+    if ((sg_logger->lines() < 10) || (sg_logger->lines() > lines_max))
+    {
+        fprintf(stderr, "[RATE] FAILURE\n");
+        exit(1);
+    }
+
+    test_period();
+    test_flush_quiet();
+    test_detach();
+
+    delete sg_logger;
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
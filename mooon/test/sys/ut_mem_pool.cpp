@@ -0,0 +1,191 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CThreadMemPool和CThreadObjectPool的测试，比较有无线程缓存时多线程分配回收的性能
+#include <mooon/sys/mem_pool.h>
+#include <mooon/sys/object_pool.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include "../ut_utils.h"
+#include <sched.h>
+#include <string.h>
+MOOON_NAMESPACE_USE
+
+static volatile bool sg_slow_reset = false; // 加大重复归还时检查和设置之间的窗口
+
+class CObject: public sys::CPoolObject
+{
+public:
+    CObject(): _value(0) {}
+    void reset() { if (sg_slow_reset) sched_yield(); _value = 0; }
+    int _value;
+};
+
+static sys::CThreadMemPool* sg_mem_pool = NULL;
+static sys::CThreadObjectPool<CObject>* sg_object_pool = NULL;
+
+// 每次分配若干个再全部回收，模拟请求处理过程
+static void mem_pool_worker(int times)
+{
+    void* buckets[8];
+
+    for (int i=0; i<times; ++i)
+    {
+        for (int j=0; j<8; ++j)
+        {
+            buckets[j] = sg_mem_pool->allocate();
+            memset(buckets[j], j, sg_mem_pool->get_bucket_size()-sg_mem_pool->get_guard_size());
+        }
+        for (int j=0; j<8; ++j)
+            CHECK(sg_mem_pool->reclaim(buckets[j]));
+    }
+}
+
+static void object_pool_worker(int times)
+{
+    CObject* objects[8];
+
+    for (int i=0; i<times; ++i)
+    {
+        for (int j=0; j<8; ++j)
+        {
+            objects[j] = sg_object_pool->borrow();
+            CHECK(0 == objects[j]->_value);
+            objects[j]->_value = j + 1;
+        }
+        for (int j=0; j<8; ++j)
+            sg_object_pool->pay_back(objects[j]);
+    }
+}
+
+// 多个线程同时归还同一批对象，只能有一个归还成功
+static CObject* sg_borrowed_objects[512];
+static void pay_back_worker(int times)
+{
+    for (int i=0; i<times; ++i)
+        sg_object_pool->pay_back(sg_borrowed_objects[i]);
+}
+
+static unsigned int run_threads(void (*func)(int), int threads, int times)
+{
+    sys::CStopWatch stop_watch;
+    sys::CThreadEngine** engines = new sys::CThreadEngine*[threads];
+
+    for (int i=0; i<threads; ++i)
+        engines[i] = new sys::CThreadEngine(sys::bind(func, times));
+    for (int i=0; i<threads; ++i)
+    {
+        engines[i]->join();
+        delete engines[i];
+    }
+
+    delete []engines;
+    return stop_watch.get_elapsed_microseconds();
+}
+
+static void test_mem_pool(int threads, int times, uint32_t magazine_size)
+{
+    sys::magazine_stats_t stats;
+
+    sg_mem_pool->create(64, 1024, true, 4, 'm', magazine_size);
+    unsigned int elapsed = run_threads(&mem_pool_worker, threads, times);
+    sg_mem_pool->get_stats(&stats);
+    fprintf(stdout, "[MEM_POOL] magazine_size=%u: %.1f ns/op, hits=%llu, misses=%llu, contentions=%llu\n"
+        , magazine_size, elapsed * 1000.0 / (threads * times * 16)
+        , (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.contentions);
+
+    // 线程退出时缓存已还给池
+    CHECK(sg_mem_pool->get_available_number() == sg_mem_pool->get_pool_size());
+}
+
+static void test_object_pool(int threads, int times, uint32_t magazine_size)
+{
+    sys::magazine_stats_t stats;
+
+    sg_object_pool->create(1024, magazine_size);
+    unsigned int elapsed = run_threads(&object_pool_worker, threads, times);
+    sg_object_pool->get_stats(&stats);
+    fprintf(stdout, "[OBJECT_POOL] magazine_size=%u: %.1f ns/op, hits=%llu, misses=%llu, contentions=%llu\n"
+        , magazine_size, elapsed * 1000.0 / (threads * times * 16)
+        , (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.contentions);
+    CHECK(sg_object_pool->get_avaliable_number() == sg_object_pool->get_pool_size());
+}
+
+static void test_checks()
+{
+    sg_mem_pool->create(64, 16, false, 4, 'm');
+
+    // 池用完后不从堆分配
+    void* buckets[16];
+    for (int i=0; i<16; ++i)
+        CHECK((buckets[i] = sg_mem_pool->allocate()) != NULL);
+    CHECK(NULL == sg_mem_pool->allocate());
+    CHECK(sg_mem_pool->reclaim(buckets[0]));
+
+    // 边界不对
+    CHECK(!sg_mem_pool->reclaim(static_cast<char*>(buckets[1])+1));
+
+#ifndef NDEBUG
+    // 重复回收
+    CHECK(!sg_mem_pool->reclaim(buckets[0]));
+
+    // 越界写坏警戒值
+    memset(buckets[2], 0, sg_mem_pool->get_bucket_size());
+    CHECK(!sg_mem_pool->reclaim(buckets[2]));
+#endif // NDEBUG
+
+    // 对象池的重复归还
+    sg_object_pool->create(4);
+    CObject* object = sg_object_pool->borrow();
+    sg_object_pool->pay_back(object);
+    sg_object_pool->pay_back(object);
+    CHECK(4 == sg_object_pool->get_avaliable_number());
+
+    // 有线程缓存时并发的重复归还
+    const int number = sizeof(sg_borrowed_objects) / sizeof(sg_borrowed_objects[0]);
+    sg_object_pool->create(number, 32);
+    sg_slow_reset = true;
+    for (int round=0; round<20; ++round)
+    {
+        for (int i=0; i<number; ++i)
+            CHECK((sg_borrowed_objects[i] = sg_object_pool->borrow()) != NULL);
+        (void)run_threads(&pay_back_worker, 4, number);
+        CHECK(sg_object_pool->get_avaliable_number() == sg_object_pool->get_pool_size());
+    }
+    sg_slow_reset = false;
+}
+
+int main(int argc, char* argv[])
+{
+    const int threads = 8;
+    const int times = 200000;
+
+    sg_mem_pool = new sys::CThreadMemPool;
+    sg_object_pool = new sys::CThreadObjectPool<CObject>(true);
+
+    test_checks();
+    test_mem_pool(threads, times, 0);
+    test_mem_pool(threads, times, 32);
+    test_object_pool(threads, times, 0);
+    test_object_pool(threads, times, 32);
+
+    delete sg_object_pool;
+    delete sg_mem_pool;
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
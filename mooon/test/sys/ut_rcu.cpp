@@ -0,0 +1,179 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CRcuSnapshot的测试：读者在写者不断替换时不会读到已释放的版本，并和读写锁比较读的开销
+// 用法：ut_rcu [读线程数]
+#include <mooon/sys/rcu.h>
+#include <mooon/sys/read_write_lock.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include "../ut_utils.h"
+#include <stdlib.h>
+MOOON_NAMESPACE_USE
+
+#define MAGIC_ALIVE 0x12345678
+#define MAGIC_DEAD  0xdeaddead
+
+struct Config
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t values[16];
+
+    Config(uint32_t version_)
+        :magic(MAGIC_ALIVE)
+        ,version(version_)
+    {
+        for (int i=0; i<16; ++i)
+            values[i] = version;
+    }
+
+    ~Config()
+    {
+        magic = MAGIC_DEAD;
+    }
+};
+
+static sys::CRcuSnapshot<Config> sg_snapshot(new Config(0));
+static volatile bool sg_stop = false;
+static uint64_t sg_reads[64];
+
+static void read_config(int index)
+{
+    uint32_t last_version = 0;
+
+    while (!sg_stop)
+    {
+        sys::CRcuReadHelper rcu_read_helper;
+        const Config* config = sg_snapshot.get();
+
+        // 嵌套读区
+        {
+            sys::CRcuReadHelper nested_rcu_read_helper;
+            CHECK(config == sg_snapshot.get() || config->version < sg_snapshot.get()->version);
+        }
+
+        for (int i=0; i<16; ++i)
+        {
+            CHECK(MAGIC_ALIVE == config->magic);
+            CHECK(config->version == config->values[i]);
+        }
+
+        // 版本只会前进
+        CHECK(config->version >= last_version);
+        last_version = config->version;
+        ++sg_reads[index];
+    }
+}
+
+static void test_update(int threads)
+{
+    const uint32_t updates = 2000;
+    std::vector<sys::CThreadEngine*> readers(threads);
+
+    for (int i=0; i<threads; ++i)
+        readers[i] = new sys::CThreadEngine(sys::bind(&read_config, i));
+
+    sys::CStopWatch stop_watch;
+    for (uint32_t version=1; version<=updates; ++version)
+        sg_snapshot.update(new Config(version));
+    unsigned int elapsed = stop_watch.get_elapsed_microseconds();
+
+    sg_stop = true;
+    uint64_t total_reads = 0;
+    for (int i=0; i<threads; ++i)
+    {
+        readers[i]->join();
+        delete readers[i];
+        total_reads += sg_reads[i];
+    }
+
+    fprintf(stdout, "%d readers, %u updates: %u us per update, %llu reads\n"
+        , threads, updates, elapsed / updates, (unsigned long long)total_reads);
+    CHECK(updates == sg_snapshot.get()->version);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 短生命期的读线程，读者记录应被复用
+
+static void read_once()
+{
+    sys::CRcuReadHelper rcu_read_helper;
+    CHECK(MAGIC_ALIVE == sg_snapshot.get()->magic);
+}
+
+static void test_thread_churn()
+{
+    for (int i=0; i<200; ++i)
+    {
+        sys::CThreadEngine reader(sys::bind(&read_once));
+        sg_snapshot.update(new Config(sg_snapshot.get()->version + 1));
+        reader.join();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 单线程读的开销
+
+static void test_read_cost()
+{
+    const int loops = 10000000;
+    uint64_t sum = 0;
+    sys::CStopWatch stop_watch;
+
+    for (int i=0; i<loops; ++i)
+    {
+        sys::CRcuReadHelper rcu_read_helper;
+        sum += sg_snapshot.get()->values[i % 16];
+    }
+    unsigned int rcu_elapsed = stop_watch.get_elapsed_microseconds();
+
+    sys::CReadWriteLock read_write_lock;
+    Config config(1);
+    stop_watch.restart();
+    for (int i=0; i<loops; ++i)
+    {
+        sys::ReadLockHelper read_lock(read_write_lock);
+        sum += config.values[i % 16];
+    }
+    unsigned int rwlock_elapsed = stop_watch.get_elapsed_microseconds();
+
+    fprintf(stdout, "read cost: rcu %.1f ns, rwlock %.1f ns (sum=%llu)\n"
+        , rcu_elapsed * 1000.0 / loops, rwlock_elapsed * 1000.0 / loops, (unsigned long long)sum);
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = (argc > 1)? atoi(argv[1]): 4;
+    CHECK((threads > 0) && (threads <= 64));
+
+    try
+    {
+        test_update(threads);
+        test_thread_churn();
+        test_read_cost();
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "exception: %s\n", ex.str().c_str());
+        exit(1);
+    }
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
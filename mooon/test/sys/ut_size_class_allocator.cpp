@@ -0,0 +1,161 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CSizeClassAllocator的测试，并和malloc比较多线程下变长分配的性能
+#include <mooon/sys/size_class_allocator.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/thread_engine.h>
+#include "../ut_utils.h"
+#include <stdlib.h>
+#include <string.h>
+MOOON_NAMESPACE_USE
+
+static sys::CSizeClassAllocator* sg_allocator = NULL;
+
+// 消息大小多数较小，偶尔较大
+static size_t random_size(unsigned int* seed)
+{
+    unsigned int r = rand_r(seed);
+    return (r % 16 != 0)? (r % 512): (r % 16384);
+}
+
+static void allocator_worker(int times)
+{
+    void* ptrs[16];
+    size_t sizes[16];
+    unsigned int seed = static_cast<unsigned int>(times);
+
+    for (int i=0; i<times; ++i)
+    {
+        for (int j=0; j<16; ++j)
+        {
+            sizes[j] = random_size(&seed);
+            ptrs[j] = sg_allocator->allocate(sizes[j]);
+            CHECK(0 == reinterpret_cast<unsigned long>(ptrs[j]) % 16);
+            memset(ptrs[j], j, sizes[j]);
+        }
+        for (int j=0; j<16; ++j)
+        {
+            CHECK((0 == sizes[j]) || (static_cast<char*>(ptrs[j])[sizes[j]-1] == j));
+            sg_allocator->reclaim(ptrs[j]);
+        }
+    }
+}
+
+static void malloc_worker(int times)
+{
+    void* ptrs[16];
+    size_t sizes[16];
+    unsigned int seed = static_cast<unsigned int>(times);
+
+    for (int i=0; i<times; ++i)
+    {
+        for (int j=0; j<16; ++j)
+        {
+            sizes[j] = random_size(&seed);
+            ptrs[j] = malloc(sizes[j]);
+            memset(ptrs[j], j, sizes[j]);
+        }
+        for (int j=0; j<16; ++j)
+            free(ptrs[j]);
+    }
+}
+
+static unsigned int run_threads(void (*func)(int), int threads, int times)
+{
+    sys::CStopWatch stop_watch;
+    sys::CThreadEngine** engines = new sys::CThreadEngine*[threads];
+
+    for (int i=0; i<threads; ++i)
+        engines[i] = new sys::CThreadEngine(sys::bind(func, times));
+    for (int i=0; i<threads; ++i)
+    {
+        engines[i]->join();
+        delete engines[i];
+    }
+
+    delete []engines;
+    return stop_watch.get_elapsed_microseconds();
+}
+
+static void test_class_size()
+{
+    size_t last_class_size = 0;
+
+    for (size_t size=0; size<=sys::CSizeClassAllocator::SIZE_CLASS_MAX; ++size)
+    {
+        size_t class_size = sys::CSizeClassAllocator::get_class_size(size);
+
+        // 大小类至少为size，且不超过size的1.5倍
+        CHECK(class_size >= size);
+        CHECK((class_size == sys::CSizeClassAllocator::SIZE_CLASS_MIN) || (class_size*2 <= size*3));
+        CHECK(class_size >= last_class_size);
+        last_class_size = class_size;
+    }
+
+    CHECK(sys::CSizeClassAllocator::SIZE_CLASS_MAX+1 == sys::CSizeClassAllocator::get_class_size(sys::CSizeClassAllocator::SIZE_CLASS_MAX+1));
+}
+
+static void test_large()
+{
+    uint64_t number, bytes;
+    void* ptr = sg_allocator->allocate(1024*1024);
+
+    memset(ptr, 1, 1024*1024);
+    sg_allocator->get_large_stats(&number, &bytes);
+    CHECK(1 == number);
+    CHECK(bytes >= 1024*1024);
+
+    sg_allocator->reclaim(ptr);
+    sg_allocator->get_large_stats(&number, &bytes);
+    CHECK((0 == number) && (0 == bytes));
+}
+
+int main(int argc, char* argv[])
+{
+    const int threads = 8;
+    const int times = 100000;
+    std::vector<sys::size_class_stats_t> stats_array;
+
+    sg_allocator = new sys::CSizeClassAllocator;
+    sg_allocator->create();
+
+    test_class_size();
+    test_large();
+
+    unsigned int elapsed = run_threads(&allocator_worker, threads, times);
+    fprintf(stdout, "[ALLOCATOR] %.1f ns/op\n", elapsed * 1000.0 / (threads * times * 32));
+    elapsed = run_threads(&malloc_worker, threads, times);
+    fprintf(stdout, "[MALLOC] %.1f ns/op\n", elapsed * 1000.0 / (threads * times * 32));
+
+    sg_allocator->get_class_stats(&stats_array);
+    for (size_t i=0; i<stats_array.size(); ++i)
+    {
+        const sys::size_class_stats_t& stats = stats_array[i];
+
+        fprintf(stdout, "class %5u: pool=%u available=%u heap=%llu hits=%llu misses=%llu contentions=%llu\n"
+            , stats.class_size, stats.pool_size, stats.available_number, (unsigned long long)stats.heap_number
+            , (unsigned long long)stats.magazine_stats.hits, (unsigned long long)stats.magazine_stats.misses
+            , (unsigned long long)stats.magazine_stats.contentions);
+        CHECK(stats.available_number == stats.pool_size);
+    }
+
+    delete sg_allocator;
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
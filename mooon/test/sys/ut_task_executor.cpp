@@ -0,0 +1,275 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CTaskExecutor的测试，并和按轮询固定分配给CThreadEngine数组的方式比较不均衡负载
+// 用法：ut_task_executor [线程数]
+#include <mooon/sys/task_executor.h>
+#include <mooon/sys/stop_watch.h>
+#include <mooon/sys/utils.h>
+#include "../ut_utils.h"
+#include <stdlib.h>
+MOOON_NAMESPACE_USE
+
+static sys::CTaskExecutor* sg_executor = NULL;
+static volatile int64_t sg_sum = 0;
+static volatile int sg_finished = 0;
+
+////////////////////////////////////////////////////////////////////////////////
+// 在工作线程中拆分任务，拆出的任务进入本线程的队列，由其它线程窃取
+
+static void range_sum(int low, int high)
+{
+    if (high - low <= 100)
+    {
+        int64_t sum = 0;
+        for (int i=low; i<high; ++i)
+            sum += i;
+        __sync_add_and_fetch(&sg_sum, sum);
+        __sync_add_and_fetch(&sg_finished, high - low);
+        return;
+    }
+
+    int middle = low + (high - low) / 2;
+    CHECK(sg_executor->execute(sys::bind(&range_sum, low, middle)));
+    CHECK(sg_executor->execute(sys::bind(&range_sum, middle, high)));
+}
+
+static void test_split()
+{
+    const int n = 1000000;
+
+    sg_sum = 0;
+    sg_finished = 0;
+    CHECK(sg_executor->execute(sys::bind(&range_sum, 0, n)));
+    while (sg_finished < n)
+        sys::CUtils::millisleep(1);
+
+    CHECK(sg_sum == static_cast<int64_t>(n) * (n - 1) / 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 一个生产者加几个空闲的工作线程：生产者在工作线程中提交的任务都进入它自己的队列，
+// 它等所有任务完成才返回，期间不会取自己的队列，任务只能被其它线程窃取
+
+static void producer(int tasks)
+{
+    for (int i=0; i<tasks; ++i)
+        CHECK(sg_executor->execute(sys::bind(&range_sum, i * 100, (i + 1) * 100)));
+    // 最多等10秒，没有窃取时由test_steal报告失败，而不是挂住
+    for (int i=0; (i<10000) && (sg_finished<tasks*100); ++i)
+        sys::CUtils::millisleep(1);
+}
+
+static void test_steal()
+{
+    const int tasks = 1000;
+    sys::CTaskExecutor* executor = sg_executor;
+    sys::executor_stats_t stats;
+
+    sg_executor = new sys::CTaskExecutor;
+    sg_executor->create(4);
+    sg_sum = 0;
+    sg_finished = 0;
+    CHECK(sg_executor->execute(sys::bind(&producer, tasks)));
+    for (int i=0; (i<10000) && (sg_finished<tasks*100); ++i)
+        sys::CUtils::millisleep(1);
+    CHECK(sg_finished == tasks * 100);
+
+    sg_executor->get_stats(&stats);
+    fprintf(stdout, "[steal] %d tasks, stolen=%llu\n", tasks, (unsigned long long)stats.stolen_number);
+    CHECK(stats.stolen_number > 0);
+    CHECK(sg_sum == static_cast<int64_t>(tasks * 100) * (tasks * 100 - 1) / 2);
+
+    delete sg_executor;
+    sg_executor = executor;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 带结果的任务和完成回调
+
+static int square(int m)
+{
+    return m * m;
+}
+
+static int fail(int m)
+{
+    throw m;
+}
+
+class CCallback: public sys::ITaskCallback<int>
+{
+public:
+    CCallback()
+        :number(0)
+    {
+    }
+
+    virtual void on_task_completed(sys::CTaskFuture<int>* future)
+    {
+        CHECK(future->is_done());
+        __sync_add_and_fetch(&number, 1);
+    }
+
+    volatile int number;
+};
+
+static void test_future()
+{
+    const int n = 1000;
+    CCallback callback;
+    sys::CTaskFuture<int>* futures[n];
+
+    for (int i=0; i<n; ++i)
+    {
+        futures[i] = sg_executor->submit(utils::bind<int>(&square, i), &callback);
+        CHECK(futures[i] != NULL);
+    }
+    for (int i=0; i<n; ++i)
+    {
+        CHECK(futures[i]->get() == i * i);
+        CHECK(!futures[i]->is_failed());
+        futures[i]->dec_refcount();
+    }
+
+    sys::CTaskFuture<int>* future = sg_executor->submit(utils::bind<int>(&fail, 1));
+    CHECK(future->timed_wait(1000));
+    CHECK(future->is_failed());
+    future->dec_refcount();
+
+    // 回调在future完成之后进行
+    while (callback.number < n)
+        sys::CUtils::millisleep(1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// 不均衡负载：少数任务很重
+
+static volatile int64_t sg_work_result = 0;
+static volatile int sg_work_done = 0;
+
+static void do_work(int weight)
+{
+    int64_t result = 0;
+    for (int i=0; i<weight*1000; ++i)
+        result += i ^ weight;
+    __sync_add_and_fetch(&sg_work_result, result);
+    __sync_add_and_fetch(&sg_work_done, 1);
+}
+
+static int get_weight(int i)
+{
+    return (i % 64 == 0)? 200: 1;
+}
+
+static void engine_worker(int index, int threads, int tasks)
+{
+    for (int i=index; i<tasks; i+=threads)
+        do_work(get_weight(i));
+}
+
+static void test_uneven(int threads)
+{
+    const int tasks = 20000;
+
+    sys::CStopWatch stop_watch;
+    sys::CThreadEngine** engines = new sys::CThreadEngine*[threads];
+    for (int i=0; i<threads; ++i)
+        engines[i] = new sys::CThreadEngine(sys::bind(&engine_worker, i, threads, tasks));
+    for (int i=0; i<threads; ++i)
+    {
+        engines[i]->join();
+        delete engines[i];
+    }
+    delete []engines;
+    unsigned int elapsed = stop_watch.get_elapsed_microseconds();
+    fprintf(stdout, "[CThreadEngine] %d threads, %d uneven tasks: %u us\n", threads, tasks, elapsed);
+
+    int64_t result = sg_work_result;
+    sys::executor_stats_t stats;
+    sg_executor->get_stats(&stats);
+    uint64_t stolen_number = stats.stolen_number;
+    uint64_t parked_number = stats.parked_number;
+
+    sg_work_result = 0;
+    sg_work_done = 0;
+    stop_watch.restart();
+    for (int i=0; i<tasks; ++i)
+    {
+        while (!sg_executor->execute(sys::bind(&do_work, get_weight(i))))
+            sys::CUtils::millisleep(1);
+    }
+    while (sg_work_done < tasks)
+        sys::CUtils::millisleep(1);
+
+    elapsed = stop_watch.get_elapsed_microseconds();
+    sg_executor->get_stats(&stats);
+    fprintf(stdout, "[CTaskExecutor] %d threads, %d uneven tasks: %u us, stolen=%llu, parked=%llu\n"
+        , threads, tasks, elapsed
+        , (unsigned long long)(stats.stolen_number - stolen_number), (unsigned long long)(stats.parked_number - parked_number));
+    CHECK(sg_work_result == result);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// destroy时执行完所有已提交的任务
+
+static void count_task()
+{
+    __sync_add_and_fetch(&sg_finished, 1);
+}
+
+static void test_destroy(int threads)
+{
+    sys::CTaskExecutor executor;
+    executor.create(threads, 100000);
+
+    sg_finished = 0;
+    for (int i=0; i<50000; ++i)
+        CHECK(executor.execute(sys::bind(&count_task)));
+
+    executor.destroy();
+    CHECK(50000 == sg_finished);
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = (argc > 1)? atoi(argv[1]): 4;
+    CHECK(threads > 0);
+
+    try
+    {
+        sg_executor = new sys::CTaskExecutor;
+        sg_executor->create(threads);
+
+        test_split();
+        test_steal();
+        test_future();
+        test_uneven(threads);
+
+        delete sg_executor;
+        test_destroy(threads);
+    }
+    catch (sys::CSyscallException& ex)
+    {
+        fprintf(stderr, "exception: %s\n", ex.str().c_str());
+        exit(1);
+    }
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ *
+ * 单元测试公用的断言和回环Socket辅助函数，各ut_*.cpp以#include "../ut_utils.h"引用
+ */
+#ifndef MOOON_TEST_UT_UTILS_H
+#define MOOON_TEST_UT_UTILS_H
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** 断言，失败时输出所在位置和表达式，并以1退出 */
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            fprintf(stderr, "[%s:%d] FAILURE: %s\n", __FILE__, __LINE__, #expr); \
+            exit(1); \
+        } \
+    } while (0)
+
+/***
+  * 在127.0.0.1的任意端口上监听
+  * @port: 输出参数，监听的端口
+  * @return: 监听的fd
+  */
+static inline int listen_any(uint16_t* port, int backlog=128)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd != -1);
+    CHECK(0 == bind(fd, (struct sockaddr*)&addr, sizeof(addr)));
+    CHECK(0 == listen(fd, backlog));
+    CHECK(0 == getsockname(fd, (struct sockaddr*)&addr, &addr_len));
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+/** 阻塞连接127.0.0.1的port端口，返回连接的fd */
+static inline int connect_to(uint16_t port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(fd != -1);
+    CHECK(0 == connect(fd, (struct sockaddr*)&addr, sizeof(addr)));
+    return fd;
+}
+
+/***
+  * 在回环地址上建立一个TCP连接
+  * @client_fd: 输出参数，主动连接端的fd
+  * @server_fd: 输出参数，被动接受端的fd
+  * @return: 监听的端口，监听的fd已关闭
+  */
+static inline uint16_t connect_loopback(int* client_fd, int* server_fd)
+{
+    uint16_t port;
+    int listen_fd = listen_any(&port, 1);
+
+    *client_fd = connect_to(port);
+    *server_fd = accept(listen_fd, NULL, NULL);
+    CHECK(*server_fd != -1);
+    close(listen_fd);
+    return port;
+}
+
+#endif // MOOON_TEST_UT_UTILS_H
@@ -0,0 +1,273 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// CTimingWheel的测试，并在10万连接下和CTimeoutManager比较
+// 用法：ut_timing_wheel [连接数]
+#include <mooon/utils/timing_wheel.h>
+#include "../ut_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <vector>
+MOOON_NAMESPACE_USE
+
+// 模拟一个连接，可同时放在CTimingWheel和CTimeoutManager中
+class CConnection: public utils::CTimingWheelNode<CConnection>
+                 , public utils::CTimeoutable
+                 , public utils::CListable<CConnection>
+{
+public:
+    CConnection()
+        :expire(0)
+        ,expired_number(0)
+    {
+    }
+
+    uint64_t expire; // 期望的到期时间，0表示未定时
+    int expired_number;
+};
+
+class CTimeoutHandler: public utils::ITimeoutHandler<CConnection>
+{
+public:
+    CTimeoutHandler()
+        :current(0)
+        ,number(0)
+    {
+    }
+
+    virtual void on_timeout_event(CConnection* connection)
+    {
+        if (connection->expire != 0)
+        {
+            // 不早于到期时间，也不晚于检测时间
+            CHECK(connection->expire <= current);
+            CHECK(connection->get_expire_milliseconds() == connection->expire);
+            connection->expire = 0;
+        }
+
+        ++connection->expired_number;
+        ++number;
+    }
+
+    uint64_t current;
+    int number;
+};
+
+static uint64_t get_microseconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+// 随机添加、重新定时和删除，检查每个定时器在到期后的第一次检测时恰好回调一次
+static void test_random(int number)
+{
+    std::vector<CConnection> connections(number);
+    CTimeoutHandler handler;
+    utils::CTimingWheel<CConnection> timing_wheel;
+    unsigned int seed = 2016;
+    uint64_t current = 1000000000; // 单调时钟一般不从0开始
+
+    timing_wheel.set_timeout_handler(&handler);
+    for (int round=0; round<200; ++round)
+    {
+        for (int i=0; i<number/10; ++i)
+        {
+            CConnection& connection = connections[rand_r(&seed) % number];
+            int op = rand_r(&seed) % 10;
+
+            if (0 == op)
+            {
+                timing_wheel.remove(&connection);
+                connection.expire = 0;
+                CHECK(!connection.is_timer_pending());
+            }
+            else
+            {
+                // 多数较短，少数跨越高层
+                uint32_t timeout = (op < 8)? rand_r(&seed) % 3000: rand_r(&seed) % 100000000;
+                timing_wheel.add(&connection, current, timeout);
+                connection.expire = current + timeout;
+                CHECK(connection.is_timer_pending());
+            }
+        }
+
+        // 检查等待时长不会越过任何一个定时器
+        uint32_t wait = timing_wheel.get_wait_milliseconds(current, 60000);
+        for (int i=0; i<number; ++i)
+        {
+            if (connections[i].expire != 0)
+                CHECK((connections[i].expire >= current + wait) || (connections[i].expire <= current));
+        }
+
+        current += (round % 50 == 49)? rand_r(&seed) % 10000000: rand_r(&seed) % 1000;
+        handler.current = current;
+        timing_wheel.check_timeout(current);
+
+        for (int i=0; i<number; ++i)
+        {
+            if (connections[i].expire != 0)
+                CHECK(connections[i].expire > current);
+        }
+    }
+
+    // 全部到期
+    current += 200000000;
+    handler.current = current;
+    timing_wheel.check_timeout(current);
+    CHECK(0 == timing_wheel.get_timer_number());
+    for (int i=0; i<number; ++i)
+        CHECK(0 == connections[i].expire);
+}
+
+// 回调中重新定时自己以及删除其它定时器
+class CReentrantHandler: public utils::ITimeoutHandler<CConnection>
+{
+public:
+    CReentrantHandler(utils::CTimingWheel<CConnection>* timing_wheel, CConnection* other)
+        :current(0)
+        ,_timing_wheel(timing_wheel)
+        ,_other(other)
+    {
+    }
+
+    virtual void on_timeout_event(CConnection* connection)
+    {
+        ++connection->expired_number;
+        if (connection != _other)
+        {
+            _timing_wheel->remove(_other);
+            if (connection->expired_number < 3)
+                _timing_wheel->add(connection, current, 10);
+        }
+    }
+
+    uint64_t current;
+
+private:
+    utils::CTimingWheel<CConnection>* _timing_wheel;
+    CConnection* _other;
+};
+
+static void test_reentrant()
+{
+    CConnection a, b;
+    utils::CTimingWheel<CConnection> timing_wheel;
+    CReentrantHandler handler(&timing_wheel, &b);
+
+    timing_wheel.set_timeout_handler(&handler);
+    timing_wheel.add(&a, 0, 5);
+    timing_wheel.add(&b, 0, 5); // 和a同槽，a先回调并删除b
+
+    for (uint64_t current=0; current<100; ++current)
+    {
+        handler.current = current;
+        timing_wheel.check_timeout(current);
+    }
+
+    CHECK(3 == a.expired_number);
+    CHECK(0 == b.expired_number);
+    CHECK(0 == timing_wheel.get_timer_number());
+}
+
+// 10万连接，每次网络事件都重新定时，每毫秒检测一次
+static void benchmark(int number)
+{
+    const int events = 10000000;
+    std::vector<CConnection> connections(number);
+    std::vector<uint32_t> randoms(events);
+    CTimeoutHandler handler;
+    unsigned int seed = 2016;
+
+    for (int i=0; i<events; ++i)
+        randoms[i] = rand_r(&seed);
+
+    utils::CTimeoutManager<CConnection> timeout_manager;
+    timeout_manager.set_timeout_handler(&handler);
+    timeout_manager.set_timeout_seconds(10);
+    for (int i=0; i<number; ++i)
+        timeout_manager.push(&connections[i], 0);
+
+    uint64_t start = get_microseconds();
+    for (int i=0; i<events; ++i)
+    {
+        timeout_manager.update(&connections[randoms[i] % number], i / 100000);
+        if (i % 100 == 99)
+            timeout_manager.check_timeout(i / 100000);
+    }
+    uint64_t elapsed = get_microseconds() - start;
+    fprintf(stdout, "[CTimeoutManager] %d connections: %.1f ns/update, %d expired\n"
+        , number, elapsed * 1000.0 / events, handler.number);
+
+    utils::CTimingWheel<CConnection> timing_wheel;
+    timing_wheel.set_timeout_handler(&handler);
+
+    // 和CTimeoutManager一样都为10秒，以及按连接的状态使用不同的超时
+    static const uint32_t same_timeouts[4] = { 10000, 10000, 10000, 10000 };
+    static const uint32_t mixed_timeouts[4] = { 10000, 10000, 3000, 500 };
+    const uint32_t* timeouts_array[2] = { same_timeouts, mixed_timeouts };
+    for (int j=0; j<2; ++j)
+    {
+        const uint32_t* timeouts = timeouts_array[j];
+        const uint64_t base = j * 200000; // 毫秒，每轮约100秒
+
+        handler.number = 0;
+        for (int i=0; i<number; ++i)
+            timing_wheel.add(&connections[i], base, 10000);
+
+        start = get_microseconds();
+        for (int i=0; i<events; ++i)
+        {
+            timing_wheel.update(&connections[randoms[i] % number], base + i / 100, timeouts[randoms[i] % 4]);
+            if (i % 100 == 99)
+                timing_wheel.check_timeout(base + i / 100);
+        }
+        elapsed = get_microseconds() - start;
+        fprintf(stdout, "[CTimingWheel] %d connections, %s timeouts: %.1f ns/update, %d expired\n"
+            , number, (0 == j)? "same": "mixed", elapsed * 1000.0 / events, handler.number);
+
+        for (int i=0; i<number; ++i)
+            timing_wheel.remove(&connections[i]);
+    }
+
+    // 全部到期时的批量回调
+    handler.number = 0;
+    for (int i=0; i<number; ++i)
+        timing_wheel.add(&connections[i], 400000, 1000 + i % 10000);
+    start = get_microseconds();
+    timing_wheel.check_timeout(500000);
+    elapsed = get_microseconds() - start;
+    CHECK(number == handler.number);
+    fprintf(stdout, "[CTimingWheel] %d timers expired in %.1f ms, %.1f ns/timer\n"
+        , number, elapsed / 1000.0, elapsed * 1000.0 / number);
+}
+
+int main(int argc, char* argv[])
+{
+    int number = (argc > 1)? atoi(argv[1]): 100000;
+    CHECK(number > 0);
+
+    test_reentrant();
+    test_random(10000);
+    benchmark(number);
+
+    fprintf(stdout, "SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Author: eyjian@qq.com or eyjian@gmail.com
+ */
+// 将CLogger延迟格式化模式写的二进制日志还原成文本，输出到标准输出，
+// 输出格式和CLogger文本模式的相同
+//
+// 用法：bin_log_decoder binary_log_file ...
+#include <mooon/sys/bin_log.h>
+#include <mooon/sys/log.h>
+#include <mooon/utils/string_utils.h>
+#include <errno.h>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+MOOON_NAMESPACE_USE
+
+// 格式串和文件名的地址到内容的映射，遇到文件头时清空
+static std::map<uint64_t, std::string> sg_strings;
+static uint32_t sg_flags = sys::BIN_LOG_FLAG_AUTO_NEWLINE;
+
+static const char* get_string(uint64_t address)
+{
+    std::map<uint64_t, std::string>::const_iterator iter = sg_strings.find(address);
+    return (iter == sg_strings.end())? "(unknown)": iter->second.c_str();
+}
+
+static void decode_text(const char* record, int record_size)
+{
+    sys::bin_log_text_t text;
+    uint16_t module_name_length;
+    char datetime[SIZE_64];
+    std::string line;
+
+    memcpy(&text, record, sizeof(text));
+    memcpy(&module_name_length, record+sizeof(text), sizeof(module_name_length));
+    int offset = static_cast<int>(sizeof(text) + sizeof(module_name_length)) + module_name_length;
+    if (offset > record_size)
+    {
+        fprintf(stderr, "invalid record at lineno %u\n", text.head.lineno);
+        return;
+    }
+
+    struct tm result;
+    time_t seconds = static_cast<time_t>(text.timestamp / 1000000);
+    localtime_r(&seconds, &result);
+    snprintf(datetime, sizeof(datetime), "%04d-%02d-%02d %02d:%02d:%02d/%u"
+        , result.tm_year+1900, result.tm_mon+1, result.tm_mday
+        , result.tm_hour, result.tm_min, result.tm_sec, static_cast<unsigned int>(text.timestamp % 1000000));
+
+    const char* level_name = sys::get_log_level_name(static_cast<sys::log_level_t>(text.head.level));
+    line = utils::CStringUtils::format_string("[%s][0x%08x][%s]", datetime, text.thread_id, (NULL == level_name)? "UNKNOWN": level_name);
+    if (module_name_length > 0)
+    {
+        line.append(1, '[');
+        line.append(record+sizeof(text)+sizeof(module_name_length), module_name_length);
+        line.append(1, ']');
+    }
+    line.append(utils::CStringUtils::format_string("[%s:%u]", get_string(text.filename), text.head.lineno));
+
+    if (sys::BIN_LOG_RECORD_RAW == text.head.type)
+    {
+        for (int i=offset; i<record_size; ++i)
+            line.append(utils::CStringUtils::format_string("%02X", static_cast<unsigned char>(record[i])));
+    }
+    else
+    {
+        (void)sys::decode_bin_log_args(&line, get_string(text.format), record+offset, record_size-offset);
+    }
+
+    // 和CLogger::complete_log_message的处理一致
+    if ((sg_flags & sys::BIN_LOG_FLAG_AUTO_ADDDOT) && (line[line.size()-1] != '.') && (line[line.size()-1] != '\n'))
+        line.append(1, '.');
+    if ((sg_flags & sys::BIN_LOG_FLAG_AUTO_NEWLINE) && (line[line.size()-1] != '\n'))
+        line.append(1, '\n');
+    fwrite(line.data(), 1, line.size(), stdout);
+}
+
+static bool decode_file(const char* filepath)
+{
+    FILE* fp = fopen(filepath, "rb");
+    if (NULL == fp)
+    {
+        fprintf(stderr, "open %s error: %s\n", filepath, strerror(errno));
+        return false;
+    }
+
+    bool success = true;
+    char record[UINT16_MAX+1];
+    sys::bin_log_head_t head;
+
+    while (1 == fread(&head, sizeof(head), 1, fp))
+    {
+        if (head.size < sizeof(head))
+        {
+            fprintf(stderr, "invalid record size %u in %s at offset %ld\n", head.size, filepath, ftell(fp));
+            success = false;
+            break;
+        }
+
+        memcpy(record, &head, sizeof(head));
+        if ((head.size > sizeof(head)) && (fread(record+sizeof(head), head.size-sizeof(head), 1, fp) != 1))
+        {
+            fprintf(stderr, "truncated record in %s\n", filepath);
+            success = false;
+            break;
+        }
+
+        if (sys::BIN_LOG_RECORD_FILE == head.type)
+        {
+            sys::bin_log_file_t file_head;
+            memcpy(&file_head, record, sizeof(file_head));
+            if (memcmp(file_head.magic, BIN_LOG_MAGIC, sizeof(file_head.magic)) != 0)
+            {
+                fprintf(stderr, "%s is not a binary log file\n", filepath);
+                success = false;
+                break;
+            }
+
+            // 之后的记录来自另一个进程，地址不再有效
+            sg_strings.clear();
+            sg_flags = file_head.flags;
+        }
+        else if (sys::BIN_LOG_RECORD_STRING == head.type)
+        {
+            sys::bin_log_string_t string_head;
+            memcpy(&string_head, record, sizeof(string_head));
+            sg_strings[string_head.address].assign(record+sizeof(string_head), head.size-sizeof(string_head));
+        }
+        else if ((sys::BIN_LOG_RECORD_TEXT == head.type) || (sys::BIN_LOG_RECORD_RAW == head.type))
+        {
+            if (head.size < sizeof(sys::bin_log_text_t) + sizeof(uint16_t))
+            {
+                fprintf(stderr, "invalid record size %u in %s\n", head.size, filepath);
+                success = false;
+                break;
+            }
+
+            decode_text(record, head.size);
+        }
+    }
+
+    fclose(fp);
+    return success;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: bin_log_decoder binary_log_file ...\n");
+        exit(1);
+    }
+
+    int exit_code = 0;
+    for (int i=1; i<argc; ++i)
+    {
+        if (!decode_file(argv[i]))
+            exit_code = 1;
+    }
+
+    return exit_code;
+}